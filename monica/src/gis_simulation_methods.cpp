@@ -8,6 +8,8 @@
 #include "cc_germany_methods.h"
 #include "debug.h"
 #include "db/abstract-db-connections.h"
+#include "tools/pipeline.h"
+#include "result-cache.h"
 
 using namespace Db;
 using namespace std;
@@ -26,11 +28,118 @@ interpolation* inter(NULL);
 struct L: public Loki::ObjectLevelLockable<L> {
 };
 
+/**
+ * @brief Guards inter and the maps it is created from, which are set up
+ * lazily by createGISSimulationEnv and getClimateInformation
+ * (inter keeps caches between its calls)
+ */
+L interLockable;
+
 
   
 Result
 Monica::createGISSimulation(int i, int j, std::string start_date_s, std::string end_date_s, double julian_sowing_date, char* hdf_filename, char* hdf_voronoi, std::string path, int ext_buek_id)
 {
+  Env env = createGISSimulationEnv(i, j, start_date_s, end_date_s, julian_sowing_date, hdf_filename, hdf_voronoi, path, ext_buek_id);
+
+  if (env.soilParams != NULL) {
+      const Monica::Result result = runMonica(env);
+      return result;
+  }
+
+  return Result();
+}
+
+/**
+ * Runs the simulations for all given cells. The environments (grid lookups,
+ * database reads and climate interpolation) are being created on a single
+ * prefetch thread at most prefetchDepth cells ahead of the worker threads
+ * running MONICA, so the workers don't have to wait for I/O.
+ * Cells whose environments have the same content hash (same soil profile,
+ * climate, crop rotation, site and parameters) are simulated only once and
+ * get a copy of the first such cell's result, carrying their own grid point
+ * and custom id.
+ * If a cache is given, results of earlier runs are taken from it
+ * and new results are stored there.
+ */
+vector<Result>
+Monica::runGISSimulations(const vector<pair<int, int> >& cells, std::string start_date_s, std::string end_date_s, double julian_sowing_date, char* hdf_filename, char* hdf_voronoi, std::string path, unsigned int noOfWorkers, unsigned int prefetchDepth, ResultCache* cache)
+{
+  vector<size_t> jobs;
+  for (size_t c = 0; c < cells.size(); c++)
+    jobs.push_back(c);
+
+  vector<Result> results(cells.size());
+
+  //the cell whose result a cell gets and the ids of the cell's own env,
+  //only touched by the prefetch thread
+  vector<size_t> simulatedCell(cells.size());
+  vector<GridPoint> gridPoints(cells.size());
+  vector<int> customIds(cells.size(), -1);
+  map<unsigned long long, size_t> hash2cell;
+  size_t noOfValidCells = 0;
+
+  //the env is prepared together with its content hash, so the worker's
+  //cache lookup doesn't hash the env again
+  typedef pair<Env, unsigned long long> HashedEnv;
+  Pipeline<size_t, HashedEnv, Result> pipeline(
+      [&](const size_t& c) -> HashedEnv {
+        simulatedCell[c] = c;
+        Env env = createGISSimulationEnv(cells.at(c).first, cells.at(c).second, start_date_s, end_date_s, julian_sowing_date, hdf_filename, hdf_voronoi, path, -1);
+        gridPoints[c] = env.gridPoint;
+        customIds[c] = env.customId;
+        unsigned long long hash = env.contentHash();
+        if (hash == 0)
+          return HashedEnv(env, hash);
+
+        noOfValidCells++;
+        map<unsigned long long, size_t>::const_iterator ci = hash2cell.find(hash);
+        if (ci == hash2cell.end()) {
+          hash2cell[hash] = c;
+          return HashedEnv(env, hash);
+        }
+        //an identical cell is already being simulated
+        simulatedCell[c] = ci->second;
+        return HashedEnv(Env(), 0);
+      },
+      [=](const HashedEnv& he) {
+        return he.first.soilParams != NULL
+            ? runMonica(he.first, he.second, cache) : Result();
+      },
+      [&](const size_t& c, const Result& result) {
+        results[c] = result;
+      },
+      noOfWorkers, prefetchDepth);
+
+  if (cache)
+    cache->resetStatistics();
+
+  pipeline.run(jobs);
+
+  for (size_t c = 0; c < cells.size(); c++) {
+    if (simulatedCell[c] != c) {
+      results[c] = results[simulatedCell[c]];
+      results[c].gp = gridPoints[c];
+      results[c].customId = customIds[c];
+    }
+  }
+
+  debug() << pipeline.statisticsToString();
+  debug() << "simulated " << hash2cell.size() << " of " << noOfValidCells
+          << " cells, deduplication ratio: "
+          << (hash2cell.empty() ? 1.0 : double(noOfValidCells) / hash2cell.size())
+          << endl;
+  if (cache)
+    debug() << cache->statistics().toString() << endl;
+
+  return results;
+}
+
+Env
+Monica::createGISSimulationEnv(int i, int j, std::string start_date_s, std::string end_date_s, double julian_sowing_date, char* hdf_filename, char* hdf_voronoi, std::string path, int ext_buek_id)
+{
+  L::Lock lock(interLockable);
+
     static grid map_height(0);
     static grid map_soil(0);
     static grid map_groundwater_depth(0);
@@ -84,7 +193,7 @@ Monica::createGISSimulation(int i, int j, std::string start_date_s, std::string
   debug() << height_nn << endl;
  if ( (height_nn == map_height.nodata) or (buek_id==72)) {
    debug() << "Breaking" << endl;
-	return Result();
+	return Env();
  }
 
   double llc = GK52Latitude(rwert, hwert);
@@ -127,7 +236,7 @@ Monica::createGISSimulation(int i, int j, std::string start_date_s, std::string
       sleep(1000);
       sps = readBUEKDataFromMonicaDB(buek_id, general_parameters);
       if (sps == NULL) {
-        return Result();
+        return Env();
       }
   }
 
@@ -180,14 +289,7 @@ Monica::createGISSimulation(int i, int j, std::string start_date_s, std::string
   env.nMinUserParams.max = 100;
   env.nMinUserParams.delayInDays = 30;
 
-  if (env.soilParams != NULL) {
-      const Monica::Result result = runMonica(env);
-      return result;
-  }
-
-  delete inter;
-
-  return Result();
+  return env;
 }
 
 
@@ -198,6 +300,9 @@ Monica::createGISSimulationSingleStation(int i, int j, std::string start_date_s,
   Tools::Date end_date = Tools::fromMysqlString(end_date_s.c_str());
   int crop_id = 1;  // 1 - Winterweizen
 
+  //guards the maps and the soil and climate caches below, which are
+  //filled lazily by the first call needing them
+  static L lockable;
 
     static grid map_height(0);
     static grid map_soil(0);
@@ -205,6 +310,9 @@ Monica::createGISSimulationSingleStation(int i, int j, std::string start_date_s,
     static grid map_slope(0);
     static grid map_voronoi(0);
 
+  {
+  L::Lock lock(lockable);
+
   if (map_height.nrows == 0) {
       cout << "Reading height map" << endl;
       map_height.read_hdf(hdf_filename,"d25_thu");
@@ -224,6 +332,7 @@ Monica::createGISSimulationSingleStation(int i, int j, std::string start_date_s,
       cout << "Reading slope map" << endl;
     map_slope.read_hdf(hdf_filename,"d25sloprz_thu");
   }
+  }
 
   double grid_rows = map_height.nrows;
 
@@ -294,6 +403,8 @@ Monica::createGISSimulationSingleStation(int i, int j, std::string start_date_s,
   static std::map<int, const SoilPMs*> buek_map;
 
   const SoilPMs* sps;
+  {
+  L::Lock lock(lockable);
   std::map<int, const SoilPMs*>::iterator sps_it = buek_map.find(buek_id);
 
   if (sps_it==buek_map.end()) {
@@ -305,6 +416,7 @@ Monica::createGISSimulationSingleStation(int i, int j, std::string start_date_s,
   } else {
     sps = sps_it->second;
   }
+  }
 
   if (sps == NULL) {
       cout << "Error while reading soil data from BUEK database. Received NULL SoilParameters.\nAborting simulation ..." << endl;
@@ -316,9 +428,11 @@ Monica::createGISSimulationSingleStation(int i, int j, std::string start_date_s,
  
   // get climate data
   static std::map<string, DataAccessor> climate_map;
-  std::map<string, DataAccessor>::iterator climate_it = climate_map.find(string(station_id));
 
   DataAccessor da(start_date, end_date);
+  {
+  L::Lock lock(lockable);
+  std::map<string, DataAccessor>::iterator climate_it = climate_map.find(string(station_id));
 
   if (climate_it == climate_map.end()) {
     cout << "Look up new climate data for station " << station_id << endl;
@@ -329,6 +443,7 @@ Monica::createGISSimulationSingleStation(int i, int j, std::string start_date_s,
   } else {
     da = climate_it->second;
   }
+  }
 
     
   // build up the monica environment
@@ -553,6 +668,8 @@ Monica::getThurStationName(int stat_id)
 std::vector<double>
 Monica::getClimateInformation(int x, int y, int date_index, char* hdf_filename, char* hdf_voronoi)
 {
+  L::Lock lock(interLockable);
+
     static grid map_height(0);
     static grid map_soil(0);
     static grid map_groundwater_depth(0);
@@ -20,11 +20,15 @@
 namespace Monica
 {
 
+class ResultCache;
+
 Climate::DataAccessor getClimateDateOfThuringiaStation(char * station, std::string start_date_s, std::string end_date_s, CentralParameterProvider& cpp);
 
 
 Monica::Result runSinglePointSimulation(char* station_id, int soiltype, double slope, double height_nn, double gw, std::string start_date_s, std::string end_date_s, double julian_sowing_date, std::string path);
 Monica::Result createGISSimulation(int x, int y, std::string start_date_s, std::string end_date_s, double julian_sowing_date, char* hdf_filename, char* hdf_voronoi, std::string path, int ext_buek_id);
+Monica::Env createGISSimulationEnv(int x, int y, std::string start_date_s, std::string end_date_s, double julian_sowing_date, char* hdf_filename, char* hdf_voronoi, std::string path, int ext_buek_id);
+std::vector<Monica::Result> runGISSimulations(const std::vector<std::pair<int, int> >& cells, std::string start_date_s, std::string end_date_s, double julian_sowing_date, char* hdf_filename, char* hdf_voronoi, std::string path, unsigned int noOfWorkers = 0, unsigned int prefetchDepth = 8, ResultCache* cache = NULL);
 
 Monica::Result createGISSimulationSingleStation(int row, int col, std::string start_date_s, std::string end_date_s, double julian_sowing_date, char* station_id,  char* hdf_filename, std::string path, int soiltype = -1);
 Monica::Result runSinglePointSimulation(char* station_id, int soiltype, double slope, double height_nn, double gw, std::string start_date_s, std::string end_date_s, double julian_sowing_date, std::string path);
@@ -322,6 +322,10 @@ void runLandcareDSSMonica(E e)
   YearlyGeneralResults avgYearlyGeneralResults;
   GeneralResults avgGeneralResults;
 
+  //realizations and rotations of the crop rotation leading to the same
+  //environment are simulated only once
+  DeduplicatingRunner runner;
+
   //initialize with current env
   BOOST_FOREACH(DAS::value_type p, das)
   {
@@ -338,7 +342,7 @@ void runLandcareDSSMonica(E e)
                env.cropRotation.end());
       env.da = da;
 
-      Monica::Result res = runMonica(env);
+      Monica::Result res = runner.run(env);
 
       cout << "realization: " << realizationName << " cropRotation: ";
       for_each(env.cropRotation.begin(), env.cropRotation.end(),
@@ -398,6 +402,8 @@ void runLandcareDSSMonica(E e)
     leave: ;
   }
 
+  cout << runner.statisticsToString() << endl;
+
   cout << endl;
   cout << "-------------------------------------------------------" << endl
       << "averaged over realizations:" << endl
@@ -37,6 +37,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "db/abstract-db-connections.h"
 #include "tools/date.h"
 #include "tools/algorithms.h"
+#include "tools/online-statistics.h"
 #include "tools/helper.h"
 
 #include "debug.h"
@@ -311,17 +312,23 @@ void runLandcareDSSMonica(E e)
   }
 
   typedef int Count;
-  typedef map<Monica::ResultId, vector<double> > CR;
+  //the results are only needed as mean and standard deviation, so they are
+  //accumulated instead of being kept
+  typedef map<Monica::ResultId, RunningStats> CR;
   typedef map<CropId, CR> CropResults;
   typedef map<Year, CropResults> YearlyCropResults;
   YearlyCropResults avgYearlyCropResults;
   CropResults avgCropResults;
 
-  typedef map<Monica::ResultId, vector<double> > GeneralResults;
+  typedef map<Monica::ResultId, RunningStats> GeneralResults;
   typedef map<Year, GeneralResults> YearlyGeneralResults;
   YearlyGeneralResults avgYearlyGeneralResults;
   GeneralResults avgGeneralResults;
 
+  //realizations and rotations of the crop rotation leading to the same
+  //environment are simulated only once
+  DeduplicatingRunner runner;
+
   //initialize with current env
   BOOST_FOREACH(DAS::value_type p, das)
   {
@@ -338,7 +345,7 @@ void runLandcareDSSMonica(E e)
                env.cropRotation.end());
       env.da = da;
 
-      Monica::Result res = runMonica(env);
+      Monica::Result res = runner.run(env);
 
       cout << "realization: " << realizationName << " cropRotation: ";
       for_each(env.cropRotation.begin(), env.cropRotation.end(),
@@ -360,8 +367,8 @@ void runLandcareDSSMonica(E e)
           ResultIdInfo info = resultIdInfo(rid);
           cout << rid << " " << info.name << " [" << info.unit << "]: " << p.second << endl;
 
-          avgYearlyCropResults[year][pvr.id][rid].push_back(p.second);
-          avgCropResults[pvr.id][rid].push_back(p.second);
+          avgYearlyCropResults[year][pvr.id][rid].add(p.second);
+          avgCropResults[pvr.id][rid].add(p.second);
         }
         cout << "---------------------------" << endl;
       }
@@ -381,12 +388,13 @@ void runLandcareDSSMonica(E e)
           cout << endl;
           cout << "---------------------------" << endl;
 
-          avgYearlyGeneralResults[year][rid].insert
-              (avgYearlyGeneralResults[year][rid].end(),
-               p.second.begin(), p.second.end());
-
-          avgGeneralResults[rid].insert(avgGeneralResults[rid].end(),
-                                        p.second.begin(), p.second.end());
+          RunningStats& yearly = avgYearlyGeneralResults[year][rid];
+          RunningStats& all = avgGeneralResults[rid];
+          BOOST_FOREACH(double v, p.second)
+          {
+            yearly.add(v);
+            all.add(v);
+          }
         }
         cout << "----------------------------------------------------" << endl;
       }
@@ -398,6 +406,8 @@ void runLandcareDSSMonica(E e)
     leave: ;
   }
 
+  cout << runner.statisticsToString() << endl;
+
   cout << endl;
   cout << "-------------------------------------------------------" << endl
       << "averaged over realizations:" << endl
@@ -418,11 +428,11 @@ void runLandcareDSSMonica(E e)
       BOOST_FOREACH(CR::value_type p3, p2.second)
       {
         Monica::ResultId rid = p3.first;
-        pair<double, double> p4 = standardDeviationAndAvg(p3.second);
+        const RunningStats& rs = p3.second;
 
         ResultIdInfo info = resultIdInfo(rid);
         cout << rid << " " << info.name << " [ " << info.unit << "] avgValue: "
-            << p4.second << " sigma: " << p4.first << endl;
+            << rs.mean() << " sigma: " << rs.standardDeviation() << endl;
       }
     }
     cout << "---------------------------" << endl;
@@ -441,11 +451,11 @@ void runLandcareDSSMonica(E e)
       BOOST_FOREACH(GeneralResults::value_type p2, p.second)
       {
         Monica::ResultId rid = p2.first;
-        pair<double, double> p3 = standardDeviationAndAvg(p2.second);
+        const RunningStats& rs = p2.second;
 
         ResultIdInfo info = resultIdInfo(rid);
         cout << rid << " " << info.name << " [ " << info.unit << "] avgValue: "
-            << p3.second << " sigma: " << p3.first << endl;
+            << rs.mean() << " sigma: " << rs.standardDeviation() << endl;
       }
       cout << "---------------------------" << endl;
     }
@@ -468,11 +478,11 @@ void runLandcareDSSMonica(E e)
     BOOST_FOREACH(CR::value_type p2, p.second)
     {
       Monica::ResultId rid = p2.first;
-      pair<double, double> p3 = standardDeviationAndAvg(p2.second);
+      const RunningStats& rs = p2.second;
 
       ResultIdInfo info = resultIdInfo(rid);
       cout << rid << " " << info.name << " [ " << info.unit << "] avgValue: "
-          << p3.second << " sigma: " << p3.first << endl;
+          << rs.mean() << " sigma: " << rs.standardDeviation() << endl;
     }
   }
   cout << "-----------------------------------------" << endl;
@@ -485,11 +495,11 @@ void runLandcareDSSMonica(E e)
     BOOST_FOREACH(GeneralResults::value_type p, avgGeneralResults)
     {
       Monica::ResultId rid = p.first;
-      pair<double, double> p2 = standardDeviationAndAvg(p.second);
+      const RunningStats& rs = p.second;
 
       ResultIdInfo info = resultIdInfo(rid);
       cout << rid << " " << info.name << " [ " << info.unit << "] avgValue: "
-          << p2.second << " sigma: " << p2.first << endl;
+          << rs.mean() << " sigma: " << rs.standardDeviation() << endl;
     }
     cout << "-----------------------------------------" << endl;
   }
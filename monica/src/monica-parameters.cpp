@@ -868,6 +868,7 @@ MeasuredGroundwaterTableInformation::getGroundwaterInformation(Tools::Date gwDat
 //------------------------------------------------------------------------------
 
 ProductionProcess::ProductionProcess(const std::string& name, CropPtr crop) :
+    _customId(-1),
     _name(name),
     _crop(crop),
     _cropResult(new PVResult())
@@ -604,6 +604,12 @@ namespace Monica
 			 */
 		int size() const { return cap_rates_map.size(); }
 
+		//! all rates, by soil type and distance to the ground water
+		const std::map<std::string, std::map<int, double> >& rates() const
+		{
+			return cap_rates_map;
+		}
+
 
 	private:
 		std::map<std::string, std::map<int, double> > cap_rates_map;
@@ -753,6 +759,8 @@ namespace Monica
 
 		std::vector<Tools::Date> getCuttingDates() const { return _cuttingDates; }
 
+		double crossCropAdaptionFactor() const { return _crossCropAdaptionFactor; }
+
 		void setSeedAndHarvestDate(const Tools::Date& sd, const Tools::Date& hd)
 		{
 			_seedDate = sd;
@@ -975,6 +983,8 @@ namespace Monica
 
 		virtual Seed* clone() const {return new Seed(*this); }
 
+		CropPtr crop() const { return _crop; }
+
 	private:
 		CropPtr _crop;
 	};
@@ -986,7 +996,8 @@ namespace Monica
 	public:
 
 		Harvest(const Tools::Date& at, CropPtr crop, PVResultPtr cropResult, std::string method = "total")
-			: WorkStep(at), _crop(crop), _cropResult(cropResult), _method(method) { }
+			: WorkStep(at), _crop(crop), _cropResult(cropResult), _method(method),
+				_percentage(0), _exported(true) { }
 
 		virtual void apply(MonicaModel* model);
 
@@ -1011,6 +1022,14 @@ namespace Monica
 
 		virtual Harvest* clone() const { return new Harvest(*this); }
 
+		CropPtr crop() const { return _crop; }
+
+		std::string method() const { return _method; }
+
+		double percentage() const { return _percentage; }
+
+		bool exported() const { return _exported; }
+
 	private:
 		CropPtr _crop;
 		PVResultPtr _cropResult;
@@ -1031,6 +1050,8 @@ namespace Monica
 
 		virtual Cutting* clone() const {return new Cutting(*this); }
 
+		CropPtr crop() const { return _crop; }
+
 	private:
 		CropPtr _crop;
 	};
@@ -1148,6 +1169,8 @@ namespace Monica
 		//! Returns harvest method
 		std::string method() const { return _method; }
 
+		CropPtr crop() const { return _crop; }
+
 		virtual std::string toString() const;
 
 		virtual HarvestApplication* clone() const { return new HarvestApplication(*this); }
@@ -1246,7 +1269,9 @@ namespace Monica
 
 	    double getGroundwaterInformation(Tools::Date gwDate);
 
-	    bool isGroundwaterInformationAvailable() {return this->groundwaterInformationAvailable; }
+	    bool isGroundwaterInformationAvailable() const {return this->groundwaterInformationAvailable; }
+
+	    const std::map<Tools::Date, double>& groundwaterTable() const { return groundwaterInfo; }
 
 	private:
 	    bool groundwaterInformationAvailable;
@@ -1265,7 +1290,7 @@ namespace Monica
 	class ProductionProcess
 	{
 	public:
-		ProductionProcess() { }
+		ProductionProcess() : _customId(-1) { }
 
 		ProductionProcess(const std::string& name, CropPtr crop = CropPtr());
 
@@ -1300,7 +1325,7 @@ namespace Monica
 		//! when does the whole PV end
 		Tools::Date end() const;
 
-		std::multimap<Tools::Date, WSPtr> getWorksteps() {return _worksteps; }
+		std::multimap<Tools::Date, WSPtr> getWorksteps() const {return _worksteps; }
 
 		void clearWorksteps() { _worksteps.clear(); }
 
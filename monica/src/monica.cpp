@@ -29,6 +29,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <algorithm>
 #include <set>
 #include <sstream>
+#include <type_traits>
 
 #include "boost/foreach.hpp"
 #include "tools/use-stl-algo-boost-lambda.h"
@@ -70,6 +71,282 @@ namespace
 		}
 	};
 
+	//! 64 bit FNV-1a hash, fed value by value
+	class ContentHash
+	{
+	public:
+		ContentHash() : _h(14695981039346656037ULL) {}
+
+		void add(const void* data, size_t size)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			for(size_t i = 0; i < size; i++)
+				_h = (_h ^ bytes[i]) * 1099511628211ULL;
+		}
+
+		template<typename T>
+		typename std::enable_if<std::is_arithmetic<T>::value, ContentHash&>::type
+		operator<<(T value)
+		{
+			add(&value, sizeof(T));
+			return *this;
+		}
+
+		ContentHash& operator<<(const string& s)
+		{
+			*this << s.size();
+			add(s.data(), s.size());
+			return *this;
+		}
+
+		ContentHash& operator<<(const Date& d)
+		{
+			return *this << d.day() << d.month() << d.year() << d.useLeapYears();
+		}
+
+		template<typename T>
+		ContentHash& operator<<(const vector<T>& vs)
+		{
+			*this << vs.size();
+			BOOST_FOREACH(const T& v, vs)
+				*this << v;
+			return *this;
+		}
+
+		ContentHash& operator<<(const YieldComponent& yc)
+		{
+			return *this << yc.organId << yc.yieldPercentage << yc.yieldDryMatter;
+		}
+
+		ContentHash& operator<<(const CropParameters& cps)
+		{
+			*this << cps.pc_CropName << cps.pc_Perennial
+				<< cps.pc_NumberOfDevelopmentalStages << cps.pc_NumberOfOrgans
+				<< cps.pc_CarboxylationPathway << cps.pc_DefaultRadiationUseEfficiency
+				<< cps.pc_PartBiologicalNFixation << cps.pc_InitialKcFactor
+				<< cps.pc_LuxuryNCoeff << cps.pc_MaxAssimilationRate
+				<< cps.pc_MaxCropDiameter << cps.pc_MaxCropHeight << cps.pc_CropHeightP1
+				<< cps.pc_CropHeightP2 << cps.pc_StageAtMaxHeight
+				<< cps.pc_StageAtMaxDiameter << cps.pc_MinimumNConcentration
+				<< cps.pc_MinimumTemperatureForAssimilation
+				<< cps.pc_NConcentrationAbovegroundBiomass << cps.pc_NConcentrationB0
+				<< cps.pc_NConcentrationPN << cps.pc_NConcentrationRoot
+				<< cps.pc_ResidueNRatio << cps.pc_DevelopmentAccelerationByNitrogenStress
+				<< cps.pc_FieldConditionModifier << cps.pc_AssimilateReallocation
+				<< cps.pc_LT50cultivar << cps.pc_FrostHardening << cps.pc_FrostDehardening
+				<< cps.pc_LowTemperatureExposure << cps.pc_RespiratoryStress
+				<< cps.pc_AssimilatePartitioningCoeff << cps.pc_OrganSenescenceRate
+				<< cps.pc_BaseDaylength << cps.pc_BaseTemperature
+				<< cps.pc_OptimumTemperature << cps.pc_DaylengthRequirement
+				<< cps.pc_DroughtStressThreshold << cps.pc_OrganMaintenanceRespiration
+				<< cps.pc_OrganGrowthRespiration << cps.pc_SpecificLeafArea
+				<< cps.pc_StageMaxRootNConcentration << cps.pc_StageKcFactor
+				<< cps.pc_StageTemperatureSum << cps.pc_VernalisationRequirement
+				<< cps.pc_InitialOrganBiomass << cps.pc_CriticalOxygenContent
+				<< cps.pc_CropSpecificMaxRootingDepth << cps.pc_AbovegroundOrgan
+				<< cps.pc_StorageOrgan << cps.pc_SamplingDepth
+				<< cps.pc_TargetNSamplingDepth << cps.pc_TargetN30
+				<< cps.pc_HeatSumIrrigationStart << cps.pc_HeatSumIrrigationEnd
+				<< cps.pc_MaxNUptakeParam << cps.pc_RootDistributionParam
+				<< cps.pc_PlantDensity << cps.pc_RootGrowthLag
+				<< cps.pc_MinimumTemperatureRootGrowth << cps.pc_InitialRootingDepth
+				<< cps.pc_RootPenetrationRate << cps.pc_RootFormFactor
+				<< cps.pc_SpecificRootLength << cps.pc_StageAfterCut
+				<< cps.pc_CriticalTemperatureHeatStress
+				<< cps.pc_LimitingTemperatureHeatStress
+				<< cps.pc_BeginSensitivePhaseHeatStress
+				<< cps.pc_EndSensitivePhaseHeatStress << cps.pc_CuttingDelayDays
+				<< cps.pc_DroughtImpactOnFertilityFactor << cps.pc_OrganIdsForPrimaryYield
+				<< cps.pc_OrganIdsForSecondaryYield << cps.pc_OrganIdsForCutting;
+			return *this;
+		}
+
+		ContentHash& operator<<(const OrganicMatterParameters& omps)
+		{
+			return *this << omps.name << omps.vo_AOM_DryMatterContent
+				<< omps.vo_AOM_NH4Content << omps.vo_AOM_NO3Content
+				<< omps.vo_AOM_CarbamidContent << omps.vo_AOM_SlowDecCoeffStandard
+				<< omps.vo_AOM_FastDecCoeffStandard << omps.vo_PartAOM_to_AOM_Slow
+				<< omps.vo_PartAOM_to_AOM_Fast << omps.vo_CN_Ratio_AOM_Slow
+				<< omps.vo_CN_Ratio_AOM_Fast << omps.vo_PartAOM_Slow_to_SMB_Slow
+				<< omps.vo_PartAOM_Slow_to_SMB_Fast << omps.vo_NConcentration;
+		}
+
+		ContentHash& operator<<(const MineralFertiliserParameters& mfps)
+		{
+			return *this << mfps.getName() << mfps.getCarbamid() << mfps.getNH4()
+				<< mfps.getNO3();
+		}
+
+		//! hashes the pointee, so that equal parameters from different places match
+		template<typename T>
+		ContentHash& operator<<(const T* ps)
+		{
+			*this << (ps != NULL);
+			if(ps)
+				*this << *ps;
+			return *this;
+		}
+
+		//! 0 is reserved for no hash
+		unsigned long long value() const { return _h == 0 ? 1 : _h; }
+
+	private:
+		unsigned long long _h;
+	};
+
+	void hashCrop(ContentHash& h, CropPtr crop)
+	{
+		if(!crop)
+		{
+			h << false;
+			return;
+		}
+		h << true << crop->id() << crop->name() << crop->seedDate()
+			<< crop->harvestDate() << crop->getCuttingDates()
+			<< crop->crossCropAdaptionFactor();
+		h << crop->cropParameters() << crop->perennialCropParameters()
+			<< crop->residueParameters();
+	}
+
+	//! hashes the type and the raw fields of a workstep
+	void hashWorkstep(ContentHash& h, const WorkStep* ws)
+	{
+		h << ws->date();
+		if(const Seed* s = dynamic_cast<const Seed*>(ws))
+		{
+			h << 1;
+			hashCrop(h, s->crop());
+		}
+		else if(const Harvest* hv = dynamic_cast<const Harvest*>(ws))
+		{
+			h << 2 << hv->method() << hv->percentage() << hv->exported();
+			hashCrop(h, hv->crop());
+		}
+		else if(const Cutting* c = dynamic_cast<const Cutting*>(ws))
+		{
+			h << 3;
+			hashCrop(h, c->crop());
+		}
+		else if(const MineralFertiliserApplication* mfa =
+		        dynamic_cast<const MineralFertiliserApplication*>(ws))
+			h << 4 << mfa->partition() << mfa->amount();
+		else if(const OrganicFertiliserApplication* ofa =
+		        dynamic_cast<const OrganicFertiliserApplication*>(ws))
+			h << 5 << ofa->parameters() << ofa->amount() << ofa->incorporation();
+		else if(const HarvestApplication* ha =
+		        dynamic_cast<const HarvestApplication*>(ws))
+		{
+			h << 6 << ha->method() << ha->percentage();
+			hashCrop(h, ha->crop());
+		}
+		else if(const TillageApplication* ta =
+		        dynamic_cast<const TillageApplication*>(ws))
+			h << 7 << ta->depth();
+		else if(const IrrigationApplication* ia =
+		        dynamic_cast<const IrrigationApplication*>(ws))
+			h << 8 << ia->amount() << ia->nitrateConcentration()
+				<< ia->sulfateConcentration();
+		else //unknown workstep types fall back to their description
+			h << 0 << ws->toString();
+	}
+
+	void hashCentralParameterProvider(ContentHash& h,
+	                                  const CentralParameterProvider& cpp)
+	{
+		const UserCropParameters& ucp = cpp.userCropParameters;
+		h << ucp.pc_CanopyReflectionCoefficient << ucp.pc_ReferenceMaxAssimilationRate
+			<< ucp.pc_ReferenceLeafAreaIndex << ucp.pc_MaintenanceRespirationParameter1
+			<< ucp.pc_MaintenanceRespirationParameter2 << ucp.pc_MinimumNConcentrationRoot
+			<< ucp.pc_MinimumAvailableN << ucp.pc_ReferenceAlbedo
+			<< ucp.pc_StomataConductanceAlpha << ucp.pc_SaturationBeta
+			<< ucp.pc_GrowthRespirationRedux << ucp.pc_MaxCropNDemand
+			<< ucp.pc_GrowthRespirationParameter1 << ucp.pc_GrowthRespirationParameter2
+			<< ucp.pc_Tortuosity;
+
+		const UserEnvironmentParameters& uep = cpp.userEnvironmentParameters;
+		h << uep.p_UseAutomaticIrrigation << uep.p_UseNMinMineralFertilisingMethod
+			<< uep.p_UseSecondaryYields << uep.p_LayerThickness << uep.p_Albedo
+			<< uep.p_AthmosphericCO2 << uep.p_WindSpeedHeight << uep.p_LeachingDepth
+			<< uep.p_timeStep << uep.p_MaxGroundwaterDepth << uep.p_MinGroundwaterDepth
+			<< uep.p_NumberOfLayers << uep.p_StartPVIndex
+			<< uep.p_JulianDayAutomaticFertilising << uep.p_MinGroundwaterDepthMonth;
+
+		const UserSoilMoistureParameters& usmp = cpp.userSoilMoistureParameters;
+		h << usmp.pm_CriticalMoistureDepth << usmp.pm_SaturatedHydraulicConductivity
+			<< usmp.pm_SurfaceRoughness << usmp.pm_GroundwaterDischarge
+			<< usmp.pm_HydraulicConductivityRedux
+			<< usmp.pm_SnowAccumulationTresholdTemperature << usmp.pm_KcFactor
+			<< usmp.pm_TemperatureLimitForLiquidWater << usmp.pm_CorrectionSnow
+			<< usmp.pm_CorrectionRain << usmp.pm_SnowMaxAdditionalDensity
+			<< usmp.pm_NewSnowDensityMin << usmp.pm_SnowRetentionCapacityMin
+			<< usmp.pm_RefreezeParameter1 << usmp.pm_RefreezeParameter2
+			<< usmp.pm_RefreezeTemperature << usmp.pm_SnowMeltTemperature
+			<< usmp.pm_SnowPacking << usmp.pm_SnowRetentionCapacityMax
+			<< usmp.pm_EvaporationZeta << usmp.pm_XSACriticalSoilMoisture
+			<< usmp.pm_MaximumEvaporationImpactDepth << usmp.pm_MaxPercolationRate
+			<< usmp.pm_MoistureInitValue;
+
+		const UserSoilTemperatureParameters& ustp = cpp.userSoilTemperatureParameters;
+		h << ustp.pt_NTau << ustp.pt_InitialSurfaceTemperature
+			<< ustp.pt_BaseTemperature << ustp.pt_QuartzRawDensity
+			<< ustp.pt_DensityAir << ustp.pt_DensityWater << ustp.pt_DensityHumus
+			<< ustp.pt_SpecificHeatCapacityAir << ustp.pt_SpecificHeatCapacityQuartz
+			<< ustp.pt_SpecificHeatCapacityWater << ustp.pt_SpecificHeatCapacityHumus
+			<< ustp.pt_SoilAlbedo << ustp.pt_SoilMoisture;
+
+		const UserSoilTransportParameters& ustrp = cpp.userSoilTransportParameters;
+		h << ustrp.pq_DispersionLength << ustrp.pq_AD
+			<< ustrp.pq_DiffusionCoefficientStandard << ustrp.pq_NDeposition;
+
+		const UserSoilOrganicParameters& usop = cpp.userSoilOrganicParameters;
+		h << usop.po_SOM_SlowDecCoeffStandard << usop.po_SOM_FastDecCoeffStandard
+			<< usop.po_SMB_SlowMaintRateStandard << usop.po_SMB_FastMaintRateStandard
+			<< usop.po_SMB_SlowDeathRateStandard << usop.po_SMB_FastDeathRateStandard
+			<< usop.po_SMB_UtilizationEfficiency << usop.po_SOM_SlowUtilizationEfficiency
+			<< usop.po_SOM_FastUtilizationEfficiency
+			<< usop.po_AOM_SlowUtilizationEfficiency
+			<< usop.po_AOM_FastUtilizationEfficiency << usop.po_AOM_FastMaxC_to_N
+			<< usop.po_PartSOM_Fast_to_SOM_Slow << usop.po_PartSMB_Slow_to_SOM_Fast
+			<< usop.po_PartSMB_Fast_to_SOM_Fast << usop.po_PartSOM_to_SMB_Slow
+			<< usop.po_PartSOM_to_SMB_Fast << usop.po_CN_Ratio_SMB
+			<< usop.po_LimitClayEffect << usop.po_AmmoniaOxidationRateCoeffStandard
+			<< usop.po_NitriteOxidationRateCoeffStandard << usop.po_TransportRateCoeff
+			<< usop.po_SpecAnaerobDenitrification << usop.po_ImmobilisationRateCoeffNO3
+			<< usop.po_ImmobilisationRateCoeffNH4 << usop.po_Denit1 << usop.po_Denit2
+			<< usop.po_Denit3 << usop.po_HydrolysisKM << usop.po_ActivationEnergy
+			<< usop.po_HydrolysisP1 << usop.po_HydrolysisP2
+			<< usop.po_AtmosphericResistance << usop.po_N2OProductionRate
+			<< usop.po_Inhibitor_NH3;
+
+		const SensitivityAnalysisParameters& sap = cpp.sensitivityAnalysisParameters;
+		h << sap.p_MeanFieldCapacity << sap.p_MeanBulkDensity
+			<< sap.p_HeatConductivityFrozen << sap.p_HeatConductivityUnfrozen
+			<< sap.p_LatentHeatTransfer << sap.p_ReducedHydraulicConductivity
+			<< sap.vs_FieldCapacity << sap.vs_Saturation << sap.vs_PermanentWiltingPoint
+			<< sap.vs_SoilMoisture << sap.vs_SoilTemperature << sap.vc_SoilCoverage
+			<< sap.vc_MaxRootingDepth << sap.vc_RootDiameter << sap.sa_crop_id
+			<< sap.crop_parameters << sap.organic_matter_parameters;
+
+		const UserInitialValues& uiv = cpp.userInitValues;
+		h << uiv.p_initPercentageFC << uiv.p_initSoilNitrate << uiv.p_initSoilAmmonium;
+
+		typedef map<int, double> Distance2Rate;
+		typedef map<string, Distance2Rate> Rates;
+		const Rates& rates = cpp.capillaryRiseRates.rates();
+		h << rates.size();
+		BOOST_FOREACH(const Rates::value_type& p, rates)
+		{
+			h << p.first << p.second.size();
+			BOOST_FOREACH(const Distance2Rate::value_type& p2, p.second)
+				h << p2.first << p2.second;
+		}
+
+		for(int month = 0; month < 12; month++)
+			h << cpp.getPrecipCorrectionValue(month);
+		h << cpp.writeOutputFiles;
+	}
+
 }
 
 //------------------------------------------------------------------------------
@@ -77,7 +354,8 @@ namespace
 Env::Env(const SoilPMs* sps, CentralParameterProvider cpp)
 : soilParams(sps),
 customId(-1),
-centralParameterProvider(cpp)
+centralParameterProvider(cpp),
+mode(MODE_LC_DSS)
 {
 	UserEnvironmentParameters& user_env = centralParameterProvider.userEnvironmentParameters;
   windSpeedHeight = user_env.p_WindSpeedHeight;
@@ -95,7 +373,8 @@ Env::Env(SoilPMsPtr spsPtr, CentralParameterProvider cpp) :
 _soilParamsPtr(spsPtr),
 soilParams(spsPtr.get()),
 customId(-1),
-centralParameterProvider(cpp)
+centralParameterProvider(cpp),
+mode(MODE_LC_DSS)
 {
 	UserEnvironmentParameters& user_env = centralParameterProvider.userEnvironmentParameters;
 	windSpeedHeight = user_env.p_WindSpeedHeight;
@@ -132,6 +411,83 @@ string Env::toString() const
   return s.str();
 }
 
+unsigned long long Env::contentHash() const
+{
+	if(!soilParams)
+		return 0;
+
+	ContentHash h;
+
+	h << soilParams->size();
+	BOOST_FOREACH(const SoilParameters& sps, *soilParams)
+	{
+		h << sps.vs_SoilSandContent << sps.vs_SoilClayContent << sps.vs_SoilpH
+			<< sps.vs_SoilStoneContent << sps.vs_Lambda << sps.vs_FieldCapacity
+			<< sps.vs_Saturation << sps.vs_PermanentWiltingPoint << sps.vs_SoilTexture
+			<< sps.vs_SoilAmmonium << sps.vs_SoilNitrate << sps.vs_SoilRawDensity()
+			<< sps.vs_SoilBulkDensity() << sps.vs_SoilOrganicCarbon()
+			<< sps.vs_SoilOrganicMatter();
+	}
+	h << noOfLayers << layerThickness;
+
+	h << useNMinMineralFertilisingMethod << nMinFertiliserPartition.getName()
+		<< nMinFertiliserPartition.getCarbamid() << nMinFertiliserPartition.getNH4()
+		<< nMinFertiliserPartition.getNO3() << nMinUserParams.min
+		<< nMinUserParams.max << nMinUserParams.delayInDays;
+
+	h << useAutomaticIrrigation << autoIrrigationParams.amount
+		<< autoIrrigationParams.treshold << autoIrrigationParams.nitrateConcentration
+		<< autoIrrigationParams.sulfateConcentration;
+
+	h << groundwaterInformation.isGroundwaterInformationAvailable();
+	typedef map<Date, double> GroundwaterTable;
+	const GroundwaterTable& gwt = groundwaterInformation.groundwaterTable();
+	h << gwt.size();
+	BOOST_FOREACH(const GroundwaterTable::value_type& p, gwt)
+		h << p.first << p.second;
+
+	h << useSecondaryYields << windSpeedHeight << atmosphericCO2 << albedo;
+
+	//the climate is identified by its data, not by where it came from,
+	//so e.g. the same station read twice or identical interpolations match
+	h << da.startDate() << da.endDate() << da.noOfStepsPossible();
+	for(unsigned int acd = 0; acd < availableClimateDataSize(); acd++)
+	{
+		if(da.hasAvailableClimateData(ACD(acd)))
+			h << acd << da.dataAsVector(ACD(acd));
+	}
+
+	h << cropRotation.size();
+	BOOST_FOREACH(const ProductionProcess& pp, cropRotation)
+	{
+		h << pp.name() << pp.customId();
+		hashCrop(h, pp.crop());
+		typedef multimap<Date, WSPtr> Worksteps;
+		Worksteps wss = pp.getWorksteps();
+		h << wss.size();
+		BOOST_FOREACH(const Worksteps::value_type& p, wss)
+		{
+			h << p.first;
+			hashWorkstep(h, p.second.get());
+		}
+	}
+
+	h << site.vs_Latitude << site.vs_Slope << site.vs_HeightNN
+		<< site.vs_GroundwaterDepth << site.vs_Soil_CN_Ratio << site.vs_DrainageCoeff
+		<< site.vq_NDeposition << site.vs_MaxEffectiveRootingDepth;
+
+	h << general.ps_LayerThickness << general.ps_ProfileDepth
+		<< general.ps_MaxMineralisationDepth << general.pc_NitrogenResponseOn
+		<< general.pc_WaterDeficitResponseOn << general.pc_EmergenceFloodingControlOn
+		<< general.pc_EmergenceMoistureControlOn;
+
+	hashCentralParameterProvider(h, centralParameterProvider);
+
+	h << mode;
+
+	return h.value();
+}
+
 /**
  * @brief Copy constructor
  * @param env
@@ -141,7 +497,8 @@ Env::Env(const Env& env) :
 _soilParamsPtr(env._soilParamsPtr),
 customId(env.customId)
 {
-  debug() << "Copy constructor: Env" << "\tsoil param size: " << env.soilParams->size() << endl;
+  debug() << "Copy constructor: Env" << "\tsoil param size: "
+    << (env.soilParams ? env.soilParams->size() : 0) << endl;
   soilParams = env.soilParams;
   noOfLayers = env.noOfLayers;
   layerThickness = env.layerThickness;
@@ -1178,6 +1535,34 @@ double MonicaModel::getsum30cmActDenitrificationRate()
 
 //------------------------------------------------------------------------------
 
+Result DeduplicatingRunner::run(const Env& env)
+{
+	_noOfRuns++;
+	unsigned long long hash = env.contentHash();
+	if(hash == 0)
+		return runMonica(env);
+
+	typedef map<unsigned long long, Result> Hash2Result;
+	Hash2Result::iterator hri = _hash2result.find(hash);
+	if(hri == _hash2result.end())
+		hri = _hash2result.insert(make_pair(hash, runMonica(env))).first;
+
+	Result res = hri->second;
+	res.gp = env.gridPoint;
+	res.customId = env.customId;
+	return res;
+}
+
+string DeduplicatingRunner::statisticsToString() const
+{
+	ostringstream s;
+	s << "simulated " << noOfSimulations() << " of " << noOfRuns()
+		<< " runs, deduplication ratio: " << deduplicationRatio();
+	return s.str();
+}
+
+//------------------------------------------------------------------------------
+
 /**
  * @brief Static method for starting calculation
  * @param env
@@ -1207,10 +1592,7 @@ double MonicaModel::getsum30cmActDenitrificationRate()
   bool write_output_files = false;
 
   // activate writing to output files only in special modes
-  if (env.getMode() == Env::MODE_HERMES ||
-      env.getMode() == Env::MODE_EVA2 ||
-      env.getMode() == Env::MODE_MACSUR_SCALING ||
-      env.getMode() == Env::MODE_ACTIVATE_OUTPUT_FILES)
+  if (env.writesOutputFiles())
   {
 
     write_output_files = true;
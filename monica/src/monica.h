@@ -84,7 +84,8 @@ namespace Monica
 				useAutomaticIrrigation(false),
 				useSecondaryYields(true),
 				atmosphericCO2(-1),
-				customId(-1)
+				customId(-1),
+				mode(MODE_LC_DSS)
 		{ }
 
     Env(const Env&);
@@ -139,11 +140,31 @@ namespace Monica
     CentralParameterProvider centralParameterProvider;
 
     std::string toString() const;
+
+		/*!
+		 * 64 bit hash of everything a simulation depends on: soil profile,
+		 * climate data and range, crop rotation, site, general and user
+		 * parameters and the mode
+		 * - environments with the same hash yield the same results, so
+		 * regional runs can simulate cells sharing a hash only once
+		 * - gridPoint, customId and pathToOutputDir aren't part of it
+		 * - all parameters are hashed with their full precision values
+		 * - 0 if there are no soil parameters
+		 */
+		unsigned long long contentHash() const;
+
 		std::string pathToOutputDir;
 
 		void setMode(int mode);
 		int getMode() {return this->mode; }
 
+		//! runMonica writes the daily results to files in pathToOutputDir
+		bool writesOutputFiles() const
+		{
+			return mode == MODE_HERMES || mode == MODE_EVA2
+				|| mode == MODE_MACSUR_SCALING || mode == MODE_ACTIVATE_OUTPUT_FILES;
+		}
+
 		void setCropRotation(std::vector<ProductionProcess> ff)
 		{
 		  cropRotation = ff;
@@ -434,6 +455,38 @@ namespace Monica
   Result runMonica(Env env, Configuration* cfg = NULL);
 #endif
 
+  /*!
+   * runs MONICA for a sequence of environments, but simulates environments
+   * with the same content hash only once and returns a copy of the
+   * first result for the others
+   * - the copies get the grid point and custom id of the env they
+   * are being returned for
+   */
+  class DeduplicatingRunner
+  {
+  public:
+    DeduplicatingRunner() : _noOfRuns(0) {}
+
+    Result run(const Env& env);
+
+    //! how often run has been called
+    int noOfRuns() const { return _noOfRuns; }
+
+    //! how often MONICA actually has been run
+    int noOfSimulations() const { return int(_hash2result.size()); }
+
+    double deduplicationRatio() const
+    {
+      return _hash2result.empty() ? 1.0 : double(_noOfRuns) / _hash2result.size();
+    }
+
+    std::string statisticsToString() const;
+
+  private:
+    std::map<unsigned long long, Result> _hash2result;
+    int _noOfRuns;
+  };
+
   void initializeFoutHeader(std::ofstream&);
   void initializeGoutHeader(std::ofstream&);
   void writeCropResults(const CropGrowth*, std::ofstream&, std::ofstream&, bool);
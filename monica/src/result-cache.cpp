@@ -0,0 +1,535 @@
+/**
+Authors: 
+Dr. Claas Nendel <claas.nendel@zalf.de>
+Xenia Specka <xenia.specka@zalf.de>
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers: 
+Currently maintained by the authors.
+
+This file is part of the MONICA model. 
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <thread>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#include "grid/dirent.h"
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#include "boost/foreach.hpp"
+#include "boost/cstdint.hpp"
+
+#include "result-cache.h"
+
+using namespace Monica;
+using namespace std;
+using boost::int32_t;
+using boost::uint64_t;
+
+namespace
+{
+	const char magic[8] = {'M', 'O', 'N', 'R', 'E', 'S', '0', '1'};
+	const string entrySuffix = ".result";
+
+	//! with headroom, so not every store evicts again
+	const double sizeAfterEviction = 0.9;
+
+	unsigned long long fnv1a(const void* data, size_t size,
+	                         unsigned long long h = 14695981039346656037ULL)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for(size_t i = 0; i < size; i++)
+			h = (h ^ bytes[i]) * 1099511628211ULL;
+		return h;
+	}
+
+	//----------------------------------------------------------------------------
+
+	/*!
+	 * layout of an entry (little endian, as written by the machine):
+	 * magic, key, model version,
+	 * number of crop results, per crop: id, custom id, number of values,
+	 * (result id, value)*,
+	 * number of general results, per result id: id, number of values, values*,
+	 * number of dates, per date: length, characters
+	 */
+	class Writer
+	{
+	public:
+		void bytes(const void* data, size_t size)
+		{
+			const char* cs = static_cast<const char*>(data);
+			_buffer.insert(_buffer.end(), cs, cs + size);
+		}
+
+		void i32(int32_t i) { bytes(&i, sizeof(i)); }
+
+		void u64(uint64_t i) { bytes(&i, sizeof(i)); }
+
+		void d(double d) { bytes(&d, sizeof(d)); }
+
+		void str(const string& s)
+		{
+			i32(int32_t(s.size()));
+			bytes(s.data(), s.size());
+		}
+
+		const vector<char>& buffer() const { return _buffer; }
+
+	private:
+		vector<char> _buffer;
+	};
+
+	//! reads what Writer wrote, ok() turns false when reading past the end
+	class Reader
+	{
+	public:
+		Reader(const vector<char>& buffer)
+			: _buffer(buffer), _pos(0), _ok(true) {}
+
+		bool bytes(void* data, size_t size)
+		{
+			if(!_ok || _buffer.size() - _pos < size)
+				return _ok = false;
+			memcpy(data, &_buffer[_pos], size);
+			_pos += size;
+			return true;
+		}
+
+		int32_t i32() { int32_t i = 0; bytes(&i, sizeof(i)); return i; }
+
+		uint64_t u64() { uint64_t i = 0; bytes(&i, sizeof(i)); return i; }
+
+		double d() { double d = 0; bytes(&d, sizeof(d)); return d; }
+
+		//! sizes have to be sane, so a corrupt file can't allocate arbitrary memory
+		int32_t count(size_t minBytesPerElement)
+		{
+			int32_t n = i32();
+			if(n < 0 || size_t(n)*minBytesPerElement > _buffer.size() - _pos)
+			{
+				_ok = false;
+				return 0;
+			}
+			return n;
+		}
+
+		string str()
+		{
+			int32_t n = count(1);
+			string s(size_t(n), ' ');
+			if(n > 0)
+				bytes(&s[0], size_t(n));
+			return s;
+		}
+
+		bool ok() const { return _ok; }
+
+		bool atEnd() const { return _pos == _buffer.size(); }
+
+	private:
+		const vector<char>& _buffer;
+		size_t _pos;
+		bool _ok;
+	};
+
+	void write(Writer& w, const Result& r)
+	{
+		w.i32(int32_t(r.pvrs.size()));
+		BOOST_FOREACH(const PVResult& pvr, r.pvrs)
+		{
+			w.i32(pvr.id);
+			w.i32(pvr.customId);
+			w.i32(int32_t(pvr.pvResults.size()));
+			typedef map<ResultId, double> Values;
+			BOOST_FOREACH(const Values::value_type& p, pvr.pvResults)
+			{
+				w.i32(p.first);
+				w.d(p.second);
+			}
+		}
+
+		w.i32(int32_t(r.generalResults.size()));
+		BOOST_FOREACH(const Result::RId2Vector::value_type& p, r.generalResults)
+		{
+			w.i32(p.first);
+			w.i32(int32_t(p.second.size()));
+			if(!p.second.empty())
+				w.bytes(&p.second[0], p.second.size()*sizeof(double));
+		}
+
+		w.i32(int32_t(r.dates.size()));
+		BOOST_FOREACH(const string& date, r.dates)
+			w.str(date);
+	}
+
+	bool read(Reader& rd, Result& r)
+	{
+		int32_t noOfPVResults = rd.count(3*sizeof(int32_t));
+		r.pvrs.resize(noOfPVResults);
+		for(int32_t i = 0; i < noOfPVResults && rd.ok(); i++)
+		{
+			PVResult& pvr = r.pvrs[i];
+			pvr.id = rd.i32();
+			pvr.customId = rd.i32();
+			int32_t noOfValues = rd.count(sizeof(int32_t) + sizeof(double));
+			for(int32_t k = 0; k < noOfValues && rd.ok(); k++)
+			{
+				ResultId rid = ResultId(rd.i32());
+				pvr.pvResults[rid] = rd.d();
+			}
+		}
+
+		int32_t noOfGeneralResults = rd.count(2*sizeof(int32_t));
+		for(int32_t i = 0; i < noOfGeneralResults && rd.ok(); i++)
+		{
+			ResultId rid = ResultId(rd.i32());
+			vector<double>& vs = r.generalResults[rid];
+			vs.resize(rd.count(sizeof(double)));
+			if(!vs.empty())
+				rd.bytes(&vs[0], vs.size()*sizeof(double));
+		}
+
+		int32_t noOfDates = rd.count(sizeof(int32_t));
+		for(int32_t i = 0; i < noOfDates && rd.ok(); i++)
+			r.dates.push_back(rd.str());
+
+		return rd.ok() && rd.atEnd();
+	}
+
+	//----------------------------------------------------------------------------
+
+	bool ensureDirExists(const string& pathToDir)
+	{
+		DIR* dp = opendir(pathToDir.c_str());
+		if(dp)
+		{
+			closedir(dp);
+			return true;
+		}
+
+		size_t index = pathToDir.find_last_of('/', pathToDir.size() - 2);
+		if(index != string::npos && index > 0
+			 && !ensureDirExists(pathToDir.substr(0, index)))
+			return false;
+
+#ifdef WIN32
+		int status = _mkdir(pathToDir.c_str());
+#else
+		int status = mkdir(pathToDir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+#endif
+		if(status == 0)
+			return true;
+
+		//another process might have created it in the meantime
+		dp = opendir(pathToDir.c_str());
+		if(dp)
+			closedir(dp);
+		return dp != NULL;
+	}
+
+	bool isEntry(const string& fileName)
+	{
+		return fileName.size() > entrySuffix.size()
+			&& fileName.compare(fileName.size() - entrySuffix.size(),
+			                    entrySuffix.size(), entrySuffix) == 0;
+	}
+
+	struct Entry
+	{
+		Entry(const string& path, long long size, time_t lastUsed)
+			: path(path), size(size), lastUsed(lastUsed) {}
+		string path;
+		long long size;
+		time_t lastUsed;
+		bool operator<(const Entry& other) const { return lastUsed < other.lastUsed; }
+	};
+
+	vector<Entry> entries(const string& pathToDir)
+	{
+		vector<Entry> es;
+		DIR* dp = opendir(pathToDir.c_str());
+		if(!dp)
+			return es;
+
+		while(struct dirent* ep = readdir(dp))
+		{
+			string fileName = ep->d_name;
+			if(!isEntry(fileName))
+				continue;
+
+			string path = pathToDir + fileName;
+			struct stat attrib;
+			if(stat(path.c_str(), &attrib) == 0)
+				es.push_back(Entry(path, attrib.st_size, attrib.st_mtime));
+		}
+		closedir(dp);
+		return es;
+	}
+
+	//! the modification time of an entry is its last use, for LRU eviction
+	void touch(const string& path)
+	{
+#ifdef WIN32
+		_utime(path.c_str(), NULL);
+#else
+		utime(path.c_str(), NULL);
+#endif
+	}
+
+	int processId()
+	{
+#ifdef WIN32
+		return _getpid();
+#else
+		return int(getpid());
+#endif
+	}
+}
+
+//------------------------------------------------------------------------------
+
+string Monica::defaultResultCacheModelVersion()
+{
+#ifdef MONICA_MODEL_REVISION
+	return MONICA_MODEL_REVISION;
+#else
+	return string("compiled ") + __DATE__ + " " + __TIME__;
+#endif
+}
+
+string ResultCacheStatistics::toString() const
+{
+	ostringstream s;
+	s << "result cache: " << hits << " hits, " << misses << " misses (hit rate: "
+		<< int(hitRate()*100) << "%), " << stores << " stored, " << evictions
+		<< " evicted";
+	return s.str();
+}
+
+//------------------------------------------------------------------------------
+
+ResultCache::ResultCache(const string& pathToCacheDir,
+                         const string& modelVersion,
+                         int maxSizeMB)
+	: _pathToCacheDir(pathToCacheDir),
+		_modelVersion(modelVersion),
+		_maxSize(max(1, maxSizeMB)*1024LL*1024LL),
+		_size(0),
+		_isValid(false)
+{
+	if(_pathToCacheDir.empty() || _pathToCacheDir.at(_pathToCacheDir.size() - 1) != '/')
+		_pathToCacheDir.append("/");
+
+	if(!ensureDirExists(_pathToCacheDir))
+	{
+		cerr << "error (ResultCache): couldn't create cache directory: "
+			<< _pathToCacheDir << endl;
+		return;
+	}
+	_isValid = true;
+
+	BOOST_FOREACH(const Entry& e, entries(_pathToCacheDir))
+		_size += e.size;
+}
+
+unsigned long long ResultCache::key(unsigned long long envHash) const
+{
+	unsigned long long h = fnv1a(_modelVersion.data(), _modelVersion.size());
+	return fnv1a(&envHash, sizeof(envHash), h);
+}
+
+string ResultCache::pathToEntry(unsigned long long key) const
+{
+	ostringstream s;
+	s << _pathToCacheDir << hex << setw(16) << setfill('0') << key << entrySuffix;
+	return s.str();
+}
+
+bool ResultCache::lookup(unsigned long long envHash, const Env& env, Result& result)
+{
+	bool found = false;
+	if(_isValid && envHash != 0)
+	{
+		unsigned long long k = key(envHash);
+		string path = pathToEntry(k);
+		ifstream in(path.c_str(), ios::binary);
+		if(in)
+		{
+			vector<char> buffer((istreambuf_iterator<char>(in)),
+			                    istreambuf_iterator<char>());
+			in.close();
+
+			Reader rd(buffer);
+			char m[sizeof(magic)];
+			Result r;
+			//a different key or model version means a hash collision of the file names
+			found = rd.bytes(m, sizeof(m)) && memcmp(m, magic, sizeof(magic)) == 0
+				&& rd.u64() == k && rd.str() == _modelVersion
+				&& read(rd, r);
+			if(found)
+			{
+				r.gp = env.gridPoint;
+				r.customId = env.customId;
+				result = r;
+				touch(path);
+			}
+			else
+				cerr << "warning (ResultCache): ignoring invalid entry: " << path << endl;
+		}
+	}
+
+	Lock lock(this);
+	if(found)
+		_stats.hits++;
+	else
+		_stats.misses++;
+	return found;
+}
+
+void ResultCache::store(unsigned long long envHash, const Result& result)
+{
+	if(!_isValid || envHash == 0)
+		return;
+
+	unsigned long long k = key(envHash);
+	Writer w;
+	w.bytes(magic, sizeof(magic));
+	w.u64(k);
+	w.str(_modelVersion);
+	write(w, result);
+
+	//writers use their own temporary files, the rename makes an entry
+	//appear complete or not at all
+	string path = pathToEntry(k);
+	ostringstream tmp;
+	tmp << path << "." << processId() << "-" << this_thread::get_id() << ".tmp";
+	string pathToTmp = tmp.str();
+	{
+		ofstream out(pathToTmp.c_str(), ios::binary);
+		if(!out.write(&w.buffer()[0], w.buffer().size()))
+		{
+			cerr << "error (ResultCache): couldn't write entry: " << pathToTmp << endl;
+			out.close();
+			remove(pathToTmp.c_str());
+			return;
+		}
+	}
+
+	bool existed = false;
+	{
+		struct stat attrib;
+		existed = stat(path.c_str(), &attrib) == 0;
+	}
+	if(rename(pathToTmp.c_str(), path.c_str()) != 0)
+	{
+		//on windows rename doesn't replace an existing file,
+		//but then another writer stored the same result already
+		remove(pathToTmp.c_str());
+		return;
+	}
+
+	bool tooLarge = false;
+	{
+		Lock lock(this);
+		_stats.stores++;
+		if(!existed)
+			_size += (long long)(w.buffer().size());
+		tooLarge = _size > _maxSize;
+	}
+	if(tooLarge)
+		evict();
+}
+
+void ResultCache::evict()
+{
+	Lock lock(this);
+
+	//the directory is the truth, other processes might have added entries
+	vector<Entry> es = entries(_pathToCacheDir);
+	long long size = 0;
+	BOOST_FOREACH(const Entry& e, es)
+		size += e.size;
+
+	sort(es.begin(), es.end());
+	long long targetSize = (long long)(_maxSize*sizeAfterEviction);
+	for(vector<Entry>::const_iterator ci = es.begin(); ci != es.end() && size > targetSize; ci++)
+	{
+		//if another process deleted it already, it's gone anyway
+		remove(ci->path.c_str());
+		size -= ci->size;
+		_stats.evictions++;
+	}
+	_size = size;
+}
+
+long long ResultCache::size() const
+{
+	Lock lock(this);
+	return _size;
+}
+
+ResultCacheStatistics ResultCache::statistics() const
+{
+	Lock lock(this);
+	return _stats;
+}
+
+void ResultCache::resetStatistics()
+{
+	Lock lock(this);
+	_stats = ResultCacheStatistics();
+}
+
+//------------------------------------------------------------------------------
+
+Result Monica::runMonica(const Env& env, ResultCache* cache)
+{
+	return runMonica(env, cache ? env.contentHash() : 0, cache);
+}
+
+Result Monica::runMonica(const Env& env, unsigned long long envHash, ResultCache* cache)
+{
+	if(!cache || env.writesOutputFiles())
+		return runMonica(env);
+
+	Result result;
+	if(cache->lookup(envHash, env, result))
+		return result;
+
+	result = runMonica(env);
+	cache->store(envHash, result);
+	return result;
+}
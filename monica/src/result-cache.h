@@ -0,0 +1,145 @@
+/**
+Authors: 
+Dr. Claas Nendel <claas.nendel@zalf.de>
+Xenia Specka <xenia.specka@zalf.de>
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers: 
+Currently maintained by the authors.
+
+This file is part of the MONICA model. 
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MONICA_RESULT_CACHE_H_
+#define MONICA_RESULT_CACHE_H_
+
+#include <string>
+
+#define LOKI_OBJECT_LEVEL_THREADING
+#include "loki/Threads.h"
+
+#include "monica.h"
+
+namespace Monica
+{
+	/*!
+	 * identifies the model code the cached results have been computed with
+	 * - the source revision MONICA has been built from (MONICA_MODEL_REVISION,
+	 * set by monica.pro from git describe), else the time this file
+	 * has been compiled
+	 * - when tuning a module without rebuilding this file pass an own
+	 * version to the ResultCache
+	 */
+	std::string defaultResultCacheModelVersion();
+
+	//! hits and misses of a ResultCache since the last reset
+	struct ResultCacheStatistics
+	{
+		ResultCacheStatistics()
+			: hits(0), misses(0), stores(0), evictions(0) {}
+
+		unsigned int hits;
+		unsigned int misses;
+		unsigned int stores;
+		unsigned int evictions;
+
+		double hitRate() const
+		{
+			return hits + misses > 0 ? double(hits) / (hits + misses) : 0;
+		}
+
+		std::string toString() const;
+	};
+
+	/*!
+	 * on disk store of the results of MONICA runs, keyed by the content hash
+	 * of the Env and the model version
+	 * - every result is a small binary file "<key as hex>.result" in
+	 * pathToCacheDir, results are written to a temporary file first
+	 * and then renamed, so several threads or processes can share a cache
+	 * - if the files together get larger than maxSizeMB, the least
+	 * recently used ones get deleted
+	 * - the grid point and custom id of a returned result are the ones
+	 * of the env it is being looked up for
+	 */
+	class ResultCache : public Loki::ObjectLevelLockable<ResultCache>
+	{
+	public:
+		ResultCache(const std::string& pathToCacheDir,
+		            const std::string& modelVersion = defaultResultCacheModelVersion(),
+		            int maxSizeMB = 1024);
+
+		bool isValid() const { return _isValid; }
+
+		//! the result stored for env, false if there is none
+		bool lookup(const Env& env, Result& result)
+		{
+			return lookup(env.contentHash(), env, result);
+		}
+
+		//! as above, if env's content hash has already been calculated
+		bool lookup(unsigned long long envHash, const Env& env, Result& result);
+
+		void store(const Env& env, const Result& result)
+		{
+			store(env.contentHash(), result);
+		}
+
+		void store(unsigned long long envHash, const Result& result);
+
+		std::string pathToCacheDir() const { return _pathToCacheDir; }
+
+		std::string modelVersion() const { return _modelVersion; }
+
+		//! current size of the cache in bytes, as far as this instance knows
+		long long size() const;
+
+		ResultCacheStatistics statistics() const;
+
+		//! start a new batch
+		void resetStatistics();
+
+	private:
+		std::string pathToEntry(unsigned long long key) const;
+
+		//! key of the entry, combines the env's hash and the model version
+		unsigned long long key(unsigned long long envHash) const;
+
+		//! delete the least recently used entries until the cache fits again
+		void evict();
+
+		std::string _pathToCacheDir;
+		std::string _modelVersion;
+		long long _maxSize;
+		long long _size;
+		bool _isValid;
+		ResultCacheStatistics _stats;
+	};
+
+	/*!
+	 * runMonica(env), but takes the result from the cache if it's there
+	 * and stores it otherwise
+	 * - without a cache or if env writes output files just runs MONICA,
+	 * as a cached result wouldn't write them
+	 */
+	Result runMonica(const Env& env, ResultCache* cache);
+
+	//! as above, if env's content hash has already been calculated
+	Result runMonica(const Env& env, unsigned long long envHash, ResultCache* cache);
+}
+
+#endif
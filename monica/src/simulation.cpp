@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "eva_methods.h"
 #include "cc_germany_methods.h"
+#include "tools/pipeline.h"
 
 #include "climate/climate-common.h"
 
@@ -721,6 +722,65 @@ Monica::runCCGermanySimulation(const CCGermanySimulationConfiguration *simulatio
 {
   Monica::activateDebug = true;
 
+  Env env = createCCGermanySimulationEnv(simulation_config);
+  if (env.soilParams == NULL)
+    return Monica::Result();
+
+  std::cout << env.toString().c_str() << endl;
+
+  /** @todo Do something useful with the result */
+  // start calucation of model
+  const Monica::Result result = runMonica(env);
+  return result;
+}
+
+/**
+ * Runs the simulations for all given configurations. While noOfWorkers
+ * threads run MONICA, a single prefetch thread reads soil, climate and
+ * management data of the next (at most prefetchDepth) configurations
+ * from the databases.
+ *
+ * @param simulation_configs Configurations of the simulations to run
+ * @return results in the order of the configurations
+ */
+std::vector<Monica::Result>
+Monica::runCCGermanySimulations(const std::vector<const CCGermanySimulationConfiguration*>& simulation_configs,
+                                unsigned int noOfWorkers, unsigned int prefetchDepth)
+{
+  vector<size_t> jobs;
+  for (size_t c = 0; c < simulation_configs.size(); c++)
+    jobs.push_back(c);
+
+  vector<Monica::Result> results(simulation_configs.size());
+
+  Tools::Pipeline<size_t, Env, Monica::Result> pipeline(
+      [&](const size_t& c) {
+        return createCCGermanySimulationEnv(simulation_configs.at(c));
+      },
+      [](const Env& env) {
+        return env.soilParams != NULL ? runMonica(env) : Monica::Result();
+      },
+      [&](const size_t& c, const Monica::Result& result) {
+        results[c] = result;
+      },
+      noOfWorkers, prefetchDepth);
+
+  pipeline.run(jobs);
+  debug() << pipeline.statisticsToString();
+
+  return results;
+}
+
+/**
+ * Creates the environment for a simulation with data from the
+ * cc germany databases.
+ *
+ * @param simulation_config Configuration object that stores all simulation information
+ * @return the environment, which is invalid (soilParams == NULL) if no soil data could be read
+ */
+Env
+Monica::createCCGermanySimulationEnv(const CCGermanySimulationConfiguration *simulation_config)
+{
   // eva2 controlling parameters
   int leg1000_id;
   double jul_sowing_date;
@@ -792,7 +852,7 @@ Monica::runCCGermanySimulation(const CCGermanySimulationConfiguration *simulatio
   const SoilPMs* sps = readBUEKDataFromMonicaDB(leg1000_id, gps);
   if (sps == NULL) {
       cout << "Error while reading soil data from BUEK database. Received NULL SoilParameters.\nAbortin simulation ..." << endl;
-      return Monica::Result();
+      return Env();
   }
   // crop rotation
   vector<ProductionProcess> ff = getCropManagementData(crop_id, start_date.toMysqlString(""), end_date.toMysqlString(""), jul_sowing_date);
@@ -814,12 +874,7 @@ Monica::runCCGermanySimulation(const CCGermanySimulationConfiguration *simulatio
   env.nMinUserParams.max = 100;
   env.nMinUserParams.delayInDays = 30;
 
-  std::cout << env.toString().c_str() << endl;
-
-  /** @todo Do something useful with the result */
-  // start calucation of model
-  const Monica::Result result = runMonica(env);
-  return result;
+  return env;
 }
 
 #endif /*#ifdef RUN_CC_GERMANY*/
@@ -438,6 +438,9 @@ const Monica::Result runEVA2Simulation(const Eva2SimulationConfiguration *simula
 
 #ifdef RUN_CC_GERMANY
 const Monica::Result runCCGermanySimulation(const CCGermanySimulationConfiguration *simulation_config=0);
+Env createCCGermanySimulationEnv(const CCGermanySimulationConfiguration *simulation_config=0);
+std::vector<Monica::Result> runCCGermanySimulations(const std::vector<const CCGermanySimulationConfiguration*>& simulation_configs,
+                                                    unsigned int noOfWorkers=0, unsigned int prefetchDepth=8);
 #endif
 
 #ifdef RUN_GIS
@@ -0,0 +1,38 @@
+TEMPLATE = app
+VERSION = 1.0
+TARGET = climate-benchmarks
+DESTDIR = .
+OBJECTS_DIR = obj
+
+USER_LIBS_DIR = ..
+SYS_LIBS_DIR = ../../sys-libs
+
+QMAKE_CXXFLAGS += -std=c++0x
+
+HEADERS += \
+climate.h
+
+SOURCES += \
+climate.cpp \
+climate-benchmarks-main.cpp
+
+CONFIG -= qt
+
+# coord-trans.cpp uses the thread contexts of proj (pj_ctx_alloc,
+# pj_init_plus_ctx), which need proj 4.8 or newer
+INCLUDEPATH += \
+.. \
+$${SYS_LIBS_DIR}/boost-1.39.0 \
+$${SYS_LIBS_DIR}/loki-lib/include \
+$${SYS_LIBS_DIR}/proj-4.8.0/src \
+$${USER_LIBS_DIR}/include
+
+LIBS += \
+-lm \
+-lpthread \
+-L$${USER_LIBS_DIR}/lib \
+-ltools \
+-ldb \
+-lmysqlclient \
+-L$${SYS_LIBS_DIR}/lib \
+-lproj
@@ -32,13 +32,15 @@ CONFIG -= qt
 #includes
 #-------------------------------------------------------------
 
+# coord-trans.cpp uses the thread contexts of proj (pj_ctx_alloc,
+# pj_init_plus_ctx), which need proj 4.8 or newer
 INCLUDEPATH += \
 #. \
 .. \
 $${SYS_LIBS_DIR}/boost-1.39.0 \
 $${SYS_LIBS_DIR}/loki-lib/include \
 $${SYS_LIBS_DIR}/sqlite-amalgamation-3070603 \
-$${SYS_LIBS_DIR}/proj-4.7.0/src \
+$${SYS_LIBS_DIR}/proj-4.8.0/src \
 $${SYS_LIBS_DIR}/hdf5-1.8.7-include \
 $${USER_LIBS_DIR}/include
 
@@ -27,6 +27,7 @@ void createPrecipGrids(string folder, string sim, string scen,
                          regionName + "_100.asc"));
 
 	Regionalization::Env env(precip);
+	env.fIsThreadSafe = true;
 
 	env.dgm = dgm.get();//->subGridClone(100, 100, 15, 15);
 	env.fromYear = 1961;
@@ -132,6 +133,7 @@ void fillGrowthPeriodPrecipCache(string real = "", Date start = Date(),
   renv.cacheInfo.cacheData = true;
   renv.functionId = 0;
   renv.f = PrecipSum(start, end);
+  renv.fIsThreadSafe = true;
 
   timeval before1 = startMeasurementViaTimeOfDay();
   Regionalization::regionalize(renv);
@@ -151,6 +153,7 @@ void example()
                          "../../data/grids/general/dgm_uecker_100.asc"));
 
 	Regionalization::Env env(tavg);
+	env.fIsThreadSafe = true;
 
 	env.dgm = dgm->subGridClone(100, 100, 15, 15);
 	env.fromYear = 1961;
@@ -0,0 +1,224 @@
+/**
+Authors:
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers:
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+
+#include "climate/climate.h"
+
+using namespace Climate;
+using namespace std;
+using namespace Tools;
+
+namespace
+{
+	typedef chrono::steady_clock Clock;
+
+	double secondsSince(Clock::time_point start)
+	{
+		return chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	//! stations on a regular grid, without a database
+	class BenchmarkSimulation : public ClimateSimulation
+	{
+	public:
+		BenchmarkSimulation(int noOfStations)
+			: ClimateSimulation("benchmark", "benchmark", NULL)
+		{
+			for(int i = 0; i < noOfStations; i++)
+			{
+				LatLngCoord llc(50 + (i / 10)*0.1, 10 + (i % 10)*0.1);
+				ostringstream name;
+				name << "station-" << i;
+				_stations.push_back(new ClimateStation(i, llc, 100, name.str(), this));
+			}
+			_yearRange = YearRange(1990, 2010);
+			indexClimateStations();
+		}
+
+		virtual ClimateScenario* defaultScenario() const { return NULL; }
+	};
+
+	//! generates the data instead of querying them and counts the queries
+	class BenchmarkRealization : public ClimateRealization
+	{
+	public:
+		BenchmarkRealization(ClimateSimulation* simulation)
+			: ClimateRealization("1", simulation, NULL, NULL), noOfQueries(0) {}
+
+		mutable atomic<int> noOfQueries;
+
+		//! the value of acd at gc on the day'th day after 1.1.2000
+		static double value(ACD acd, const LatLngCoord& gc, int day)
+		{
+			return acd*100000 + gc.lat + day;
+		}
+
+	protected:
+		virtual map<ACD, vector<double>*>
+		executeQuery(const ACDV& acds, const LatLngCoord& gc,
+		             const Date& startDate, const Date& endDate) const
+		{
+			noOfQueries++;
+			map<ACD, vector<double>*> res;
+			int n = startDate.numberOfDaysTo(endDate) + 1;
+			int first = Date(1, 1, 2000).numberOfDaysTo(startDate);
+			for(size_t i = 0; i < acds.size(); i++)
+			{
+				vector<double>* ds = new vector<double>(n);
+				for(int d = 0; d < n; d++)
+					(*ds)[d] = value(acds[i], gc, first + d);
+				res[acds[i]] = ds;
+			}
+			return res;
+		}
+	};
+
+	/*!
+	 * noOfThreads threads get data accessors of random stations and years out
+	 * of the warm caches of a realization, the caches aren't filled anymore,
+	 * so the threads just contend for the lookups of the published caches
+	 */
+	void warmCacheContention(unsigned int noOfThreads)
+	{
+		const int noOfStations = 50;
+		const int callsPerThread = 20000;
+		BenchmarkSimulation sim(noOfStations);
+		BenchmarkRealization real(&sim);
+
+		ACDV acds;
+		acds.push_back(tavg);
+		acds.push_back(precip);
+		acds.push_back(globrad);
+		Date start(1, 1, 2000), end(31, 12, 2004);
+
+		vector<LatLngCoord> gcs = sim.geoCoords();
+		real.fillCacheFor(acds, gcs, start, end);
+		int queriesAfterFill = real.noOfQueries;
+
+		Clock::time_point before = Clock::now();
+		vector<thread> ts;
+		atomic<long> noOfValues(0);
+		for(unsigned int t = 0; t < noOfThreads; t++)
+			ts.push_back(thread([&, t]()
+			{
+				long values = 0;
+				for(int k = 0; k < callsPerThread; k++)
+				{
+					const LatLngCoord& gc = gcs.at((k*7 + t*13) % gcs.size());
+					Date from(1, 1, 2000 + (k + t) % 5);
+					DataAccessor da = real.dataAccessorFor(acds, gc, from, from + 364);
+					values += da.noOfStepsPossible();
+				}
+				noOfValues += values;
+			}));
+		for(size_t t = 0; t < ts.size(); t++)
+			ts[t].join();
+		double secs = secondsSince(before);
+
+		long calls = long(noOfThreads)*callsPerThread;
+		cout << "warm cache dataAccessorFor, " << noOfThreads << " thread(s): "
+		     << calls << " calls in " << secs << "s, "
+		     << (secs*1e6/calls) << "us per call" << endl;
+		if(noOfValues != calls*365 || real.noOfQueries != queriesAfterFill)
+		{
+			cerr << "error (warmCacheContention): " << noOfValues << " values, "
+			     << (real.noOfQueries - queriesAfterFill) << " queries on a warm cache"
+			     << endl;
+			exit(1);
+		}
+	}
+
+	/*!
+	 * the caches of a station are extended to earlier and later years while
+	 * other threads read the already cached year, the readers have to keep
+	 * getting the right values from the caches they hold
+	 */
+	void extendWhileReading(unsigned int noOfThreads)
+	{
+		BenchmarkSimulation sim(1);
+		BenchmarkRealization real(&sim);
+		ACDV acds(1, tavg);
+		LatLngCoord gc = sim.geoCoords().front();
+		Date from(1, 1, 2000), to(31, 12, 2000);
+		unsigned int noOfDays = from.numberOfDaysTo(to) + 1;
+		real.fillCacheFor(acds, gc, from, to);
+
+		atomic<bool> extending(true);
+		atomic<int> wrong(0);
+		vector<thread> ts;
+		for(unsigned int t = 0; t < noOfThreads; t++)
+			ts.push_back(thread([&]()
+			{
+				while(extending)
+				{
+					DataAccessor da = real.dataAccessorFor(acds, gc, from, to);
+					if(da.noOfStepsPossible() != noOfDays
+					   || da.dataForTimestep(tavg, 10) != BenchmarkRealization::value(tavg, gc, 10))
+						wrong++;
+				}
+			}));
+
+		Clock::time_point before = Clock::now();
+		for(int y = 1; y <= 8; y++)
+		{
+			real.fillCacheFor(acds, gc, Date(1, 1, 2000 - y), to);
+			real.fillCacheFor(acds, gc, from, Date(31, 12, 2000 + y));
+		}
+		double secs = secondsSince(before);
+		extending = false;
+		for(size_t t = 0; t < ts.size(); t++)
+			ts[t].join();
+
+		cout << "16 cache extensions while " << noOfThreads
+		     << " thread(s) read: " << secs << "s" << endl;
+		Date first(1, 1, 1992), last(31, 12, 2008);
+		DataAccessor all = real.dataAccessorFor(acds, gc, first, last);
+		if(wrong > 0 || all.noOfStepsPossible() != unsigned(first.numberOfDaysTo(last) + 1)
+		   || all.dataForTimestep(tavg, 0)
+		      != BenchmarkRealization::value(tavg, gc, from.numberOfDaysTo(first)))
+		{
+			cerr << "error (extendWhileReading): " << wrong << " wrong reads" << endl;
+			exit(1);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int maxThreads = argc > 1 ? atoi(argv[1]) : 32;
+	cout << "cores: " << thread::hardware_concurrency() << endl;
+	for(unsigned int n = 1; n <= maxThreads; n *= 2)
+		warmCacheContention(n);
+	extendWhileReading(maxThreads);
+	return 0;
+}
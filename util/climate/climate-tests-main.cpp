@@ -0,0 +1,196 @@
+/**
+Authors:
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers:
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#include "climate/climate.h"
+#include "db/db.h"
+
+using namespace Climate;
+using namespace std;
+using namespace Tools;
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool ok, const string& what)
+	{
+		if(!ok)
+		{
+			cerr << "FAILED: " << what << endl;
+			failures++;
+		}
+	}
+
+	const char* dbFile = "./climate-tests.sqlite";
+	const int noOfStations = 250;
+
+	//! the tavg value of the station on the day'th day since 1.1.2000
+	double tavgValue(int id, int day) { return id*100000 + day; }
+
+	double precipValue(int id, int day) { return tavgValue(id, day)/10; }
+
+	//! a Star2 like database in sqlite, 2000 in refzen and 2001 in s2k_1
+	bool createStar2Db()
+	{
+		remove(dbFile);
+		ofstream(dbFile).close();
+		Db::SqliteDB sqlite(dbFile);
+		// SqliteDB hides the string overloads of DB
+		Db::DB& con = sqlite;
+
+		string tavgCol = availableClimateData2StarDBColName(tavg);
+		string precipCol = availableClimateData2StarDBColName(precip);
+		string dataCols = "(tag integer, mo integer, jahr integer, id integer, " +
+				tavgCol + " real, " + precipCol + " real)";
+		bool ok = con.update("create table station (lat real, lon real, name text, id integer)")
+				&& con.update("create table days (tag integer, mo integer, jahr integer, dn integer)")
+				&& con.update("create table refzen " + dataCols)
+				&& con.update("create table s2k_1 " + dataCols)
+				&& con.update("begin transaction");
+
+		for(int i = 0; ok && i < noOfStations; i++)
+		{
+			ostringstream s;
+			s << "insert into station values (" << 50 + (i / 20)*0.1 << ", "
+			  << 10 + (i % 20)*0.1 << ", 'STATION " << i << "', " << i + 1 << ")";
+			ok = con.insert(s.str());
+		}
+		Date d(1, 1, 2000);
+		for(int dn = 0; ok && d <= Date(31, 12, 2001); dn++, d++)
+		{
+			ostringstream s;
+			s << "insert into days values (" << d.day() << ", " << d.month() << ", "
+			  << d.year() << ", " << dn << ")";
+			ok = con.insert(s.str());
+		}
+
+		string fill = " (tag, mo, jahr, id, " + tavgCol + ", " + precipCol + ") "
+				"select d.tag, d.mo, d.jahr, s.id, s.id*100000 + d.dn, (s.id*100000 + d.dn)/10.0 "
+				"from days d, station s where d.jahr ";
+		return ok
+				&& con.insert("insert into refzen" + fill + "= 2000")
+				&& con.insert("insert into s2k_1" + fill + "= 2001")
+				&& con.update("commit");
+	}
+
+	//! counts the (batch) queries of a Star2 realization
+	class CountingStar2Realization : public Star2Realization
+	{
+	public:
+		CountingStar2Realization(Star2Simulation* sim, Star2Scenario* s, Db::DB* con)
+			: Star2Realization(sim, s, con, 1), noOfQueries(0), noOfBatchQueries(0) {}
+
+		mutable int noOfQueries;
+		mutable int noOfBatchQueries;
+
+	protected:
+		virtual map<ACD, vector<double>*>
+		executeQuery(const ACDV& acds, const LatLngCoord& gc,
+		             const Date& startDate, const Date& endDate) const
+		{
+			noOfQueries++;
+			return Star2Realization::executeQuery(acds, gc, startDate, endDate);
+		}
+
+		virtual GeoCoord2Data
+		executeBatchQuery(const ACDV& acds, const vector<LatLngCoord>& gcs,
+		                  const Date& startDate, const Date& endDate) const
+		{
+			noOfBatchQueries++;
+			return Star2Realization::executeBatchQuery(acds, gcs, startDate, endDate);
+		}
+	};
+
+	bool hasStar2Values(ClimateRealization& real, const ClimateStation& cs,
+	                    const ACDV& acds, const Date& from, const Date& to)
+	{
+		DataAccessor da = real.dataAccessorFor(acds, cs.geoCoord(), from, to);
+		int n = from.numberOfDaysTo(to) + 1;
+		if(int(da.noOfStepsPossible()) != n)
+			return false;
+		for(int i = 0; i < n; i++)
+			if(da.dataForTimestep(tavg, i) != tavgValue(cs.id(), i)
+			   || da.dataForTimestep(precip, i) != precipValue(cs.id(), i))
+				return false;
+		return true;
+	}
+
+	/*!
+	 * the caches of 250 Star2 stations are filled with two batch queries
+	 * (200 stations at most) against a sqlite stand-in of the database and
+	 * hold the same data as filling them station by station
+	 */
+	void star2BatchQueries()
+	{
+		check(createStar2Db(), "star2BatchQueries: create db");
+
+		Star2Simulation sim(new Db::SqliteDB(dbFile));
+		check(sim.climateStations().size() == size_t(noOfStations),
+		      "star2BatchQueries: stations");
+		Star2Scenario scenario("s2k", "S2K", "s2k_", &sim);
+		ACDV acds;
+		acds.push_back(tavg);
+		acds.push_back(precip);
+		Date from(1, 1, 2000), to(31, 12, 2001);
+
+		CountingStar2Realization batched(&sim, &scenario, new Db::SqliteDB(dbFile));
+		batched.fillCacheFor(acds, sim.geoCoords(), from, to);
+		check(batched.noOfBatchQueries == 2 && batched.noOfQueries == 0,
+		      "star2BatchQueries: two batch queries");
+
+		CountingStar2Realization single(&sim, &scenario, new Db::SqliteDB(dbFile));
+		bool same = true;
+		for(size_t i = 0; i < sim.climateStations().size(); i++)
+		{
+			const ClimateStation& cs = *sim.climateStations().at(i);
+			same = same && hasStar2Values(batched, cs, acds, from, to);
+			if(i % 50 == 0)
+				same = same && hasStar2Values(single, cs, acds, from, to);
+		}
+		check(same, "star2BatchQueries: values");
+		check(batched.noOfBatchQueries == 2 && batched.noOfQueries == 0,
+		      "star2BatchQueries: no queries on filled caches");
+		check(single.noOfQueries == 5 && single.noOfBatchQueries == 0,
+		      "star2BatchQueries: single station queries");
+
+		remove(dbFile);
+	}
+}
+
+int main()
+{
+	star2BatchQueries();
+
+	if(failures == 0)
+		cout << "all climate tests passed" << endl;
+	return failures == 0 ? 0 : 1;
+}
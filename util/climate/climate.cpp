@@ -32,6 +32,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <cassert>
 #include <map>
 #include <list>
+#include <atomic>
+#include <limits>
+#include <unordered_map>
 
 #include <boost/foreach.hpp>
 #include <boost/function.hpp>
@@ -91,65 +94,248 @@ ClimateSimulation::~ClimateSimulation()
 
 std::vector<LatLngCoord> ClimateSimulation::geoCoords() const
 {
-	std::vector<LatLngCoord> gcs(climateStations().size());
-	for(unsigned int i = 0; i < gcs.size(); i++)
-		gcs[i] = climateStations().at(i)->geoCoord();
-	return gcs;
+	return _geoCoords;
+}
+
+void ClimateSimulation::indexClimateStations()
+{
+	_lowerStationNames.clear();
+	_lowerName2station.clear();
+	_geoCoord2station.clear();
+	_geoCoords.clear();
+
+	BOOST_FOREACH(ClimateStation* cs, _stations)
+	{
+		string lowerName = boost::to_lower_copy(cs->name());
+		_lowerStationNames.push_back(lowerName);
+		//insert won't overwrite, so the first station in order is kept
+		_lowerName2station.insert(make_pair(lowerName, cs));
+		_geoCoord2station.insert(make_pair(cs->geoCoord(), cs));
+		_geoCoords.push_back(cs->geoCoord());
+	}
+
+	_stationIndex.build(_stations);
+}
+
+namespace
+{
+	ClimateStation* findStationByName(const string& stationName,
+																		const Stations& stations,
+																		const vector<string>& lowerNames,
+																		const unordered_map<string, ClimateStation*>& lowerName2station)
+	{
+		string lowerStationName = boost::to_lower_copy(stationName);
+
+		unordered_map<string, ClimateStation*>::const_iterator ci =
+				lowerName2station.find(lowerStationName);
+		if(ci != lowerName2station.end())
+			return ci->second;
+
+		for(size_t i = 0, size = lowerNames.size(); i < size; i++)
+			if(lowerNames[i].find(lowerStationName) != string::npos)
+				return stations.at(i);
+
+		return NULL;
+	}
 }
 
 LatLngCoord ClimateSimulation::
 climateStation2geoCoord(const string& stationName) const
 {
-  string lowerStationName = boost::to_lower_copy(stationName);
-  BOOST_FOREACH(ClimateStation* cs, _stations)
-  {
-    if(boost::to_lower_copy(cs->name()).find(lowerStationName) != string::npos)
-      return cs->geoCoord();
-	}
-	return LatLngCoord();
+	ClimateStation* cs = findStationByName(stationName, _stations,
+																				 _lowerStationNames, _lowerName2station);
+	return cs ? cs->geoCoord() : LatLngCoord();
 }
 
 ClimateStation ClimateSimulation::
 geoCoord2climateStation(const LatLngCoord& gc) const
 {
-  BOOST_FOREACH(ClimateStation* cs, _stations)
-  {
-    if(cs->geoCoord() == gc)
-      return *cs;
-	}
-	return ClimateStation();
+	map<LatLngCoord, ClimateStation*>::const_iterator ci =
+			_geoCoord2station.find(gc);
+	return ci == _geoCoord2station.end() ? ClimateStation() : *(ci->second);
 }
 
 LatLngCoord ClimateSimulation::
 getClosestClimateDataGeoCoord(const LatLngCoord& gc) const
 {
-	ClimateStation* closestCS = _stations.front();
-	double minDist = gc.distanceTo(closestCS->geoCoord());
-  BOOST_FOREACH(ClimateStation* cs, _stations)
-  {
-    double dist = gc.distanceTo(cs->geoCoord());
-    if(dist < minDist)
-    {
-			minDist = dist;
-      closestCS = cs;
-		}
-	}
+	ClimateStation* closestCS = _stationIndex.nearest(gc);
 
 	//cout << "closestCS: " << closestCS->toString() << endl;
-	return closestCS->geoCoord();
+	return closestCS ? closestCS->geoCoord() : LatLngCoord();
 }
 
 ClimateStation ClimateSimulation::climateStation(const string& stationName) const
 {
-  string lowerStationName = boost::to_lower_copy(stationName);
-  BOOST_FOREACH(ClimateStation* cs, _stations)
-  {
-    if(boost::to_lower_copy(cs->name()).find(lowerStationName) != string::npos)
-      return *cs;
+	ClimateStation* cs = findStationByName(stationName, _stations,
+																				 _lowerStationNames, _lowerName2station);
+	return cs ? *cs : ClimateStation();
+}
+
+//------------------------------------------------------------------------------
+
+void ClimateStationIndex::build(const Stations& stations)
+{
+	_stations = stations;
+	_buckets.clear();
+	_rows = _cols = 0;
+	if(_stations.empty())
+		return;
+
+	double minLat = _stations.front()->geoCoord().lat, maxLat = minLat;
+	double minLng = _stations.front()->geoCoord().lng, maxLng = minLng;
+	BOOST_FOREACH(ClimateStation* cs, _stations)
+	{
+		const LatLngCoord& gc = cs->geoCoord();
+		minLat = min(minLat, gc.lat);
+		maxLat = max(maxLat, gc.lat);
+		minLng = min(minLng, gc.lng);
+		maxLng = max(maxLng, gc.lng);
+	}
+
+	//choose the bucket size for about two stations per bucket
+	double height = maxLat - minLat, width = maxLng - minLng;
+	double noOfBuckets = max(1.0, _stations.size() / 2.0);
+	double area = max(height, 1e-6) * max(width, 1e-6);
+	_cellSize = max(sqrt(area / noOfBuckets), 1e-6);
+	_minLat = minLat;
+	_minLng = minLng;
+	_rows = int(height / _cellSize) + 1;
+	_cols = int(width / _cellSize) + 1;
+
+	_buckets.resize(_rows * _cols);
+	for(int i = 0, size = _stations.size(); i < size; i++)
+	{
+		const LatLngCoord& gc = _stations[i]->geoCoord();
+		_buckets[row(gc.lat) * _cols + col(gc.lng)].push_back(i);
+	}
+}
+
+int ClimateStationIndex::row(double lat) const
+{
+	return max(0, min(_rows - 1, int(std::floor((lat - _minLat) / _cellSize))));
+}
+
+int ClimateStationIndex::col(double lng) const
+{
+	return max(0, min(_cols - 1, int(std::floor((lng - _minLng) / _cellSize))));
+}
+
+ClimateStation* ClimateStationIndex::nearest(const LatLngCoord& gc) const
+{
+	Stations css = kNearest(gc, 1);
+	return css.empty() ? NULL : css.front();
+}
+
+Stations ClimateStationIndex::kNearest(const LatLngCoord& gc,
+																			 unsigned int k) const
+{
+	if(_stations.empty() || k == 0)
+		return Stations();
+
+	int qr = row(gc.lat), qc = col(gc.lng);
+
+	//max heap of the k best stations found so far
+	vector<DistIndex> best;
+	for(int ring = 0; ; ring++)
+	{
+		//look at the buckets on the border of the square of the given ring size
+		for(int r = qr - ring; r <= qr + ring; r++)
+		{
+			if(r < 0 || r >= _rows)
+				continue;
+			bool isBorderRow = r == qr - ring || r == qr + ring;
+			for(int c = qc - ring; c <= qc + ring;
+					c += isBorderRow ? 1 : max(1, 2 * ring))
+			{
+				if(c < 0 || c >= _cols)
+					continue;
+				BOOST_FOREACH(int i, _buckets[r * _cols + c])
+				{
+					DistIndex di(gc.distanceTo(_stations[i]->geoCoord()), i);
+					if(best.size() < k)
+					{
+						best.push_back(di);
+						push_heap(best.begin(), best.end());
+					}
+					else if(di < best.front())
+					{
+						pop_heap(best.begin(), best.end());
+						best.back() = di;
+						push_heap(best.begin(), best.end());
+					}
+				}
+			}
+		}
+
+		//min distance to any station in the not yet searched buckets
+		bool unsearched = false;
+		double bound = numeric_limits<double>::max();
+		if(qr - ring > 0)
+		{
+			unsearched = true;
+			bound = min(bound, max(0.0, gc.lat - (_minLat + (qr - ring) * _cellSize)));
+		}
+		if(qr + ring < _rows - 1)
+		{
+			unsearched = true;
+			bound = min(bound, max(0.0, (_minLat + (qr + ring + 1) * _cellSize) - gc.lat));
+		}
+		if(qc - ring > 0)
+		{
+			unsearched = true;
+			bound = min(bound, max(0.0, gc.lng - (_minLng + (qc - ring) * _cellSize)));
+		}
+		if(qc + ring < _cols - 1)
+		{
+			unsearched = true;
+			bound = min(bound, max(0.0, (_minLng + (qc + ring + 1) * _cellSize) - gc.lng));
+		}
+
+		//stations at exactly the bound distance might still win by their index
+		if(!unsearched || (best.size() == k && best.front().first < bound))
+			break;
+	}
+
+	sort_heap(best.begin(), best.end());
+	Stations res;
+	BOOST_FOREACH(const DistIndex& di, best)
+	{
+		res.push_back(_stations[di.second]);
+	}
+	return res;
+}
+
+Stations ClimateStationIndex::withinRadius(const LatLngCoord& gc,
+																					 double radius) const
+{
+	if(_stations.empty() || radius < 0)
+		return Stations();
+
+	vector<DistIndex> found;
+	for(int r = row(gc.lat - radius), re = row(gc.lat + radius); r <= re; r++)
+	{
+		for(int c = col(gc.lng - radius), ce = col(gc.lng + radius); c <= ce; c++)
+		{
+			BOOST_FOREACH(int i, _buckets[r * _cols + c])
+			{
+				double dist = gc.distanceTo(_stations[i]->geoCoord());
+				if(dist <= radius)
+					found.push_back(DistIndex(dist, i));
+			}
+		}
 	}
-	return ClimateStation();
+
+	sort(found.begin(), found.end());
+	Stations res;
+	BOOST_FOREACH(const DistIndex& di, found)
+	{
+		res.push_back(_stations[di.second]);
+	}
+	return res;
 }
 
+//------------------------------------------------------------------------------
+
 ClimateScenario* ClimateSimulation::scenario(const string& name) const
 {
   BOOST_FOREACH(ClimateScenario* s, _scenarios)
@@ -218,6 +404,7 @@ void StarSimulation::setClimateStations()
   }
 
   sort(_stations.begin(), _stations.end(), cmpClimateStationPtrs);
+  indexClimateStations();
   connection().freeResultSet();
 }
 
@@ -261,6 +448,7 @@ void CarbiocialSimulation::setClimateStations()
 	}
 
 	sort(_stations.begin(), _stations.end(), cmpClimateStationPtrs);
+	indexClimateStations();
 	connection().freeResultSet();
 }
 
@@ -312,9 +500,8 @@ void Star2Simulation::setClimateStations()
 {
 	connection().select("select lat, lon, name, id from station");// where klim = 1");
 
-	Db::MysqlDB* con = Db::toMysqlDB(&connection());
-	MYSQL_ROW row;
-	while((row = con->getMysqlRow()) != 0)
+	Db::RawDBRow row;
+	while((row = connection().getRawRow()) != 0)
   {
     string name(row[2]);
     for_each(name.begin(), name.end(), ToLower());
@@ -329,6 +516,7 @@ void Star2Simulation::setClimateStations()
   }
 
   sort(_stations.begin(), _stations.end(), cmpClimateStationPtrs);
+  indexClimateStations();
   connection().freeResultSet();
 }
 
@@ -372,6 +560,7 @@ void Star2MeasuredDataSimulation::setClimateStations()
   }
 
   sort(_stations.begin(), _stations.end(), cmpClimateStationPtrs);
+  indexClimateStations();
   connection().freeResultSet();
 }
 
@@ -463,6 +652,7 @@ void DDClimateDataServerSimulation::setClimateStations()
 	}
 
 	sort(_stations.begin(), _stations.end(), cmpClimateStationPtrs);
+	indexClimateStations();
 	connection().freeResultSet();
 }
 
@@ -639,6 +829,7 @@ void CLMSimulation::setClimateStations()
   }
 
 	sort(_stations.begin(), _stations.end(), cmpClimateStationPtrs);
+	indexClimateStations();
 	connection().freeResultSet();
 }
 
@@ -693,10 +884,24 @@ void ClimateRealization::fillCacheFor(const vector<AvailableClimateData>& acds,
                                       const Date& startDate,
                                       const Date& endDate)
 {
+	const LatLngCoord& cgc = simulation()->getClosestClimateDataGeoCoord(gc);
+
+	//the usual case, everything is already there
+	CachesPtr published = publishedCaches(cgc);
+	if(published && isInCache(published.get(), acds, startDate, endDate))
+		return;
+
 	Lock lock(this);
 
-	const LatLngCoord& cgc = simulation()->getClosestClimateDataGeoCoord(gc);
-	vector<Cache>& cs = _geoCoord2cache[cgc];
+	//another thread might have filled the caches in the meantime
+	published = publishedCaches(cgc);
+	if(published && isInCache(published.get(), acds, startDate, endDate))
+		return;
+
+	map<LatLngCoord, vector<Cache> > updated;
+	vector<Cache>& cs = updated[cgc];
+	if(published)
+		cs = *published;
 
 	if(cs.size() < availableClimateDataSize())
 		cs.resize(availableClimateDataSize());
@@ -707,6 +912,146 @@ void ClimateRealization::fillCacheFor(const vector<AvailableClimateData>& acds,
 	vector<ACDV>::const_iterator acdvi;
 	for(acdvi = cseAcds.begin(); acdvi != cseAcds.end(); acdvi++)
 		updateCaches(cs, *acdvi, cgc, startDate, endDate);
+
+	publishCaches(updated);
+}
+
+void ClimateRealization::fillCacheFor(const ACDV& acds,
+																			const vector<LatLngCoord>& gcs,
+																			const Date& startDate,
+																			const Date& endDate)
+{
+	Lock lock(this);
+
+	//group the missing data of all closest climate stations by the queried
+	//range and acds, so every group can be fetched by a single batch query
+	typedef pair<pair<Date, Date>, ACDV> Request;
+	//closest geo coord and if its cache for the request is new
+	typedef pair<LatLngCoord, bool> CGC;
+	map<Request, vector<CGC> > request2cgcs;
+	//copies of the caches which will be updated
+	map<LatLngCoord, vector<Cache> > updated;
+	set<LatLngCoord> seenCgcs;
+	BOOST_FOREACH(const LatLngCoord& gc, gcs)
+	{
+		const LatLngCoord& cgc = simulation()->getClosestClimateDataGeoCoord(gc);
+		if(!seenCgcs.insert(cgc).second)
+			continue;
+
+		CachesPtr published = publishedCaches(cgc);
+		if(published && isInCache(published.get(), acds, startDate, endDate))
+			continue;
+
+		vector<Cache>& cs = updated[cgc];
+		if(published)
+			cs = *published;
+		if(cs.size() < availableClimateDataSize())
+			cs.resize(availableClimateDataSize());
+
+		const ACDV& nicAcds = notInCache(cs, acds, startDate, endDate);
+		const vector<ACDV>& cseAcds = commonStartEnd(cs, nicAcds, startDate, endDate);
+		BOOST_FOREACH(const ACDV& cseAcdv, cseAcds)
+		{
+			Date sd, ed;
+			if(missingRange(cs, cseAcdv, startDate, endDate, sd, ed))
+				request2cgcs[make_pair(make_pair(sd, ed), cseAcdv)].
+						push_back(make_pair(cgc, !cs.at(cseAcdv.front()).isInitialized()));
+		}
+	}
+
+	typedef map<Request, vector<CGC> >::value_type R2CGCS;
+	BOOST_FOREACH(const R2CGCS& p, request2cgcs)
+	{
+		const Date& sd = p.first.first.first;
+		const Date& ed = p.first.first.second;
+		const ACDV& racds = p.first.second;
+		const vector<CGC>& cgcs = p.second;
+
+		for(size_t i = 0; i < cgcs.size(); i += maxStationsPerBatchQuery())
+		{
+			map<LatLngCoord, bool> chunk(cgcs.begin() + i,
+																	 cgcs.begin() + min(i + maxStationsPerBatchQuery(),
+																											cgcs.size()));
+			vector<LatLngCoord> chunkGcs;
+			transform(chunk.begin(), chunk.end(), back_inserter(chunkGcs),
+								[](const CGC& cgc){ return cgc.first; });
+
+			GeoCoord2Data gc2ds = executeBatchQuery(racds, chunkGcs, sd, ed);
+			BOOST_FOREACH(GeoCoord2Data::value_type& gc2d, gc2ds)
+			{
+				map<LatLngCoord, bool>::const_iterator ci = chunk.find(gc2d.first);
+				if(ci != chunk.end())
+					spliceIntoCaches(updated[ci->first], ci->second, sd, ed,
+													 gc2d.second);
+				else
+				{
+					typedef map<ACD, vector<double>*>::value_type ACD2DS;
+					BOOST_FOREACH(const ACD2DS& acd2d, gc2d.second)
+					{
+						delete acd2d.second;
+					}
+				}
+			}
+		}
+	}
+
+	publishCaches(updated);
+}
+
+ClimateRealization::GeoCoord2Data
+ClimateRealization::executeBatchQuery(const ACDV& acds,
+																			const vector<LatLngCoord>& gcs,
+																			const Date& startDate,
+																			const Date& endDate) const
+{
+	GeoCoord2Data res;
+	BOOST_FOREACH(const LatLngCoord& gc, gcs)
+	{
+		res[gc] = executeQuery(acds, gc, startDate, endDate);
+	}
+	return res;
+}
+
+ClimateRealization::CachesPtr
+ClimateRealization::publishedCaches(const LatLngCoord& cgc) const
+{
+	PublishLock::Lock lock(_publishLockable);
+	GeoCoord2Caches::const_iterator ci = _geoCoord2caches.find(cgc);
+	return ci == _geoCoord2caches.end() ? CachesPtr() : ci->second;
+}
+
+void ClimateRealization::
+publishCaches(map<LatLngCoord, vector<Cache> >& updated)
+{
+	//the new caches are built before taking the lock, so readers just wait
+	//for the pointers to be swapped
+	vector<pair<LatLngCoord, CachesPtr> > newCaches;
+	typedef map<LatLngCoord, vector<Cache> >::value_type GC2CS;
+	BOOST_FOREACH(GC2CS& p, updated)
+	{
+		boost::shared_ptr<vector<Cache> > cs(new vector<Cache>);
+		cs->swap(p.second);
+		newCaches.push_back(make_pair(p.first, CachesPtr(cs)));
+	}
+
+	PublishLock::Lock lock(_publishLockable);
+	for(size_t i = 0; i < newCaches.size(); i++)
+		_geoCoord2caches[newCaches[i].first].swap(newCaches[i].second);
+}
+
+bool ClimateRealization::isInCache(const vector<Cache>* cs, const ACDV& acds,
+																	 const Date& startDate,
+																	 const Date& endDate) const
+{
+	BOOST_FOREACH(ACD acd, acds)
+	{
+		if(acd >= int(cs->size()))
+			return false;
+		const Cache& c = cs->at(acd);
+		if(!c.isInitialized() || c.startDate > startDate || c.endDate < endDate)
+			return false;
+	}
+	return true;
 }
 
 ACDV ClimateRealization::notInCache(const vector<Cache>& cs, const ACDV& acds,
@@ -763,10 +1108,10 @@ dataAccessorFor(const ACDV& acds, const LatLngCoord& gc,
   {
     fillCacheFor(acds, gc, startDate, endDate);
 
-		Lock lock(this);
-
+		//the published caches won't change anymore, so no locking is needed
     const LatLngCoord& cgc = simulation()->getClosestClimateDataGeoCoord(gc);
-    vector<Cache>& cs = _geoCoord2cache[cgc];
+		CachesPtr published = publishedCaches(cgc);
+		const vector<Cache>* cs = published.get();
 
     int numberOfValues = startDate.numberOfDaysTo(endDate+1);
     DataAccessor bda(startDate, endDate);
@@ -777,12 +1122,12 @@ dataAccessorFor(const ACDV& acds, const LatLngCoord& gc,
 
     for(ACDV::const_iterator acdi = acds.begin(); acdi != acds.end(); acdi++)
     {
-      Cache& c = cs[*acdi];
-			if(c.isInitialized())
+			if(cs && *acdi < int(cs->size()) && cs->at(*acdi).isInitialized())
 			{
+				const Cache& c = cs->at(*acdi);
 				unsigned int o = c.offsetFor(startDate);
-				bda.addClimateData(*acdi, vector<double>(c._cache.begin()+o,
-																								 c._cache.begin()+o+numberOfValues));
+				bda.addClimateData(*acdi, vector<double>(c._cache->begin()+o,
+																								 c._cache->begin()+o+numberOfValues));
 			}
 			else
 			{
@@ -819,17 +1164,32 @@ void ClimateRealization::updateCaches(vector<Cache>& cs, ACDV acds,
                                       const Date& startDate,
                                       const Date& endDate)
 {
-	const Cache& exampleCache = cs.at(acds.front());
+	Date sd, ed;
+	if(!missingRange(cs, acds, startDate, endDate, sd, ed))
+		return;
+
+	bool isNewCache = !cs.at(acds.front()).isInitialized();
 
-	bool isNewCache = !exampleCache.isInitialized();
+	//cout << "executing query" << endl;
+	spliceIntoCaches(cs, isNewCache, sd, ed, executeQuery(acds, gc, sd, ed));
+}
 
-	Date sd = startDate, ed = endDate;
+bool ClimateRealization::missingRange(const vector<Cache>& cs,
+																			const ACDV& acds,
+																			const Date& startDate,
+																			const Date& endDate,
+																			Date& sd, Date& ed) const
+{
+	const Cache& exampleCache = cs.at(acds.front());
 
-  if(!isNewCache)
+	sd = startDate;
+	ed = endDate;
+
+	if(exampleCache.isInitialized())
   {
 		//the cache contains already the the whole needed range of data
 		if(startDate >= exampleCache.startDate && endDate <= exampleCache.endDate)
-			return;
+			return false;
 
 		//we got no sparse vectors, so have to extend the endDate until the
 		//existing start date (could potentially be many elements
@@ -841,8 +1201,13 @@ void ClimateRealization::updateCaches(vector<Cache>& cs, ACDV acds,
 			sd = exampleCache.endDate + 1;
 	}
 
-	//cout << "executing query" << endl;
-	map<ACD, vector<double>*> acd2ds = executeQuery(acds, gc, sd, ed);
+	return true;
+}
+
+void ClimateRealization::spliceIntoCaches(vector<Cache>& cs, bool isNewCache,
+																					const Date& sd, const Date& ed,
+																					const map<ACD, vector<double>*>& acd2ds)
+{
 	map<ACD, vector<double>*>::const_iterator dsi;
   for(dsi = acd2ds.begin(); dsi != acd2ds.end(); dsi++)
   {
@@ -865,21 +1230,35 @@ void ClimateRealization::updateCaches(vector<Cache>& cs, ACDV acds,
 				c.offsets[i] += oldOffset;
 		}
 
-		//prepend lower slice of rows
-    if(lowerSlice > 0)
-    {
-			c._cache.insert(c._cache.begin(), ds->begin(), ds->begin() + lowerSlice);
+		//a new cache just takes over the queried data without copying
+		if(isNewCache && lowerSlice > 0)
+		{
+			c._cache.reset(ds);
+			ds = NULL;
 			c.startDate = sd;
-
-			if(isNewCache)
-				c.endDate = ed;
-		}
-		//append upper slice of rows
-    if(upperSlice > 0)
-    {
-			c._cache.insert(c._cache.end(), ds->end() - upperSlice, ds->end());
 			c.endDate = ed;
 		}
+		//the values of the old cache may still be read, so the extended values
+		//go into a new vector: the lower slice of rows, the old values and the
+		//upper slice of rows
+		else if(lowerSlice > 0 || upperSlice > 0)
+		{
+			vector<double>* vs = new vector<double>;
+			vs->reserve(max(lowerSlice, 0) + c.size() + max(upperSlice, 0));
+			if(lowerSlice > 0)
+			{
+				vs->insert(vs->end(), ds->begin(), ds->begin() + lowerSlice);
+				c.startDate = sd;
+			}
+			if(c._cache)
+				vs->insert(vs->end(), c._cache->begin(), c._cache->end());
+			if(upperSlice > 0)
+			{
+				vs->insert(vs->end(), ds->end() - upperSlice, ds->end());
+				c.endDate = ed;
+			}
+			c._cache.reset(vs);
+		}
 
 		//took ownership of data-vector
 		delete ds;
@@ -1020,7 +1399,7 @@ namespace
   struct Fun
   {
 		virtual ~Fun(){}
-		virtual double operator()(MYSQL_ROW row) const = 0;
+		virtual double operator()(Db::RawDBRow row) const = 0;
 		virtual double operator()(const Db::DBRow& row) const = 0;
 	};
 
@@ -1030,7 +1409,7 @@ namespace
 		ParseAsDouble(int pos) : _pos(pos) {}
 		virtual ~ParseAsDouble(){}
 
-		double operator()(MYSQL_ROW row) const
+		double operator()(Db::RawDBRow row) const
 		{
 			return atof(row[_pos]);
 		}
@@ -1048,7 +1427,7 @@ namespace
         _pos(pos), _asMJpm2pd(asMJpm2pd) {}
 		virtual ~CalcStarGlobrad(){}
 
-		double operator()(MYSQL_ROW row) const
+		double operator()(Db::RawDBRow row) const
 		{
 			//100.0*100.0/1000000.0 -> 1/100
 			//double gr = std::atof(row[_pos])*4.1868;
@@ -1072,7 +1451,7 @@ namespace
 		: _posSun(posSun), _posYd(posYd), _lat(lat) {}
 		virtual ~CalcWettRegGlobrad(){}
 
-		double operator()(MYSQL_ROW row) const
+		double operator()(Db::RawDBRow row) const
 		{
 			return Tools::sunshine2globalRadiation(atoi(row[_posYd]),
 																						 atof(row[_posSun]),
@@ -1099,7 +1478,7 @@ namespace
 		{}
 		virtual ~CalcRemoGlobrad(){}
 
-		double operator()(MYSQL_ROW row) const
+		double operator()(Db::RawDBRow row) const
 		{
 			return Tools::cloudAmount2globalRadiation(atoi(row[_posDoy]),
 																								atof(row[_posCloudAmount]),
@@ -1121,7 +1500,7 @@ namespace
 		: _posPrecip(posPrecip), _posTavg(posTavg), _posMonth(posMonth), _sl(sl) {}
 		virtual ~CalcCorrWRAndCLMPrecip(){}
 
-		double operator()(MYSQL_ROW row) const
+		double operator()(Db::RawDBRow row) const
 		{
 			int month = atoi(row[_posMonth]);
 			PArtPlus pap = createPArtPlus(PArt4tmit(atof(row[_posTavg])), month);
@@ -1141,6 +1520,71 @@ namespace
 			return P+b*pow(P, epsilon);
 		}
 	};
+
+	//! maps the key of a climate station in a batch result set to its index
+	typedef map<string, unsigned int> Key2StationIndex;
+
+	/*!
+	 * parse a batch result set ordered by station straight into one
+	 * data-vector per station and acd without creating intermediate DBRows
+	 * @param keyPos column containing the key of the climate station
+	 * @param stationFs the parse functions (one per acd) for every station
+	 * @param expectedNoOfRows number of rows expected per station
+	 * @return for every station index the acd to data-vector map
+	 */
+	vector<map<ACD, vector<double>*> >
+	parseRowsByStation(Db::DB& con, const ACDV& acds, int keyPos,
+										 const Key2StationIndex& key2index,
+										 const vector<vector<Fun*> >& stationFs,
+										 unsigned int expectedNoOfRows)
+	{
+		vector<map<ACD, vector<double>*> > res(stationFs.size());
+		vector<vector<vector<double>*> > columns(stationFs.size());
+		for(unsigned int si = 0; si < stationFs.size(); si++)
+		{
+			BOOST_FOREACH(ACD acd, acds)
+			{
+				vector<double>* ds = new vector<double>();
+				ds->reserve(expectedNoOfRows);
+				res[si][acd] = ds;
+				columns[si].push_back(ds);
+			}
+		}
+
+		string currentKey;
+		Key2StationIndex::const_iterator ki = key2index.end();
+		Db::RawDBRow row;
+		while((row = con.getRawRow()) != 0)
+		{
+			if(!row[keyPos])
+				continue;
+
+			//rows are ordered by station, so look up key only on changes
+			if(currentKey != row[keyPos])
+			{
+				currentKey = row[keyPos];
+				ki = key2index.find(currentKey);
+			}
+			if(ki == key2index.end())
+				continue;
+
+			const vector<Fun*>& fs = stationFs.at(ki->second);
+			vector<vector<double>*>& cols = columns.at(ki->second);
+			for(unsigned int c = 0; c < cols.size(); c++)
+				cols[c]->push_back((*(fs[c]))(row));
+		}
+
+		con.freeResultSet();
+
+		return res;
+	}
+
+	void deleteFuns(vector<Fun*>& fs)
+	{
+		for(unsigned int i = 0; i < fs.size(); i++)
+			delete fs.at(i);
+		fs.clear();
+	}
 }
 
 //------------------------------------------------------------------------------
@@ -1205,9 +1649,8 @@ StarRealization::executeQuery(const ACDV& acds,
   }
 
 	int count = 0;
-	Db::MysqlDB* con = Db::toMysqlDB(&connection());
-	MYSQL_ROW row;
-	while((row = con->getMysqlRow()) != 0)
+	Db::RawDBRow row;
+	while((row = connection().getRawRow()) != 0)
 	{
 		int c = 0;
     BOOST_FOREACH(ACD acd, acds)
@@ -1223,6 +1666,63 @@ StarRealization::executeQuery(const ACDV& acds,
 	return acd2ds;
 }
 
+ClimateRealization::GeoCoord2Data
+StarRealization::executeBatchQuery(const ACDV& acds,
+																	 const vector<LatLngCoord>& gcs,
+																	 const Date& startDate,
+																	 const Date& endDate) const
+{
+	ostringstream cols;
+	int c = 0;
+	vector<Fun*> fs;
+	BOOST_FOREACH(ACD acd, acds)
+	{
+		cols << availableClimateData2StarDBColName(acd) << ", ";
+		if(acd == Climate::globrad)
+			fs.push_back(new CalcStarGlobrad(c++));
+		else
+			fs.push_back(new ParseAsDouble(c++));
+	}
+
+	string dbDate =
+			"concat(jahr, \'-\', "
+			"if(mo<10,concat(\'0\',mo),mo), \'-\', "
+			"if(tag<10,concat(\'0\',tag),tag))";
+
+	//every Star station has its own table, so just union all the stations'
+	//selects into one query and mark the rows with the index of the station
+	ostringstream query;
+	Key2StationIndex key2index;
+	for(unsigned int i = 0; i < gcs.size(); i++)
+	{
+		const ClimateStation& cs = simulation()->geoCoord2climateStation(gcs.at(i));
+		key2index[Tools::toString(i)] = i;
+
+		query << (i > 0 ? " union all " : "") <<
+						 "(select " << cols.str() << i << " as _sidx, "
+						 "jahr as _jahr, mo as _mo, tag as _tag "
+						 "from " << cs.dbName() << " "
+						 "where " << dbDate << " >= '" << connection().toDBDate(startDate) << "' "
+						 "and " << dbDate << " <= '" << connection().toDBDate(endDate) << "' "
+						 "and not (mo = 2 and tag = 29))";
+	}
+	query << " order by _sidx, _jahr, _mo, _tag";
+
+	connection().select(query.str().c_str());
+
+	vector<vector<Fun*> > stationFs(gcs.size(), fs);
+	vector<map<ACD, vector<double>*> > sds =
+			parseRowsByStation(connection(), acds, c, key2index, stationFs,
+												 startDate.numberOfDaysTo(endDate) + 1);
+	deleteFuns(fs);
+
+	GeoCoord2Data res;
+	for(unsigned int i = 0; i < gcs.size(); i++)
+		res[gcs.at(i)] = sds.at(i);
+
+	return res;
+}
+
 //------------------------------------------------------------------------------
 
 DataAccessor CarbiocialRealization::
@@ -1391,9 +1891,8 @@ Star2Realization::executeQuery(const ACDV& acds,
   }
 
 	int count = 0;
-	Db::MysqlDB* con = Db::toMysqlDB(&connection());
-	MYSQL_ROW row;
-	while((row = con->getMysqlRow()) != 0)
+	Db::RawDBRow row;
+	while((row = connection().getRawRow()) != 0)
 	{
     int c = 0;
     BOOST_FOREACH(ACD acd, acds)
@@ -1409,6 +1908,72 @@ Star2Realization::executeQuery(const ACDV& acds,
   return acd2ds;
 }
 
+ClimateRealization::GeoCoord2Data
+Star2Realization::executeBatchQuery(const ACDV& acds,
+                                    const vector<LatLngCoord>& gcs,
+                                    const Date& startDate,
+                                    const Date& endDate) const
+{
+  ostringstream query, query2; query << "select ";
+  int c = 0;
+  vector<Fun*> fs;
+  BOOST_FOREACH(ACD acd, acds)
+  {
+    query << availableClimateData2StarDBColName(acd) << ", ";
+    if(acd == Climate::globrad)
+      fs.push_back(new CalcStarGlobrad(c++));
+    else
+      fs.push_back(new ParseAsDouble(c++));
+  }
+  query << " tag as _tag, mo as _mo, jahr as _jahr, id as _id ";
+  int keyPos = c + 3;
+
+  string dbDate =
+      "concat(jahr, \'-\', "
+      "if(mo<10,concat(\'0\',mo),mo), \'-\', "
+      "if(tag<10,concat(\'0\',tag),tag))";
+
+  Key2StationIndex key2index;
+  ostringstream ids;
+  for(unsigned int i = 0; i < gcs.size(); i++)
+  {
+    const ClimateStation& cs = simulation()->geoCoord2climateStation(gcs.at(i));
+    key2index[Tools::toString(cs.id())] = i;
+    ids << (i > 0 ? "," : "") << cs.id();
+  }
+
+  query2 << query.str();
+
+  query << "from " << scenario()->id() << "_" << id() << " "
+           "where " << dbDate << " >= '" << connection().toDBDate(startDate) << "' "
+           "and " << dbDate << " <= '" << connection().toDBDate(endDate) << "' "
+           "and not (mo = 2 and tag = 29) "
+           "and id in (" << ids.str() << ")";
+
+  query2 << "from refzen "
+            "where " << dbDate << " >= '" << connection().toDBDate(startDate) << "' "
+            "and " << dbDate << " <= '" << connection().toDBDate(endDate) << "' "
+            "and not (mo = 2 and tag = 29) "
+            "and id in (" << ids.str() << ")";
+
+  query << " union " << query2.str() << " "
+           "order by _id, _jahr, _mo, _tag";
+
+  connection().select(query.str().c_str());
+
+  vector<vector<Fun*> > stationFs(gcs.size(), fs);
+  vector<map<ACD, vector<double>*> > sds =
+      parseRowsByStation(connection(), acds, keyPos, key2index, stationFs,
+                         startDate.numberOfDaysTo(endDate) + 1);
+  deleteFuns(fs);
+
+  GeoCoord2Data res;
+  for(unsigned int i = 0; i < gcs.size(); i++)
+    res[gcs.at(i)] = sds.at(i);
+
+  return res;
+}
+
 //------------------------------------------------------------------------------
 
 DataAccessor Star2MeasuredDataRealization::
@@ -1474,9 +2039,8 @@ map<ACD, vector<double>*>
   }
 
 	int count = 0;
-	Db::MysqlDB* con = Db::toMysqlDB(&connection());
-	MYSQL_ROW row;
-	while((row = con->getMysqlRow()) != 0)
+	Db::RawDBRow row;
+	while((row = connection().getRawRow()) != 0)
 	{
     int c = 0;
     BOOST_FOREACH(ACD acd, acds)
@@ -1494,6 +2058,75 @@ map<ACD, vector<double>*>
 
 //------------------------------------------------------------------------------
 
+namespace
+{
+	//! select columns (and their parse functions) for a DD data server station
+	string ddSelectColumns(const ACDV& acds, const string& simulationId,
+												 const string& dbDate, const ClimateStation& cs,
+												 vector<Fun*>& fs, int* noOfColumns = NULL)
+	{
+		ostringstream query;
+		int c = 0;
+		for(ACDV::const_iterator acdi = acds.begin(); acdi != acds.end(); acdi++)
+		{
+			ACD acd = *acdi;
+			switch(acd)
+			{
+			case Climate::globrad:
+			{
+				if(simulationId == "remo")
+				{
+					query << "nn, dayofyear(" << dbDate << ") as dy";
+					int posCloudAmount = c++; int posDoy = c++;
+					fs.push_back(new CalcRemoGlobrad(posCloudAmount, posDoy,
+																					 cs.geoCoord().lat, cs.nn()));
+				}
+				else
+				{
+					query << "sd, dayofyear(" << dbDate << ") as dy";
+					int posSun = c++; int posYd = c++;
+					fs.push_back(new CalcWettRegGlobrad(posSun, posYd, cs.geoCoord().lat));
+				}
+				break;
+			}
+			case Climate::precip:
+			{
+				if(simulationId == "remo")
+				{
+					query << "rr_drift";
+					fs.push_back(new ParseAsDouble(c++));
+				}
+				else
+				{
+					query << "rr, tm, monat";
+					int posPrecip = c++; int posTavg = c++; int posMonat = c++;
+					fs.push_back(new CalcCorrWRAndCLMPrecip(posPrecip, posTavg, posMonat,
+																									cs.sl()));
+				}
+				break;
+			}
+			case Climate::sunhours:
+			{
+				if(simulationId == "remo")
+					query << "0 as sd";
+				else
+					query << availableClimateData2CLMDBColName(acd);
+				fs.push_back(new ParseAsDouble(c++));
+				break;
+			}
+			default:
+				query << availableClimateData2CLMDBColName(acd);
+				fs.push_back(new ParseAsDouble(c++));
+				break;
+			}
+			query << (acdi+1 != acds.end() ? ", " : " ");
+		}
+		if(noOfColumns)
+			*noOfColumns = c;
+		return query.str();
+	}
+}
+
 DataAccessor DDClimateDataServerRealization::
 dataAccessorFor(const vector<AvailableClimateData>& acds,
 								const string& stationName, const Date& startDate,
@@ -1517,63 +2150,10 @@ DDClimateDataServerRealization::executeQuery(const ACDV& acds,
 			"if(monat<10,concat(\'0\',monat),monat), \'-\', "
 			"if(tag<10,concat(\'0\',tag),tag))";
 
-	ostringstream query; query << "select ";
-	int c = 0;
 	vector<Fun*> fs;
-	for(ACDV::const_iterator acdi = acds.begin(); acdi != acds.end(); acdi++)
-	{
-		ACD acd = *acdi;
-		switch(acd)
-		{
-		case Climate::globrad:
-		{
-			if(_setupData.simulationId() == "remo")
-			{
-				query << "nn, dayofyear(" << dbDate << ") as dy";
-				int posCloudAmount = c++; int posDoy = c++;
-				fs.push_back(new CalcRemoGlobrad(posCloudAmount, posDoy,
-																				 cs.geoCoord().lat, cs.nn()));
-			}
-			else
-			{
-				query << "sd, dayofyear(" << dbDate << ") as dy";
-				int posSun = c++; int posYd = c++;
-				fs.push_back(new CalcWettRegGlobrad(posSun, posYd, cs.geoCoord().lat));
-			}
-			break;
-		}
-		case Climate::precip:
-		{
-			if(_setupData.simulationId() == "remo")
-			{
-				query << "rr_drift";
-				fs.push_back(new ParseAsDouble(c++));
-			}
-			else
-			{
-				query << "rr, tm, monat";
-				int posPrecip = c++; int posTavg = c++; int posMonat = c++;
-				fs.push_back(new CalcCorrWRAndCLMPrecip(posPrecip, posTavg, posMonat,
-																								cs.sl()));
-			}
-			break;
-		}
-		case Climate::sunhours:
-		{
-			if(_setupData.simulationId() == "remo")
-				query << "0 as sd";
-			else
-				query << availableClimateData2CLMDBColName(acd);
-			fs.push_back(new ParseAsDouble(c++));
-			break;
-		}
-		default:
-			query << availableClimateData2CLMDBColName(acd);
-			fs.push_back(new ParseAsDouble(c++));
-			break;
-		}
-		query << (acdi+1 != acds.end() ? ", " : " ");
-	}
+	ostringstream query;
+	query << "select "
+				<< ddSelectColumns(acds, _setupData.simulationId(), dbDate, cs, fs);
 	query << "from "
 				<< _setupData.dataDbName() << "." << _setupData.dataTableName() << " "
 					 "where szenario = '" << _scenario->name() << "' "
@@ -1595,9 +2175,8 @@ DDClimateDataServerRealization::executeQuery(const ACDV& acds,
 	}
 
 	int count = 0;
-	Db::MysqlDB* con = Db::toMysqlDB(&connection());
-	MYSQL_ROW row;
-	while((row = con->getMysqlRow()) != 0)
+	Db::RawDBRow row;
+	while((row = connection().getRawRow()) != 0)
 	{
 		int c = 0;
 		BOOST_FOREACH(ACD acd, acds)
@@ -1613,8 +2192,125 @@ DDClimateDataServerRealization::executeQuery(const ACDV& acds,
 	return acd2ds;
 }
 
+ClimateRealization::GeoCoord2Data
+DDClimateDataServerRealization::executeBatchQuery(const ACDV& acds,
+																									const vector<LatLngCoord>& gcs,
+																									const Date& startDate,
+																									const Date& endDate) const
+{
+	string dbDate =
+			"concat(jahr, \'-\', "
+			"if(monat<10,concat(\'0\',monat),monat), \'-\', "
+			"if(tag<10,concat(\'0\',tag),tag))";
+
+	//the selected columns are the same for all stations, but the parse
+	//functions might depend on the stations location
+	string cols;
+	int keyPos = 0;
+	Key2StationIndex key2index;
+	vector<vector<Fun*> > stationFs(gcs.size());
+	ostringstream datIds;
+	for(unsigned int i = 0; i < gcs.size(); i++)
+	{
+		const ClimateStation& cs = simulation()->geoCoord2climateStation(gcs.at(i));
+		cols = ddSelectColumns(acds, _setupData.simulationId(), dbDate, cs,
+													 stationFs[i], &keyPos);
+		key2index[cs.dbName()] = i;
+		datIds << (i > 0 ? "," : "") << cs.dbName();
+	}
+
+	ostringstream query;
+	query << "select " << cols << ", dat_id as _dat_id "
+					 "from "
+				<< _setupData.dataDbName() << "." << _setupData.dataTableName() << " "
+					 "where szenario = '" << _scenario->name() << "' "
+					 "and realisierung = '" << id() << "' "
+					 "and dat_id in (" << datIds.str() << ") "
+					 "and " << dbDate << " >= '" << connection().toDBDate(startDate) << "' "
+					 "and " << dbDate << " <= '" << connection().toDBDate(endDate) << "' "
+					 "and not (monat = 2 and tag = 29) "
+					 "order by dat_id, jahr, monat, tag";
+
+	connection().select(query.str().c_str());
+
+	vector<map<ACD, vector<double>*> > sds =
+			parseRowsByStation(connection(), acds, keyPos, key2index, stationFs,
+												 startDate.numberOfDaysTo(endDate) + 1);
+	BOOST_FOREACH(vector<Fun*>& fs, stationFs)
+	{
+		deleteFuns(fs);
+	}
+
+	GeoCoord2Data res;
+	for(unsigned int i = 0; i < gcs.size(); i++)
+		res[gcs.at(i)] = sds.at(i);
+
+	return res;
+}
+
 //------------------------------------------------------------------------------
 
+namespace
+{
+	//! select columns (and their parse functions) for a CLM station
+	string clmSelectColumns(const ACDV& acds, const string& dbDate,
+													const ClimateStation& cs, vector<Fun*>& fs,
+													int* noOfColumns = NULL)
+	{
+		ostringstream query;
+		int c = 0;
+		for(ACDV::const_iterator acdi = acds.begin(); acdi != acds.end(); acdi++)
+		{
+			ACD acd = *acdi;
+			switch(acd)
+			{
+			case Climate::globrad:
+				{
+					query << "avg(sd), avg(dayofyear(" << dbDate << ")) as dy";
+					int posSun = c++; int posYd = c++;
+					fs.push_back(new CalcWettRegGlobrad(posSun, posYd, cs.geoCoord().lat));
+					break;
+				}
+			case day:
+			case month:
+			case year:
+				query << availableClimateData2CLMDBColName(acd);
+				fs.push_back(new ParseAsDouble(c++));
+				break;
+			case precip:
+				query << "avg(if("
+						<< availableClimateData2CLMDBColName(precip) << " < -998, "
+						<< availableClimateData2CLMDBColName(precipOrig) << ", "
+						<< availableClimateData2CLMDBColName(precip) << "))";
+				fs.push_back(new ParseAsDouble(c++));
+				break;
+			default:
+				query << "avg(" << availableClimateData2CLMDBColName(acd) << ")";
+				fs.push_back(new ParseAsDouble(c++));
+				break;
+			}
+			query << (acdi+1 != acds.end() ? ", " : " ");
+		}
+		if(noOfColumns)
+			*noOfColumns = c;
+		return query.str();
+	}
+
+	//! list of the db names of all stations to be averaged for station cs
+	string clmAvgStationList(CLMSimulation* sim, const ClimateStation& cs)
+	{
+		ostringstream stationList;
+		stationList << "(";
+		BOOST_FOREACH(const ClimateStation* c, sim->avgClimateStationSet(&cs))
+		{
+			stationList << c->dbName() << ",";
+		}
+		string sl = stationList.str();
+		sl.at(sl.length()-1) = ')';
+		return sl;
+	}
+}
+
 DataAccessor CLMRealization::
 dataAccessorFor(const vector<AvailableClimateData>& acds,
                 const string& stationName, const Date& startDate,
@@ -1638,50 +2334,10 @@ CLMRealization::executeQuery(const ACDV& acds,
       "if(monat<10,concat(\'0\',monat),monat), \'-\', "
       "if(tag<10,concat(\'0\',tag),tag))";
 
-	ostringstream query; query << "select ";
-	int c = 0;
 	vector<Fun*> fs;
-  for(ACDV::const_iterator acdi = acds.begin(); acdi != acds.end(); acdi++)
-  {
-    ACD acd = *acdi;
-    switch(acd)
-    {
-    case Climate::globrad:
-      {
-        query << "avg(sd), avg(dayofyear(" << dbDate << ")) as dy";
-				int posSun = c++; int posYd = c++;
-				fs.push_back(new CalcWettRegGlobrad(posSun, posYd, cs.geoCoord().lat));
-				break;
-			}
-    case day:
-    case month:
-    case year:
-      query << availableClimateData2CLMDBColName(acd);
-      fs.push_back(new ParseAsDouble(c++));
-      break;
-    case precip:
-      query << "avg(if("
-          << availableClimateData2CLMDBColName(precip) << " < -998, "
-          << availableClimateData2CLMDBColName(precipOrig) << ", "
-          << availableClimateData2CLMDBColName(precip) << "))";
-      fs.push_back(new ParseAsDouble(c++));
-      break;
-    default:
-      query << "avg(" << availableClimateData2CLMDBColName(acd) << ")";
-      fs.push_back(new ParseAsDouble(c++));
-      break;
-    }
-    query << (acdi+1 != acds.end() ? ", " : " ");
-	}
-  CLMSimulation* sim = static_cast<CLMSimulation*>(simulation());
-  ostringstream stationList;
-  stationList << "(";
-  BOOST_FOREACH(const ClimateStation* c, sim->avgClimateStationSet(&cs))
-  {
-    stationList << c->dbName() << ",";
-  }
-  string sl = stationList.str();
-  sl.at(sl.length()-1) = ')';
+	ostringstream query;
+	query << "select " << clmSelectColumns(acds, dbDate, cs, fs);
+	string sl = clmAvgStationList(static_cast<CLMSimulation*>(simulation()), cs);
 
 	query <<
 					 "from clm20.clm20_data "
@@ -1705,9 +2361,8 @@ CLMRealization::executeQuery(const ACDV& acds,
   }
 
 	int count = 0;
-	Db::MysqlDB* con = Db::toMysqlDB(&connection());
-	MYSQL_ROW row;
-	while((row = con->getMysqlRow()) != 0)
+	Db::RawDBRow row;
+	while((row = connection().getRawRow()) != 0)
   {
 		int c = 0;
     BOOST_FOREACH(ACD acd, acds)
@@ -1723,13 +2378,71 @@ CLMRealization::executeQuery(const ACDV& acds,
 	return acd2ds;
 }
 
+ClimateRealization::GeoCoord2Data
+CLMRealization::executeBatchQuery(const ACDV& acds,
+																	const vector<LatLngCoord>& gcs,
+																	const Date& startDate,
+																	const Date& endDate) const
+{
+	string dbDate =
+			"concat(jahr, \'-\', "
+			"if(monat<10,concat(\'0\',monat),monat), \'-\', "
+			"if(tag<10,concat(\'0\',tag),tag))";
+
+	CLMSimulation* sim = static_cast<CLMSimulation*>(simulation());
+
+	//every station averages over its own set of neighbours, so union all the
+	//stations' aggregating selects into one query and mark the rows with the
+	//index of the station
+	ostringstream query;
+	int keyPos = 0;
+	Key2StationIndex key2index;
+	vector<vector<Fun*> > stationFs(gcs.size());
+	for(unsigned int i = 0; i < gcs.size(); i++)
+	{
+		const ClimateStation& cs = simulation()->geoCoord2climateStation(gcs.at(i));
+		string cols = clmSelectColumns(acds, dbDate, cs, stationFs[i], &keyPos);
+		key2index[Tools::toString(i)] = i;
+
+		query << (i > 0 ? " union all " : "") <<
+						 "(select " << cols << ", " << i << " as _sidx, "
+						 "jahr as _jahr, monat as _monat, tag as _tag "
+						 "from clm20.clm20_data "
+						 "where szenario = '" << _scenario->name() << "' "
+						 "and realisierung = '" << _realizationNo << "' "
+						 "and dat_id in " << clmAvgStationList(sim, cs) << " "
+						 "and " << dbDate << " >= '" << connection().toDBDate(startDate) << "' "
+						 "and " << dbDate << " <= '" << connection().toDBDate(endDate) << "' "
+						 "and not (monat = 2 and tag = 29) "
+						 "group by szenario, realisierung, tag, monat, jahr)";
+	}
+	query << " order by _sidx, _jahr, _monat, _tag";
+
+	connection().select(query.str().c_str());
+
+	vector<map<ACD, vector<double>*> > sds =
+			parseRowsByStation(connection(), acds, keyPos, key2index, stationFs,
+												 startDate.numberOfDaysTo(endDate) + 1);
+	BOOST_FOREACH(vector<Fun*>& fs, stationFs)
+	{
+		deleteFuns(fs);
+	}
+
+	GeoCoord2Data res;
+	for(unsigned int i = 0; i < gcs.size(); i++)
+		res[gcs.at(i)] = sds.at(i);
+
+	return res;
+}
+
 //------------------------------------------------------------------------------
 
 ClimateDataManager& Climate::climateDataManager()
 {
 	static ClimateDataManager cdm;
   static L lockable;
-  static bool initialized = false;
+	//atomic, so the lock is just needed once for the initialization
+	static atomic<bool> initialized(false);
   if(!initialized)
   {
     L::Lock lock(lockable);
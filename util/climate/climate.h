@@ -29,6 +29,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <cstdlib>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <list>
 #include <set>
 #include <string>
@@ -206,6 +207,44 @@ namespace Climate
 	//! other name for std::vector of ClimateRealization pointers
 	typedef std::vector<ClimateRealization*> Realizations;
 
+	/*!
+	 * spatial index over a set of climate stations, the stations are being
+	 * put into the buckets of a regular grid over their bounding box
+	 * (about two stations per bucket), so the nearest stations to a location
+	 * can be found by just looking at the buckets around the location
+	 * - distances are the same as LatLngCoord::distanceTo
+	 * - equally distant stations are returned in the order of the indexed stations
+	 */
+	class ClimateStationIndex
+	{
+	public:
+		ClimateStationIndex() : _minLat(0), _minLng(0), _cellSize(1), _rows(0), _cols(0) {}
+
+		void build(const Stations& stations);
+
+		//! the closest station or NULL if no stations are indexed
+		ClimateStation* nearest(const Tools::LatLngCoord& gc) const;
+
+		//! the k closest stations ordered by their distance
+		Stations kNearest(const Tools::LatLngCoord& gc, unsigned int k) const;
+
+		//! all stations with a distance <= radius, ordered by their distance
+		Stations withinRadius(const Tools::LatLngCoord& gc, double radius) const;
+
+	private:
+		int row(double lat) const;
+		int col(double lng) const;
+
+		//! a station index and its distance to the query location
+		typedef std::pair<double, int> DistIndex;
+
+		Stations _stations;
+		double _minLat, _minLng, _cellSize;
+		int _rows, _cols;
+		//! the indices into _stations of every bucket (row major)
+		std::vector<std::vector<int> > _buckets;
+	};
+
 	//! represents a climatesimulation as WettReg, CLM or Star
 	/*!
 	 * A ClimateSimulation top of the hierarchy for getting climate data.
@@ -262,12 +301,18 @@ namespace Climate
 		//! all climate stations available for this simulation
     const Stations& climateStations() const { return _stations; }
 
-		//! get a station via its id
+		/*!
+		 * get a station via its name (case insensitive), a station with exactly
+		 * the given name is preferred over stations just containing the name
+		 */
     ClimateStation climateStation(const std::string& stationName) const;
 
 		//! all geoCoordinates for this simulation
 		virtual std::vector<Tools::LatLngCoord> geoCoords() const;
 
+		//! spatial index over all climate stations of this simulation
+		const ClimateStationIndex& climateStationIndex() const { return _stationIndex; }
+
 		//! get geo coord from a given climate station id
 		Tools::LatLngCoord
     climateStation2geoCoord(const std::string& stationName) const;
@@ -305,7 +350,25 @@ namespace Climate
 
     YearRange _yearRange;
 
+		/*!
+		 * build the name and spatial indices, has to be called by the
+		 * subclasses after the climate stations have been loaded
+		 */
+		void indexClimateStations();
+
 	private: //state
+		//! lower case names of the stations (in the order of _stations)
+		std::vector<std::string> _lowerStationNames;
+
+		//! lower case name to first station with this name
+		std::unordered_map<std::string, ClimateStation*> _lowerName2station;
+
+		std::map<Tools::LatLngCoord, ClimateStation*> _geoCoord2station;
+
+		std::vector<Tools::LatLngCoord> _geoCoords;
+
+		ClimateStationIndex _stationIndex;
+
 		//! the simulations name
 		std::string _name;
 
@@ -588,7 +651,7 @@ namespace Climate
   {
 		Cache() {}
 
-    Cache(unsigned int num) : _cache(num) {}
+    Cache(unsigned int num) : _cache(new std::vector<double>(num)) {}
 
 		//! the start date for the all the current values
 		Tools::Date startDate;
@@ -608,12 +671,14 @@ namespace Climate
 			return startDate.isValid() && endDate.isValid();
 		}
 
-		double at(unsigned int index) const { return _cache.at(index); }
+		double at(unsigned int index) const { return _cache->at(index); }
 
-    unsigned int size() const { return _cache.size(); }
+    unsigned int size() const { return _cache ? _cache->size() : 0; }
 
 	private:
-		std::vector<double> _cache;
+		//! the values are never modified once set, an extended cache gets a new
+		//! vector, so copies of a cache share the values instead of copying them
+		boost::shared_ptr<const std::vector<double> > _cache;
 		friend class ClimateRealization;
 	};
 
@@ -626,7 +691,7 @@ namespace Climate
   public:
 		ClimateRealization(const std::string& id, ClimateSimulation* simulation,
 											 ClimateScenario* s, Db::DB* connection) :
-		_id(id), _con(connection), _simulation(simulation), _scenario(s){}
+		_id(id), _con(connection), _simulation(simulation), _scenario(s) {}
 
     virtual ~ClimateRealization(){}
 
@@ -636,6 +701,19 @@ namespace Climate
 											const Tools::Date& startDate,
 											const Tools::Date& endDate);
 
+		/*!
+		 * fills the caches for all given geo coordinates at once, using as few
+		 * database queries as possible (a query fetches the data of
+		 * up to maxStationsPerBatchQuery() stations)
+		 */
+		void fillCacheFor(const std::vector<AvailableClimateData>& acds,
+											const std::vector<Tools::LatLngCoord>& geoCoords,
+											const Tools::Date& startDate,
+											const Tools::Date& endDate);
+
+		//! max number of stations to fetch with a single batch query
+		static unsigned int maxStationsPerBatchQuery() { return 200; }
+
     //! get data deep copied without references to climate cache
     DataAccessor dataAccessorFor(const std::vector<AvailableClimateData>& acds,
 																 const Tools::LatLngCoord& geoCoord,
@@ -661,7 +739,35 @@ namespace Climate
 										 const Tools::Date& startDate,
 										 const Tools::Date& endDate) const = 0;
 
+		typedef std::map<Tools::LatLngCoord, std::map<ACD, std::vector<double>*> >
+		GeoCoord2Data;
+
+		/*!
+		 * query the data for a set of geo coordinates, the default implementation
+		 * just runs executeQuery for every single geo coordinate,
+		 * caller takes care of returned pointers to data-vectors
+		 */
+		virtual GeoCoord2Data
+				executeBatchQuery(const ACDV& acds,
+													const std::vector<Tools::LatLngCoord>& geoCoords,
+													const Tools::Date& startDate,
+													const Tools::Date& endDate) const;
+
   private: //methods
+		typedef boost::shared_ptr<const std::vector<Cache> > CachesPtr;
+		//! the caches of all locations
+		typedef std::map<Tools::LatLngCoord, CachesPtr> GeoCoord2Caches;
+
+		//! the currently published caches of the closest geo coord cgc
+		//! (NULL if there are none), safe to read without locking
+		CachesPtr publishedCaches(const Tools::LatLngCoord& cgc) const;
+		//! publish new versions of the caches of the given locations
+		void publishCaches(std::map<Tools::LatLngCoord, std::vector<Cache> >& updated);
+		//! are the acds for the whole range in the (published) caches cs
+		bool isInCache(const std::vector<Cache>* cs, const ACDV& acds,
+									 const Tools::Date& startDate,
+									 const Tools::Date& endDate) const;
+
     //! create list of acds not completely in cache
     ACDV notInCache(const std::vector<Cache>& cs, const ACDV& acds,
 										const Tools::Date& startDate,
@@ -676,6 +782,14 @@ namespace Climate
 											const Tools::LatLngCoord& geoCoord,
 											const Tools::Date& startDate,
 											const Tools::Date& endDate);
+		//! range [sd, ed] to be queried for acds with common start/end date
+		bool missingRange(const std::vector<Cache>& cs, const ACDV& acds,
+											const Tools::Date& startDate, const Tools::Date& endDate,
+											Tools::Date& sd, Tools::Date& ed) const;
+		//! put queried data into caches, takes ownership of the data-vectors
+		void spliceIntoCaches(std::vector<Cache>& cs, bool isNewCache,
+													const Tools::Date& sd, const Tools::Date& ed,
+													const std::map<ACD, std::vector<double>*>& acd2ds);
 
   private:
 		std::string _id;
@@ -686,7 +800,18 @@ namespace Climate
     ClimateSimulation* _simulation;
     ClimateScenario* _scenario;
 
-		std::map<Tools::LatLngCoord, std::vector<Cache> > _geoCoord2cache;
+		/*!
+		 * published caches are never modified, fills (which hold the object lock)
+		 * update copies of the affected locations' caches (sharing the values of
+		 * the unchanged ones) and swap them in, so readers just need to get the
+		 * current version of a location's caches
+		 */
+		GeoCoord2Caches _geoCoord2caches;
+
+		//! guards just _geoCoord2caches, it's held to look up or swap in the
+		//! caches of a location, never while they are being filled
+		struct PublishLock : public Loki::ObjectLevelLockable<PublishLock> {};
+		mutable PublishLock _publishLockable;
 
 //    friend void testClimate();
 	};
@@ -714,6 +839,12 @@ namespace Climate
 				executeQuery(const ACDV& acds, const Tools::LatLngCoord& geoCoord,
 										 const Tools::Date& startDate,
 										 const Tools::Date& endDate) const;
+
+		virtual GeoCoord2Data
+		executeBatchQuery(const ACDV& acds,
+											const std::vector<Tools::LatLngCoord>& geoCoords,
+											const Tools::Date& startDate,
+											const Tools::Date& endDate) const;
 	};
 
   //----------------------------------------------------------------------------
@@ -761,6 +892,12 @@ namespace Climate
 				executeQuery(const ACDV& acds, const Tools::LatLngCoord& geoCoord,
 										 const Tools::Date& startDate,
 										 const Tools::Date& endDate) const;
+
+    virtual GeoCoord2Data
+    executeBatchQuery(const ACDV& acds,
+                      const std::vector<Tools::LatLngCoord>& geoCoords,
+                      const Tools::Date& startDate,
+                      const Tools::Date& endDate) const;
   };
 
   //----------------------------------------------------------------------------
@@ -813,6 +950,12 @@ namespace Climate
 										 const Tools::Date& startDate,
 										 const Tools::Date& endDate) const;
 
+		virtual GeoCoord2Data
+		executeBatchQuery(const ACDV& acds,
+											const std::vector<Tools::LatLngCoord>& geoCoords,
+											const Tools::Date& startDate,
+											const Tools::Date& endDate) const;
+
 	private: //state
 		ClimateScenario* _scenario;
 		DDServerSetup _setupData;
@@ -841,6 +984,12 @@ namespace Climate
 										 const Tools::Date& startDate,
 										 const Tools::Date& endDate) const;
 
+		virtual GeoCoord2Data
+		executeBatchQuery(const ACDV& acds,
+											const std::vector<Tools::LatLngCoord>& geoCoords,
+											const Tools::Date& startDate,
+											const Tools::Date& endDate) const;
+
 	private: //state
 		//! realization belongs to this scenario
 		ClimateScenario* _scenario;
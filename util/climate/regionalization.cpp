@@ -26,6 +26,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <string>
 #include <cstring>
 #include <sstream>
+#include <list>
+#include <unordered_map>
+#include <atomic>
 
 #include <boost/foreach.hpp>
 
@@ -199,6 +202,38 @@ namespace
     return res;
   }
 
+  //! file of the disk cache holding all years of the result rid
+  string pathToDiskCacheFile(const Env& env, const GridMetaData& gmd,
+                             ClimateRealization* r, const string& acds,
+                             ResultId rid)
+  {
+    const string& pathToCache = env.cacheInfo.pathToHdfCache;
+    ClimateScenario* scen = r->scenario();
+    ostringstream path;
+    path << pathToCache;
+    if(*(pathToCache.rbegin()) != '/')
+      path << "/";
+    path << gmd.toCanonicalString("_") << "/"
+        << scen->simulation()->name() << "/" << scen->name() << "/"
+        << r->id() << "/" << acds << "/"
+        << env.cacheInfo.functionIdString << "/" << rid << ".grids";
+    return path.str();
+  }
+
+}
+
+int Regionalization::memoryCacheBudgetMB(int newGlobalValue)
+{
+	static L lockable;
+	static int globalValue = defaultMemoryCacheBudget;
+
+	if(newGlobalValue > 0)
+	{
+		L::Lock lock(lockable);
+		globalValue = newGlobalValue;
+	}
+
+	return globalValue;
 }
 
 int Regionalization::borderSizeIncrementKM(int newGlobalValue)
@@ -261,334 +296,272 @@ void Regionalization::preloadClimateData(ClimateRealization* r,
 			filterClimateStations(r->simulation(), gmd,
 														borderSize < 0 ? borderSizeIncrementKM() : borderSize);
 	int nocs = climateStations.size();
-	int csCount = 0;
-  BOOST_FOREACH(const ClimateStation* cs, climateStations)
-  {
-//		cout << "Filling climate data cache for:"
-//				<< " ClimateStation: " << cs->name()
-//				<< " ClimateRealization: " << r->name()
-//				<< " GridMetaData: " << gmd.toString()
-//				<< " ACDs: [ ";
-//		BOOST_FOREACH(ACD acd, acds)
-//		{
-//			cout << acd << " ";
-//		}
-//		cout << " ] fromYear: " << fromYear << " toYear: " << toYear
-//				<< " borderSize: " << borderSize << "km" << endl;
-		r->fillCacheFor(acds, cs->geoCoord(), Date(1, 1, fromYear),
-                    Date(31, 12, toYear));
+	int chunkSize = ClimateRealization::maxStationsPerBatchQuery();
+	for(int i = 0; i < nocs; i += chunkSize)
+	{
+		int chunkEnd = min(i + chunkSize, nocs);
+		vector<LatLngCoord> gcs;
+		for(int k = i; k < chunkEnd; k++)
+			gcs.push_back(climateStations.at(k)->geoCoord());
+
+		//fetch the data for a whole chunk of stations with a few queries
+		r->fillCacheFor(acds, gcs, Date(1, 1, fromYear), Date(31, 12, toYear));
 		if(callback)
-			callback(++csCount, nocs);
+			callback(chunkEnd, nocs);
 	}
 }
 
 namespace
 {
-  template <typename Pair>
-  struct Contains
+  //! identifies a regionalized grid in the memory cache
+  struct CacheKey
   {
-		RCRect _r;
-		Contains(GridMetaData gmd) : _r(gmd.rcRect()) {}
-    bool operator()(Pair p) const
+		CacheKey(const GridMetaData& gmd, const string& simulationId,
+		         const string& scenarioId, const string& realizationId,
+		         const string& acds, int functionId, ResultId resultId, int year)
+			: region(gmd.toCanonicalString()), simulationId(simulationId),
+				scenarioId(scenarioId), realizationId(realizationId), acds(acds),
+				functionId(functionId), resultId(resultId), year(year), hash(0)
     {
-			return p.first.rcRect().contains(_r);
-    }
-  };
-}
-
-Results Regionalization::regionalize(Env env)
-{
-//	cout << "entering Climate::regionalize acds: ( ";
-//	BOOST_FOREACH(ACD acd, env.acds)
-//	{
-//		cout << acd << " ";
-//	}
-//	cout << ") functionId: " << env.functionId
-//			<< " functionIdString: " << env.cacheInfo.functionIdString
-//			<< " from: " << env.fromYear << " to: " << env.toYear << endl;
-
-  static L memoryCacheLockable;
-  static L diskCacheLockable;
-	typedef string SimulationId;
-	typedef string ScenarioId;
-	typedef string RealizationName;
-	typedef int FunctionId;
-  typedef int Year;
-	typedef map<Year, GridPPtr> Year2Res;
-	typedef map<ResultId, Year2Res> ResId2Res;
-	typedef map<FunctionId, ResId2Res> FuncId2Res;
-	typedef map<set<ACD>, FuncId2Res> ACD2Res;
-	typedef map<RealizationName, ACD2Res> Real2Res;
-	typedef map<ScenarioId, Real2Res> Scen2Res;
-	typedef map<SimulationId, Scen2Res> Sim2Res;
-	typedef map<GridMetaData, Sim2Res> GMD2Res;
-	static GMD2Res cache;
+			hash_combine(region);
+			hash_combine(simulationId);
+			hash_combine(scenarioId);
+			hash_combine(realizationId);
+			hash_combine(acds);
+			hash_combine(functionId);
+			hash_combine(resultId);
+			hash_combine(year);
+		}
 
-	Results res;
+		bool operator==(const CacheKey& o) const
+    {
+			return hash == o.hash && year == o.year && resultId == o.resultId
+					&& functionId == o.functionId && region == o.region
+					&& simulationId == o.simulationId && scenarioId == o.scenarioId
+					&& realizationId == o.realizationId && acds == o.acds;
+		}
 
-	const Realizations& realizations = env.realizations;
-	if(realizations.empty())
-		return res;
-//	cout << "number of realizations used: " << realizations.size() << endl;
+		string region, simulationId, scenarioId, realizationId, acds;
+		int functionId;
+		ResultId resultId;
+		int year;
+		size_t hash;
 
-	ClimateRealization* someRealization = realizations.front();
-	ClimateScenario* scen = someRealization->scenario();
-	ClimateSimulation* sim = scen->simulation();
+	private:
+		template<typename T>
+		void hash_combine(const T& v)
+    {
+			hash ^= std::hash<T>()(v) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+		}
+	};
 
-	typedef map<ClimateRealization*, set<Year> > Real2Years;
-	Real2Years realization2years;
-  BOOST_FOREACH(ClimateRealization* r, realizations)
+  struct CacheKeyHash
   {
-		realization2years[r] =  Tools::range<set<Year> >(env.fromYear, env.toYear);
-	}
+		size_t operator()(const CacheKey& k) const { return k.hash; }
+	};
 
-	GridMetaData gmd(env.dgm->gridPtr());
+  /*!
+   * the regionalized grids of this session
+   * - the grids are spread over stripes with a lock each, so concurrent
+   * requests don't wait for each other
+   * - the memory of all stripes is counted together, if it exceeds
+   * memoryCacheBudgetMB the least recently used grids of all stripes are
+   * being dropped
+   */
+  class MemoryCache
+  {
+	public:
+		MemoryCache() : _bytes(0), _clock(0) {}
 
-	set<ACD> acdsSet(env.acds.begin(), env.acds.end());
+		GridPPtr get(const CacheKey& key)
+    {
+			Stripe& s = stripeFor(key);
+			Stripe::Lock lock(s);
+			Entries::iterator it = s.entries.find(key);
+			if(it == s.entries.end())
+				return GridPPtr();
+			s.lru.splice(s.lru.begin(), s.lru, it->second.lruPos);
+			it->second.lastUsed = _clock++;
+			return it->second.grid;
+		}
 
-	{
-		//lock the cache, so only one thread can change it
-    L::Lock lock(memoryCacheLockable);
-
-    //check if cache contains the same grid size already
-    GMD2Res::const_iterator ci = cache.find(gmd);
-    if(ci == cache.end())
-      ci = find_if(cache.begin(), cache.end(),
-                   Contains<GMD2Res::value_type>(gmd));
-    if(ci != cache.end())
+		void put(const CacheKey& key, const GridMetaData& gmd, GridPPtr g)
     {
-			bool gmdIsSubregion = ci->first.rcRect().contains(gmd.rcRect()) &&
-                            ci->first != gmd;
-			//if so check for the correct simulation
-			Sim2Res::const_iterator ci2 = ci->second.find(sim->id());
-      if(ci2 != ci->second.end())
-      {
-				//if so check for the correct scenario
-				Scen2Res::const_iterator ci3 = ci2->second.find(scen->id());
-        if(ci3 != ci2->second.end())
-        {
-          BOOST_FOREACH(ClimateRealization* real, realizations)
-          {
-						RealizationName realn = real->name();
-						set<Year>& years = realization2years[real];
-						//if so check for the correct realization
-						Real2Res::const_iterator ci4 = ci3->second.find(realn);
-            if(ci4 != ci3->second.end())
-            {
-							//if so check for the correct data element
-							ACD2Res::const_iterator ci5 = ci4->second.find(acdsSet);
-              if(ci5 != ci4->second.end())
-              {
-								//and check whether the function yielding the requested data
-								//is the same (via the generic handchoosen function id (right now))
-								FuncId2Res::const_iterator ci6 = ci5->second.find(env.functionId);
-                if(ci6 != ci5->second.end())
-                {
-									const ResId2Res& rs = ci6->second;
-									//now find all possible years for the given data element
-									//and load only really necessary ones
-                  if(!rs.empty())
-                  {
-										//assume that for one set of results all the years are the same
-										//as they should have been calculated at the same time
-										const Year2Res& r = rs.begin()->second;
-										//add known years to result and remove them from list of
-										//all requested years
-                    for(int year = env.fromYear; year <= env.toYear; year++)
-                    {
-											Year2Res::const_iterator ci7 = r.find(year);
-                      if(ci7 != r.end())
-                      {
-                        BOOST_FOREACH(const ResId2Res::value_type& p, rs)
-                        {
-													ResultId rid = p.first;
-													const Year2Res& r = p.second;
-													Year2Res::const_iterator ci8 = r.find(year);
-													assert(ci8 != r.end());
-                          GridPPtr g = ci8->second;
-                          if(gmdIsSubregion)
-                          {
-                            pair<Row, Col> rc =
-                                rowColInGrid(gmd, gmd.topLeftCorner());
-                            g = GridPPtr(g->subGridClone(rc.first, rc.second,
-                                                         gmd.nrows, gmd.ncols));
-                          }
-                          res[rid][year].push_back(g);
-												}
-												years.erase(year);
-											}
-										}
-										//if we found all years in cache, we can remove
-										//the realization for the list of data to regionalize
-										if(years.empty())
-											realization2years.erase(real);
-									}
-								}
-							}
-						}
-					}
-          //if all data are in cache, then there are no more realizations
-          //in the map
-          if(realization2years.empty())
-          {
-//            cout << "all requested regionalized data are available in cache" << endl;
-            return res;
-          }
+			size_t bytes = g->gridRef().memory_size();
+
+			{
+				Stripe& s = stripeFor(key);
+				Stripe::Lock lock(s);
+				Entries::iterator it = s.entries.find(key);
+				if(it != s.entries.end())
+				{
+					_bytes -= it->second.bytes;
+					it->second.grid = g;
+					it->second.bytes = bytes;
+					it->second.lastUsed = _clock++;
+					s.lru.splice(s.lru.begin(), s.lru, it->second.lruPos);
+				}
+				else
+				{
+					s.lru.push_front(key);
+					Entry e = {g, gmd, bytes, _clock++, s.lru.begin()};
+					s.entries.insert(make_pair(key, e));
+					addRegion(gmd, 1);
 				}
+				_bytes += bytes;
 			}
-		}
-
-  }
 
-  {
-    L::Lock lock(diskCacheLockable);
+			//keep at least the new grid
+			size_t budget = size_t(memoryCacheBudgetMB()) * 1024 * 1024;
+			while(_bytes > budget && evictOldest(key))
+				;
+		}
 
-    //if data are not yet in the cache, try to load them from a hdf
-    if(env.cacheInfo.cacheData)
+		//! regions with cached grids containing gmd (at the same resolution),
+		//! gmd itself first
+		vector<GridMetaData> containingRegions(const GridMetaData& gmd)
     {
-      string pathToHdfCache = env.cacheInfo.pathToHdfCache;
-      string functionIdString = env.cacheInfo.functionIdString;
-
-      BOOST_FOREACH(Real2Years::value_type p, realization2years)
-      {
-        ClimateRealization* r = p.first;
-        set<Year>& years = p.second;
-
-        //assume that the cache contains for every year all the resultids
-        BOOST_FOREACH(Year year, years)
-        {
-          bool foundYear = false;
-          BOOST_FOREACH(ResultId rid, env.cacheInfo.resultIds)
-          {
-            ostringstream pathToHdf;
-            pathToHdf << pathToHdfCache;
-            if(*(pathToHdfCache.rbegin()) != '/')
-              pathToHdf << "/";
-            pathToHdf << gmd.toCanonicalString("_") << "/"
-                << sim->name() << "/" << scen->name() << "/"
-                << r->id() << "/" << acdsToString(acdsSet) << "/"
-                << functionIdString << "/" << rid << ".hdf";
-            ostringstream dsn;
-            dsn << year;
-//            cout << "trying to load: year: " << year << " path: " << pathToHdf.str() << endl;
-            GridPPtr g = GridPPtr(new GridP(dsn.str(), GridP::HDF, pathToHdf.str()));
-            if(g->isValid())
-            {
-//              cout << "found grid in hdf" << endl;
-              foundYear = true;
-              {
-                L::Lock lock(memoryCacheLockable);
-                cache[gmd][sim->id()][scen->id()][r->id()][acdsSet]
-                    [env.functionId][rid][year] = g;
-              }
-              res[rid][year].push_back(g);
-            }
-          }
-          if(foundYear)
-            years.erase(year);
-        }
-
-        if(years.empty())
-          realization2years.erase(r);
-      }
-      if(realization2years.empty())
+			L::Lock lock(_regionsLockable);
+			vector<GridMetaData> rs;
+			if(_regions.find(gmd) != _regions.end())
+				rs.push_back(gmd);
+      BOOST_FOREACH(const Regions::value_type& p, _regions)
       {
-//        cout << "all requested regionalized data have been loaded from the hdf" << endl;
-        return res;
-      }
-    }
-	}
-
-	//now regionalize climate data
-	vector<const ClimateStation*> climateStations =
-			filterClimateStations(sim, gmd, env.borderSize);
-
-  if(climateStations.empty())
-    return res;
-
-  BOOST_FOREACH(Real2Years::value_type p, realization2years)
-  {
-		ClimateRealization* r = p.first;
-//		cout << "calculating realization: " << r->name() << endl;
-		set<Year> years = p.second;
+				const GridMetaData& r = p.first;
+				if(r != gmd && r.cellsize == gmd.cellsize
+					 && r.coordinateSystem == gmd.coordinateSystem
+					 && (gmd.xllcorner - r.xllcorner) % r.cellsize == 0
+					 && (gmd.yllcorner - r.yllcorner) % r.cellsize == 0
+					 && r.rcRect().contains(gmd.rcRect()))
+					rs.push_back(r);
+			}
+			return rs;
+		}
 
-		typedef map<Year, vector<X> > XS;
-		XS year2xs;
+	private:
+		enum { noOfStripes = 16 };
+		typedef list<CacheKey> LRU;
+		struct Entry
+    {
+			GridPPtr grid;
+			GridMetaData gmd;
+			size_t bytes;
+			unsigned long long lastUsed;
+			LRU::iterator lruPos;
+		};
+		typedef unordered_map<CacheKey, Entry, CacheKeyHash> Entries;
+		struct Stripe : public Loki::ObjectLevelLockable<Stripe>
+    {
+			Entries entries;
+			LRU lru; //!< most recently used first
+		};
+		typedef map<GridMetaData, int> Regions;
 
-    BOOST_FOREACH(const ClimateStation* cs, climateStations)
+		Stripe& stripeFor(const CacheKey& key)
     {
-			DataAccessor da = r->dataAccessorFor(env.acds, cs->geoCoord(),
-                                           Date(1, 1, env.fromYear),
-                                           Date(31, 12, env.toYear));
+			return _stripes[key.hash % noOfStripes];
+		}
 
-      for(int k = 0, to = env.toYear - env.fromYear + 1 - (env.yearSlice - 1);
-      k < to; k++)
+		//! drops the least recently used grid of all stripes, but never keep
+		//! @return false if there was nothing to drop
+		bool evictOldest(const CacheKey& keep)
+    {
+			int oldestStripe = -1;
+			unsigned long long oldest = 0;
+			for(int i = 0; i < noOfStripes; i++)
       {
-				//skip years which have already been calculated and are available
-				//in the cache
-				int currentYear = env.fromYear + k;
-        if(years.find(currentYear) != years.end())
+				Stripe& s = _stripes[i];
+				Stripe::Lock lock(s);
+				if(s.lru.empty() || s.lru.back() == keep)
+					continue;
+				unsigned long long lastUsed = s.entries.find(s.lru.back())->second.lastUsed;
+				if(oldestStripe < 0 || lastUsed < oldest)
         {
-					DataAccessor yda = da.cloneForRange(k * 365, 365 * env.yearSlice);
-					const FuncResult& vals = env.f(yda);
-
-					vector<double> values;
-          BOOST_FOREACH(FuncResult::value_type p, vals)
-          {
-						values.push_back(p.second);
-					}
-
-					//cache also rc coordinate of station
-					year2xs[currentYear].push_back(X(*cs, cs->rcCoord(), values));
-//					cout << "current year: " << currentYear << " station: " << cs->name();
-//					BOOST_FOREACH(FuncResult::value_type p, vals)
-//					{
-//						cout << " [id: " << p.first << "|value: " << p.second << "]";
-//					}
-//					cout << endl;
+					oldestStripe = i;
+					oldest = lastUsed;
 				}
 			}
+			if(oldestStripe < 0)
+				return false;
+
+			//the stripe might have changed in between, then just drop its
+			//current least recently used grid
+			Stripe& s = _stripes[oldestStripe];
+			Stripe::Lock lock(s);
+			if(s.lru.empty() || s.lru.back() == keep)
+				return true;
+			Entries::iterator lit = s.entries.find(s.lru.back());
+			_bytes -= lit->second.bytes;
+			addRegion(lit->second.gmd, -1);
+			s.entries.erase(lit);
+			s.lru.pop_back();
+			return true;
 		}
 
-		//get results for current realization
-		//is basically the same as the avg realization results
-		AvgRealizationsResults newRes;
-    BOOST_FOREACH(XS::value_type p, year2xs)
+		void addRegion(const GridMetaData& gmd, int noOfGrids)
     {
-      int year = p.first;
-//			cout << year << "|" << r->name() << " " << endl;
+			L::Lock lock(_regionsLockable);
+			int& n = _regions[gmd];
+			n += noOfGrids;
+			if(n <= 0)
+				_regions.erase(gmd);
+		}
 
-			vector<X>& xs = year2xs[year];
+		Stripe _stripes[noOfStripes];
+		atomic<size_t> _bytes; //!< size of the grids of all stripes
+		atomic<unsigned long long> _clock; //!< orders the uses over all stripes
+		L _regionsLockable;
+		Regions _regions; //!< number of cached grids per region
+	};
 
-      //if less than three stations, don't do the regression, but
-      //simply average the two stations or take the values of the one stationso/one station/s
-      bool moreThanTwoStations = xs.size() > 2;
+  MemoryCache& memoryCache()
+  {
+		static MemoryCache mc;
+		return mc;
+	}
+}
 
-      int noOfResults = xs.front().values.size();
-      vector<GridPPtr> gs(noOfResults);
-      for(int i = 0, size = gs.size(); i < size; i++)
-        gs[i] = GridPPtr(env.dgm->clone());
+namespace
+{
+  //! gets the regionalized grids: result id, year, index of the realization
+  typedef std::function<void(ResultId, int, int, GridPPtr)> GridSink;
+
+  /*!
+   * interpolates the values at the stations (of one realization and year)
+   * onto the dgm, one grid per result
+   * - the rows are calculated in parallel if parallelRows is set
+   */
+  vector<GridPPtr> interpolate(const GridP* dgm, vector<X>& xs,
+                               bool parallelRows)
+  {
+    //if less than three stations, don't do the regression, but
+    //simply average the two stations or take the values of the one station
+    bool moreThanTwoStations = xs.size() > 2;
 
-      RegressionResult rr;
-      if(moreThanTwoStations)
-      {
-        rr = regression(xs);
+    int noOfResults = xs.front().values.size();
+    vector<GridPPtr> gs(noOfResults);
+    for(int i = 0, size = gs.size(); i < size; i++)
+      gs[i] = GridPPtr(dgm->clone());
 
-        // inverse distance and regression
-        BOOST_FOREACH(X& x, xs)
-        {
-          x.residua = x.values - ((rr.m * x.station.nn()) + rr.n);
-//					cout << "residua=values-((m*nn)+n)=" << toString(x.values)
-//							 << "-" << "((" << toString(rr.m) << "*" << x.station.nn() << ")+"
-//							 << toString(rr.n) << "=" << toString(x.residua) << endl;
-        }
+    RegressionResult rr;
+    if(moreThanTwoStations)
+    {
+      rr = regression(xs);
+
+      // inverse distance and regression
+      BOOST_FOREACH(X& x, xs)
+      {
+        x.residua = x.values - ((rr.m * x.station.nn()) + rr.n);
       }
+    }
 
-			GridPPtr g = gs.front();
-			double cellSize = g->cellSize();
-			double r = g->gridPtr()->xcorner + (cellSize / 2);
-			double h = g->gridPtr()->ycorner + (double(g->rows()) * cellSize)-(cellSize / 2.0);
-      for(int i = 0, rs = g->rows(); i < rs; i++)
+		GridPPtr g = gs.front();
+		double cellSize = g->cellSize();
+		double r = g->gridPtr()->xcorner + (cellSize / 2);
+		double h = g->gridPtr()->ycorner + (double(g->rows()) * cellSize)-(cellSize / 2.0);
+		auto interpolateRows = [&](int firstRow, int lastRow)
+		{
+      for(int i = firstRow; i < lastRow; i++)
       {
         for(int j = 0, cs = g->cols(); j < cs; j++)
         {
@@ -612,18 +585,11 @@ Results Regionalization::regionalize(Env env)
               }
               for(int k = 0; k < noOfResults; k++)
               {
-                double dgm = env.dgm->dataAt(i, j);
+                double dgmv = dgm->dataAt(i, j);
                 double m = rr.m[k];
                 double n = rr.n[k];
-                double oldValue = dgm * m + n + sumz[k]/sum;
+                double oldValue = dgmv * m + n + sumz[k]/sum;
 								gs[k]->setDataAt(i, j, float(oldValue));
-//								cout << "dataAt(" << i << "," << j << ")="
-//										 << "dgm*m+n+sumz/sum="
-//										 << dgm << "*"
-//										 << m << "+" << n << "+"
-//										 << sumz[k] << "/" << sum << "="
-//										 << oldValue
-//										 << endl;
               }
             }
             else
@@ -642,123 +608,520 @@ Results Regionalization::regionalize(Env env)
                   double fv = df/(df+ds)*f.values[k];
                   double sv = ds/(df+ds)*s.values[k];
 									gs[k]->setDataAt(i, j, float(fv + sv));
-//									cout << "dataAt(" << i << "," << j << ")="
-//											 << "(fv + sv="
-//											 << fv << "+" << sv << "="
-//											 << (fv + sv)
-//											 << endl;
 								}
                 else
                 {
 									gs[k]->setDataAt(i, j, float(xs.at(0).values[k]));
-//									cout << "dataAt(" << i << "," << j << ")="
-//											 << "value=" << xs.at(0).values[k] << endl;
 								}
-
               }
             }
 					}
 				}
 			}
-      for(int k = 0; k < noOfResults; k++)
+		};
+
+		if(parallelRows)
+			parallel_rows(g->rows(), interpolateRows);
+		else
+			interpolateRows(0, g->rows());
+
+		return gs;
+	}
+
+  /*!
+   * average of the realizations of one result and year, built up while the
+   * realizations are being regionalized, so their grids needn't be kept
+   * - yields the same as Grids::average of the grids in realization order,
+   * grids coming in early wait for their predecessors, so the average
+   * doesn't depend on the order the tasks finish
+   */
+  class RealizationsAverage : public Loki::ObjectLevelLockable<RealizationsAverage>
+  {
+	public:
+		RealizationsAverage(int noOfRealizations)
+			: _noOfRealizations(noOfRealizations), _next(0), _count(0) {}
+
+		void add(int realizationIndex, GridPPtr g)
+    {
+			Lock lock(this);
+			_waiting[realizationIndex] = g;
+      while(!_waiting.empty() && _waiting.begin()->first == _next)
       {
-        ResultId rid = env.cacheInfo.resultIds[k];
-				newRes[rid][year] = gs.at(k);
-//				cout << "newRes[rid][year]=newRes[" << rid << "][" << year << "]=" << gs.at(k)->dataAt(0,0) << endl;
+				fold(*_waiting.begin()->second);
+				_waiting.erase(_waiting.begin());
+				_next++;
 			}
-//			cout << "year: " << year << endl;
 		}
-//		cout << endl;
 
-		//store the newly loaded data in cache
-		{
-      //lock the cache, so only one thread can change it
-      //we have to lock until all date in newRes have been
-      //stored, because the cache-code at the start of this function
-      //assumes for instance that all years are being stored at the same time
-      //and thus are available at the same time
-      L::Lock lock(memoryCacheLockable);
-      BOOST_FOREACH(const AvgRealizationsResults::value_type& p, newRes)
+		GridPPtr result()
+    {
+			Lock lock(this);
+			//realizations without grid (for this year) are left out
+      BOOST_FOREACH(const Waiting::value_type& p, _waiting)
+      {
+				fold(*p.second);
+			}
+			_waiting.clear();
+
+			if(!_sum)
+				return GridPPtr(new GridP());
+
+			double scale = _count < _noOfRealizations
+					? double(_noOfRealizations) / _count : 1.0;
+			float nodata = float(_sum->noDataValue());
+      for(int r = 0, rs = _sum->rows(), cs = _sum->cols(); r < rs; r++)
       {
-				ResultId rid = p.first;
-				const AvgRealizationsResult& arr = p.second;
-        BOOST_FOREACH(const AvgRealizationsResult::value_type& p2, arr)
+				float* out = (*_sum)[r];
+				const char* state = &_state[size_t(r)*cs];
+				for(int c = 0; c < cs; c++)
+					if(state[c] == eValid)
+						out[c] = scale == 1.0 ? out[c] : float(out[c] * scale);
+					else if(state[c] == eNoData)
+						out[c] = nodata;
+			}
+			if(_withValidityMask)
+				_sum->enableValidityMask();
+			return _sum;
+		}
+
+	private:
+		//! eFirstNoData: no data in the first grid, which keeps its value
+		enum State { eValid, eNoData, eFirstNoData };
+
+		void fold(const GridP& g)
+    {
+			int rs = g.rows(), cs = g.cols();
+      if(!_sum)
+      {
+				_sum = GridPPtr(g.uninitializedClone());
+				_state.assign(size_t(rs)*cs, char(eValid));
+				_withValidityMask = g.validityMask() != NULL;
+			}
+
+			double size = _noOfRealizations;
+			int nd = g.noDataValue();
+			const grid& in = g.gridRef();
+      for(int r = 0; r < rs; r++)
+      {
+				const float* row = in.feld[r];
+				float* sum = (*_sum)[r];
+				char* state = &_state[size_t(r)*cs];
+        for(int c = 0; c < cs; c++)
         {
-					Year year = p2.first;
-					GridPPtr g = p2.second;
+					if(state[c] == eFirstNoData)
+						continue;
+          if(_count == 0 && int(row[c]) == nd)
+          {
+						state[c] = eFirstNoData;
+						sum[c] = row[c];
+						continue;
+					}
+					if(int(row[c]) == nd)
+						state[c] = eNoData;
+					sum[c] = float((_count == 0 ? 0.0f : sum[c]) + (row[c] / size));
+				}
+			}
+			_count++;
+		}
+
+		typedef map<int, GridPPtr> Waiting;
+		int _noOfRealizations;
+		int _next; //!< index of the realization to add next
+		int _count; //!< number of grids added
+		Waiting _waiting;
+		GridPPtr _sum;
+		vector<char> _state;
+		bool _withValidityMask;
+	};
+
+  /*!
+   * regionalizes env and hands every grid over to sink, without keeping
+   * the grids itself
+   * - the grids found in the caches are passed first, then the
+   * (realization, year) pairs left are calculated in parallel, so sink has
+   * to be thread safe
+   */
+  void regionalizeInto(Env env, const GridSink& sink)
+  {
+//	cout << "entering Climate::regionalize acds: ( ";
+//	BOOST_FOREACH(ACD acd, env.acds)
+//	{
+//		cout << acd << " ";
+//	}
+//	cout << ") functionId: " << env.functionId
+//			<< " functionIdString: " << env.cacheInfo.functionIdString
+//			<< " from: " << env.fromYear << " to: " << env.toYear << endl;
+
+  static L diskCacheLockable;
+  typedef int Year;
+	MemoryCache& cache = memoryCache();
+
+	const Realizations& realizations = env.realizations;
+	if(realizations.empty())
+		return;
+//	cout << "number of realizations used: " << realizations.size() << endl;
+
+	ClimateRealization* someRealization = realizations.front();
+	ClimateScenario* scen = someRealization->scenario();
+	ClimateSimulation* sim = scen->simulation();
+
+	typedef map<ClimateRealization*, set<Year> > Real2Years;
+	Real2Years realization2years;
+	map<ClimateRealization*, int> realizationIndex;
+  BOOST_FOREACH(ClimateRealization* r, realizations)
+  {
+		realization2years[r] =  Tools::range<set<Year> >(env.fromYear, env.toYear);
+		realizationIndex.insert(make_pair(r, int(realizationIndex.size())));
+	}
+
+	GridMetaData gmd(env.dgm->gridPtr());
+
+	set<ACD> acdsSet(env.acds.begin(), env.acds.end());
+
+	string acds = acdsToString(acdsSet);
+	const vector<ResultId>& rids = env.cacheInfo.resultIds;
+
+	//check the cache for the same region or a region containing it
+	//(e.g. a district of an already regionalized state)
+	if(!rids.empty())
+	{
+    BOOST_FOREACH(const GridMetaData& region, cache.containingRegions(gmd))
+    {
+			bool gmdIsSubregion = region != gmd;
+			pair<Row, Col> rc = rowColInGrid(region, gmd.topLeftCorner());
+
+      BOOST_FOREACH(ClimateRealization* real, realizations)
+      {
+				Real2Years::iterator ryi = realization2years.find(real);
+				if(ryi == realization2years.end())
+					continue;
+				set<Year>& years = ryi->second;
+
+				//a year counts only if all requested results are cached,
+				//as they have been calculated and stored together
+				for(set<Year>::iterator yi = years.begin(); yi != years.end();)
+				{
+					Year year = *yi;
+					vector<GridPPtr> gs;
+          BOOST_FOREACH(ResultId rid, rids)
           {
+						GridPPtr g = cache.get(CacheKey(region, sim->id(), scen->id(),
+																						real->id(), acds, env.functionId,
+																						rid, year));
+						if(!g)
+							break;
+						gs.push_back(gmdIsSubregion
+												 ? GridP::subGridView(g, rc.first, rc.second,
+																							gmd.nrows, gmd.ncols)
+												 : g);
+					}
 
-            cache[gmd][sim->id()][scen->id()][r->id()][acdsSet]
-                [env.functionId][rid][year] = g;
+					if(gs.size() == rids.size())
+          {
+						for(size_t k = 0; k < rids.size(); k++)
+							sink(rids[k], year, realizationIndex.at(real), gs[k]);
+						years.erase(yi++);
+					}
+					else
+						++yi;
+				}
+
+				//if we found all years in cache, we can remove
+				//the realization for the list of data to regionalize
+				if(years.empty())
+					realization2years.erase(ryi);
+			}
+
+      //if all data are in cache, then there are no more realizations
+      //in the map
+      if(realization2years.empty())
+      {
+//        cout << "all requested regionalized data are available in cache" << endl;
+        return;
+      }
+		}
+	}
+
+  {
+    L::Lock lock(diskCacheLockable);
+
+    //if data are not yet in the cache, try to map them from the disk cache
+    //the cells are read only when they are accessed
+    if(env.cacheInfo.cacheData && !rids.empty())
+    {
+      for(Real2Years::iterator ryi = realization2years.begin();
+          ryi != realization2years.end();)
+      {
+        ClimateRealization* r = ryi->first;
+        set<Year>& years = ryi->second;
+
+        vector<string> paths;
+        BOOST_FOREACH(ResultId rid, rids)
+        {
+          paths.push_back(pathToDiskCacheFile(env, gmd, r, acds, rid));
+        }
+
+        //a year counts only if all requested results are cached
+        for(set<Year>::iterator yi = years.begin(); yi != years.end();)
+        {
+          Year year = *yi;
+          ostringstream dsn;
+          dsn << year;
+          vector<GridPPtr> gs;
+          for(size_t k = 0; k < rids.size(); k++)
+          {
+            GridPPtr g = GridPPtr(new GridP(dsn.str(), GridP::MAPPED, paths[k]));
+            if(!g->isValid())
+              break;
+            gs.push_back(g);
           }
 
-					if(env.cacheInfo.cacheData)
+          if(gs.size() == rids.size())
           {
-            string pathToHdfCache = env.cacheInfo.pathToHdfCache;
-            string functionIdString = env.cacheInfo.functionIdString;
-
-            ostringstream pathToHdf;
-            pathToHdf << pathToHdfCache;
-            if(*(pathToHdfCache.rbegin()) != '/')
-              pathToHdf << "/";
-						pathToHdf << gmd.toCanonicalString("_") << "/"
-								<< sim->name() << "/" << scen->name() << "/"
-								<< r->id() << "/" << acdsToString(acdsSet) << "/"
-								<< functionIdString << "/" << rid << ".hdf";
-//						pathToHdf << gmd.toCanonicalString("_") << "/"
-//								<< sim->name() << "/" << scen->name() << "/"
-//								<< r->id() << "/" << acdsToString(acdsSet) << "/"
-//								<< functionIdString << "/" << rid << "-" << year << ".ascii";
-						ostringstream dsn;
-            dsn << year;
-
-            //should be ok to store separately because the memory cache
-            //is anyway only used during this runtime-session
-            L::Lock lock(diskCacheLockable);
-//            cout << "writing into hdf: year: " << year << " path: " << pathToHdf.str() << endl;
-						g->writeHdf(pathToHdf.str(), dsn.str(), "", -1);
-//						cout << "writeAscii path: " << pathToHdf.str() << endl;
-//						g->writeAscii(pathToHdf.str());
+            for(size_t k = 0; k < rids.size(); k++)
+            {
+              cache.put(CacheKey(gmd, sim->id(), scen->id(), r->id(), acds,
+                                 env.functionId, rids[k], year), gmd, gs[k]);
+              sink(rids[k], year, realizationIndex.at(r), gs[k]);
+            }
+            years.erase(yi++);
           }
+          else
+            ++yi;
+        }
+
+        if(years.empty())
+          realization2years.erase(ryi++);
+        else
+          ++ryi;
+      }
+      if(realization2years.empty())
+      {
+//        cout << "all requested regionalized data have been mapped from the disk cache" << endl;
+        return;
+      }
+    }
+	}
+
+
+	//now regionalize climate data
+	vector<const ClimateStation*> climateStations =
+			filterClimateStations(sim, gmd, env.borderSize);
+
+  if(climateStations.empty())
+    return;
+
+	//get the values at the stations, the realizations are read in parallel
+	typedef map<Year, vector<X> > XS;
+	vector<Real2Years::value_type> reals(realization2years.begin(),
+																			 realization2years.end());
+	vector<XS> year2xss(reals.size());
+	L fLockable;
+	parallel_rows(int(reals.size()), [&](int first, int last)
+	{
+		for(int ri = first; ri < last; ri++)
+		{
+			ClimateRealization* r = reals[ri].first;
+			const set<Year>& years = reals[ri].second;
+			XS& year2xs = year2xss[ri];
+
+	    BOOST_FOREACH(const ClimateStation* cs, climateStations)
+	    {
+				DataAccessor da = r->dataAccessorFor(env.acds, cs->geoCoord(),
+	                                           Date(1, 1, env.fromYear),
+	                                           Date(31, 12, env.toYear));
+
+	      for(int k = 0, to = env.toYear - env.fromYear + 1 - (env.yearSlice - 1);
+	      k < to; k++)
+	      {
+					//skip years which have already been calculated and are available
+					//in the cache
+					int currentYear = env.fromYear + k;
+	        if(years.find(currentYear) != years.end())
+	        {
+						DataAccessor yda = da.cloneForRange(k * 365, 365 * env.yearSlice);
+						FuncResult vals;
+						if(env.fIsThreadSafe)
+							vals = env.f(yda);
+						else
+						{
+							L::Lock lock(fLockable);
+							vals = env.f(yda);
+						}
+
+						vector<double> values;
+	          BOOST_FOREACH(FuncResult::value_type p, vals)
+	          {
+							values.push_back(p.second);
+						}
+
+						//cache also rc coordinate of station
+						year2xs[currentYear].push_back(X(*cs, cs->rcCoord(), values));
+					}
 				}
 			}
 		}
+	});
 
-		//add potentially missing years to result
-    BOOST_FOREACH(AvgRealizationsResults::value_type p, newRes)
+	//every (realization, year) is calculated on its own, ordered by year,
+	//so the realizations of a year are finished about the same time
+	vector<pair<Year, int> > tasks;
+	for(size_t ri = 0; ri < year2xss.size(); ri++)
+    BOOST_FOREACH(const XS::value_type& p, year2xss[ri])
     {
-			ResultId rid = p.first;
-			const AvgRealizationsResult& arr = p.second;
-      BOOST_FOREACH(const AvgRealizationsResult::value_type& p2, arr)
+			tasks.push_back(make_pair(p.first, int(ri)));
+		}
+	sort(tasks.begin(), tasks.end());
+
+	auto calculate = [&](const pair<Year, int>& task, bool parallelRows)
+	{
+		Year year = task.first;
+		ClimateRealization* r = reals[task.second].first;
+		vector<GridPPtr> gs =
+				interpolate(env.dgm, year2xss[task.second].find(year)->second,
+										parallelRows);
+
+    for(int k = 0, size = gs.size(); k < size; k++)
+    {
+			ResultId rid = rids[k];
+			GridPPtr g = gs[k];
+			//a year is taken from the cache only if all its results are there,
+			//so the entries can be stored one by one
+			cache.put(CacheKey(gmd, sim->id(), scen->id(), r->id(), acds,
+												 env.functionId, rid, year), gmd, g);
+
+			if(env.cacheInfo.cacheData)
       {
-				Year year = p2.first;
-				GridPPtr g = p2.second;
-				res[rid][year].push_back(g);
+				ostringstream dsn;
+				dsn << year;
+
+				L::Lock lock(diskCacheLockable);
+				g->writeMapped(pathToDiskCacheFile(env, gmd, r, acds, rid), dsn.str());
 			}
+
+			sink(rid, year, realizationIndex.at(r), g);
 		}
+	};
 
-		//and next realization
+	//the threads take the next task when they are done with one, if there are
+	//fewer tasks than threads, the rows of a task are calculated in parallel
+	int noOfTasks = tasks.size();
+  if(noOfTasks >= grid_threads())
+  {
+		atomic<int> nextTask(0);
+		parallel_rows(grid_threads(), [&](int, int)
+		{
+			for(int t = nextTask++; t < noOfTasks; t = nextTask++)
+				calculate(tasks[t], false);
+		});
 	}
-	
+	else
+		for(int t = 0; t < noOfTasks; t++)
+			calculate(tasks[t], true);
+
 //	cout << "leaving Climate::regionalize" << endl;
+	}
+}
+
+Results Regionalization::regionalize(Env env)
+{
+	//the grids are kept by realization, so they are in the order
+	//of the realizations, whichever task finishes first
+	typedef map<int, GridPPtr> Realization2Grid;
+	typedef map<int, Realization2Grid> Year2Grids;
+	typedef map<ResultId, Year2Grids> ResultId2Grids;
+	ResultId2Grids grids;
+	L lockable;
+	regionalizeInto(env, [&](ResultId rid, int year, int ri, GridPPtr g)
+	{
+		L::Lock lock(lockable);
+		grids[rid][year][ri] = g;
+	});
+
+	Results res;
+	BOOST_FOREACH(const ResultId2Grids::value_type& p, grids)
+  {
+		BOOST_FOREACH(const Year2Grids::value_type& p2, p.second)
+    {
+			vector<GridPPtr>& gs = res[p.first][p2.first];
+			BOOST_FOREACH(const Realization2Grid::value_type& p3, p2.second)
+				gs.push_back(p3.second);
+		}
+	}
 
 	return res;
 }
 
 AvgRealizationsResults Regionalization::regionalizeAndAvgRealizations(Env env)
 {
-	AvgRealizationsResults res;
+	int noOfRealizations =
+			set<ClimateRealization*>(env.realizations.begin(), env.realizations.end()).size();
+
+	//the realizations are averaged while they are calculated
+	typedef boost::shared_ptr<RealizationsAverage> AvgPtr;
+	typedef map<int, AvgPtr> Year2Avg;
+	typedef map<ResultId, Year2Avg> ResultId2Avg;
+	ResultId2Avg avgs;
+	L lockable;
+	regionalizeInto(env, [&](ResultId rid, int year, int ri, GridPPtr g)
+	{
+		AvgPtr avg;
+    {
+			L::Lock lock(lockable);
+			AvgPtr& a = avgs[rid][year];
+			if(!a)
+				a = AvgPtr(new RealizationsAverage(noOfRealizations));
+			avg = a;
+		}
+		avg->add(ri, g);
+	});
 
-	const Results& rs = regionalize(env);
-  BOOST_FOREACH(const Results::value_type& p, rs)
+	AvgRealizationsResults res;
+	BOOST_FOREACH(const ResultId2Avg::value_type& p, avgs)
   {
-		ResultId rid = p.first;
-    BOOST_FOREACH(const Result::value_type& p2, p.second)
+		BOOST_FOREACH(const Year2Avg::value_type& p2, p.second)
     {
-      res[rid][p2.first] = Grids::average(p2.second);
+			res[p.first][p2.first] = p2.second->result();
 		}
 	}
 
 	return res;
 }
 
+SummarizedRealizationsResults
+Regionalization::regionalizeAndSummarizeRealizations(Env env,
+																										 double quantileCompression)
+{
+	//the statistics of a (result, year) get each grid once it is calculated,
+	//add isn't thread safe, so it is serialized per statistics object
+	typedef pair<GridStatisticsPtr, boost::shared_ptr<L> > Entry;
+	typedef map<int, Entry> Year2Entry;
+	typedef map<ResultId, Year2Entry> ResultId2Entry;
+	ResultId2Entry entries;
+	L lockable;
+	regionalizeInto(env, [&](ResultId rid, int year, int, GridPPtr g)
+	{
+		Entry e;
+    {
+			L::Lock lock(lockable);
+			Entry& en = entries[rid][year];
+			if(!en.first)
+				en = Entry(GridStatisticsPtr(new GridStatistics(quantileCompression)),
+									 boost::shared_ptr<L>(new L));
+			e = en;
+		}
+		L::Lock lock(*e.second);
+		e.first->add(*g);
+	});
+
+	SummarizedRealizationsResults res;
+	BOOST_FOREACH(const ResultId2Entry::value_type& p, entries)
+  {
+		BOOST_FOREACH(const Year2Entry::value_type& p2, p.second)
+    {
+			res[p.first][p2.first] = p2.second.first;
+		}
+	}
+
+	return res;
+}
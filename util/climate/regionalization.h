@@ -40,6 +40,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <boost/function.hpp>
 
 #include "grid/grid+.h"
+#include "grid/grid-statistics.h"
 #include "climate.h"
 
 namespace Climate
@@ -49,6 +50,11 @@ namespace Climate
 		int borderSizeIncrementKM(int newGlobalValue = -1 /*km*/);
     const int defaultBorderSize = 100;
 
+		//! how many MB the regionalized grids kept in memory may use, the least
+		//! recently used ones are dropped if there are more
+		int memoryCacheBudgetMB(int newGlobalValue = -1 /*MB*/);
+		const int defaultMemoryCacheBudget = 1024;
+
 		typedef int ResultId;
 
 		typedef std::map<ResultId, double> FuncResult;
@@ -70,6 +76,8 @@ namespace Climate
     {
       CacheInfo() : cacheData(false) {}
       bool cacheData;
+			//! directory of the disk cache, it keeps the results as memory
+			//! mappable grid files (see grid/mapped-grid-file.h)
 			std::string pathToHdfCache;
 			std::string functionIdString;
       std::vector<ResultId> resultIds;
@@ -79,11 +87,13 @@ namespace Climate
     {
 			Env()
         : dgm(NULL), fromYear(0), toYear(0), yearSlice(1),
-					borderSize(borderSizeIncrementKM()), functionId(0) { }
+					borderSize(borderSizeIncrementKM()), functionId(0),
+					fIsThreadSafe(false) { }
 
 			Env(AvailableClimateData acd)
         : dgm(NULL), acds(1, acd), fromYear(0), toYear(0), yearSlice(1),
-				borderSize(borderSizeIncrementKM()), functionId(0), f(defaultFunctionWith(acd)) { }
+				borderSize(borderSizeIncrementKM()), functionId(0), f(defaultFunctionWith(acd)),
+				fIsThreadSafe(false) { }
 
 			const Grids::GridP* dgm;
 			std::vector<AvailableClimateData> acds;
@@ -97,8 +107,17 @@ namespace Climate
 
       CacheInfo cacheInfo;
 
-			//! function being applied to a complete year
+			/*!
+			 * function being applied to a complete year
+			 * - the realizations are read in parallel, the calls to f are
+			 * serialized unless fIsThreadSafe is set
+			 */
 			std::function < FuncResult(DataAccessor) > f;
+
+			//! set to true if f may be called concurrently from several threads,
+			//! i.e. it doesn't modify shared state without synchronization
+			//! (the default functions don't), false serializes the calls
+			bool fIsThreadSafe;
 		};
 
     typedef std::map<int, std::vector<Grids::GridPPtr> > Result;
@@ -120,6 +139,17 @@ namespace Climate
     {
 			return regionalizeAndAvgRealizations(env).begin()->second;
 		}
+
+		typedef boost::shared_ptr<Grids::GridStatistics> GridStatisticsPtr;
+		typedef std::map<int, GridStatisticsPtr> SummarizedRealizationsResult;
+		typedef std::map<ResultId, SummarizedRealizationsResult>
+				SummarizedRealizationsResults;
+		//! like regionalizeAndAvgRealizations but every realization grid is
+		//! added to the statistics (mean, variance, min, max and with
+		//! quantileCompression > 0 the quantiles) of its result and year
+		//! as soon as it is calculated, the grids themselves aren't kept
+		SummarizedRealizationsResults
+		regionalizeAndSummarizeRealizations(Env env, double quantileCompression = 0);
 	}
 }
 
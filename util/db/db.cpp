@@ -164,6 +164,18 @@ MYSQL_ROW MysqlDB::getMysqlRow()
 	return _resultSet ? mysql_fetch_row(_resultSet) : NULL;
 }
 
+RawDBRow MysqlDB::getRawRow()
+{
+	MYSQL_ROW mrow = getMysqlRow();
+	if(mrow == 0)
+		return NULL;
+
+	_rawRow.resize(getNumberOfFields());
+	for(size_t i = 0; i < _rawRow.size(); i++)
+		_rawRow[i] = mrow[i] ? mrow[i] : "";
+	return _rawRow.empty() ? NULL : &_rawRow.front();
+}
+
 void MysqlDB::freeResultSet()
 {
   lazyInit();
@@ -219,8 +231,12 @@ SqliteDB::SqliteDB(const string& filename) :
 
 SqliteDB::~SqliteDB()
 {
-  freeResultSet();
-  sqlite3_close(_db);
+	//a connection which has never been used hasn't opened the db either
+	if(_initialized)
+	{
+		freeResultSet();
+		sqlite3_close(_db);
+	}
 }
 
 void SqliteDB::lazyInit()
@@ -356,6 +372,38 @@ DBRow SqliteDB::getRow()
 	return row;
 }
 
+RawDBRow SqliteDB::getRawRow()
+{
+  lazyInit();
+
+	int rc = sqlite3_step(_ppStmt);
+	switch(rc)
+	{
+	case SQLITE_ROW:
+	{
+		_currentRowNo++;
+		int colCount = sqlite3_column_count(_ppStmt);
+		_rawRow.resize(colCount);
+		for(int i = 0; i < colCount; i++)
+		{
+			const char* col = (const char*)sqlite3_column_text(_ppStmt, i);
+			_rawRow[i] = col ? col : "";
+		}
+		return _rawRow.empty() ? NULL : &_rawRow.front();
+	}
+	case SQLITE_DONE:
+		sqlite3_reset(_ppStmt);
+		_currentRowNo = -1;
+		break;
+
+	default: //error
+		cerr << "Error during getRawRow in: " << _query << endl
+				 << ". Error: " << sqlite3_errmsg(_db) << endl;
+	}
+
+	return NULL;
+}
+
 void SqliteDB::freeResultSet()
 {
   lazyInit();
@@ -411,11 +459,39 @@ namespace
 		else
 			sqlite3_result_error(c, "Wrong numer of arguments to mod function.", -1);
 	}
+
+	//! like MySQL's concat, NULL if any of the arguments is NULL
+	void sqlite_concat(sqlite3_context* c, int argc, sqlite3_value** argv)
+	{
+		string res;
+		for(int i = 0; i < argc; i++)
+		{
+			const unsigned char* v = sqlite3_value_text(argv[i]);
+			if(!v)
+			{
+				sqlite3_result_null(c);
+				return;
+			}
+			res += (const char*)v;
+		}
+		sqlite3_result_text(c, res.c_str(), int(res.size()), SQLITE_TRANSIENT);
+	}
+
+	//! like MySQL's if(condition, then, else)
+	void sqlite_if(sqlite3_context* c, int argc, sqlite3_value** argv)
+	{
+		if(argc == 3)
+			sqlite3_result_value(c, sqlite3_value_int(argv[0]) != 0 ? argv[1] : argv[2]);
+		else
+			sqlite3_result_error(c, "Wrong numer of arguments to if function.", -1);
+	}
 }
 
 void SqliteDB::addNeededSQLFunctions()
 {
 	sqlite3_create_function(_db, "mod", 2, SQLITE_ANY, NULL, sqlite_mod, NULL, NULL);
+	sqlite3_create_function(_db, "concat", -1, SQLITE_ANY, NULL, sqlite_concat, NULL, NULL);
+	sqlite3_create_function(_db, "if", 3, SQLITE_ANY, NULL, sqlite_if, NULL, NULL);
 }
 
 bool SqliteDB::attachDB(std::string pathToDB, std::string alias)
@@ -57,6 +57,9 @@ namespace Db
 {
 	typedef std::vector<std::string> DBRow;
 
+	//! a row as array of column c-strings, only valid until the next fetch
+	typedef const char* const* RawDBRow;
+
 	class DB
 	{
 	public:
@@ -86,6 +89,13 @@ namespace Db
 		//MYSQL_FIELD* getNextField();
 		virtual unsigned long getNumberOfRows() = 0;
 		virtual DBRow getRow() = 0;
+		/*!
+		 * fetch next row without copying the columns into a DBRow
+		 * - NULL columns are returned as empty strings, like getRow does
+		 * @return the row's columns (valid until the next fetch) or NULL if
+		 * there are no more rows
+		 */
+		virtual RawDBRow getRawRow() = 0;
 		virtual void freeResultSet() = 0;
 
 		virtual bool isConnected() = 0; //{ return _isConnected; }
@@ -121,6 +131,7 @@ namespace Db
 		virtual unsigned long getNumberOfRows();
 		virtual DBRow getRow();
 		MYSQL_ROW getMysqlRow();
+		virtual RawDBRow getRawRow();
 		virtual void freeResultSet();
 
 		virtual bool isConnected(){ return _isConnected; }
@@ -151,6 +162,7 @@ namespace Db
 		bool _isConnected;
 		long _id;
 		bool _initialized;
+		std::vector<const char*> _rawRow;
 	};
 #endif
 
@@ -170,6 +182,7 @@ namespace Db
 		virtual unsigned int getNumberOfFields();
 		virtual unsigned long getNumberOfRows();
 		virtual DBRow getRow();
+		virtual RawDBRow getRawRow();
 
 		virtual void freeResultSet();
 
@@ -208,6 +221,7 @@ namespace Db
 		bool _initialized;
 		int _currentRowNo;
 		int _noOfRows;
+		std::vector<const char*> _rawRow;
 	};
 #endif
 
@@ -0,0 +1,55 @@
+TEMPLATE = app
+VERSION = 1.0
+TARGET = grid-benchmarks
+DESTDIR = .
+OBJECTS_DIR = obj
+
+QMAKE_CXXFLAGS += -std=c++0x
+
+HEADERS += \
+	grid.h \
+	platform.h \
+	mapped-file.h \
+	mapped-grid-file.h \
+	grid+.h \
+	tiled-grid.h \
+	grid-statistics.h \
+	grid-manager.h \
+	../tools/online-statistics.h \
+	../tools/pipeline.h \
+
+SOURCES += \
+	grid.cpp \
+	grid-ascii.cpp \
+	platform.cpp \
+	feldw.cpp \
+	mapped-grid-file.cpp \
+	grid+.cpp \
+	tiled-grid.cpp \
+	grid-statistics.cpp \
+	grid-manager.cpp \
+	../tools/online-statistics.cpp \
+	grid-benchmarks-main.cpp
+
+# coord-trans.cpp uses the thread contexts of proj (pj_ctx_alloc,
+# pj_init_plus_ctx), which need proj 4.8 or newer
+LIBS += \
+	-lm \
+	-lpthread \
+	-L../../sys-libs/lib \
+	-lhdf5 \
+	-L../lib \
+	-ltools \
+	-ldb \
+	-lmysqlclient \
+	-lproj
+
+CONFIG += release
+CONFIG -= qt
+
+# not ".", the windows dirent.h in there would hide the system one
+INCLUDEPATH += \
+	.. \
+	../../sys-libs/include \
+	../../sys-libs/boost-1.39.0 \
+	../../sys-libs/loki-lib/include
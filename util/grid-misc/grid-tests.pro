@@ -0,0 +1,51 @@
+TEMPLATE = app
+VERSION = 1.0
+TARGET = grid-tests
+DESTDIR = .
+OBJECTS_DIR = obj
+
+QMAKE_CXXFLAGS += -std=c++0x
+
+HEADERS += \
+	grid.h \
+	platform.h \
+	mapped-file.h \
+	mapped-grid-file.h \
+	grid+.h \
+	tiled-grid.h \
+	grid-statistics.h \
+	../tools/online-statistics.h \
+	../tools/pipeline.h \
+
+SOURCES += \
+	grid.cpp \
+	grid-ascii.cpp \
+	platform.cpp \
+	feldw.cpp \
+	mapped-grid-file.cpp \
+	grid+.cpp \
+	tiled-grid.cpp \
+	grid-statistics.cpp \
+	../tools/online-statistics.cpp \
+	grid-tests-main.cpp
+
+# coord-trans.cpp uses the thread contexts of proj (pj_ctx_alloc,
+# pj_init_plus_ctx), which need proj 4.8 or newer
+LIBS += \
+	-lm \
+	-lpthread \
+	-L../../sys-libs/lib \
+	-lhdf5 \
+	-L../lib \
+	-ltools \
+	-lproj
+
+CONFIG += debug
+CONFIG -= qt
+
+INCLUDEPATH += \
+	. \
+	.. \
+	../../sys-libs/include \
+	../../sys-libs/boost-1.39.0 \
+	../../sys-libs/loki-lib/include
@@ -7,9 +7,11 @@ OBJECTS_DIR = obj
 HEADERS += \
 	grid.h \
 	platform.h \
+	mapped-file.h \
 
 SOURCES += \
 	grid.cpp \
+	grid-ascii.cpp \
 	platform.cpp \
 	feldw.cpp \
   list-hdf-main.cpp
@@ -24,15 +24,39 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cstring>
+#include <mutex>
+
 #include "platform.h"
 #include "grid.h"
 
 using namespace std;
 using namespace Grids;
 
+namespace
+{
+	recursive_mutex& hdfMutex()
+	{
+		static recursive_mutex m;
+		return m;
+	}
+}
+
+HdfLock::HdfLock()
+{
+	hdfMutex().lock();
+}
+
+HdfLock::~HdfLock()
+{
+	hdfMutex().unlock();
+}
+
 hdf5::hdf5()
 {
 	size=0;
+	file=-1;
+	dataset=-1;
 	i1 = (int*)NULL;
 	f1 = (float*)NULL;
 }
@@ -82,6 +106,19 @@ int hdf5::open_d(const char* name)
 	return 0;
 }
 
+int hdf5::delete_d(const char* name)
+{
+	if(dataset>=0){
+		H5Dclose(dataset);
+		dataset=-1;
+	}
+	H5Eset_auto(H5E_DEFAULT,NULL,NULL);
+	if(H5Ldelete(file,name,H5P_DEFAULT)<0){
+		return 1; // error: could not delete dataset
+	}
+	return 0;
+}
+
 herr_t h5gIterator(hid_t /*group*/, const char* name, void* op_data){
 	list<string>* dsns = static_cast<list<string>*>(op_data);
 	dsns->push_back(name);
@@ -89,6 +126,7 @@ herr_t h5gIterator(hid_t /*group*/, const char* name, void* op_data){
 }
 
 list<string> hdf5::allDatasetNames(const char* fileName){
+	HdfLock lock;
 	list<string> dsns;
 
 	hid_t fh = H5Fopen(fileName, H5F_ACC_RDONLY, H5P_DEFAULT);
@@ -139,6 +177,44 @@ void hdf5::write_f_feld(const char* name, float* feld,int nx,int ny)
 	H5Tclose(datatype);
 }
 
+// writes NX rows of NY values, which are stride values apart in feld,
+// returns 0 if the dataset has been created and written
+int hdf5::write_f_feld(const char* name, float* feld,int nx,int ny,int stride)
+{
+	hid_t dataspace, memspace, datatype;
+	herr_t status;
+	hsize_t dims[1], mdims[1];
+	hsize_t start[1], step[1], count[1], block[1];
+
+	dims[0]=nx*ny;
+	dataspace=H5Screate_simple(1,dims,NULL);
+	// select the rows without the padding at their ends
+	mdims[0]=hsize_t(nx)*stride;
+	memspace=H5Screate_simple(1,mdims,NULL);
+	start[0]=0; step[0]=stride; count[0]=nx; block[0]=ny;
+	status=H5Sselect_hyperslab(memspace,H5S_SELECT_SET,start,step,count,block);
+	datatype=H5Tcopy(H5T_NATIVE_FLOAT);
+	if(status>=0)
+		status=H5Tset_order(datatype,H5T_ORDER_LE);
+	if(status>=0){
+		dataset=H5Dcreate(file,name,datatype,dataspace,H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+		if(dataset<0)
+			status=-1;
+	}
+	if(status>=0)
+		status=H5Dwrite(dataset
+		                ,H5T_NATIVE_FLOAT,memspace,dataspace
+		                ,H5P_DEFAULT,feld);
+	H5Sclose(memspace);
+	H5Sclose(dataspace);
+	H5Tclose(datatype);
+	if(status<0){
+		fprintf(stderr,"can not write dataset: %s\n",name);
+		return 1;
+	}
+	return 0;
+}
+
 int* hdf5::read_i_feld(const char* name)
 {
 	hid_t dataspace;//, datatype;
@@ -195,6 +271,98 @@ float* hdf5::read_f_feld(const char* name)
 	return f1;
 }
 
+// reads NX rows of NY values into feld, the rows being stride values apart
+int hdf5::read_f_feld(const char* name, float* feld,int nx,int ny,int stride)
+{
+	hid_t dataspace, memspace;
+	hsize_t dims[1], mdims[1];
+	hsize_t start[1], step[1], count[1], block[1];
+	herr_t  ret;
+
+	if((dataset = H5Dopen(file, name,H5P_DEFAULT))<0){
+		fprintf(stderr,"No Dataset : %s\n",name);
+		exit(2);
+	}
+	dataspace = H5Dget_space(dataset);    /* dataspace handle */
+	H5Sget_simple_extent_dims(dataspace, dims, NULL);
+	if(dims[0]!=hsize_t(nx)*ny){
+		fprintf(stderr,"Dataset %s has %d values, expected %d\n",name,int(dims[0]),nx*ny);
+		H5Sclose(dataspace);
+		return 1;
+	}
+	mdims[0]=hsize_t(nx)*stride;
+	memspace=H5Screate_simple(1,mdims,NULL);
+	start[0]=0; step[0]=stride; count[0]=nx; block[0]=ny;
+	H5Sselect_hyperslab(memspace,H5S_SELECT_SET,start,step,count,block);
+	size=dims[0];
+	ret = H5Dread(dataset, H5T_NATIVE_FLOAT, memspace, dataspace,
+	              H5P_DEFAULT, feld);
+	H5Sclose(memspace);
+	H5Sclose(dataspace);
+	return ret<0 ? 1 : 0;
+}
+
+// writes NX rows of NY values (stride values apart in feld) over the values of
+// the dataset opened by open_d, so a dataset of unchanged size is replaced
+// without leaving its old storage unused in the file
+int hdf5::overwrite_f_feld(float* feld,int nx,int ny,int stride)
+{
+	hid_t dataspace, memspace;
+	hsize_t dims[1], mdims[1];
+	hsize_t start[1], step[1], count[1], block[1];
+	herr_t  ret;
+
+	dataspace = H5Dget_space(dataset);
+	if(dataspace<0)
+		return 1;
+	H5Sget_simple_extent_dims(dataspace, dims, NULL);
+	if(dims[0]!=hsize_t(nx)*ny){
+		H5Sclose(dataspace);
+		return 1;
+	}
+	mdims[0]=hsize_t(nx)*stride;
+	memspace=H5Screate_simple(1,mdims,NULL);
+	start[0]=0; step[0]=stride; count[0]=nx; block[0]=ny;
+	H5Sselect_hyperslab(memspace,H5S_SELECT_SET,start,step,count,block);
+	ret = H5Dwrite(dataset, H5T_NATIVE_FLOAT, memspace, dataspace,
+	               H5P_DEFAULT, feld);
+	H5Sclose(memspace);
+	H5Sclose(dataspace);
+	return ret<0 ? 1 : 0;
+}
+
+// reads rows*cols values starting at (row,col) out of the dataset opened by
+// open_d, which holds NX rows of NY values, into feld (stride values per row)
+int hdf5::read_f_block(float* feld,int nx,int ny,int row,int col,int rows,int cols,int stride)
+{
+	hid_t dataspace, memspace;
+	hsize_t dims[1], mdims[1];
+	hsize_t start[1], step[1], count[1], block[1];
+	herr_t  ret;
+
+	if(row<0 || col<0 || rows<=0 || cols<=0 || row+rows>nx || col+cols>ny || stride<cols)
+		return 1;
+	dataspace = H5Dget_space(dataset);
+	if(dataspace<0)
+		return 1;
+	H5Sget_simple_extent_dims(dataspace, dims, NULL);
+	if(dims[0]!=hsize_t(nx)*ny){
+		H5Sclose(dataspace);
+		return 1;
+	}
+	start[0]=hsize_t(row)*ny+col; step[0]=ny; count[0]=rows; block[0]=cols;
+	H5Sselect_hyperslab(dataspace,H5S_SELECT_SET,start,step,count,block);
+	mdims[0]=hsize_t(rows)*stride;
+	memspace=H5Screate_simple(1,mdims,NULL);
+	start[0]=0; step[0]=stride; count[0]=rows; block[0]=cols;
+	H5Sselect_hyperslab(memspace,H5S_SELECT_SET,start,step,count,block);
+	ret = H5Dread(dataset, H5T_NATIVE_FLOAT, memspace, dataspace,
+	              H5P_DEFAULT, feld);
+	H5Sclose(memspace);
+	H5Sclose(dataspace);
+	return ret<0 ? 1 : 0;
+}
+
 int hdf5::write_i_attribute(const char* name, int val)
 {
 	hid_t aid1,attr1;
@@ -271,8 +439,11 @@ int hdf5::write_s_attribute(const char* name, const char* val)
 	H5Tset_strpad(atype,H5T_STR_NULLTERM);
 	if((attr1=H5Aopen_name(dataset,name))<0)
 		attr1 = H5Acreate(dataset, name, atype, aid1, H5P_DEFAULT,H5P_DEFAULT);
-	// Write string attribute.
-	ret = H5Awrite(attr1, atype, (void*) val);
+	// Write string attribute, the attribute has 80 chars, so val is copied
+	// into a buffer of that size instead of reading past its end
+	char buf[80] = {0};
+	strncpy(buf, val, sizeof(buf) - 1);
+	ret = H5Awrite(attr1, atype, (void*) buf);
 	ret = H5Tclose(atype);
 	ret = H5Sclose(aid1);
 	ret = H5Aclose(attr1);
@@ -43,6 +43,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 #include "grid+.h"
+#include "tiled-grid.h"
+#include "mapped-grid-file.h"
 #include "tools/algorithms.h"
 #include "tools/helper.h"
 
@@ -265,6 +267,7 @@ Grids::readGridMetadataFromHdf(const char* hdfFileName,
 {
 	GridMetaData gmd;
 
+	HdfLock lock;
 	hdf5 hd;
   if(hd.open_f((char*)hdfFileName)!=0)
   {
@@ -430,6 +433,15 @@ GridP::GridP(const string& datasetName, FileType ft, const string& pathToFile,
   case ASCII:
     _grid = GridPtr(new grid(100));
     _grid->read_ascii((char*)pathToFile.c_str());
+    break;
+  case MAPPED:
+    {
+      boost::shared_ptr<MappedFile> mapping;
+      grid* g = mapGrid(pathToFile, datasetName, mapping);
+      //the deleter holds on to the mapping the fields belong to
+      _grid = g ? GridPtr(g, [mapping](grid* mg){ delete mg; })
+                : GridPtr(new grid(100));
+    }
     break;
 	}
 }
@@ -447,10 +459,38 @@ GridP::GridP(const GridP& other)
 	_unit(other._unit),
 	_coordinateSystem(other._coordinateSystem)
 {
+	if(other._validityMask)
+		_validityMask = boost::shared_ptr<validity_mask>(new validity_mask(*other._validityMask));
 }
 
 GridP::~GridP() { }
 
+void GridP::allocateLike(const GridP& other)
+{
+	const grid& og = other.gridRef();
+	grid* g = new grid(int(og.csize));
+	g->ncols = og.ncols;
+	g->nrows = og.nrows;
+	g->xcorner = og.xcorner;
+	g->ycorner = og.ycorner;
+	g->csize = og.csize;
+	g->nodata = og.nodata;
+	g->alloc_feld(g->nrows, g->ncols);
+	_grid = GridPtr(g);
+	_validityMask.reset();
+	_datasetName = other._datasetName;
+	_descriptiveLabel = other._descriptiveLabel;
+	_unit = other._unit;
+	_coordinateSystem = other._coordinateSystem;
+}
+
+GridP* GridP::uninitializedClone() const
+{
+	GridP* c = new GridP(coordinateSystem());
+	c->allocateLike(*this);
+	return c;
+}
+
 GridP::GridP(const grid& other, CoordinateSystem cs)
 	: _grid(GridPtr(const_cast<grid*>(&other)->grid_copy())),
 		_coordinateSystem(cs)
@@ -468,13 +508,16 @@ GridP& GridP::operator=(const GridP& other)
 	_descriptiveLabel = other._descriptiveLabel;
   _unit = other._unit;
 	_coordinateSystem = other._coordinateSystem;
+	_validityMask.reset();
+	if(other._validityMask)
+		_validityMask = boost::shared_ptr<validity_mask>(new validity_mask(*other._validityMask));
 	return *this;
 }
 
 GridP& GridP::operator=(const grid& other)
 {
 	_grid = GridPtr(const_cast<grid*>(&other)->grid_copy());
-	return *this;
+	return *updateValidityMask();
 }
 
 bool GridP::operator==(const GridP& other) const
@@ -498,7 +541,7 @@ bool GridP::operator==(const GridP& other) const
 
 #ifndef NO_HDF5
 bool GridP::writeHdf(const string& pathToHdfFile, const string& datasetName,
-                     const string& regionName, time_t t)
+                     const string& regionName, time_t t, bool overwrite)
 {
   //cout << "pathToHdfFile: " << pathToHdfFile << endl;
   if(!ensureDirExists(pathToHdfFile.substr(0, pathToHdfFile.find_last_of('/'))))
@@ -509,25 +552,18 @@ bool GridP::writeHdf(const string& pathToHdfFile, const string& datasetName,
 	char* modell = (char*)regionName.c_str();
 	int ncols = _grid->ncols;
 	int nrows = _grid->nrows;
-	float** feld = _grid->feld;
-
   //cerr << "hdf " << fname << " " << datasetn << endl;
-	float* f1 = new float[nrows * ncols];
-  if(f1 == NULL)
-  {
-		cerr << "error (write_hdf): no space on device\n";
-		exit(2);
-	}
-	for(int i = 0; i < nrows; i++)
-		for(int j = 0; j < ncols; j++)
-			f1[i * ncols + j] = feld[i][j];
+	HdfLock lock;
 	hdf5* hd = new hdf5;
 	if(hd->open_f(fname) != 0)
 		hd->create_f(fname);
 	bool success = false;
-  if(hd->open_d(datasetn) != 0)
+	bool exists = hd->open_d(datasetn) == 0;
+	if(exists
+	   ? overwrite
+	     && hd->overwrite_f_feld(_grid->data, nrows, ncols, _grid->stride) == 0
+	   : hd->write_f_feld(datasetn, _grid->data, nrows, ncols, _grid->stride) == 0)
   {
-		hd->write_f_feld(datasetn, f1, nrows, ncols);
 		hd->write_s_attribute((char*)"Autor", (char*)"LandcareDSS-GridManager");
 		hd->write_s_attribute((char*)"Modell", modell);
 		hd->write_l_attribute((char*)"time", t);
@@ -539,12 +575,19 @@ bool GridP::writeHdf(const string& pathToHdfFile, const string& datasetName,
 		hd->write_i_attribute((char*)"nrows", nrows);
 		success = true;
 	}
-	delete[] f1;
 	delete hd;
 	return success;
 }
 #endif
 
+bool GridP::writeMapped(const string& pathToFile, const string& datasetName) const
+{
+  if(!ensureDirExists(pathToFile.substr(0, pathToFile.find_last_of('/'))))
+    return false;
+
+  return writeMappedGrid(pathToFile, datasetName, *_grid);
+}
+
 //void GridP::writeAscii(const std::string& pathToAsciiFile)
 //{
 //	return _grid->write_ascii((char*)pathToAsciiFile.c_str());
@@ -553,11 +596,7 @@ bool GridP::writeHdf(const string& pathToHdfFile, const string& datasetName,
 vector<double> GridP::allDataAsLinearVector() const
 {
 	vector<double> linear;
-	for(int i = 0; i < rows(); i++)
-		for(int j = 0; j < cols(); j++)
-			if(isDataField(i, j))
-				linear.push_back(dataAt(i, j));
-
+	forEachDataField([&](int, int, float v){ linear.push_back(v); });
 	return linear;
 }
 
@@ -568,17 +607,11 @@ HistogramData GridP::histogram(int noOfClasses)
 	vector<double> linear(rows()*cols());
 	int k = -1;
 	int nop = 0; // number of pixels
-  for(int i = 0; i < rows(); i++)
-  {
-    for(int j = 0; j < cols(); j++)
-    {
-      if(isDataField(i, j))
-      {
-				linear[++k] = dataAt(i, j);
-				nop++;
-			}
-		}
-	}
+	forEachDataField([&](int, int, float v)
+	{
+		linear[++k] = v;
+		nop++;
+	});
 
 	if(nop == 0) return res;
 
@@ -774,6 +807,21 @@ GridP* GridP::subGridClone(int top, int left, int nrows, int ncols) const
 	return subGrid;
 }
 
+GridPPtr GridP::subGridView(GridPPtr g, int top, int left, int nrows, int ncols)
+{
+	grid* v = g ? g->gridRef().sub_view(top, left, nrows, ncols) : NULL;
+	if(!v)
+		return GridPPtr();
+
+	GridPPtr view(new GridP(g->coordinateSystem()));
+	//the deleter holds on to g, so its fields outlive the view
+	view->_grid = GridPtr(v, [g](grid* vg){ delete vg; });
+	view->_datasetName = g->_datasetName;
+	view->_descriptiveLabel = g->_descriptiveLabel;
+	view->_unit = g->_unit;
+	return view;
+}
+
 GridP* GridP::fillClone(double fillValue, bool keepNodata) const
 {
 	GridP* c = clone();
@@ -793,33 +841,19 @@ std::pair<double, double> GridP::minMax() const
 	if(rows() < 1 && cols() < 1)
 		return make_pair(0.0, 0.0);
 
-	double min = 0;
-	for(int i = 0; i < rows(); i++)
-  {
-		for(int j = 0; j < cols(); j++)
-    {
-      if(isDataField(i, j))
-      {
-        min = dataAt(i, j);
-        goto foundValidValue;
-      }
-    }
-  }
-  foundValidValue:
-	double max = min;
-
-  for(int i = 0; i < rows(); i++)
-  {
-    for(int j = 0; j < cols(); j++)
-    {
-      if(isDataField(i, j))
-      {
-				double v = dataAt(i, j);
-				if(v < min) min = v;
-				if(v > max) max = v;
-			}
+	double min = 0, max = 0;
+	bool foundValidValue = false;
+	forEachDataField([&](int, int, float f)
+	{
+		double v = f;
+		if(!foundValidValue)
+		{
+			min = max = v;
+			foundValidValue = true;
 		}
-	}
+		if(v < min) min = v;
+		if(v > max) max = v;
+	});
 
 	return make_pair(min, max);
 }
@@ -850,33 +884,58 @@ double GridP::average() const
 {
 	double sum = 0;
 	int count = 0;
-  for(int r = 0, rs = rows(); r < rs; r++)
-  {
-    for(int c = 0, cs = cols(); c < cs; c++)
-    {
-      if(isDataField(r, c))
-      {
-				sum += dataAt(r, c);
-				++count;
-			}
-		}
-	}
+	forEachDataField([&](int, int, float v)
+	{
+		sum += v;
+		++count;
+	});
 	return sum / double(count);
 }
 
-GridP* GridP::transformInPlace(std::function<float(float)> transformFunction)
+GridP* GridP::transformInPlace(std::function<float(float)> transformFunction,
+                               bool inParallel)
 {
-  for(int r = 0, rs = rows(); r < rs; r++)
-    for(int c = 0, cs = cols(); c < cs; c++)
-      if(isDataField(r, c))
-        setDataAt(r, c, transformFunction(dataAt(r, c)));
+	int nodata = noDataValue();
+	auto transformRows = [&](int r0, int r1)
+	{
+		for(int r = r0; r < r1; r++)
+		{
+			float* row = _grid->feld[r];
+			for(int c = 0, cs = cols(); c < cs; c++)
+				if(int(row[c]) != nodata)
+					row[c] = transformFunction(row[c]);
+			updateValidityMask(r);
+		}
+	};
+	if(inParallel)
+		parallel_rows(rows(), transformRows);
+	else
+		transformRows(0, rows());
 	return this;
 }
 
-GridP* GridP::transformP(std::function<float(float)> transformFunction) const
+GridP* GridP::transformP(std::function<float(float)> transformFunction,
+                         bool inParallel) const
 {
-	GridP* res = clone();
-  res->transformInPlace(transformFunction);
+	//transform while copying, instead of copying first and transforming after
+	GridP* res = uninitializedClone();
+	int nodata = noDataValue();
+	auto transformRows = [&](int r0, int r1)
+	{
+		for(int r = r0; r < r1; r++)
+		{
+			const float* row = _grid->feld[r];
+			float* out = res->_grid->feld[r];
+			for(int c = 0, cs = cols(); c < cs; c++)
+				out[c] = int(row[c]) != nodata ? transformFunction(row[c]) : row[c];
+		}
+	};
+	if(inParallel)
+		parallel_rows(rows(), transformRows);
+	else
+		transformRows(0, rows());
+	if(_validityMask)
+		res->enableValidityMask();
 	return res;
 }
 
@@ -1061,8 +1120,24 @@ GridPPtr GridProxy::gridPPtr()
 	return g;
 }
 
+#ifndef NO_HDF5
+TiledGridPPtr GridProxy::tiledGridPPtr()
+{
+	if(pathToHdf.empty())
+		return TiledGridPPtr();
+
+	Lock lock(this);
+	if(!tg)
+		tg = TiledGridPPtr(new TiledGridP(datasetName,
+		                                  pathToHdf + "/" + hdfFileName,
+		                                  coordinateSystem));
+	return tg;
+}
+#endif
+
 void GridProxy::resetToLoadFromAscii(const string& ptg)
 {
+	reset();
 	pathToHdf = "";
 	hdfFileName = "";
 	pathToGrid = ptg;
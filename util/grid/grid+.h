@@ -31,8 +31,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 #include <vector>
+#include <algorithm>
 #include <functional>
 #include <iostream>
+#include <type_traits>
 
 #ifndef Q_MOC_RUN
 #include <boost/shared_ptr.hpp>
@@ -214,11 +216,14 @@ namespace Grids
 
 	typedef boost::shared_ptr<GridP> GridPPtr;
 
+	template<class E> struct GridExpression;
+
 	//!grid+ class
 	class GridP
 	{
 	public:
-		enum FileType { HDF, ASCII };
+		//! MAPPED: grid in a memory mapped grid file (see mapped-grid-file.h)
+		enum FileType { HDF, ASCII, MAPPED };
 
 		GridP(Tools::CoordinateSystem cs = Tools::GK5_EPSG31469);
 
@@ -239,6 +244,10 @@ namespace Grids
 		//! copy constructor
 		GridP(const GridP& other);
 
+		//! evaluates the grid expression in a single pass into this new grid
+		template<class E>
+		GridP(const GridExpression<E>& e);
+
 		virtual ~GridP();
 
 		/**
@@ -246,6 +255,10 @@ namespace Grids
 		*/
 		GridP& operator=(const GridP& other);
 
+		//! evaluates the grid expression into a new grid and takes that over
+		template<class E>
+		GridP& operator=(const GridExpression<E>& e);
+
 		/**
 		* conversion copy constructor
 		*/
@@ -267,20 +280,38 @@ namespace Grids
 		}
 
 #ifndef NO_HDF5
+		//! an existing dataset is left alone, unless overwrite is set and it has
+		//! the size of this grid, then its values and attributes are replaced in
+		//! place (deleting and rewriting it would leave its old storage unused
+		//! in the file)
 		bool writeHdf(const std::string& pathToHdfFile,
 			const std::string& datasetName,
-			const std::string& regionName, time_t t);
+			const std::string& regionName, time_t t, bool overwrite = false);
 #endif
 
 		template<typename ValueType>
 		void writeAscii(const std::string& pathToAsciiFile) const;
 
+		//! store the grid as datasetName in a memory mappable grid file
+		bool writeMapped(const std::string& pathToFile,
+			const std::string& datasetName) const;
+
 		//! create clone of part of the grid
 		GridP* subGridClone(int top, int left, int rows, int cols) const;
 
+		/*!
+		 * part of the grid without copying it, the view shares the fields with
+		 * g and keeps g alive, so changes are visible in both
+		 * @return empty pointer if the part isn't inside g
+		 */
+		static GridPPtr subGridView(GridPPtr g, int top, int left, int rows, int cols);
+
 		//! create exact copy of the grid
 		GridP* clone() const { return new GridP(*this); }
 
+		//! like clone, but the fields are left uninitialized, for results overwriting every field anyway
+		GridP* uninitializedClone() const;
+
 		//! create a structural copy, but set all fields to given emptyValue
 		GridP* emptyClone(bool keepNoData = true) const
 		{
@@ -358,9 +389,12 @@ namespace Grids
 		GridP* setDataAt(int row, int col, float value)
 		{
 			_grid->feld[row][col] = value;
+			if(_validityMask)
+				_validityMask->set(row, col, int(value) != noDataValue());
 			return this;
 		}
 
+		//! raw access to a row, call updateValidityMask() after writing through it
 		float* operator[](int row){ return _grid->feld[row]; }
 
 		GridP* setDataAt(Tools::RectCoord rcc, float value);
@@ -395,6 +429,40 @@ namespace Grids
 			return !isNoDataField(rcc);
 		}
 
+		/*!
+		 * optional packed mask of the data fields, which lets statistics and
+		 * element wise operations skip whole words of no data fields at once
+		 * - kept in sync by the GridP operations, after writing directly into
+		 * the fields (operator[], gridRef()) call updateValidityMask()
+		 */
+		GridP* enableValidityMask()
+		{
+			_validityMask = boost::shared_ptr<validity_mask>(new validity_mask(*_grid));
+			return this;
+		}
+
+		GridP* disableValidityMask()
+		{
+			_validityMask.reset();
+			return this;
+		}
+
+		//! rebuild the mask from the data, if it is enabled
+		GridP* updateValidityMask()
+		{
+			return _validityMask ? enableValidityMask() : this;
+		}
+
+		//! rebuild just the mask of the given row, if it is enabled
+		GridP* updateValidityMask(int row)
+		{
+			if(_validityMask)
+				_validityMask->update_row(row, _grid->feld[row], noDataValue());
+			return this;
+		}
+
+		const validity_mask* validityMask() const { return _validityMask.get(); }
+
 		std::string toString() const;
 
 		grid& gridRef() const { return *gridPtr(); }
@@ -448,7 +516,10 @@ namespace Grids
 
 		double average() const;
 
-		GridP* transformInPlace(std::function<float(float)> transformFunction);
+		//! with inParallel the rows are transformed on several threads (see
+		//! set_grid_threads), so transformFunction has to be thread safe then
+		GridP* transformInPlace(std::function<float(float)> transformFunction,
+		                        bool inParallel = false);
 
 		GridP* replace(float searchValue, float replaceValue)
 		{
@@ -456,15 +527,18 @@ namespace Grids
 			//														(boost::lambda::_1 == searchValue,
 			//														 replaceValue, boost::lambda::_1));
 			return transformInPlace([=](float v){ return v == searchValue
-				? replaceValue : v; });
+				? replaceValue : v; }, true);
 		}
 
-		GridPPtr transform(std::function<float(float)> transformFunction) const
+		GridPPtr transform(std::function<float(float)> transformFunction,
+		                   bool inParallel = false) const
 		{
-			return GridPPtr(transformP(transformFunction));
+			return GridPPtr(transformP(transformFunction, inParallel));
 		}
 
-		GridP* transformP(std::function<float(float)> transformFunction) const;
+		//! see transformInPlace for inParallel
+		GridP* transformP(std::function<float(float)> transformFunction,
+		                  bool inParallel = false) const;
 
 		std::pair<int, int> rc2rowCol(Tools::RectCoord rcc) const;
 
@@ -530,7 +604,27 @@ namespace Grids
 		}
 
 	private:
+		//! allocate a grid with the structure of other, without initializing the fields
+		void allocateLike(const GridP& other);
+
+		//! calls f(row, col, value) for all data fields, row by row
+		template<class F>
+		void forEachDataField(F f) const
+		{
+			for(int r = 0, rs = rows(); r < rs; r++)
+			{
+				const float* row = _grid->feld[r];
+				if(_validityMask)
+					_validityMask->for_each_valid(r, [&](int c){ f(r, c, row[c]); });
+				else
+					for(int c = 0, cs = cols(); c < cs; c++)
+						if(int(row[c]) != noDataValue())
+							f(r, c, row[c]);
+			}
+		}
+
 		GridPtr _grid;
+		boost::shared_ptr<validity_mask> _validityMask;
 		std::string _datasetName;
 		std::string _descriptiveLabel;
 		std::string _unit;
@@ -538,6 +632,11 @@ namespace Grids
 		Tools::CoordinateSystem _coordinateSystem;
 	};
 
+	/*!
+	 * average of the grids, a field is no data if it is no data in any of the grids
+	 * - single pass over the rows, the validity of the fields is tracked
+	 * in a mask instead of breaking out per field
+	 */
 	template<class CollectionOfGrids>
 	GridP* averageP(const CollectionOfGrids& gridps)
 	{
@@ -545,26 +644,70 @@ namespace Grids
 			return new GridP();
 
 		double size = gridps.size();
-		GridP* res = (*(gridps.begin()))->fillClone(0.0);
-		for(int r = 0, rs = res->rows(); r < rs; r++)
+		const GridP* first = &(**(gridps.begin()));
+		GridP* res = first->uninitializedClone();
+		int rs = res->rows(), cs = res->cols();
+		float nodata = float(res->noDataValue());
+
+		std::vector<float**> felds;
+		std::vector<int> nodatas;
+		BOOST_FOREACH(typename CollectionOfGrids::value_type g, gridps)
+		{
+			felds.push_back(g->gridRef().feld);
+			nodatas.push_back(g->noDataValue());
+		}
+
+		//if all grids have a validity mask, words without data in any grid are skipped
+		std::vector<const validity_mask*> masks;
+		BOOST_FOREACH(typename CollectionOfGrids::value_type g, gridps)
+			if(g->validityMask())
+				masks.push_back(g->validityMask());
+		if(masks.size() < felds.size())
+			masks.clear();
+		int bpw = validity_mask::bits_per_word;
+		std::vector<validity_mask::word> words((cs + bpw - 1) / bpw);
+
+		std::vector<float> sum(cs);
+		std::vector<char> valid(cs);
+		for(int r = 0; r < rs; r++)
 		{
-			for(int c = 0, cs = res->cols(); c < cs; c++)
+			std::fill(sum.begin(), sum.end(), 0.0f);
+			std::fill(valid.begin(), valid.end(), 1);
+			std::fill(words.begin(), words.end(), ~validity_mask::word(0));
+			for(size_t i = 0; i < masks.size(); i++)
+				for(size_t w = 0; w < words.size(); w++)
+					words[w] &= masks[i]->row_words(r)[w];
+
+			for(size_t w = 0; w < words.size(); w++)
 			{
-				if(res->isDataField(r, c))
+				int c0 = int(w)*bpw, c1 = std::min(c0 + bpw, cs);
+				if(words[w] == 0)
 				{
-					BOOST_FOREACH(typename CollectionOfGrids::value_type g, gridps)
+					std::fill(valid.begin() + c0, valid.begin() + c1, 0);
+					continue;
+				}
+				for(size_t i = 0, is = felds.size(); i < is; i++)
+				{
+					const float* row = felds[i][r];
+					int nd = nodatas[i];
+					for(int c = c0; c < c1; c++)
 					{
-						if(g->isNoDataField(r, c))
-						{
-							res->setNoDataValueAt(r, c);
-							break;
-						}
-						res->setDataAt(r, c, float(res->dataAt(r, c) + (g->dataAt(r, c) / size)));
+						valid[c] &= int(row[c]) != nd;
+						sum[c] = float(sum[c] + (row[c] / size));
 					}
 				}
 			}
+
+			// no data fields of the first grid keep their value
+			const float* firstRow = felds.front()[r];
+			float* out = (*res)[r];
+			for(int c = 0; c < cs; c++)
+				out[c] = int(firstRow[c]) == nodatas.front()
+					? firstRow[c] : valid[c] ? sum[c] : nodata;
 		}
 
+		if(first->validityMask())
+			res->enableValidityMask();
 		return res;
 	}
 
@@ -574,48 +717,6 @@ namespace Grids
 		return GridPPtr(averageP(gridps));
 	}
 
-	template<class OP>
-	GridP& inPlaceScalarMatrixOp(GridP& left, float value, OP op)
-	{
-		for (int r = 0, rs = left.rows(); r < rs; r++)
-			for (int c = 0, cs = left.cols(); c < cs; c++)
-				if (left.isDataField(r, c))
-					left.setDataAt(r, c, op(left.dataAt(r, c), value));
-		return left;
-	}
-
-	inline GridP& operator*=(GridP& left, float value)
-	{
-		return inPlaceScalarMatrixOp(left, value, std::multiplies<float>());
-	}
-
-	template<class OP>
-	GridP& inPlaceScalarMatrixOp(GridP& left, const GridP& right, OP op)
-	{
-		assert(left.isCompatible(&right));
-		for (int r = 0, rs = left.rows(); r < rs; r++)
-		{
-			for (int c = 0, cs = left.cols(); c < cs; c++)
-			{
-				if (left.isDataField(r, c) && right.isDataField(r, c))
-					left.setDataAt(r, c, op(left.dataAt(r, c), right.dataAt(r, c)));
-				else
-					left.setNoDataValueAt(r,c);
-			}
-		}
-		return left;
-	}
-
-	inline GridP& operator*=(GridP& left, const GridP& right)
-	{
-		return inPlaceScalarMatrixOp(left, right, std::multiplies<float>());
-	}
-
-	inline GridP& operator+=(GridP& left, const GridP& right)
-	{
-		return inPlaceScalarMatrixOp(left, right, std::plus<float>());
-	}
-
 	template<class OP>
 	GridP& merge(const GridP& left, const GridP& right, OP op)
 	{
@@ -644,44 +745,294 @@ namespace Grids
 		return *res;
 	}
 
-	template<class OP>
-	GridP& scalarMatrixOp(const GridP& left, const GridP& right, OP op)
+	//----------------------------------------------------------------------------
+
+	/*!
+	 * lazy element wise grid algebra
+	 * - the operators on grids (and scalars) just build up an expression,
+	 * e.g. (a*b + c)/d, which is evaluated in a single pass over the fields,
+	 * when assigned to a GridP or passed to evaluateP, so only the result grid
+	 * is allocated
+	 * - a field is valid if it isn't no data in any grid of the expression,
+	 * invalid fields get the no data value of the result, which has the structure
+	 * of the first grid in the expression
+	 * - expressions only reference their grids, so evaluate them before
+	 * the grids go away
+	 */
+	template<class E>
+	struct GridExpression
 	{
-		assert(left.isCompatible(&right));
-		GridP* res = left.clone();
-		for (int r = 0, rs = res->rows(); r < rs; r++)
+		const E& self() const { return static_cast<const E&>(*this); }
+	};
+
+	//! a grid as leaf of a grid expression
+	class GridTerm : public GridExpression<GridTerm>
+	{
+	public:
+		GridTerm(const GridP& g)
+			: _grid(&g), _feld(g.gridRef().feld), _nodata(g.noDataValue()),
+				_mask(g.validityMask()) {}
+
+		float valueAt(int row, int col) const { return _feld[row][col]; }
+
+		bool isValidAt(int row, int col) const
 		{
-			for (int c = 0, cs = res->cols(); c < cs; c++)
-			{
-				if (left.isDataField(r, c) && right.isDataField(r, c))
-					res->setDataAt(r, c, op(left.dataAt(r, c), right.dataAt(r, c)));
-				else
-					res->setNoDataValueAt(r, c);
-			}
+			return int(_feld[row][col]) != _nodata;
 		}
-		return *res;
+
+		//! bits of the validity mask, if there is no mask, all fields might be valid
+		validity_mask::word validWord(int row, int word) const
+		{
+			return _mask ? _mask->row_words(row)[word] : ~validity_mask::word(0);
+		}
+
+		const GridP* firstGrid() const { return _grid; }
+
+		bool isCompatible(const GridP* g) const { return _grid->isCompatible(g); }
+
+	private:
+		const GridP* _grid;
+		float** _feld;
+		int _nodata;
+		const validity_mask* _mask;
+	};
+
+	//! a scalar as leaf of a grid expression, always valid
+	class ScalarTerm : public GridExpression<ScalarTerm>
+	{
+	public:
+		ScalarTerm(float value) : _value(value) {}
+
+		float valueAt(int, int) const { return _value; }
+
+		bool isValidAt(int, int) const { return true; }
+
+		validity_mask::word validWord(int, int) const { return ~validity_mask::word(0); }
+
+		const GridP* firstGrid() const { return NULL; }
+
+		bool isCompatible(const GridP*) const { return true; }
+
+	private:
+		float _value;
+	};
+
+	//! op applied to the fields of two sub expressions
+	template<class L, class R, class OP>
+	class BinaryGridExpression : public GridExpression<BinaryGridExpression<L, R, OP> >
+	{
+	public:
+		BinaryGridExpression(const L& left, const R& right, OP op = OP())
+			: _left(left), _right(right), _op(op) {}
+
+		float valueAt(int row, int col) const
+		{
+			return _op(_left.valueAt(row, col), _right.valueAt(row, col));
+		}
+
+		//! non short circuit and, to keep the evaluation loop branch free
+		bool isValidAt(int row, int col) const
+		{
+			return _left.isValidAt(row, col) & _right.isValidAt(row, col);
+		}
+
+		validity_mask::word validWord(int row, int word) const
+		{
+			return _left.validWord(row, word) & _right.validWord(row, word);
+		}
+
+		const GridP* firstGrid() const
+		{
+			return _left.firstGrid() ? _left.firstGrid() : _right.firstGrid();
+		}
+
+		bool isCompatible(const GridP* g) const
+		{
+			return _left.isCompatible(g) && _right.isCompatible(g);
+		}
+
+	private:
+		L _left;
+		R _right;
+		OP _op;
+	};
+
+	//! maps the operands of the grid operators to their expression types
+	template<typename T, typename Enable = void>
+	struct GridOperand
+	{
+		static const bool isOperand = false;
+		static const bool isGrid = false;
+	};
+
+	template<typename T>
+	struct GridOperand<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>
+	{
+		typedef ScalarTerm Type;
+		static const bool isOperand = true;
+		static const bool isGrid = false;
+		static ScalarTerm term(T value) { return ScalarTerm(float(value)); }
+	};
+
+	template<typename T>
+	struct GridOperand<T, typename std::enable_if<std::is_base_of<GridP, T>::value>::type>
+	{
+		typedef GridTerm Type;
+		static const bool isOperand = true;
+		static const bool isGrid = true;
+		static GridTerm term(const GridP& g) { return GridTerm(g); }
+	};
+
+	template<typename T>
+	struct GridOperand<T, typename std::enable_if<std::is_base_of<GridExpression<T>, T>::value>::type>
+	{
+		typedef T Type;
+		static const bool isOperand = true;
+		static const bool isGrid = true;
+		static const T& term(const T& e) { return e; }
+	};
+
+	//! type of the expression left op right, if at least one of them is a grid (expression)
+	template<class L, class R, class OP,
+	         bool = GridOperand<L>::isOperand && GridOperand<R>::isOperand
+	                && (GridOperand<L>::isGrid || GridOperand<R>::isGrid)>
+	struct GridOpResult {};
+
+	template<class L, class R, class OP>
+	struct GridOpResult<L, R, OP, true>
+	{
+		typedef BinaryGridExpression<typename GridOperand<L>::Type,
+		                             typename GridOperand<R>::Type, OP> type;
+	};
+
+	template<class L, class R, class OP>
+	typename GridOpResult<L, R, OP>::type
+	scalarMatrixOp(const L& left, const R& right, OP op)
+	{
+		return typename GridOpResult<L, R, OP>::type(GridOperand<L>::term(left),
+		                                             GridOperand<R>::term(right), op);
 	}
 
-	inline GridP& operator*(const GridP& left, const GridP& right)
+	template<class L, class R>
+	typename GridOpResult<L, R, std::multiplies<float> >::type
+	operator*(const L& left, const R& right)
 	{
 		return scalarMatrixOp(left, right, std::multiplies<float>());
 	}
 
-	inline GridP& operator-(const GridP& left, const GridP& right)
+	template<class L, class R>
+	typename GridOpResult<L, R, std::minus<float> >::type
+	operator-(const L& left, const R& right)
 	{
 		return scalarMatrixOp(left, right, std::minus<float>());
 	}
 
-	inline GridP& operator+(const GridP& left, const GridP& right)
+	template<class L, class R>
+	typename GridOpResult<L, R, std::plus<float> >::type
+	operator+(const L& left, const R& right)
 	{
 		return scalarMatrixOp(left, right, std::plus<float>());
 	}
 
-	inline GridP& operator/(const GridP& left, const GridP& right)
+	template<class L, class R>
+	typename GridOpResult<L, R, std::divides<float> >::type
+	operator/(const L& left, const R& right)
 	{
 		return scalarMatrixOp(left, right, std::divides<float>());
 	}
 
+	//! evaluate expression into the already allocated (and compatible) grid res
+	template<class E>
+	GridP& evaluateInto(GridP& res, const GridExpression<E>& expression)
+	{
+		const E& e = expression.self();
+		assert(e.isCompatible(&res));
+		float nodata = float(res.noDataValue());
+		int bpw = validity_mask::bits_per_word;
+		for(int r = 0, rs = res.rows(); r < rs; r++)
+		{
+			float* row = res[r];
+			for(int c0 = 0, w = 0, cs = res.cols(); c0 < cs; c0 += bpw, w++)
+			{
+				int c1 = std::min(c0 + bpw, cs);
+				//no data in at least one of the masked grids
+				if(e.validWord(r, w) == 0)
+					std::fill(row + c0, row + c1, nodata);
+				else
+					for(int c = c0; c < c1; c++)
+						row[c] = e.isValidAt(r, c) ? e.valueAt(r, c) : nodata;
+			}
+			res.updateValidityMask(r);
+		}
+		return res;
+	}
+
+	template<class E>
+	GridP* evaluateP(const GridExpression<E>& e)
+	{
+		return new GridP(e);
+	}
+
+	template<class E>
+	GridPPtr evaluate(const GridExpression<E>& e)
+	{
+		return GridPPtr(evaluateP(e));
+	}
+
+	template<class E>
+	GridP::GridP(const GridExpression<E>& e)
+		: _coordinateSystem(e.self().firstGrid()->coordinateSystem())
+	{
+		allocateLike(*e.self().firstGrid());
+		if(e.self().firstGrid()->validityMask())
+			_validityMask = boost::shared_ptr<validity_mask>(new validity_mask(rows(), cols()));
+		evaluateInto(*this, e);
+	}
+
+	template<class E>
+	GridP& GridP::operator=(const GridExpression<E>& e)
+	{
+		GridP res(e);
+		_grid = res._grid;
+		_datasetName = res._datasetName;
+		_descriptiveLabel = res._descriptiveLabel;
+		_unit = res._unit;
+		_coordinateSystem = res._coordinateSystem;
+		_validityMask = res._validityMask;
+		return *this;
+	}
+
+	//! left = left op right in a single pass, without allocating a new grid
+	template<class R, class OP>
+	GridP& inPlaceScalarMatrixOp(GridP& left, const R& right, OP op)
+	{
+		return evaluateInto(left, scalarMatrixOp(left, right, op));
+	}
+
+	template<class R>
+	GridP& operator*=(GridP& left, const R& right)
+	{
+		return inPlaceScalarMatrixOp(left, right, std::multiplies<float>());
+	}
+
+	template<class R>
+	GridP& operator-=(GridP& left, const R& right)
+	{
+		return inPlaceScalarMatrixOp(left, right, std::minus<float>());
+	}
+
+	template<class R>
+	GridP& operator+=(GridP& left, const R& right)
+	{
+		return inPlaceScalarMatrixOp(left, right, std::plus<float>());
+	}
+
+	template<class R>
+	GridP& operator/=(GridP& left, const R& right)
+	{
+		return inPlaceScalarMatrixOp(left, right, std::divides<float>());
+	}
+
 	inline std::vector<double> allDataAsLinearVector(const GridP* g)
 	{
 		return g->allDataAsLinearVector();
@@ -722,6 +1073,10 @@ namespace Grids
 
 	//----------------------------------------------------------------------------
 
+	class TiledGridP;
+
+	typedef boost::shared_ptr<TiledGridP> TiledGridPPtr;
+
 	//! hold just some information about the grid, without having to load it
 	struct GridProxy : public Loki::ObjectLevelLockable<GridProxy>
 	{
@@ -758,8 +1113,16 @@ namespace Grids
 
 		GridPPtr gridPPtr();
 
+		//! is the whole grid in memory
+		bool isLoaded() const { return bool(g); }
+
+#ifndef NO_HDF5
+		//! the grid in the hdf store, loaded tile by tile on access (NULL if not in a hdf)
+		TiledGridPPtr tiledGridPPtr();
+#endif
+
 		//! resets gridproxy which in the end (without references to it) deletes possibly loaded grid
-		void reset(){ g.reset(); }
+		void reset(){ g.reset(); tg.reset(); }
 
 		GridP* copyOfFullGrid() { return gridPtr()->clone(); }
 
@@ -777,6 +1140,7 @@ namespace Grids
 		Tools::CoordinateSystem coordinateSystem;
 	protected:
 		GridPPtr g;
+		TiledGridPPtr tg;
 	};
 
 	typedef boost::shared_ptr<GridProxy> GridProxyPtr;
@@ -799,18 +1163,18 @@ namespace Grids
 
 		Tools::RectCoord rc = lowerLeftCorner();
 		fout << std::fixed <<
-			"ncols         " << cols() << endl <<
-			"nrows         " << rows() << endl <<
-			"xllcorner     " << rc.r << endl <<
-			"yllcorner     " << rc.h << endl <<
-			"cellsize      " << static_cast<VT>(cellSize()) << endl <<
-			"NODATA_value  " << static_cast<VT>(noDataValue()) << endl;
+			"ncols         " << cols() << std::endl <<
+			"nrows         " << rows() << std::endl <<
+			"xllcorner     " << rc.r << std::endl <<
+			"yllcorner     " << rc.h << std::endl <<
+			"cellsize      " << static_cast<VT>(cellSize()) << std::endl <<
+			"NODATA_value  " << static_cast<VT>(noDataValue()) << std::endl;
 
 		for(int r = 0, rs = rows(); r < rs; r++)
 		{
 			for(int c = 0, cs = cols(); c < cs; c++)
 				fout << static_cast<VT>(dataAt(r, c)) << " ";
-			fout << endl;
+			fout << std::endl;
 		}
 
 		fout.close();
@@ -839,7 +1203,7 @@ namespace Grids
 			}
 		}
 
-		multimap<ValueType, double, greater<double> > res;
+		std::multimap<ValueType, double, std::greater<double> > res;
 
 		int allPixels = includeNoDataValues ? rows()*cols() : nops;
 		if(includeNoDataValues)
@@ -848,7 +1212,7 @@ namespace Grids
 				Tools::round(double(allPixels - nops)/double(allPixels)*100.0, roundResultToDigits);
 
 			if(int(percentNoData) != 0)
-				res.insert(make_pair(percentNoData, double(noDataValue()))); 
+				res.insert(std::make_pair(percentNoData, double(noDataValue()))); 
 		}
 
 		BOOST_FOREACH(Map::value_type p, m)
@@ -856,7 +1220,7 @@ namespace Grids
 			double percent = double(p.second)/double(allPixels)*100.0;
 			double rp = Tools::round(percent, roundResultToDigits);
 			if(int(percent != 0))
-				res.insert(make_pair(rp, ValueType(double(p.first)/pow(10.0, roundValueToDigits))));
+				res.insert(std::make_pair(rp, ValueType(double(p.first)/std::pow(10.0, roundValueToDigits))));
 		}
 
 		return res;
@@ -894,7 +1258,7 @@ namespace Grids
 				result[GridValueType(noDataValue())] = percentNoData; 
 		}
 				
-		for_each(m.begin(), m.end(), [&](Map::value_type p)
+		for_each(m.begin(), m.end(), [&](typename Map::value_type p)
 		{
 			PercentageType percent = roundPercentageValueF(double(p.second)/double(allPixels)*100.0);
 			if(percent > PercentageType(0))
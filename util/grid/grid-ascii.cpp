@@ -0,0 +1,450 @@
+/**
+Authors:
+Ralf Wieland <ralf.wieland@zalf.de>
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers:
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * reading and writing of ESRI ASCII grids
+ * - the file is mapped into memory (read completely on windows) and the
+ * cell values are parsed by several threads at once
+ * - the float parser doesn't depend on the global locale and yields exactly
+ * the values "file >> val" produced before (correctly rounded), uncommon
+ * tokens are handed over to a classic locale stream
+ * - the rows are formatted by several threads and written out in order,
+ * the output is byte for byte the same as the former fprintf loop, the
+ * "%4.3f" of common values is produced without printf
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <cfloat>
+#include <climits>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <locale>
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+#include "grid.h"
+#include "mapped-file.h"
+
+using namespace std;
+using namespace Grids;
+
+namespace
+{
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+	}
+
+	inline const char* skipSpace(const char* p, const char* end)
+	{
+		while(p < end && isSpace(*p))
+			++p;
+		return p;
+	}
+
+	inline const char* tokenEnd(const char* p, const char* end)
+	{
+		while(p < end && !isSpace(*p))
+			++p;
+		return p;
+	}
+
+	//! parses the token [p, end) with a classic locale stream, like "file >> val"
+	template<typename T>
+	bool parseSlow(const char* p, const char* end, T& val)
+	{
+		istringstream s(string(p, end));
+		s.imbue(locale::classic());
+		val = T();
+		s >> val;
+		return !s.fail();
+	}
+
+	template<typename T>
+	bool parseSlow(const string& token, T& val)
+	{
+		return parseSlow(token.data(), token.data() + token.size(), val);
+	}
+
+	/*!
+	 * parses the token [p, end) into a float
+	 * - plain decimal numbers with up to 19 significant digits and
+	 * a small exponent are converted exactly in double precision,
+	 * which rounds to the same float as a direct conversion except
+	 * for values which end up exactly between two floats, those and all
+	 * other tokens are parsed by parseSlow
+	 */
+	bool parseFloat(const char* p, const char* end, float& val)
+	{
+		static const double pow10[] =
+		{1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+		const char* start = p;
+		bool negative = false;
+		if(p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		unsigned long long m = 0;
+		int digits = 0, exp10 = 0;
+		bool anyDigit = false;
+		for(; p < end && *p >= '0' && *p <= '9'; ++p)
+		{
+			anyDigit = true;
+			if(m == 0 && *p == '0')
+				continue;
+			if(++digits > 19)
+				return parseSlow(start, end, val);
+			m = m*10 + (*p - '0');
+		}
+		if(p < end && *p == '.')
+		{
+			for(++p; p < end && *p >= '0' && *p <= '9'; ++p)
+			{
+				anyDigit = true;
+				exp10--;
+				if(m == 0 && *p == '0')
+					continue;
+				if(++digits > 19)
+					return parseSlow(start, end, val);
+				m = m*10 + (*p - '0');
+			}
+		}
+		if(!anyDigit)
+			return parseSlow(start, end, val);
+		if(p < end && (*p == 'e' || *p == 'E'))
+		{
+			++p;
+			bool negativeExp = false;
+			if(p < end && (*p == '-' || *p == '+'))
+				negativeExp = *p++ == '-';
+			if(p == end || *p < '0' || *p > '9')
+				return parseSlow(start, end, val);
+			int e = 0;
+			for(; p < end && *p >= '0' && *p <= '9'; ++p)
+				if(e < 10000)
+					e = e*10 + (*p - '0');
+			exp10 += negativeExp ? -e : e;
+		}
+		if(p != end)
+			return parseSlow(start, end, val);
+
+		if(m == 0)
+		{
+			val = negative ? -0.0f : 0.0f;
+			return true;
+		}
+		// m and 10^|exp10| are exact doubles, so d is correctly rounded
+		if(m > (1ULL << 53) || exp10 < -22 || exp10 > 22)
+			return parseSlow(start, end, val);
+		double d = exp10 < 0 ? double(m) / pow10[-exp10] : double(m) * pow10[exp10];
+		if(d < FLT_MIN || d > FLT_MAX)
+			return parseSlow(start, end, val);
+		// exactly halfway between two floats, the decimal value might not be
+		unsigned long long bits;
+		memcpy(&bits, &d, sizeof(bits));
+		if((bits & ((1ULL << 29) - 1)) == (1ULL << 28))
+			return parseSlow(start, end, val);
+		val = negative ? -float(d) : float(d);
+		return true;
+	}
+
+	unsigned int noOfThreadsFor(size_t work, size_t workPerThread)
+	{
+		size_t n = max(1u, thread::hardware_concurrency());
+		return (unsigned int)max(size_t(1), min(n, work / workPerThread));
+	}
+
+	/*!
+	 * parses the cell values of an ASCII grid in [begin, end) into g->feld
+	 * - the text is split at whitespace into one chunk per thread, the
+	 * tokens of each chunk are counted first to know where the chunk's values
+	 * start, then all chunks are parsed at the same time
+	 * - inverted fills the grid from the last cell backwards (read_ascii_inv)
+	 * - returns the number of values read, at most nrows*ncols
+	 */
+	size_t parseCells(grid* g, const char* begin, const char* end, bool inverted)
+	{
+		size_t noOfCells = size_t(g->nrows)*size_t(g->ncols);
+		unsigned int noOfChunks = noOfThreadsFor(size_t(end - begin), 1 << 20);
+
+		vector<const char*> bounds(noOfChunks + 1, end);
+		bounds[0] = begin;
+		for(unsigned int c = 1; c < noOfChunks; c++)
+		{
+			const char* b = max(bounds[c-1], begin + (end - begin)/noOfChunks*c);
+			bounds[c] = tokenEnd(b, end);
+		}
+
+		vector<size_t> firstCell(noOfChunks + 1, 0);
+		vector<char> failed(noOfChunks, 0);
+		auto forEachChunk = [&](const function<void(unsigned int)>& f)
+		{
+			vector<thread> threads;
+			for(unsigned int c = 1; c < noOfChunks; c++)
+				threads.push_back(thread(f, c));
+			f(0);
+			for(size_t t = 0; t < threads.size(); t++)
+				threads[t].join();
+		};
+
+		if(noOfChunks > 1)
+		{
+			forEachChunk([&](unsigned int c)
+			{
+				size_t count = 0;
+				for(const char* p = skipSpace(bounds[c], bounds[c+1]); p < bounds[c+1];
+				    p = skipSpace(tokenEnd(p, bounds[c+1]), bounds[c+1]))
+					count++;
+				firstCell[c+1] = count;
+			});
+			for(unsigned int c = 0; c < noOfChunks; c++)
+				firstCell[c+1] += firstCell[c];
+		}
+
+		vector<size_t> noOfValues(noOfChunks, 0);
+		forEachChunk([&](unsigned int c)
+		{
+			size_t k = firstCell[c];
+			const char* p = skipSpace(bounds[c], bounds[c+1]);
+			while(p < bounds[c+1] && k < noOfCells)
+			{
+				const char* e = tokenEnd(p, bounds[c+1]);
+				float val;
+				if(!parseFloat(p, e, val))
+				{
+					failed[c] = true;
+					break;
+				}
+				size_t i = k / g->ncols, j = k % g->ncols;
+				if(inverted)
+					g->feld[g->nrows-1-i][g->ncols-1-j] = val;
+				else
+					g->feld[i][j] = val;
+				k++;
+				p = skipSpace(e, bounds[c+1]);
+			}
+			noOfValues[c] = k - firstCell[c];
+		});
+
+		// like the stream, stop at the first value which couldn't be read
+		size_t read = 0;
+		for(unsigned int c = 0; c < noOfChunks; c++)
+		{
+			read += noOfValues[c];
+			if(failed[c] || read >= noOfCells)
+				break;
+		}
+		return min(read, noOfCells);
+	}
+
+	int readAsciiGrid(grid* g, const char* name, bool inverted)
+	{
+		MappedFile file(name);
+		if(!file.isOpen())
+		{
+			cerr << "error (read_ascii): can not open inputfile: " << name << endl;
+			return -1;
+		}
+		g->free_feld();
+
+		// header
+		const char* p = file.begin;
+		// the keywords are case insensitive (e.g. NCOLS, xllCorner)
+		string keys[6], values[6];
+		for(int h = 0; h < 6; h++)
+		{
+			p = skipSpace(p, file.end);
+			const char* e = tokenEnd(p, file.end);
+			keys[h].assign(p, e);
+			transform(keys[h].begin(), keys[h].end(), keys[h].begin(), ::tolower);
+			p = skipSpace(e, file.end);
+			e = tokenEnd(p, file.end);
+			values[h].assign(p, e);
+			p = e;
+		}
+		if(keys[0].compare(0, 5, "ncols") != 0)
+		{
+			cerr << "error (read_ascii): not an ASCII-Grid: " << name << endl;
+			return -2;
+		}
+		parseSlow(values[0], g->ncols);
+		parseSlow(values[1], g->nrows);
+		parseSlow(values[2], g->xcorner);
+		parseSlow(values[3], g->ycorner);
+		parseSlow(values[4], g->csize);
+		parseSlow(values[5], g->nodata);
+
+		// allocate memory
+		if(g->nrows <= 0 || g->ncols <= 0)
+			return -2;
+		g->alloc_feld(g->nrows, g->ncols);
+
+		// read_in
+		size_t noOfCells = size_t(g->nrows)*size_t(g->ncols);
+		size_t read = parseCells(g, p, file.end, inverted);
+		if(read < noOfCells)
+		{
+			cerr << "error (read_ascii): only " << read << " of " << noOfCells
+					 << " values could be read from: " << name << endl;
+			for(size_t k = read; k < noOfCells; k++)
+			{
+				size_t i = k / g->ncols, j = k % g->ncols;
+				if(inverted)
+					g->feld[g->nrows-1-i][g->ncols-1-j] = 0;
+				else
+					g->feld[i][j] = 0;
+			}
+		}
+		return 0;
+	}
+
+	/*!
+	 * writes "%4.3f " of v to buf and returns its length, like snprintf
+	 * - v*1000 is exact in double (24 + 10 bits), so rounding it to an
+	 * integer in the current rounding mode gives the digits printf prints,
+	 * infinite, nan and huge values are left to snprintf
+	 */
+	inline int formatFixed3(float v, char* buf, size_t size)
+	{
+		double x = fabs(double(v))*1000;
+		if(!(x < 9007199254740992.0) || size < 32)
+			return snprintf(buf, size, "%4.3f ", v);
+
+		unsigned long long k = (unsigned long long)nearbyint(x);
+		char digits[24];
+		int n = 0;
+		do
+		{
+			digits[n++] = char('0' + k % 10);
+			k /= 10;
+		}
+		while(k > 0 || n < 4);
+
+		char* p = buf;
+		if(signbit(v))
+			*p++ = '-';
+		while(n > 3)
+			*p++ = digits[--n];
+		*p++ = '.';
+		while(n > 0)
+			*p++ = digits[--n];
+		*p++ = ' ';
+		return int(p - buf);
+	}
+
+	void writeAsciiGrid(grid* g, const char* name, bool inverted)
+	{
+		FILE* fp1 = fopen(name, "w");
+		if(!fp1)
+		{
+			cerr << "error (write_ascii): can not open outputfile: " << name << endl;
+			return;
+		}
+
+		fprintf(fp1,"ncols         %d\n",g->ncols);
+		fprintf(fp1,"nrows         %d\n",g->nrows);
+		fprintf(fp1,"xllcorner     %f\n",g->xcorner);
+		fprintf(fp1,"yllcorner     %f\n",g->ycorner);
+		fprintf(fp1,"cellsize      %5.1f\n",g->csize);
+		fprintf(fp1,"NODATA_value  %d\n",g->nodata);
+
+		// a block of rows per thread is formatted, then the blocks are written in order
+		int nrows = g->nrows, ncols = g->ncols;
+		unsigned int noOfThreads =
+				noOfThreadsFor(size_t(max(0, nrows))*size_t(max(0, ncols)), 1 << 16);
+		int rowsPerBlock = max(1, min(nrows, (1 << 18) / max(1, ncols)));
+		vector<string> blocks(noOfThreads);
+
+		auto format = [&](int firstRow, int lastRow, string& out)
+		{
+			out.clear();
+			char buf[64];
+			for(int r = firstRow; r < lastRow; r++)
+			{
+				const float* row = g->feld[inverted ? nrows-1-r : r];
+				for(int j = 0; j < ncols; j++)
+				{
+					int n = formatFixed3(row[j], buf, sizeof(buf));
+					if(n < 0)
+						continue;
+					if(size_t(n) < sizeof(buf))
+						out.append(buf, size_t(n));
+					else
+					{
+						vector<char> big(size_t(n) + 1);
+						snprintf(big.data(), big.size(), "%4.3f ", row[j]);
+						out.append(big.data(), size_t(n));
+					}
+				}
+				out.push_back('\n');
+			}
+		};
+
+		for(int r = 0; r < nrows; r += rowsPerBlock*int(noOfThreads))
+		{
+			vector<thread> threads;
+			for(unsigned int t = 1; t < noOfThreads; t++)
+			{
+				int first = min(nrows, r + rowsPerBlock*int(t));
+				threads.push_back(thread(format, first, min(nrows, first + rowsPerBlock),
+				                         ref(blocks[t])));
+			}
+			format(r, min(nrows, r + rowsPerBlock), blocks[0]);
+			for(size_t t = 0; t < threads.size(); t++)
+				threads[t].join();
+			for(unsigned int t = 0; t < noOfThreads; t++)
+				fwrite(blocks[t].data(), 1, blocks[t].size(), fp1);
+		}
+		fclose(fp1);
+	}
+}
+
+int grid::read_ascii(const char* name)
+{
+	return readAsciiGrid(this, name, false);
+}
+
+int grid::read_ascii_inv(const char* name)
+{
+	return readAsciiGrid(this, name, true);
+}
+
+void grid::write_ascii(char* name)
+{
+	writeAsciiGrid(this, name, false);
+}
+
+void grid::write_ascii_inv(char* name)
+{
+	writeAsciiGrid(this, name, true);
+}
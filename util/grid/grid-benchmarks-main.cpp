@@ -0,0 +1,499 @@
+/**
+Authors:
+Ralf Wieland <ralf.wieland@zalf.de>
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers:
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <sys/stat.h>
+#include <utime.h>
+
+#include "grid/grid.h"
+#include "grid/grid+.h"
+#include "grid/grid-manager.h"
+
+using namespace Grids;
+using namespace std;
+using namespace Tools;
+
+/*
+ * grid-benchmarks [size [max threads [ascii size [no of grids]]]]
+ * times the grid operations on size x size grids (default 4000, a multiple
+ * of 4 for downscale) with up to max threads (default 32), the ascii grid
+ * i/o on a ascii size x ascii size grid (default 5000), the start of a
+ * GridManager on a store of no of grids ascii grids (default 500) and the
+ * sweep over a 2000 x 2000 virtual grid, the results are checked too, so
+ * a failing check ends with exit code 1
+ * (grid::hist prints its histograms to stderr)
+ */
+
+namespace
+{
+	typedef chrono::steady_clock Clock;
+
+	double secondsSince(Clock::time_point start)
+	{
+		return chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	void fail(const string& what)
+	{
+		cerr << "error (" << what << ")" << endl;
+		exit(1);
+	}
+
+	//! as in grid.cpp
+	const double RES = 0.0001;
+
+	//! the brute force grid::distance before the distance transform
+	grid* bruteForceDistance(grid& g, float val)
+	{
+		vector<pair<int, int> > sources;
+		grid* gx = g.grid_copy();
+		for(int i = 0; i < g.nrows; i++)
+			for(int j = 0; j < g.ncols; j++)
+			{
+				gx->feld[i][j] = fabs(g.feld[i][j] - val) < RES ? 0 : FLT_MAX;
+				if(gx->feld[i][j] == 0)
+					sources.push_back(make_pair(i, j));
+			}
+		for(int i = 0; i < g.nrows; i++)
+			for(int j = 0; j < g.ncols; j++)
+			{
+				if(gx->feld[i][j] != 0)
+					for(size_t k = 0; k < sources.size(); k++)
+					{
+						int di = sources[k].first - i, dj = sources[k].second - j;
+						double dist = sqrt(double(di*di + dj*dj));
+						if(gx->feld[i][j] > dist)
+							gx->feld[i][j] = float(dist);
+						if(fabs(double(gx->feld[i][j] - 1)) < RES)
+							break;
+					}
+				if(g.feld[i][j] != g.nodata)
+					gx->feld[i][j] *= gx->csize;
+				else
+					gx->feld[i][j] = g.nodata;
+			}
+		return gx;
+	}
+
+	/*!
+	 * grid::distance on a n x n grid with 50 source cells and a nodata
+	 * border, against the brute force version it replaced (whose cost
+	 * grows with the number of sources times the number of cells)
+	 */
+	void distanceTransform(int n)
+	{
+		grid g(n, n);
+		g.csize = 100;
+		g.nodata = -9999;
+		unsigned int seed = 4711;
+		for(int i = 0; i < n; i++)
+			for(int j = 0; j < n; j++)
+				g.feld[i][j] = i == 0 || j == 0 ? -9999 : 1;
+		for(int k = 0; k < 50; k++)
+		{
+			seed = seed*1103515245 + 12345;
+			int i = 1 + (seed >> 8) % (n - 1);
+			seed = seed*1103515245 + 12345;
+			int j = 1 + (seed >> 8) % (n - 1);
+			g.feld[i][j] = 5;
+		}
+
+		Clock::time_point before = Clock::now();
+		grid* edt = g.distance(5);
+		double edtSecs = secondsSince(before);
+
+		before = Clock::now();
+		grid* bf = bruteForceDistance(g, 5);
+		double bfSecs = secondsSince(before);
+
+		double maxDiff = 0;
+		for(int i = 0; i < n; i++)
+			for(int j = 0; j < n; j++)
+				maxDiff = max(maxDiff, double(fabs(edt->feld[i][j] - bf->feld[i][j])));
+
+		cout << "distance " << n << "x" << n << ", 50 sources: transform "
+		     << edtSecs << "s, brute force " << bfSecs << "s, max difference "
+		     << maxDiff << endl;
+		delete edt;
+		delete bf;
+		// both compute sqrt in double and scale in float
+		if(maxDiff > 1e-6*n*g.csize)
+			fail("distanceTransform: results differ");
+	}
+
+	//! sum of all fields, in double and field order
+	double checksum(grid* g)
+	{
+		double sum = 0;
+		for(int i = 0; i < g->nrows; i++)
+			for(int j = 0; j < g->ncols; j++)
+				sum += g->feld[i][j];
+		return sum;
+	}
+
+	/*!
+	 * the row parallel grid operations with 1, 2, 4 ... maxThreads threads,
+	 * the results have to be the same for every number of threads
+	 */
+	void threadScaling(int n, int maxThreads)
+	{
+		grid g(n, n);
+		g.nodata = -9999;
+		for(int i = 0; i < n; i++)
+			for(int j = 0; j < n; j++)
+				g.feld[i][j] = (i*7 + j*13) % 97 == 0 ? -9999
+				               : float(sin(i*0.01)*cos(j*0.013)*100 + (i + j) % 10);
+		GridP gp("bench", n, n, 100, 0, 0, -9999);
+		for(int i = 0; i < n; i++)
+			memcpy(gp.gridPtr()->feld[i], g.feld[i], n*sizeof(float));
+
+		vector<double> results;
+		for(int t = 1; t <= maxThreads; t *= 2)
+		{
+			set_grid_threads(t);
+			vector<double> rs;
+			cout << t << " thread(s):";
+
+			Clock::time_point before = Clock::now();
+			g.stat();
+			cout << " stat " << secondsSince(before) << "s";
+			rs.push_back(g.gridmean);
+			rs.push_back(g.gridstd);
+
+			before = Clock::now();
+			int* h = g.hist(100);
+			cout << ", hist " << secondsSince(before) << "s";
+			for(int b = 0; b < 100; b++)
+				rs.push_back(h[b]);
+			delete [] h;
+
+			before = Clock::now();
+			grid* s = g.sobol();
+			cout << ", sobol " << secondsSince(before) << "s";
+			rs.push_back(checksum(s));
+			delete s;
+
+			before = Clock::now();
+			grid* l = g.laplace();
+			cout << ", laplace " << secondsSince(before) << "s";
+			rs.push_back(checksum(l));
+			delete l;
+
+			before = Clock::now();
+			grid* d = g.downscale(4);
+			cout << ", downscale " << secondsSince(before) << "s";
+			rs.push_back(checksum(d));
+			delete d;
+
+			before = Clock::now();
+			GridPPtr tp = gp.transform([](float v){ return v*2 + 1; }, true);
+			cout << ", transform " << secondsSince(before) << "s" << endl;
+			rs.push_back(checksum(tp->gridPtr()));
+
+			if(results.empty())
+				results = rs;
+			else if(rs != results)
+				fail("threadScaling: results differ with " + to_string(t) + " threads");
+		}
+		set_grid_threads(0);
+	}
+
+	//! grid::write_ascii before it formatted the rows in parallel
+	void fprintfWriteAscii(grid& g, const char* name)
+	{
+		FILE* fp = fopen(name, "w");
+		fprintf(fp, "ncols         %d\n", g.ncols);
+		fprintf(fp, "nrows         %d\n", g.nrows);
+		fprintf(fp, "xllcorner     %f\n", g.xcorner);
+		fprintf(fp, "yllcorner     %f\n", g.ycorner);
+		fprintf(fp, "cellsize      %5.1f\n", g.csize);
+		fprintf(fp, "NODATA_value  %d\n", g.nodata);
+		for(int i = 0; i < g.nrows; i++)
+		{
+			for(int j = 0; j < g.ncols; j++)
+				fprintf(fp, "%4.3f ", g.feld[i][j]);
+			fprintf(fp, "\n");
+		}
+		fclose(fp);
+	}
+
+	//! grid::read_ascii before it parsed the mapped file, only the fields
+	void streamReadAscii(grid& g, const char* name)
+	{
+		ifstream in(name);
+		string key;
+		double value;
+		for(int k = 0; k < 6; k++)
+			in >> key >> value;
+		for(int i = 0; i < g.nrows; i++)
+			for(int j = 0; j < g.ncols; j++)
+				in >> g.feld[i][j];
+	}
+
+	bool sameFiles(const char* a, const char* b)
+	{
+		ifstream fa(a, ios::binary), fb(b, ios::binary);
+		vector<char> ba(1 << 20), bb(1 << 20);
+		while(fa && fb)
+		{
+			fa.read(&ba[0], ba.size());
+			fb.read(&bb[0], bb.size());
+			if(fa.gcount() != fb.gcount()
+			   || memcmp(&ba[0], &bb[0], size_t(fa.gcount())) != 0)
+				return false;
+		}
+		return !fa && !fb;
+	}
+
+	/*!
+	 * writes and reads a n x n dem like ascii grid with grid::write_ascii
+	 * and grid::read_ascii and with the fprintf/ifstream versions they
+	 * replaced, the files have to be byte identical and the read fields equal
+	 */
+	void asciiThroughput(int n)
+	{
+		grid g(n, n);
+		g.xcorner = 4500000;
+		g.ycorner = 5800000;
+		g.csize = 25;
+		g.nodata = -9999;
+		for(int i = 0; i < n; i++)
+			for(int j = 0; j < n; j++)
+				g.feld[i][j] = (i/50 + j/70) % 23 == 0 ? -9999
+				               : float(int(200 + 150*sin(i*0.003) + 80*cos(j*0.002)
+				                           + (i*31 + j*17) % 1000*0.001)*1000)/1000;
+		const char* name = "./grid-benchmark.asc";
+		const char* oldName = "./grid-benchmark-fprintf.asc";
+
+		Clock::time_point before = Clock::now();
+		g.write_ascii(const_cast<char*>(name));
+		double writeSecs = secondsSince(before);
+
+		before = Clock::now();
+		fprintfWriteAscii(g, oldName);
+		double oldWriteSecs = secondsSince(before);
+
+		ifstream f(name, ios::binary | ios::ate);
+		double mb = double(f.tellg())/(1 << 20);
+		f.close();
+		bool sameFile = sameFiles(name, oldName);
+
+		grid r(n, n);
+		before = Clock::now();
+		r.read_ascii(name);
+		double readSecs = secondsSince(before);
+
+		grid o(n, n);
+		before = Clock::now();
+		streamReadAscii(o, name);
+		double oldReadSecs = secondsSince(before);
+
+		bool sameFields = r.nrows == n && r.ncols == n;
+		for(int i = 0; sameFields && i < n; i++)
+			sameFields = memcmp(r.feld[i], o.feld[i], n*sizeof(float)) == 0;
+		remove(name);
+		remove(oldName);
+
+		cout << "ascii " << n << "x" << n << " (" << mb << " MB): write "
+		     << writeSecs << "s (" << mb/writeSecs << " MB/s), fprintf "
+		     << oldWriteSecs << "s (" << mb/oldWriteSecs << " MB/s), read "
+		     << readSecs << "s (" << mb/readSecs << " MB/s), ifstream "
+		     << oldReadSecs << "s (" << mb/oldReadSecs << " MB/s)" << endl;
+		if(!sameFile)
+			fail("asciiThroughput: written files differ");
+		if(!sameFields)
+			fail("asciiThroughput: read fields differ");
+	}
+
+	//! a GridManager on the store, timed
+	double startGridManager(const GridManager::Env& env, GridManager*& gm)
+	{
+		delete gm;
+		Clock::time_point before = Clock::now();
+		gm = new GridManager(env);
+		return secondsSince(before);
+	}
+
+	/*!
+	 * GridManager start on a store of noOfGrids 200 x 200 ascii grids: the
+	 * first start converts them all into the hdf store, the next ones find
+	 * the store unchanged, then one grid is only touched and one is changed
+	 */
+	void hdfStoreStartup(int noOfGrids)
+	{
+		string root = "./grid-benchmark-store";
+		if(system(("rm -rf " + root).c_str()) != 0)
+			fail("hdfStoreStartup: can't clean up " + root);
+		mkdir(root.c_str(), 0755);
+		mkdir((root + "/grids").c_str(), 0755);
+		mkdir((root + "/grids/general").c_str(), 0755);
+		mkdir((root + "/hdfs").c_str(), 0755);
+		GridManager::Env env(root + "/hdfs", "hdfs.ini", root + "/grids",
+		                     "DONT_CHECK_FOR_CHANGES", root + "/regionalization-hdfs",
+		                     root + "/regionalization-hdfs/hdfs.ini");
+
+		grid g(200, 200);
+		g.xcorner = 4500000;
+		g.ycorner = 5800000;
+		g.csize = 100;
+		g.nodata = -9999;
+		auto pathTo = [&](int k)
+		{
+			return root + "/grids/general/ds" + to_string(k) + "_bench_100.asc";
+		};
+		auto fill = [&](int k)
+		{
+			for(int i = 0; i < 200; i++)
+				for(int j = 0; j < 200; j++)
+					g.feld[i][j] = float(k + i + j);
+		};
+		for(int k = 0; k < noOfGrids; k++)
+		{
+			fill(k);
+			g.write_ascii(const_cast<char*>(pathTo(k).c_str()));
+		}
+
+		GridManager* gm = NULL;
+		double first = startGridManager(env, gm);
+		double unchanged = startGridManager(env, gm);
+		double unchanged2 = startGridManager(env, gm);
+
+		// a newer modification time, but the same content
+		struct stat st;
+		stat(pathTo(0).c_str(), &st);
+		struct utimbuf times = {st.st_atime, st.st_mtime + 10};
+		utime(pathTo(0).c_str(), &times);
+		double touched = startGridManager(env, gm);
+
+		fill(1);
+		g.feld[0][0] = -1;
+		g.write_ascii(const_cast<char*>(pathTo(1).c_str()));
+		times.modtime = st.st_mtime + 20;
+		utime(pathTo(1).c_str(), &times);
+		double changed = startGridManager(env, gm);
+
+		GridPPtr g0 = gm->gridFor("bench", "ds0");
+		GridPPtr g1 = gm->gridFor("bench", "ds1");
+		GridPPtr gl = gm->gridFor("bench", "ds" + to_string(noOfGrids - 1));
+		bool ok = g0 && g1 && gl
+		          && g0->dataAt(5, 7) == 12 && g1->dataAt(0, 0) == -1
+		          && g1->dataAt(5, 7) == 13 && gl->dataAt(1, 1) == noOfGrids + 1;
+		delete gm;
+		if(system(("rm -rf " + root).c_str()) != 0)
+			fail("hdfStoreStartup: can't clean up " + root);
+
+		cout << "GridManager start, " << noOfGrids << " grids: converting "
+		     << first << "s, unchanged " << unchanged << "s and " << unchanged2
+		     << "s, one touched " << touched << "s, one changed " << changed
+		     << "s" << endl;
+		if(!ok)
+			fail("hdfStoreStartup: wrong grids after the restarts");
+		if(unchanged2 >= 1)
+			fail("hdfStoreStartup: unchanged store took a second or longer");
+	}
+
+	/*!
+	 * sweeps a 2000 x 2000 RealVirtualGrid with data in 70% of its cells
+	 * once with dataAt per cell and once with forEachCell, both have to
+	 * visit the same data
+	 */
+	void virtualGridSweep()
+	{
+		const unsigned int n = 2000;
+		RCRect rect(RectCoord(GK5_EPSG31469, 4500000, 5800000 + n*100),
+		            RectCoord(GK5_EPSG31469, 4500000 + n*100, 5800000));
+		vector<GridProxyPtr>* gps = new vector<GridProxyPtr>;
+		RealVirtualGrid vg(GK5_EPSG31469, rect, 100, n, n,
+		                   RealVirtualGrid::VVGP(1, gps));
+		for(unsigned int i = 0; i < n; i++)
+			for(unsigned int j = 0; j < n; j++)
+				if((i*7 + j*3) % 10 < 7)
+					vg.addDataAt(i, j, VirtualGrid::Data(gps, i, j));
+
+		Clock::time_point before = Clock::now();
+		long dataAtSum = 0, dataAtNoData = 0;
+		for(unsigned int i = 0; i < n; i++)
+			for(unsigned int j = 0; j < n; j++)
+			{
+				vector<VirtualGrid::Data> ds = vg.dataAt(i, j);
+				for(size_t k = 0; k < ds.size(); k++)
+				{
+					if(ds[k].isNoData())
+						dataAtNoData++;
+					else
+						dataAtSum += ds[k].row() + ds[k].col();
+				}
+			}
+		double dataAtSecs = secondsSince(before);
+
+		before = Clock::now();
+		long sum = 0, noData = 0;
+		vg.forEachCell([&](unsigned int, unsigned int, VirtualGrid::DataRange data)
+		{
+			for(size_t k = 0; k < data.size(); k++)
+			{
+				if(data[k].isNoData())
+					noData++;
+				else
+					sum += data[k].row() + data[k].col();
+			}
+		});
+		double forEachSecs = secondsSince(before);
+
+		cout << "virtual grid " << n << "x" << n << " sweep: dataAt "
+		     << dataAtSecs << "s, forEachCell " << forEachSecs << "s" << endl;
+		if(sum != dataAtSum || noData != dataAtNoData
+		   || noData != long(n)*n - long(n)*n*7/10)
+			fail("virtualGridSweep: the sweeps visited different data");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : 4000;
+	int maxThreads = argc > 2 ? atoi(argv[2]) : 32;
+	int asciiN = argc > 3 ? atoi(argv[3]) : 5000;
+	int noOfGrids = argc > 4 ? atoi(argv[4]) : 500;
+	if(n <= 0 || n % 4 != 0)
+		fail("main: size has to be a positive multiple of 4");
+	cout << "cores: " << thread::hardware_concurrency() << endl;
+	distanceTransform(n);
+	threadScaling(n, maxThreads);
+	asciiThroughput(asciiN);
+	hdfStoreStartup(noOfGrids);
+	virtualGridSweep();
+	return 0;
+}
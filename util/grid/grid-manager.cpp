@@ -40,6 +40,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "tools/use-stl-algo-boost-lambda.h"
 
 #include "grid-manager.h"
+#include "tiled-grid.h"
 #include "tools/algorithms.h"
 #include "db/abstract-db-connections.h"
 #include "tools/read-ini.h"
@@ -56,6 +57,57 @@ using namespace Tools;
 namespace
 {
 	struct L : public Loki::ObjectLevelLockable<L> {};
+
+	//! serializes the lookups of gridFor, gridsFor and overviewGridFor, which
+	//! share the proxies and pyramids, the hdf files themselves are guarded by
+	//! the process wide HdfLock
+	L& managerLockable()
+	{
+		static L lockable;
+		return lockable;
+	}
+
+#ifndef NO_HDF5
+	//! an overview pyramid level persisted in file, if it has been built from
+	//! the current version of the grid, outdated levels are overwritten when
+	//! the level is written again
+	GridPPtr persistedOverviewLevel(const string& file, const string& dsn,
+	                                time_t modificationTime, CoordinateSystem cs)
+	{
+		struct stat attrib;
+		if(stat(file.c_str(), &attrib) != 0)
+			return GridPPtr();
+
+		HdfLock lock;
+		{
+			hdf5 hd;
+			if(hd.open_f(file.c_str()) != 0 || hd.open_d(dsn.c_str()) != 0
+			   || hd.get_l_attribute("time") != long(modificationTime))
+				return GridPPtr();
+		}
+
+		GridPPtr level(new GridP(dsn, GridP::HDF, file, cs));
+		return level->isValid() ? level : GridPPtr();
+	}
+
+	//! writes an overview level over its outdated version in file, an outdated
+	//! level of another size (the grid's size changed) is deleted first, its
+	//! storage stays unused in the file until it is repacked (h5repack)
+	void persistOverviewLevel(GridPPtr level, const string& file,
+	                          const string& dsn, time_t modificationTime)
+	{
+		HdfLock lock;
+		if(level->writeHdf(file, dsn, "overview-pyramid", modificationTime, true))
+			return;
+
+		{
+			hdf5 hd;
+			if(hd.open_f(file.c_str()) != 0 || hd.delete_d(dsn.c_str()) != 0)
+				return;
+		}
+		level->writeHdf(file, dsn, "overview-pyramid", modificationTime);
+	}
+#endif
 }
 
 VirtualGrid::~VirtualGrid()
@@ -118,7 +170,9 @@ const LatLngPolygonsMatrix& VirtualGrid::latLngCellPolygons()
   {
 		//_cellPolygons.resize((_cols-1)*(_rows-1));
 
-		vector<RectCoord> rccs((_cols+1) * (_rows+1));
+		//transform all cell corners at once, r/h become lat/lng in place
+		size_t noOfCorners = size_t(_cols+1) * (_rows+1);
+		vector<double> lats(noOfCorners), lngs(noOfCorners);
 		//paint the grid cells
     for(unsigned int j = 0; j < _rows+1; j++)
     {
@@ -126,23 +180,27 @@ const LatLngPolygonsMatrix& VirtualGrid::latLngCellPolygons()
       {
 				double left = _rect.tl.r + (double(i) * _cellSize);
 				double top = _rect.tl.h - (double(j) * _cellSize);
-				rccs[(j*(_cols+1))+i] = RectCoord(left, top);
+				lats[(j*(_cols+1))+i] = left;
+				lngs[(j*(_cols+1))+i] = top;
 				//cout << "(" << left << "," << top << ") ";
 			}
 		}
 		//cout << endl;
-		const vector<LatLngCoord>& llcs = RC2latLng(rccs);
+		if(!transformCoordinates(_coordinateSystem, LatLng_EPSG4326,
+		                         noOfCorners, &lats[0], &lngs[0]))
+			return _cellPolygons;
 
+		auto llc = [&](size_t k){ return LatLngCoord(lats[k], lngs[k]); };
 		_cellPolygons.resize(_rows, _cols);
     for(unsigned int j = 0; j < _rows; j++)
     {
       for(unsigned int i = 0; i < _cols; i++)
       {
 				_cellPolygons[j][i] =
-				(LatLngPolygon(llcs.at((j*(_cols+1))+i),
-				               llcs.at((j*(_cols+1))+i+1),
-				               llcs.at(((j+1)*(_cols+1))+i+1),
-				               llcs.at(((j+1)*(_cols+1))+i)));
+				(LatLngPolygon(llc((j*(_cols+1))+i),
+				               llc((j*(_cols+1))+i+1),
+				               llc(((j+1)*(_cols+1))+i+1),
+				               llc(((j+1)*(_cols+1))+i)));
 			}
 		}
 
@@ -151,6 +209,30 @@ const LatLngPolygonsMatrix& VirtualGrid::latLngCellPolygons()
 	return _cellPolygons;
 }
 
+void VirtualGrid::forEachCell(const CellVisitor& f, unsigned int blockSize) const
+{
+	unsigned int bs = max(1u, blockSize);
+	for(unsigned int r = 0; r < rows(); r += bs)
+		for(unsigned int c = 0; c < cols(); c += bs)
+			forEachCellIn(r, c, min(r + bs, rows()), min(c + bs, cols()), f);
+}
+
+void VirtualGrid::forEachCellIn(unsigned int row0, unsigned int col0,
+                                unsigned int row1, unsigned int col1,
+                                const CellVisitor& f) const
+{
+	//fallback for virtual grids which can't hand out their data directly
+	for(unsigned int i = row0; i < row1; i++)
+  {
+		for(unsigned int j = col0; j < col1; j++)
+    {
+			const vector<Data>& v = dataAt(i, j);
+			const Data* first = v.empty() ? NULL : &v.front();
+			f(i, j, DataRange(first, first + v.size()));
+		}
+	}
+}
+
 //------------------------------------------------------------------------------
 
 NoVirtualGrid::NoVirtualGrid(CoordinateSystem cs,
@@ -194,6 +276,20 @@ vector<VirtualGrid::Data> NoVirtualGrid::dataAt(const RectCoord& rcc) const
 	return dataAt(iy, ix);
 }
 
+void NoVirtualGrid::forEachCellIn(unsigned int row0, unsigned int col0,
+                                  unsigned int row1, unsigned int col1,
+                                  const CellVisitor& f) const
+{
+	for(unsigned int i = row0; i < row1; i++)
+  {
+		for(unsigned int j = col0; j < col1; j++)
+    {
+			Data d(_gps, i, j);
+			f(i, j, DataRange(&d, &d + 1));
+		}
+	}
+}
+
 //------------------------------------------------------------------------------
 
 RealVirtualGrid::RealVirtualGrid(CoordinateSystem cs, const RCRect& rect,
@@ -223,41 +319,56 @@ RealVirtualGrid::dataAt(unsigned int row, unsigned int col) const
 	return v.empty() ? vector<Data>(1, Data()) : v;
 }
 
+void RealVirtualGrid::forEachCellIn(unsigned int row0, unsigned int col0,
+                                    unsigned int row1, unsigned int col1,
+                                    const CellVisitor& f) const
+{
+	for(unsigned int i = row0; i < row1; i++)
+  {
+		const vector<vector<Data> >& row = _data[i];
+		for(unsigned int j = col0; j < col1; j++)
+    {
+			const vector<Data>& v = row[j];
+			if(v.empty())
+				f(i, j, DataRange(&_noData, &_noData + 1));
+			else
+				f(i, j, DataRange(&v.front(), &v.front() + v.size()));
+		}
+	}
+}
+
 vector<const GridP*> RealVirtualGrid::availableGrids()
 {
   if(_availableGrids.empty())
   {
 		map<string, GridP*> dsn2g;
 
-    for(unsigned int i = 0; i < rows(); i++)
+		forEachCell([&](unsigned int i, unsigned int j, DataRange data)
     {
-      for(unsigned int j = 0; j < cols(); j++)
+      BOOST_FOREACH(const Data& d, data)
       {
-        BOOST_FOREACH(Data d, dataAt(i, j))
+        if(!d.isNoData())
         {
-          if(!d.isNoData())
+          BOOST_FOREACH(GridProxyPtr gp, *d.gridProxies())
           {
-            BOOST_FOREACH(GridProxyPtr gp, *d.gridProxies())
+            //target grid
+            GridP* tg = valueD(dsn2g, gp->datasetName,
+                               static_cast<GridP*>(NULL));
+            if(!tg)
             {
-              //target grid
-              GridP* tg = valueD(dsn2g, gp->datasetName,
-                                 static_cast<GridP*>(NULL));
-              if(!tg)
-              {
-								RectCoord bl = rcRect().toTlTrBrBlVector().at(3);
-                tg = new GridP(gp->datasetName, rows(), cols(), cellSize(),
-															 bl.r, bl.h, noDataValue(),
-															 gp->coordinateSystem);
-                dsn2g[gp->datasetName] = tg;
-								_availableGrids.push_back(tg);
-              }
-
-              tg->setDataAt(i, j, gp->gridPtr()->dataAt(d.row(), d.col()));
-						}
+							RectCoord bl = rcRect().toTlTrBrBlVector().at(3);
+              tg = new GridP(gp->datasetName, rows(), cols(), cellSize(),
+														 bl.r, bl.h, noDataValue(),
+														 gp->coordinateSystem);
+              dsn2g[gp->datasetName] = tg;
+							_availableGrids.push_back(tg);
+            }
+
+            tg->setDataAt(i, j, gp->gridPtr()->dataAt(d.row(), d.col()));
 					}
 				}
 			}
-		}
+		});
 	}
 
 	return VirtualGrid::availableGrids();
@@ -313,8 +424,8 @@ void GridManager::init(const Path& userSubPath)
 	}
 
 	//cout << "reading grids in " << pathToGrids << endl;
-	readGrid2HdfMappingFile(userSubPath);
-	checkAndUpdateHdfStore(userSubPath);
+	bool indexComplete = readGrid2HdfMappingFile(userSubPath);
+	checkAndUpdateHdfStore(userSubPath, !indexComplete);
 
 	//cout << "leaving GridManager::init(" << userSubPath << ")" << endl;
 }
@@ -551,9 +662,16 @@ GridPPtr GridManager::gridFor(const string& regionName,
                               const Path& userSubPath, int cellSize,
                               GridMetaData subgridMetaData)
 {
-	static L lockable;
-	L::Lock lock(lockable);
+	L::Lock lock(managerLockable());
+
+	GridProxyPtr gp = gridProxyFor(regionName, datasetName, userSubPath, cellSize);
+	return gp ? createSubgrid(gp, subgridMetaData) : GridPPtr();
+}
 
+GridProxyPtr GridManager::gridProxyFor(const string& regionName,
+                                       const string& datasetName,
+                                       const Path& userSubPath, int cellSize)
+{
   BOOST_FOREACH(const GridMetaData& gmd, regionGmds(userSubPath))
   {
     if(gmd.regionName == regionName && gmd.cellsize == cellSize)
@@ -568,15 +686,100 @@ GridPPtr GridManager::gridFor(const string& regionName,
           BOOST_FOREACH(GridProxyPtr gp, gps)
           {
 						if(gp->datasetName == datasetName)
-							return createSubgrid(gp->gridPPtr(), subgridMetaData);
+							return gp;
 					}
 				}
 			}
-			return GridPPtr();
+			return GridProxyPtr();
 		}
 	}
 
-	return GridPPtr();
+	return GridProxyPtr();
+}
+
+GridPPtr GridManager::overviewGridFor(const string& regionName,
+                                      const string& datasetName,
+                                      double requestedCellSize,
+                                      Aggregation aggregation,
+                                      const Path& userSubPath, int cellSize)
+{
+	L::Lock lock(managerLockable());
+
+	GridProxyPtr gp = gridProxyFor(regionName, datasetName, userSubPath, cellSize);
+	if(!gp)
+		return GridPPtr();
+
+	//nearest level on a logarithmic scale
+	int level = cellSize > 0 && requestedCellSize > cellSize
+		? int(std::floor(std::log(requestedCellSize / cellSize) / std::log(2.0) + 0.5)) : 0;
+	if(level == 0)
+		return gp->gridPPtr();
+
+	GridPPtr o = overviewLevel(gp, aggregation, level);
+	return o ? o : gp->gridPPtr();
+}
+
+GridPPtr GridManager::overviewLevel(GridProxyPtr gp, Aggregation aggregation,
+                                    int level)
+{
+	const char* aggregationNames[] = {"mean", "sum", "mode"};
+	string file = gp->pathToHdf.empty()
+		? string() : gp->pathToHdf + "/" + gp->hdfFileName;
+	string key = (file.empty() ? gp->pathToGrid + "/" + gp->fileName : file)
+		+ "|" + gp->datasetName + "|" + aggregationNames[aggregation];
+
+	Pyramid& p = _pyramids[key];
+	if(p.levels.empty() || p.modificationTime != gp->modificationTime)
+	{
+		p.levels.clear();
+		p.modificationTime = gp->modificationTime;
+
+		//the size of the grid without loading it, if possible
+		GridMetaData gmd;
+#ifndef NO_HDF5
+		TiledGridPPtr tg = gp->isLoaded() ? TiledGridPPtr() : gp->tiledGridPPtr();
+		if(tg && tg->isValid())
+			gmd = tg->metaData();
+		else
+#endif
+			gmd = GridMetaData(gp->gridPtr());
+
+		int noOfLevels = 0;
+		for(int factor = 2; factor / 2 < max(gmd.nrows, gmd.ncols); factor *= 2)
+			noOfLevels++;
+		p.levels.resize(noOfLevels);
+	}
+	if(p.levels.empty() || level < 1)
+		return GridPPtr();
+
+	level = min(level, int(p.levels.size()));
+	GridPPtr& l = p.levels.at(level - 1);
+	if(l)
+		return l;
+
+	int factor = 1 << level;
+	ostringstream dsn;
+	dsn << gp->datasetName << "@" << aggregationNames[aggregation] << "@" << factor;
+
+#ifndef NO_HDF5
+	if(!file.empty())
+		l = persistedOverviewLevel(file, dsn.str(), gp->modificationTime,
+		                           gp->coordinateSystem);
+#endif
+	if(!l)
+	{
+		grid* o = gp->gridPtr()->gridRef().overview(factor, aggregation);
+		if(!o)
+			return GridPPtr();
+		l = GridPPtr(new GridP(o, gp->coordinateSystem));
+#ifndef NO_HDF5
+		if(!file.empty())
+			persistOverviewLevel(l, file, dsn.str(), gp->modificationTime);
+#endif
+	}
+	l->setDatasetName(gp->datasetName);
+
+	return l;
 }
 
 GridPPtr GridManager::createSubgrid(GridPPtr g, GridMetaData subgridMetaData,
@@ -603,14 +806,35 @@ GridPPtr GridManager::createSubgrid(GridPPtr g, GridMetaData subgridMetaData,
 	return res;
 }
 
+GridPPtr GridManager::createSubgrid(GridProxyPtr gp, GridMetaData subgridMetaData)
+{
+#ifndef NO_HDF5
+	// read just the subgrid from the hdf store, unless the grid is loaded anyway
+	if(subgridMetaData.isValid() && !gp->isLoaded())
+	{
+		TiledGridPPtr tg = gp->tiledGridPPtr();
+		GridMetaData gmd = tg ? tg->metaData() : GridMetaData();
+		if(tg && tg->isValid() && gmd != subgridMetaData)
+		{
+			RCRect r = gmd.rcRect().intersected(subgridMetaData.rcRect());
+			pair<int, int> tlRowCol = tg->rc2rowCol(r.tl);
+			pair<int, int> brRowCol = tg->rc2rowCol(r.br);
+			return GridPPtr(tg->subGridClone(tlRowCol.first, tlRowCol.second,
+			                                 brRowCol.first - tlRowCol.first,
+			                                 brRowCol.second - tlRowCol.second));
+		}
+	}
+#endif
+	return createSubgrid(gp->gridPPtr(), subgridMetaData);
+}
+
 vector<GridPPtr> GridManager::gridsFor(const string& regionName,
 																			 const set<string>& datasetNames,
 																			 const Path& userSubPath,
 																			 int cellSize,
                                        GridMetaData subgridMetaData)
 {
-	static L lockable;
-	L::Lock lock(lockable);
+	L::Lock lock(managerLockable());
 
 	vector<GridPPtr> res;
   BOOST_FOREACH(const GridMetaData& gmd, regionGmds(userSubPath))
@@ -627,7 +851,7 @@ vector<GridPPtr> GridManager::gridsFor(const string& regionName,
           BOOST_FOREACH(GridProxyPtr gp, gps)
           {
 						if(datasetNames.find(gp->datasetName) != datasetNames.end())
-							res.push_back(createSubgrid(gp->gridPPtr(), subgridMetaData));
+							res.push_back(createSubgrid(gp, subgridMetaData));
 					}
 				}
 			}
@@ -650,11 +874,13 @@ GridMetaData GridManager::gridMetaDataForRegionName(const string& regionName,
 }
 
 //! assume that if availabe the internal structure has already build been build up
-void GridManager::checkAndUpdateHdfStore(const Path& userSubPath)
+void GridManager::checkAndUpdateHdfStore(const Path& userSubPath,
+                                         bool writeIndex)
 {
 //	cout << "entering GridManager::checkAndUpdateHdfStore(" << userSubPath << ")" << endl;
 
 	GFN2GP& gridFn2grid = _gridPathMap[userSubPath];
+	GFN2GFI& infos = _gridFileInfos[userSubPath];
 
 	//don't check if this file exists
 	string pathToHdfs =
@@ -681,8 +907,9 @@ void GridManager::checkAndUpdateHdfStore(const Path& userSubPath)
 
 	//after reading the directory contains grids in the mapping file
 	//but not anymore in the system
-	GridProxies leftOverGrids;
-	transform(gridFn2grid.begin(), gridFn2grid.end(), back_inserter(leftOverGrids),
+	GridProxySet leftOverGrids;
+	transform(gridFn2grid.begin(), gridFn2grid.end(),
+						inserter(leftOverGrids, leftOverGrids.end()),
 						[](const GFN2GP::value_type& p){ return p.second; });
 //						std::bind<GridProxyPtr>(&GFN2GP::value_type::second, std::placeholders::_1));
 
@@ -691,6 +918,10 @@ void GridManager::checkAndUpdateHdfStore(const Path& userSubPath)
 //					 [](GridProxyPtr gp){ cout << endl << gp->toString(); });
 //	cout << (leftOverGrids.empty() ? ")" : "\n)");
 
+	//new grids and grids with a newer modification time, their content
+	//decides if they have to be converted again
+	vector<pair<FileName, struct stat> > toBeHashed;
+
 	while((ep = readdir(dp)))
 	{
 		//filter out files starting with . and all files have to end with .asc
@@ -701,7 +932,10 @@ void GridManager::checkAndUpdateHdfStore(const Path& userSubPath)
 			string gridFileName(ep->d_name);
 			string pathToGridFile = pathToAsciiGrids + "/" + gridFileName;
 			
-			time_t t = modificationTime(pathToGridFile.c_str());
+			struct stat attrib;
+			if(stat(pathToGridFile.c_str(), &attrib) != 0)
+				continue;
+			time_t t = attrib.st_mtime;
 
 //			cout << "gfn: " << gridFileName << " -> "
 //			<< extractMetadataFromGrid(pathToGridFile).toCanonicalString() << endl;
@@ -713,18 +947,16 @@ void GridManager::checkAndUpdateHdfStore(const Path& userSubPath)
       if(it != gridFn2grid.end())
       {
 				//remove the found grid from the leftover list
-				leftOverGrids.erase(find(leftOverGrids.begin(), leftOverGrids.end(),
-																 it->second));
+				leftOverGrids.erase(it->second);
 
-				//no new grid, but has been update - visible by GridProxy::state = eChanged
 				if(it->second->modificationTime < t)
-				{
-					it->second->updateModificationTime(t);
-					cout << "grid has updated mod time" << endl;
-				}
+					toBeHashed.push_back(make_pair(gridFileName, attrib));
       }
       else
+      {
 				addNewGridProxy(userSubPath, gridFileName, t);
+				toBeHashed.push_back(make_pair(gridFileName, attrib));
+			}
 		}
 	}
 
@@ -736,7 +968,43 @@ void GridManager::checkAndUpdateHdfStore(const Path& userSubPath)
 
 	closedir(dp);
 
-  updateHdfStore(userSubPath, leftOverGrids);
+	//hashing reads the whole grid files, so do it in parallel
+	vector<unsigned long long> hashes(toBeHashed.size());
+	parallel_rows(int(toBeHashed.size()), [&](int first, int last)
+	{
+		for(int i = first; i < last; i++)
+			hashes[i] = contentHash(pathToAsciiGrids + "/" + toBeHashed[i].first);
+	});
+
+	for(size_t i = 0; i < toBeHashed.size(); i++)
+	{
+		const FileName& gridFileName = toBeHashed[i].first;
+		time_t t = toBeHashed[i].second.st_mtime;
+		long long size = toBeHashed[i].second.st_size;
+		GridFileInfo& fi = infos[gridFileName];
+
+		GFN2GP::const_iterator it = gridFn2grid.find(gridFileName);
+    if(it != gridFn2grid.end())
+    {
+			//just touched (e.g. copied), the grid in the hdf is still valid
+			if(fi.contentHash != 0 && fi.contentHash == hashes[i] && fi.size == size)
+				it->second->modificationTime = t;
+      else
+      {
+				//no new grid, but has been update - visible by GridProxy::state = eChanged
+				it->second->updateModificationTime(t);
+				cout << "grid has updated mod time" << endl;
+			}
+			writeIndex = true;
+		}
+
+		fi.size = size;
+		fi.modificationTime = t;
+		fi.contentHash = hashes[i];
+	}
+
+	if(updateHdfStore(userSubPath, leftOverGrids) || writeIndex)
+		writeGrid2HdfMappingFile(userSubPath);
 
 //	cout << "leaving GridManager::checkAndUpdateHdfStore(" << userSubPath << ")" << endl;
 }
@@ -821,8 +1089,8 @@ int& GridManager::hdfIdCount(const Path& userSubPath)
 	return i->second;
 }
  
-void GridManager::updateHdfStore(const Path& userSubPath,
-                                 const GridProxies& leftOverGrids)
+bool GridManager::updateHdfStore(const Path& userSubPath,
+                                 const GridProxySet& leftOverGrids)
 {
 //	cout << "entering GridManager::updateHdfStore(" << userSubPath
 //			 << ", leftOverGrids)" << endl;
@@ -841,6 +1109,7 @@ void GridManager::updateHdfStore(const Path& userSubPath,
 		GridProxies& gps = p.second;
 //		cout << "region in userSubPath: " << userSubPath << " with gmd: " << p.first.toString() << endl;
 		GridProxies onlyAppends;
+		GridProxies changed;
 		bool update = false; //is a grid new or has changed ?
 		bool onlyAppend = true; //are all the grids new ?
 		string hdfFileName; //we have to get the name from one of the proxies
@@ -849,10 +1118,8 @@ void GridManager::updateHdfStore(const Path& userSubPath,
 			ostringstream userInfo;
 			userInfo << "path: (" << userSubPath << ") " << gp->toString() << " -> ";
 
-			GridProxies::const_iterator fgpi = find(leftOverGrids.begin(),
-			                                        leftOverGrids.end(), gp);
       //not a grid to remove
-      if(fgpi == leftOverGrids.end())
+      if(leftOverGrids.find(gp) == leftOverGrids.end())
       {
         switch(gp->state)
         {
@@ -864,6 +1131,7 @@ void GridManager::updateHdfStore(const Path& userSubPath,
 						//the existing grid (set to load from hdf) has to reload
 						//after deleting the source hdf from the ascii grid
 						gp->resetToLoadFromAscii(pathToGrids);
+						changed.push_back(gp);
 						cout << userInfo.str() << "has changed" << endl;
 						break;
 					case GridProxy::eNew:
@@ -905,11 +1173,7 @@ void GridManager::updateHdfStore(const Path& userSubPath,
 				if(onlyAppends.size() == gps.size()){ //all are new
 					//reach for the underlying grid of every proxy in order to load it
 					//and be able to store it anew in the hdf-file
-					//for_each(gps.begin(), gps.end(), [](GridProxyPtr gp){ gp->gridPtr(); });
-					BOOST_FOREACH(GridProxyPtr gp, gps)
-					{
-					  gp->gridPtr();
-					}
+					loadGrids(gps);
 
 					ostringstream s; s << ++hdfIdCount(userSubPath) << ".h5";
 					//try to delete the new file first, so we
@@ -919,17 +1183,26 @@ void GridManager::updateHdfStore(const Path& userSubPath,
 					toBeDeletedSaveProblem = appendToHdf(userSubPath, gps, s.str());
         }
         else
+        {
+					loadGrids(onlyAppends);
 					toBeDeletedSaveProblem = appendToHdf(userSubPath, onlyAppends, hdfFileName); //append only the new ones
+				}
       }
+      else if(toBeDeletedFromHDF.empty() &&
+              overwriteInHdf(userSubPath, changed, hdfFileName))
+      {
+				//the changed grids have been written over their old datasets
+				if(!onlyAppends.empty())
+				{
+					loadGrids(onlyAppends);
+					toBeDeletedSaveProblem = appendToHdf(userSubPath, onlyAppends, hdfFileName);
+				}
+			}
       else
       {
 				//reach for the underlying grid of every proxy in order to load it
 				//and be able to store it anew in the hdf-file
-				//for_each(gps.begin(), gps.end(), [](GridProxyPtr gp){ gp->gridPtr(); });
-				BOOST_FOREACH(GridProxyPtr gp, gps)
-				{
-				  gp->gridPtr();
-				}
+				loadGrids(gps);
 
 				if(remove((pathToHdfs + "/" + hdfFileName).c_str()) != 0)
 				{
@@ -965,11 +1238,31 @@ void GridManager::updateHdfStore(const Path& userSubPath,
 		}
 	}
 
-	if(somethingChanged)
-		writeGrid2HdfMappingFile(userSubPath);
-
 //	cout << "leaving GridManager::updateHdfStore(" << userSubPath
 //			 << ", leftOverGrids)" << endl;
+
+	return somethingChanged;
+}
+
+void GridManager::loadGrids(const GridProxies& proxies)
+{
+	//parsing the ascii grids is the expensive part, the hdf library isn't
+	//thread safe though, so proxies still backed by a hdf file are loaded
+	//one by one, as the grids are written one by one afterwards
+	GridProxies asciiBacked;
+	BOOST_FOREACH(GridProxyPtr gp, proxies)
+	{
+		if(gp->pathToHdf.empty())
+			asciiBacked.push_back(gp);
+		else
+			gp->gridPtr();
+	}
+
+	parallel_rows(int(asciiBacked.size()), [&](int first, int last)
+	{
+		for(int i = first; i < last; i++)
+			asciiBacked[i]->gridPtr();
+	});
 }
 
 GridManager::GridProxies
@@ -1024,6 +1317,56 @@ GridManager::appendToHdf(const Path& userSubPath,
 	return toBeDeletedSaveProblem;
 }
 
+bool GridManager::overwriteInHdf(const Path& userSubPath,
+                                 const GridProxies& proxies,
+                                 const FileName& hdfFileName)
+{
+	if(hdfFileName.empty())
+		return false;
+
+	string pathToHdfs =
+		_env.hdfsStorePath + (userSubPath.empty() ? "" : "/" + userSubPath);
+	loadGrids(proxies);
+	bool success = true;
+	BOOST_FOREACH(GridProxyPtr gp, proxies)
+	{
+		//after a failure the whole file gets written anew anyway
+		success = success &&
+			gp->gridPtr()->writeHdf(pathToHdfs + "/" + hdfFileName, gp->datasetName,
+			                        extractRegionName(gp->fileName),
+			                        gp->modificationTime, true);
+		if(success)
+		{
+			gp->hdfFileName = hdfFileName;
+			gp->pathToHdf = pathToHdfs;
+			gp->state = GridProxy::eNormal;
+			gp->reset();
+		}
+	}
+
+	if(!success)
+		cout << "Couldn't overwrite the changed grids in hdf-file: " << hdfFileName
+				 << ", writing it anew." << endl;
+	return success;
+}
+
+unsigned long long GridManager::contentHash(const string& pathToFile)
+{
+	ifstream in(pathToFile.c_str(), ios::binary);
+	if(!in)
+		return 0;
+
+	unsigned long long h = 14695981039346656037ULL;
+	vector<char> buffer(1 << 16);
+	while(in.read(&buffer[0], buffer.size()) || in.gcount() > 0)
+	{
+		for(streamsize i = 0, n = in.gcount(); i < n; i++)
+			h = (h ^ (unsigned char)buffer[i]) * 1099511628211ULL;
+	}
+	//0 means unknown
+	return h == 0 ? 1 : h;
+}
+
 time_t GridManager::modificationTime(const char* fileName)
 {
 	struct stat attrib;	// create a file attribute structure
@@ -1159,7 +1502,7 @@ GridManager::regionalizedGroupOfData(const string& region,
 	return res;
 }
 
-void GridManager::readGrid2HdfMappingFile(const Path& userSubPath)
+bool GridManager::readGrid2HdfMappingFile(const Path& userSubPath)
 {
 	//cout << "entering GridManager::readGrid2HdfMappingFile(" << userSubPath << ")" << endl;
 	
@@ -1173,8 +1516,36 @@ void GridManager::readGrid2HdfMappingFile(const Path& userSubPath)
   {
 		//cout << "no mappings file there" << endl;
 		//cout << "leaving GridManager::readGrid2HdfMappingFile(" << userSubPath << ")" << endl;
-		return;
+		return true;
 	}
+
+	//index: file size, modification time, content hash and metadata of the grids
+	GFN2GFI& infos = _gridFileInfos[userSubPath];
+	IniParameterMap::const_iterator ixci = ipm.find("index");
+  if(ixci != ipm.end())
+  {
+    for(Names2Values::const_iterator ci = ixci->second.begin();
+        ci != ixci->second.end(); ci++)
+    {
+			GridFileInfo fi;
+			long long t;
+			istringstream ss(ci->second);
+      if(ss >> fi.size >> t >> fi.contentHash
+         >> fi.gmd.ncols >> fi.gmd.nrows >> fi.gmd.xllcorner >> fi.gmd.yllcorner
+         >> fi.gmd.cellsize >> fi.gmd.nodata)
+      {
+				fi.modificationTime = time_t(t);
+				//same as readGridMetadataFromHdf
+				fi.gmd.regionName = extractRegionName(ci->first);
+				if(fi.gmd.regionName.substr(0, 6) == "brazil")
+					fi.gmd.coordinateSystem = UTM21S_EPSG32721;
+				infos[ci->first] = fi;
+			}
+		}
+	}
+
+	bool indexComplete = true;
+	map<string, bool> hdfExists;
 	set<string> usedHdfFilenames;
 	const Names2Values& ns2vs = ipmci->second;
   for(Names2Values::const_iterator ci = ns2vs.begin(); ci != ns2vs.end(); ci++)
@@ -1186,14 +1557,35 @@ void GridManager::readGrid2HdfMappingFile(const Path& userSubPath)
 		//cout << "current max hdfIdCount(" << userSubPath << "): " << hdfIdCount(userSubPath) << endl;
 
 		string datasetName = extractDatasetName(gridFileName);
-		pair<GridMetaData, time_t> p =
-			readGridMetadataFromHdf((pathToHdfs + "/" + hdfFileName).c_str(),
-			                        datasetName.c_str());
-		//couldn't read hdf, so just ignore it
-		//if there are grids for the supposed to be there hdf, it gonna
-		//get created anew from the ascii grids
-		if(p.second < 0)
-			continue;
+
+		map<string, bool>::iterator hei = hdfExists.find(hdfFileName);
+    if(hei == hdfExists.end())
+    {
+			struct stat attrib;
+			bool exists = stat((pathToHdfs + "/" + hdfFileName).c_str(), &attrib) == 0;
+			hei = hdfExists.insert(make_pair(hdfFileName, exists)).first;
+		}
+
+		pair<GridMetaData, time_t> p;
+		GFN2GFI::const_iterator fii = infos.find(gridFileName);
+		if(fii != infos.end() && hei->second)
+			p = make_pair(fii->second.gmd, fii->second.modificationTime);
+    else
+    {
+			//no index entry, the metadata have to be read from the hdf
+			indexComplete = false;
+			p = readGridMetadataFromHdf((pathToHdfs + "/" + hdfFileName).c_str(),
+			                            datasetName.c_str());
+			//couldn't read hdf, so just ignore it
+			//if there are grids for the supposed to be there hdf, it gonna
+			//get created anew from the ascii grids
+			if(p.second < 0)
+				continue;
+
+			GridFileInfo& fi = infos[gridFileName] = GridFileInfo();
+			fi.modificationTime = p.second;
+			fi.gmd = p.first;
+		}
 
 		GridProxyPtr gp = GridProxyPtr(new GridProxy(p.first.coordinateSystem,
 																								 datasetName, gridFileName,
@@ -1222,6 +1614,8 @@ void GridManager::readGrid2HdfMappingFile(const Path& userSubPath)
 	}
 
 	//cout << "leaving GridManager::readGrid2HdfMappingFile(" << userSubPath << ")" << endl;
+
+	return indexComplete;
 }
 
 string GridManager::extractDatasetName(const string& gfn) const
@@ -1259,6 +1653,27 @@ void GridManager::writeGrid2HdfMappingFile(const Path& userSubPath)
 					fout << gp->fileName << " = " << gp->hdfFileName << endl;
 				}
 			}
+
+			//the index allows starting without opening all the hdfs
+			//and recognizes grids which have just been touched
+			GFN2GFI& infos = _gridFileInfos[userSubPath];
+			fout << endl <<
+			";ascii-grid = size modification-time content-hash "
+			"ncols nrows xllcorner yllcorner cellsize nodata" << endl <<
+			"[index]" << endl;
+      BOOST_FOREACH(GMD2GPS::value_type p, ci->second)
+      {
+				const GridMetaData& gmd = p.first;
+        BOOST_FOREACH(GridProxyPtr gp, p.second)
+        {
+					const GridFileInfo& fi = infos[gp->fileName];
+					fout << gp->fileName << " = " << fi.size << " "
+							 << (long long)gp->modificationTime << " " << fi.contentHash << " "
+							 << gmd.ncols << " " << gmd.nrows << " "
+							 << gmd.xllcorner << " " << gmd.yllcorner << " "
+							 << gmd.cellsize << " " << gmd.nodata << endl;
+				}
+			}
 		}
 	}
 	fout.close();
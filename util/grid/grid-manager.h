@@ -29,7 +29,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <vector>
 #include <string>
 #include <map>
+#include <set>
 #include <ctime>
+#include <functional>
 #include <utility>
 
 #include "grid+.h"
@@ -63,6 +65,25 @@ namespace Grids
 			unsigned int _col;
 		};
 
+		//! the data of one cell, pointing into storage of the virtual grid
+		class DataRange
+		{
+		public:
+			typedef const Data* iterator;
+			typedef const Data* const_iterator;
+			DataRange(const Data* begin, const Data* end) : _begin(begin), _end(end) {}
+			const Data* begin() const { return _begin; }
+			const Data* end() const { return _end; }
+			size_t size() const { return _end - _begin; }
+			const Data& operator[](size_t i) const { return _begin[i]; }
+		private:
+			const Data* _begin;
+			const Data* _end;
+		};
+
+		typedef std::function<void(unsigned int row, unsigned int col,
+		                           DataRange data)> CellVisitor;
+
 	public:
 		VirtualGrid(Tools::CoordinateSystem cs,
 								const Grids::RCRect& rect, double cellSize,
@@ -99,6 +120,22 @@ namespace Grids
 		virtual std::vector<Data>
 		dataAt(const Tools::RectCoord& rcc) const = 0;
 
+		/*!
+		 * call f(row, col, data) for every cell, instead of dataAt when sweeping
+		 * the whole grid
+		 * - the cells are walked in blocks of blockSize x blockSize cells, row by
+		 * row inside a block, so the underlying grids are accessed locally
+		 * - data is only valid during the call and, like dataAt, is a single
+		 * no data element for cells without data
+		 * - nothing is allocated per cell
+		 */
+		void forEachCell(const CellVisitor& f, unsigned int blockSize = 64) const;
+
+		//! as above, but only for the cells [row0, row1) x [col0, col1)
+		virtual void forEachCellIn(unsigned int row0, unsigned int col0,
+		                           unsigned int row1, unsigned int col1,
+		                           const CellVisitor& f) const;
+
 		//! number of rows of virtual grid
 		unsigned int rows() const { return _rows; }
 
@@ -120,7 +157,7 @@ namespace Grids
 			return Tools::RC2latLng(_rect.toTlTrBrBlVector());
 		}
 
-		//! get a polygon matrix for all the cells
+		//! get a polygon matrix for all the cells (calculated on first use)
 		const LatLngPolygonsMatrix& latLngCellPolygons();
 
 		//! should the cell resolution be used
@@ -202,6 +239,10 @@ namespace Grids
 
 		virtual std::vector<Data> dataAt(const Tools::RectCoord& rcc) const;
 
+		virtual void forEachCellIn(unsigned int row0, unsigned int col0,
+		                           unsigned int row1, unsigned int col1,
+		                           const CellVisitor& f) const;
+
 		virtual std::vector<const GridP*> availableGrids();
 
 		virtual std::string toShortDescription() const;
@@ -234,6 +275,10 @@ namespace Grids
 		virtual std::vector<Data>
 		dataAt(const Tools::RectCoord& /*rcc*/) const { return std::vector<Data>(); }
 
+		virtual void forEachCellIn(unsigned int row0, unsigned int col0,
+		                           unsigned int row1, unsigned int col1,
+		                           const CellVisitor& f) const;
+
 		void addDataAt(unsigned int row, unsigned int col, const Data& data)
 		{
 			_data[row][col].push_back(data);
@@ -243,6 +288,8 @@ namespace Grids
 
 	private:
 		DataMatrix _data;
+		//! the data of cells without data
+		Data _noData;
 		//! stores the proxy ptrs directly referenced in the Data elements
 		std::vector<std::vector<GridProxyPtr>*> _usedGridProxies;
 	};
@@ -259,6 +306,7 @@ namespace Grids
 		typedef std::string PathToFile;
 
 		typedef std::vector<GridProxyPtr> GridProxies;
+		typedef std::set<GridProxyPtr> GridProxySet;
 		typedef std::map<GridMetaData, GridProxies> GMD2GPS;
 		typedef std::map<Path, GMD2GPS> Path2GPS;
 		typedef std::map<FileName, GridProxyPtr> GFN2GP;
@@ -287,6 +335,14 @@ namespace Grids
 			Path regionalizationIniFilePath;
 		};
 
+		//! how the fields are combined into the cells of the overview pyramid levels
+		enum Aggregation
+		{
+			eMean = 0, //!< like grid::downscale
+			eSum = 1, //!< like grid::downscale_s
+			eMode = 2 //!< most frequent value, for class grids
+		};
+
 	public:
 		GridManager(Env env);
 		~GridManager();
@@ -317,6 +373,22 @@ namespace Grids
 																	 int cellSize = 100,
 																	 GridMetaData subgridMetaData = GridMetaData());
 
+		/*!
+		 * grid of the region at about the requested cell size, e.g. to display
+		 * it at a certain zoom level
+		 * - answered from the nearest level of an overview pyramid, level k has
+		 * cells 2^k times as large as the region's grid (level 0 = gridFor)
+		 * - a level is built when it is requested the first time and persisted
+		 * as dataset "<dataset name>@<aggregation>@<2^k>" in the hdf file
+		 * of the grid, levels of an older version of the grid are replaced
+		 */
+		GridPPtr overviewGridFor(const std::string& regionName,
+		                         const std::string& datasetName,
+		                         double requestedCellSize,
+		                         Aggregation aggregation = eMean,
+		                         const Path& userSubPath = "general",
+		                         int cellSize = 100);
+
 		std::vector<std::vector<Tools::LatLngCoord> >
 		regions(const Path& userSubPath = "general") const;
 		
@@ -364,12 +436,20 @@ namespace Grids
 		//! read all the regionalized data and create GridProxies for the maps
 		void readRegionalizedData();
 
-		//! read the mappings file and build up internal hdf store structure
-		void readGrid2HdfMappingFile(const Path& userSubPath);
+		/*!
+		 * read the mappings file and build up internal hdf store structure
+		 * - grids with an entry in the index section of the file don't need
+		 * their hdf to be opened
+		 * @return false if some grids had no index entry yet
+		 */
+		bool readGrid2HdfMappingFile(const Path& userSubPath);
 
-		//! write the mappingsfile
+		//! write the mappingsfile (including the index)
 		void writeGrid2HdfMappingFile(const Path& userSubPath);
 
+		//! 64 bit FNV-1a hash of the file's content, 0 if it can't be read
+		static unsigned long long contentHash(const std::string& pathToFile);
+
 		//! get the modification time of the given file
 		std::time_t modificationTime(const char* fileName);
 
@@ -389,18 +469,33 @@ namespace Grids
 																				 Tools::CoordinateSystem cs
 																				 = Tools::GK5_EPSG31469) const;
 
-		//! update the store by any changes to the grids available
-		void updateHdfStore(const Path& userSubPath,
-												const GridProxies& leftOverGrids);
+		/*!
+		 * update the store by any changes to the grids available
+		 * @return true if something changed and the mappings file has to be written
+		 */
+		bool updateHdfStore(const Path& userSubPath,
+		                    const GridProxySet& leftOverGrids);
 
 		//! check if something changed in the store and update if necessary
-		void checkAndUpdateHdfStore(const Path& userSubPath);
+		void checkAndUpdateHdfStore(const Path& userSubPath,
+		                            bool writeIndex = false);
+
+		//! load the grids of the proxies (in parallel)
+		void loadGrids(const GridProxies& proxies);
 
 		//! append the given proxies to an existing hdf
 		GridProxies appendToHdf(const Path& userSubPath,
 														const GridProxies& proxies,
 		                        const FileName& newHdfFileName);
 
+		/*!
+		 * write the changed grids of the proxies over their datasets in the
+		 * hdf file, instead of writing the whole file anew
+		 * @return false if a grid couldn't be overwritten (e.g. other size)
+		 */
+		bool overwriteInHdf(const Path& userSubPath, const GridProxies& proxies,
+		                    const FileName& hdfFileName);
+
 		void init(const Path& userSubPath);
 
 		int& hdfIdCount(const Path& userSubPath);
@@ -408,18 +503,51 @@ namespace Grids
 		GridPPtr createSubgrid(GridPPtr g, GridMetaData subgridMetaData,
 													 bool alwaysClone = false);
 
+		//! as above, but doesn't load the whole grid if just a part of it is needed
+		GridPPtr createSubgrid(GridProxyPtr gp, GridMetaData subgridMetaData);
+
+		GridProxyPtr gridProxyFor(const std::string& regionName,
+		                          const std::string& datasetName,
+		                          const Path& userSubPath, int cellSize);
+
+		//! level 1..n of the overview pyramid of the proxy's grid,
+		//! levels above n give the top level
+		GridPPtr overviewLevel(GridProxyPtr gp, Aggregation aggregation, int level);
+
 	private: //state
 		Env _env;
 
 		Path2GPS _gmdMap;
 		Path2GP _gridPathMap;
 
+		//! what is known about an ascii grid, persisted in the index section
+		//! of the mappings file
+		struct GridFileInfo
+		{
+			GridFileInfo() : size(0), modificationTime(0), contentHash(0) {}
+			long long size;
+			time_t modificationTime;
+			unsigned long long contentHash; //!< 0 = unknown
+			GridMetaData gmd; //!< as in the hdf store
+		};
+		typedef std::map<FileName, GridFileInfo> GFN2GFI;
+		std::map<Path, GFN2GFI> _gridFileInfos;
+
 		Region2RegData _region2regData;
 
 		Groups2Members _groups2members;
 
 		std::map<Path, int> _userSubPathToHdfIdCount;
 		int _hdfIdCount;
+
+		struct Pyramid
+		{
+			Pyramid() : modificationTime(0) {}
+			time_t modificationTime; //!< of the grid the levels were built from
+			std::vector<GridPPtr> levels; //!< levels not built yet are empty
+		};
+		//! hdf file + dataset name + aggregation -> pyramid
+		std::map<std::string, Pyramid> _pyramids;
 	};
 
 	//----------------------------------------------------------------------------
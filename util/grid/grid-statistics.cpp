@@ -0,0 +1,244 @@
+/**
+Authors:
+Ralf Wieland <ralf.wieland@zalf.de>
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers:
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include <algorithm>
+
+#include "grid-statistics.h"
+
+using namespace Grids;
+using namespace std;
+using namespace Tools;
+
+GridStatistics::GridStatistics(double quantileCompression)
+	: _count(0),
+		_cols(0),
+		_compression(quantileCompression),
+		_capacity(quantileCompression > 0 ? centroidsCapacity(quantileCompression) : 0)
+{}
+
+void GridStatistics::init(const GridP& g)
+{
+	_structure = GridPPtr(g.uninitializedClone());
+	_cols = g.cols();
+	size_t cells = size_t(g.rows())*_cols;
+	_n.assign(cells, 0);
+	_mean.assign(cells, 0.0);
+	_m2.assign(cells, 0.0);
+	_min.assign(cells, 0.0f);
+	_max.assign(cells, 0.0f);
+	_centroids.resize(cells*_capacity);
+	_noOfCentroids.assign(_capacity > 0 ? cells : 0, 0);
+}
+
+void GridStatistics::compressCell(size_t cell, int moreCentroids)
+{
+	int& n = _noOfCentroids[cell];
+	if(n + moreCentroids > _capacity)
+		n = compressCentroids(&_centroids[cell*_capacity], n, _compression);
+}
+
+void GridStatistics::add(const GridP& g)
+{
+	if(!_structure)
+		init(g);
+	else if(g.rows() != _structure->rows() || g.cols() != _structure->cols())
+	{
+		cerr << "error (GridStatistics::add): grid " << g.rows() << "x" << g.cols()
+				 << " doesn't fit " << _structure->rows() << "x" << _cols << endl;
+		return;
+	}
+
+	const grid& gr = g.gridRef();
+	int nodata = g.noDataValue();
+	parallel_rows(g.rows(), [&](int firstRow, int lastRow)
+	{
+		for(int r = firstRow; r < lastRow; r++)
+		{
+			const float* row = gr.feld[r];
+			for(int c = 0; c < _cols; c++)
+			{
+				float x = row[c];
+				if(int(x) == nodata)
+					continue;
+
+				size_t i = size_t(r)*_cols + c;
+				int n = ++_n[i];
+				double d = x - _mean[i];
+				_mean[i] += d / n;
+				_m2[i] += d * (x - _mean[i]);
+				_min[i] = n == 1 ? x : std::min(_min[i], x);
+				_max[i] = n == 1 ? x : std::max(_max[i], x);
+
+				if(_capacity > 0)
+				{
+					compressCell(i, 1);
+					Centroid ce = {x, 1.0f};
+					_centroids[i*_capacity + _noOfCentroids[i]++] = ce;
+				}
+			}
+		}
+	});
+	_count++;
+}
+
+void GridStatistics::merge(const GridStatistics& other)
+{
+	if(!other._structure)
+		return;
+	if(!_structure)
+	{
+		*this = other;
+		return;
+	}
+	if(other._n.size() != _n.size() || other._capacity != _capacity)
+	{
+		cerr << "error (GridStatistics::merge): statistics don't fit" << endl;
+		return;
+	}
+
+	parallel_rows(_structure->rows(), [&](int firstRow, int lastRow)
+	{
+		//room for the centroids of both cells
+		vector<Centroid> both(2*_capacity);
+		for(size_t i = size_t(firstRow)*_cols, last = size_t(lastRow)*_cols; i < last; i++)
+		{
+			int on = other._n[i];
+			if(on == 0)
+				continue;
+
+			int n = _n[i] + on;
+			double d = other._mean[i] - _mean[i];
+			_mean[i] += d * (double(on) / n);
+			_m2[i] += other._m2[i] + d * d * (double(_n[i]) * on / n);
+			_min[i] = _n[i] == 0 ? other._min[i] : std::min(_min[i], other._min[i]);
+			_max[i] = _n[i] == 0 ? other._max[i] : std::max(_max[i], other._max[i]);
+			_n[i] = n;
+
+			if(_capacity > 0)
+			{
+				int nc = _noOfCentroids[i], onc = other._noOfCentroids[i];
+				Centroid* cs = &_centroids[i*_capacity];
+				copy(cs, cs + nc, both.begin());
+				copy(other._centroids.begin() + i*_capacity,
+						 other._centroids.begin() + i*_capacity + onc, both.begin() + nc);
+				nc += onc;
+				if(nc > _capacity)
+					nc = compressCentroids(&both[0], nc, _compression);
+				copy(both.begin(), both.begin() + nc, cs);
+				_noOfCentroids[i] = nc;
+			}
+		}
+	});
+	_count += other._count;
+}
+
+GridPPtr GridStatistics::resultGrid(const function<double(size_t)>& f) const
+{
+	if(!_structure)
+		return GridPPtr();
+
+	GridPPtr res(_structure->uninitializedClone());
+	float nodata = float(res->noDataValue());
+	parallel_rows(res->rows(), [&](int firstRow, int lastRow)
+	{
+		for(int r = firstRow; r < lastRow; r++)
+		{
+			float* out = (*res)[r];
+			for(int c = 0; c < _cols; c++)
+			{
+				size_t i = size_t(r)*_cols + c;
+				out[c] = _n[i] > 0 ? float(f(i)) : nodata;
+			}
+		}
+	});
+	res->updateValidityMask();
+	return res;
+}
+
+GridPPtr GridStatistics::counts() const
+{
+	return resultGrid([&](size_t i){ return _n[i]; });
+}
+
+GridPPtr GridStatistics::mean() const
+{
+	return resultGrid([&](size_t i){ return _mean[i]; });
+}
+
+GridPPtr GridStatistics::variance() const
+{
+	return resultGrid([&](size_t i){ return _n[i] > 1 ? _m2[i] / (_n[i] - 1) : 0.0; });
+}
+
+GridPPtr GridStatistics::standardDeviation() const
+{
+	return resultGrid([&](size_t i){ return _n[i] > 1 ? sqrt(_m2[i] / (_n[i] - 1)) : 0.0; });
+}
+
+GridPPtr GridStatistics::min() const
+{
+	return resultGrid([&](size_t i){ return _min[i]; });
+}
+
+GridPPtr GridStatistics::max() const
+{
+	return resultGrid([&](size_t i){ return _max[i]; });
+}
+
+GridPPtr GridStatistics::quantile(double q) const
+{
+	if(_capacity == 0 || !_structure)
+		return GridPPtr();
+
+	GridPPtr res(_structure->uninitializedClone());
+	float nodata = float(res->noDataValue());
+	parallel_rows(res->rows(), [&](int firstRow, int lastRow)
+	{
+		//the centroids of a cell are sorted on a copy, so this stays const
+		vector<Centroid> sorted(_capacity);
+		for(int r = firstRow; r < lastRow; r++)
+		{
+			float* out = (*res)[r];
+			for(int c = 0; c < _cols; c++)
+			{
+				size_t i = size_t(r)*_cols + c;
+				int n = _noOfCentroids[i];
+				if(_n[i] == 0)
+				{
+					out[c] = nodata;
+					continue;
+				}
+				copy(_centroids.begin() + i*_capacity,
+						 _centroids.begin() + i*_capacity + n, sorted.begin());
+				sort(sorted.begin(), sorted.begin() + n);
+				out[c] = float(centroidsQuantile(&sorted[0], n, _min[i], _max[i], q));
+			}
+		}
+	});
+	res->updateValidityMask();
+	return res;
+}
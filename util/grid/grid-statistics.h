@@ -0,0 +1,108 @@
+/**
+Authors:
+Ralf Wieland <ralf.wieland@zalf.de>
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers:
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GRIDSTATISTICS_H_
+#define GRIDSTATISTICS_H_
+
+#include <vector>
+
+#include "grid+.h"
+#include "tools/online-statistics.h"
+
+namespace Grids
+{
+	/*!
+	 * statistics per cell of a series of grids with the same structure (e.g.
+	 * the realizations of a year), built up grid by grid without keeping them
+	 * - mean and variance (Welford), min and max over the grids, no data cells
+	 * of a grid are skipped, cells without any data are no data in the results
+	 * - optionally the quantiles from a t-digest per cell, with the error
+	 * bound of Tools::QuantileSketch (pi/compression + 1/count of the ranks),
+	 * e.g. compression 20 keeps at most 42 centroids per cell
+	 * - the statistics of parts of the series (e.g. of different threads)
+	 * can be merged
+	 * - the cells are updated in parallel, but add and merge must not be
+	 * called concurrently
+	 */
+	class GridStatistics
+	{
+	public:
+		//! quantileCompression = 0: no quantiles
+		GridStatistics(double quantileCompression = 0);
+
+		void add(const GridP& g);
+
+		void merge(const GridStatistics& other);
+
+		//! number of grids added
+		int count() const { return _count; }
+
+		//! number of values per cell
+		GridPPtr counts() const;
+
+		GridPPtr mean() const;
+
+		//! sample variance (n-1), 0 for cells with a single value
+		GridPPtr variance() const;
+
+		GridPPtr standardDeviation() const;
+
+		GridPPtr min() const;
+
+		GridPPtr max() const;
+
+		//! empty pointer if there are no quantiles
+		GridPPtr quantile(double q) const;
+
+		GridPPtr median() const { return quantile(0.5); }
+
+	private:
+		typedef Tools::Centroid<float> Centroid;
+
+		void init(const GridP& g);
+
+		//! new grid like the added ones with f(cell) in the cells with values
+		GridPPtr resultGrid(const std::function<double(size_t)>& f) const;
+
+		//! merges the centroids of cell if there are too many
+		void compressCell(size_t cell, int moreCentroids);
+
+		GridPPtr _structure;
+		int _count;
+		int _cols;
+		std::vector<int> _n;
+		std::vector<double> _mean, _m2;
+		std::vector<float> _min, _max;
+
+		double _compression;
+		int _capacity;
+		//! _capacity centroids per cell, unsorted
+		std::vector<Centroid> _centroids;
+		std::vector<int> _noOfCentroids;
+	};
+}
+
+#endif
@@ -0,0 +1,993 @@
+/**
+Authors:
+Ralf Wieland <ralf.wieland@zalf.de>
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers:
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <vector>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+#include <sys/stat.h>
+
+#include "grid/grid.h"
+#include "grid/grid+.h"
+#include "grid/tiled-grid.h"
+#include "grid/mapped-grid-file.h"
+#include "grid/mapped-file.h"
+#include "tools/coord-trans.h"
+#include "tools/online-statistics.h"
+#include "tools/pipeline.h"
+#include "grid/grid-statistics.h"
+
+using namespace Grids;
+using namespace std;
+using namespace Tools;
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool ok, const string& what)
+	{
+		if(!ok)
+		{
+			cerr << "FAILED: " << what << endl;
+			failures++;
+		}
+	}
+
+	//! rows x cols grid, cell (i, j) = i*1000 + j
+	grid* numbered(int rows, int cols)
+	{
+		grid* g = new grid(rows, cols);
+		for(int i = 0; i < rows; i++)
+			for(int j = 0; j < cols; j++)
+				g->feld[i][j] = float(i*1000 + j);
+		return g;
+	}
+
+	//! a view keeps the stride of its parent, a copy gets its own
+	void copySubView()
+	{
+		grid* g = numbered(10, 40);
+		// bottom right corner, so reading a parent stride past the view's
+		// last row would run over the end of the parent's buffer
+		grid* v = g->sub_view(6, 5, 4, 7);
+		grid* c = v->grid_copy();
+		check(c->nrows == 4 && c->ncols == 7, "copySubView: size");
+		check(c->stride < g->stride, "copySubView: own stride");
+		bool same = true;
+		for(int i = 0; i < 4; i++)
+			for(int j = 0; j < 7; j++)
+				same = same && c->feld[i][j] == float((6 + i)*1000 + 5 + j);
+		check(same, "copySubView: values");
+		check(c->xcorner == v->xcorner && c->ycorner == v->ycorner,
+		      "copySubView: corners");
+
+		// the copy doesn't share its fields with the parent
+		c->feld[0][0] = -1;
+		check(g->feld[6][5] == 6005, "copySubView: independent");
+
+		delete c;
+		delete v;
+		delete g;
+	}
+
+	//! a view owns only its row pointers, not the fields of its parent
+	void memorySizeOfViews()
+	{
+		grid* g = numbered(100, 300);
+		grid* v = g->sub_view(10, 10, 50, 50);
+		size_t fields = size_t(g->nrows)*g->stride*sizeof(float);
+		check(g->memory_size() >= fields, "memorySizeOfViews: grid");
+		check(v->memory_size() == 50*sizeof(float*), "memorySizeOfViews: view");
+		delete v;
+		delete g;
+	}
+
+	//! points in and around a 60 x 80 grid with 10m cells, from a fixed seed
+	void scatteredPoints(point& p, grid& g)
+	{
+		g.csize = 10;
+		g.xcorner = 1000;
+		g.ycorner = 2000;
+		g.nodata = -9999;
+		for(int i = 0; i < g.nrows; i++)
+			for(int j = 0; j < g.ncols; j++)
+				g.feld[i][j] = (i + j) % 17 == 0 ? -9999 : 1;
+
+		unsigned int seed = 4711;
+		for(int k = 0; k < 300; k++)
+		{
+			seed = seed*1103515245 + 12345;
+			double x = 950 + (seed >> 8) % 900;
+			seed = seed*1103515245 + 12345;
+			double y = 1950 + (seed >> 8) % 700;
+			p.set_point(x, y, k % 23);
+		}
+		// the same location twice, the first one has to win
+		p.set_point(1205, 2305, 100);
+		p.set_point(1205, 2305, 200);
+	}
+
+	bool insideGrid(const point& p, const grid& g, int k)
+	{
+		return p.feld[k][0] >= g.xcorner && p.feld[k][0] < g.xcorner + g.csize*g.ncols
+			&& p.feld[k][1] >= g.ycorner && p.feld[k][1] < g.ycorner + g.csize*g.nrows;
+	}
+
+	//! the bucket search finds exactly the nearest point a full scan finds
+	void voronoiMatchesFullScan()
+	{
+		grid g(60, 80);
+		point p;
+		scatteredPoints(p, g);
+		grid* v = p.p2g_voronoi(&g);
+
+		bool same = true;
+		for(int i = 0; i < g.nrows; i++)
+		{
+			double y = g.ycorner + g.csize*(g.nrows - i - 1);
+			for(int j = 0; j < g.ncols; j++)
+			{
+				double x = g.xcorner + g.csize*j;
+				int nearest = -1;
+				double minDist = 0;
+				for(int k = 0; k < p.length; k++)
+				{
+					if(!insideGrid(p, g, k))
+						continue;
+					double d = sqrt((x - p.feld[k][0])*(x - p.feld[k][0])
+					                + (y - p.feld[k][1])*(y - p.feld[k][1]));
+					if(nearest < 0 || d < minDist)
+					{
+						nearest = k;
+						minDist = d;
+					}
+				}
+				float expected = g.feld[i][j] == g.nodata ? g.nodata : p.feld[nearest][2];
+				same = same && v->feld[i][j] == expected;
+			}
+		}
+		check(same, "voronoiMatchesFullScan: values");
+		check(v->feld[g.nrows - 1 - 30][20] == 100, "voronoiMatchesFullScan: first of equal points");
+		delete v;
+	}
+
+	//! the bucket search sums the same points in the same order as a full scan
+	void shepardMatchesFullScan()
+	{
+		grid g(60, 80);
+		point p;
+		scatteredPoints(p, g);
+		double R = 75, mu = 2;
+		grid* s = p.p2g_shepard(&g, R, mu);
+
+		bool same = true;
+		for(int i = 0; i < g.nrows; i++)
+		{
+			double y = g.ycorner + g.csize*i;
+			for(int j = 0; j < g.ncols; j++)
+			{
+				double x = g.xcorner + g.csize*j;
+				double r = 0, rall = 0;
+				for(int k = 0; k < p.length; k++)
+				{
+					if(!insideGrid(p, g, k))
+						continue;
+					double l = sqrt((x - p.feld[k][0])*(x - p.feld[k][0])
+					                + (y - p.feld[k][1])*(y - p.feld[k][1]));
+					if(l < R)
+					{
+						double val = pow(1 - l/R, mu);
+						rall += val;
+						r += val*p.feld[k][2];
+					}
+				}
+				int row = g.nrows - 1 - i;
+				float expected = g.feld[row][j] != g.nodata && r != 0 && rall != 0
+					? float(r/rall) : float(g.nodata);
+				same = same && s->feld[row][j] == expected;
+			}
+		}
+		check(same, "shepardMatchesFullScan: values");
+		delete s;
+	}
+
+	//! the mask marks exactly the data fields, stat through it equals stat
+	void validityMaskStat()
+	{
+		// 130 columns span three words per row, the first word of the
+		// lower rows and everything right of column 100 hold no data
+		grid g(70, 130);
+		g.nodata = -9999;
+		for(int i = 0; i < g.nrows; i++)
+			for(int j = 0; j < g.ncols; j++)
+				g.feld[i][j] = (i >= 40 && j < 64) || j > 100 || (i*7 + j) % 11 == 0
+					? -9999 : float((i*31 + j*17) % 97) / 8;
+
+		validity_mask vm(g);
+		long n = 0;
+		bool bitsMatch = true, ascending = true;
+		for(int i = 0; i < g.nrows; i++)
+		{
+			int last = -1;
+			vm.for_each_valid(i, [&](int j){
+				ascending = ascending && j > last;
+				last = j;
+			});
+			for(int j = 0; j < g.ncols; j++)
+			{
+				bool valid = int(g.feld[i][j]) != g.nodata;
+				bitsMatch = bitsMatch && vm.is_valid(i, j) == valid;
+				n += valid;
+			}
+		}
+		check(bitsMatch, "validityMaskStat: bits");
+		check(ascending, "validityMaskStat: for_each_valid order");
+		check(vm.count() == n, "validityMaskStat: count");
+
+		g.stat();
+		float min = g.gridmin, max = g.gridmax, mean = g.gridmean, std = g.gridstd;
+		g.gridmin = g.gridmax = g.gridmean = g.gridstd = 0;
+		g.stat(vm);
+		check(g.gridmin == min && g.gridmax == max
+		      && g.gridmean == mean && g.gridstd == std,
+		      "validityMaskStat: stat");
+	}
+
+	//! grids written to a mapped grid file come back unchanged from its mapping
+	void mappedGridRoundTrip()
+	{
+		string file = "grid-tests-mapped.grd";
+		remove(file.c_str());
+
+		// 37 columns get padded to a stride of 48 in the file
+		grid* a = numbered(20, 37);
+		a->csize = 25;
+		a->xcorner = 4500000.5;
+		a->ycorner = 5800000.25;
+		a->nodata = -9999;
+		a->feld[3][5] = -9999;
+		grid* b = numbered(5, 3);
+		grid* c = numbered(5, 3);
+		c->feld[0][0] = 42;
+
+		check(writeMappedGrid(file, "1991", *a) && writeMappedGrid(file, "1992", *b),
+		      "mappedGridRoundTrip: written");
+		boost::shared_ptr<MappedFile> live;
+		grid* mlive = mapGrid(file, "1992", live);
+		struct stat before;
+		stat(file.c_str(), &before);
+		// rewriting a name replaces the file, the old mapping keeps its values
+		check(writeMappedGrid(file, "1992", *c), "mappedGridRoundTrip: rewritten");
+		check(mlive && mlive->feld[0][0] == 0 && mlive->feld[4][2] == 4002,
+		      "mappedGridRoundTrip: old mapping unchanged");
+		delete mlive;
+		live.reset();
+		for(int k = 0; k < 3; k++)
+			writeMappedGrid(file, "1992", k % 2 ? *b : *c);
+		struct stat after;
+		stat(file.c_str(), &after);
+		check(before.st_size == after.st_size, "mappedGridRoundTrip: no growth on rewrites");
+
+		vector<string> names = mappedGridNames(file);
+		check(names.size() == 2 && names[0] == "1991" && names[1] == "1992",
+		      "mappedGridRoundTrip: names");
+
+		boost::shared_ptr<MappedFile> mapping;
+		grid* ma = mapGrid(file, "1991", mapping);
+		check(ma && mapping, "mappedGridRoundTrip: mapped");
+		if(ma)
+		{
+			bool same = true;
+			for(int i = 0; i < a->nrows; i++)
+				for(int j = 0; j < a->ncols; j++)
+					same = same && ma->feld[i][j] == a->feld[i][j];
+			check(same && ma->nrows == a->nrows && ma->ncols == a->ncols,
+			      "mappedGridRoundTrip: values");
+			check(ma->csize == a->csize && ma->xcorner == a->xcorner
+			      && ma->ycorner == a->ycorner && ma->nodata == a->nodata,
+			      "mappedGridRoundTrip: geometry");
+
+			// the mapping is copy on write, the file keeps the written value
+			ma->feld[0][0] = -1;
+			boost::shared_ptr<MappedFile> other;
+			grid* again = mapGrid(file, "1991", other);
+			check(other == mapping, "mappedGridRoundTrip: shared mapping");
+			delete again;
+		}
+
+		boost::shared_ptr<MappedFile> mc;
+		grid* mb = mapGrid(file, "1992", mc);
+		check(mb && mb->nrows == 5 && mb->ncols == 3 && mb->feld[0][0] == 42
+		      && mb->feld[4][2] == 4002, "mappedGridRoundTrip: rewritten values");
+		delete mb;
+
+		boost::shared_ptr<MappedFile> none;
+		check(mapGrid(file, "1993", none) == NULL && !none, "mappedGridRoundTrip: unknown name");
+
+		delete ma;
+		mapping.reset();
+		mc.reset();
+
+		// a fresh mapping sees the file, not the change of the old one
+		boost::shared_ptr<MappedFile> fresh;
+		grid* fa = mapGrid(file, "1991", fresh);
+		check(fa && fa->feld[0][0] == a->feld[0][0], "mappedGridRoundTrip: copy on write");
+		delete fa;
+		fresh.reset();
+
+		delete a;
+		delete b;
+		delete c;
+		remove(file.c_str());
+		remove((file + ".lock").c_str());
+	}
+
+	//! a depression inside a basin drains over the filled flat to the outlet
+	void depressionDrainsToOutlet()
+	{
+		// a 7 x 7 basin with a rim of height 10, the outlet at (3,6) and a
+		// pit at (3,3) inside the plain of height 5
+		grid g(7, 7);
+		g.nodata = -9999;
+		for(int i = 0; i < g.nrows; i++)
+			for(int j = 0; j < g.ncols; j++)
+				g.feld[i][j] = i == 0 || j == 0 || i == 6 || j == 6 ? 10 : 5;
+		g.feld[3][6] = 0;
+		g.feld[3][3] = 1;
+		g.feld[2][2] = 4;
+
+		grid* acc = g.w_flowaccumulation();
+		// the outlet gets itself and the 25 cells of the plain
+		check(acc->feld[3][6] == 26, "depressionDrainsToOutlet: outlet");
+		bool all = true;
+		for(int i = 1; i < 6; i++)
+			for(int j = 1; j < 6; j++)
+				all = all && acc->feld[i][j] >= 1;
+		check(all && acc->feld[3][5] > 1, "depressionDrainsToOutlet: plain");
+		check(acc->feld[0][0] == 1 && acc->feld[2][6] == 1, "depressionDrainsToOutlet: rim");
+		delete acc;
+
+		// the same with a nodata hole next to the plain, which is an outlet too
+		g.feld[3][6] = 10;
+		g.feld[1][3] = g.nodata;
+		acc = g.w_flowaccumulation();
+		check(int(acc->feld[1][3]) == g.nodata, "depressionDrainsToOutlet: nodata");
+		// the 24 cells of the plain leave through the cells next to the hole
+		float out = 0;
+		for(int i = 1; i < 6; i++)
+			for(int j = 1; j < 6; j++)
+			{
+				bool nextToHole = abs(i - 1) <= 1 && abs(j - 3) <= 1 && !(i == 1 && j == 3);
+				if(nextToHole)
+					out += acc->feld[i][j];
+			}
+		check(out == 24, "depressionDrainsToOutlet: into the hole");
+		delete acc;
+	}
+
+	//! skewed values from a fixed seed, exp of a sum of uniform numbers
+	vector<double> skewedValues(int n)
+	{
+		vector<double> vs;
+		unsigned int seed = 815;
+		for(int i = 0; i < n; i++)
+		{
+			double u = 0;
+			for(int k = 0; k < 4; k++)
+			{
+				seed = seed*1103515245 + 12345;
+				u += double(seed >> 8) / double(1 << 24);
+			}
+			vs.push_back(exp(2*u) + 1000);
+		}
+		return vs;
+	}
+
+	bool near(double a, double b, double eps)
+	{
+		return fabs(a - b) <= eps*max(1.0, fabs(b));
+	}
+
+	//! three merged parts give the statistics of a two pass calculation
+	void runningStatsMerged()
+	{
+		vector<double> vs = skewedValues(10000);
+		RunningStats parts[3], empty;
+		for(size_t i = 0; i < vs.size(); i++)
+			parts[i < 10 ? 0 : i < 6000 ? 1 : 2].add(vs[i]);
+		parts[0].merge(empty);
+		parts[0].merge(parts[1]);
+		parts[0].merge(parts[2]);
+		empty.merge(parts[0]);
+
+		double sum = 0, ss = 0;
+		for(size_t i = 0; i < vs.size(); i++)
+			sum += vs[i];
+		double mean = sum / vs.size();
+		for(size_t i = 0; i < vs.size(); i++)
+			ss += (vs[i] - mean)*(vs[i] - mean);
+
+		check(empty.count() == 10000, "runningStatsMerged: count");
+		check(near(empty.mean(), mean, 1e-12), "runningStatsMerged: mean");
+		check(near(empty.variance(), ss / (vs.size() - 1), 1e-9), "runningStatsMerged: variance");
+		check(empty.min() == *min_element(vs.begin(), vs.end())
+		      && empty.max() == *max_element(vs.begin(), vs.end()),
+		      "runningStatsMerged: min max");
+	}
+
+	//! exact quantiles (Hazen) while the sketch holds single values, within
+	//! the stated rank error after merging compressed sketches
+	void quantileSketchBounds()
+	{
+		vector<double> vs = skewedValues(100);
+		QuantileSketch exact;
+		for(size_t i = 0; i < vs.size(); i++)
+			exact.add(vs[i]);
+		vector<double> sorted(vs);
+		sort(sorted.begin(), sorted.end());
+		int n = int(sorted.size());
+		bool same = exact.maxQuantileError() == 0;
+		for(double q = 0; q <= 1; q += 0.01)
+		{
+			double h = q*n - 0.5;
+			double expected = h <= 0 ? sorted[0] : h >= n - 1 ? sorted[n - 1]
+				: sorted[int(h)] + (h - int(h))*(sorted[int(h) + 1] - sorted[int(h)]);
+			same = same && near(exact.quantile(q), expected, 1e-12);
+		}
+		check(same, "quantileSketchBounds: exact");
+
+		vs = skewedValues(50000);
+		QuantileSketch parts[4];
+		for(size_t i = 0; i < vs.size(); i++)
+			parts[i % 4].add(vs[i]);
+		for(int k = 1; k < 4; k++)
+			parts[0].merge(parts[k]);
+		const QuantileSketch& qs = parts[0];
+		sorted = vs;
+		sort(sorted.begin(), sorted.end());
+		n = int(sorted.size());
+		double e = qs.maxQuantileError();
+		bool within = qs.count() == n && e > 0 && e < 0.04
+			&& qs.min() == sorted[0] && qs.max() == sorted[n - 1];
+		for(double q = 0.01; q < 1; q += 0.01)
+		{
+			double v = qs.quantile(q);
+			// ranks the returned value could have in the sorted data
+			double lo = lower_bound(sorted.begin(), sorted.end(), v) - sorted.begin();
+			double hi = upper_bound(sorted.begin(), sorted.end(), v) - sorted.begin();
+			within = within && hi >= (q - e)*n && lo <= (q + e)*n;
+		}
+		check(within, "quantileSketchBounds: merged");
+
+		BoxPlotInfo bpi = qs.boxPlotInfo();
+		check(bpi.median == qs.quantile(0.5) && bpi.Q25 == qs.quantile(0.25)
+		      && bpi.Q75 == qs.quantile(0.75), "quantileSketchBounds: box plot");
+	}
+
+	//! per cell statistics of grids, two halves merged, equal those of
+	//! the stored values of the cells
+	void gridStatisticsMerged()
+	{
+		int rows = 20, cols = 30, noOfGrids = 31;
+		vector<double> values(size_t(rows)*cols*noOfGrids);
+		GridStatistics halves[2] = {GridStatistics(50), GridStatistics(50)};
+		grid g(rows, cols);
+		g.nodata = -9999;
+		for(int k = 0; k < noOfGrids; k++)
+		{
+			for(int i = 0; i < rows; i++)
+				for(int j = 0; j < cols; j++)
+				{
+					// the first column has no data, the second only in every third grid
+					bool nodata = j == 0 || (j == 1 && k % 3 != 0);
+					float v = float((i*37 + j*11 + k*k*7) % 101) / 4;
+					g.feld[i][j] = nodata ? -9999 : v;
+					values[(size_t(i)*cols + j)*noOfGrids + k] = nodata ? -9999 : v;
+				}
+			halves[k % 2].add(GridP(g));
+		}
+		halves[0].merge(halves[1]);
+		const GridStatistics& gs = halves[0];
+		check(gs.count() == noOfGrids, "gridStatisticsMerged: count");
+
+		GridPPtr counts = gs.counts(), mean = gs.mean(), var = gs.variance(),
+				min = gs.min(), max = gs.max(), median = gs.median(), q90 = gs.quantile(0.9);
+		bool same = true;
+		for(int i = 0; i < rows; i++)
+			for(int j = 0; j < cols; j++)
+			{
+				vector<double> vs;
+				for(int k = 0; k < noOfGrids; k++)
+				{
+					double v = values[(size_t(i)*cols + j)*noOfGrids + k];
+					if(int(v) != -9999)
+						vs.push_back(v);
+				}
+				if(vs.empty())
+				{
+					same = same && counts->isNoDataField(i, j) && mean->isNoDataField(i, j)
+						&& median->isNoDataField(i, j);
+					continue;
+				}
+				double sum = 0, ss = 0;
+				for(size_t k = 0; k < vs.size(); k++)
+					sum += vs[k];
+				double m = sum / vs.size();
+				for(size_t k = 0; k < vs.size(); k++)
+					ss += (vs[k] - m)*(vs[k] - m);
+				sort(vs.begin(), vs.end());
+				// exact Hazen quantiles, as there are fewer values than centroids
+				int n = int(vs.size());
+				auto hazen = [&](double q)
+				{
+					double h = q*n - 0.5;
+					return h <= 0 ? vs[0] : h >= n - 1 ? vs[n - 1]
+						: vs[int(h)] + (h - int(h))*(vs[int(h) + 1] - vs[int(h)]);
+				};
+				same = same && counts->dataAt(i, j) == n
+					&& near(mean->dataAt(i, j), m, 1e-6)
+					&& near(var->dataAt(i, j), n > 1 ? ss / (n - 1) : 0, 1e-5)
+					&& min->dataAt(i, j) == vs.front() && max->dataAt(i, j) == vs.back()
+					&& near(median->dataAt(i, j), hazen(0.5), 1e-6)
+					&& near(q90->dataAt(i, j), hazen(0.9), 1e-6);
+			}
+		check(same, "gridStatisticsMerged: cells");
+
+		GridStatistics none;
+		none.add(GridP(g));
+		check(!none.quantile(0.5), "gridStatisticsMerged: no quantiles");
+		grid other(rows + 1, cols);
+		none.add(GridP(other));
+		check(none.count() == 1, "gridStatisticsMerged: other shape rejected");
+	}
+
+	//! what write_ascii writes, read_ascii reads back
+	void asciiRoundTrip()
+	{
+		string file = "grid-tests-round-trip.asc";
+		grid* g = numbered(7, 5);
+		g->feld[0][0] = -9999;
+		g->feld[3][2] = 0.125f;
+		g->feld[6][4] = -2.5f;
+		g->xcorner = 4500000.5;
+		g->ycorner = 5600000.25;
+		g->csize = 100;
+		g->nodata = -9999;
+		g->write_ascii((char*)file.c_str());
+
+		grid r(100);
+		check(r.read_ascii(file.c_str()) == 0, "asciiRoundTrip: read");
+		check(r.nrows == 7 && r.ncols == 5, "asciiRoundTrip: size");
+		check(r.xcorner == g->xcorner && r.ycorner == g->ycorner
+		      && r.csize == g->csize && r.nodata == g->nodata, "asciiRoundTrip: header");
+		bool same = r.nrows == 7 && r.ncols == 5;
+		for(int i = 0; same && i < 7; i++)
+			for(int j = 0; j < 5; j++)
+				same = same && r.feld[i][j] == g->feld[i][j];
+		check(same, "asciiRoundTrip: values");
+
+		delete g;
+		remove(file.c_str());
+	}
+
+	//! the cells are written exactly like fprintf("%4.3f ") did
+	void asciiWritesLikeFprintf()
+	{
+		string file = "grid-tests-fprintf.asc";
+		const float vs[] = {0.0625f, 0.1875f, -0.0625f, -0.0f, -0.0001f, 0.0005f,
+		                    123.4565f, -9999, 1e10f, 3e38f, -3e38f, 1e-40f};
+		const int n = sizeof(vs)/sizeof(vs[0]);
+		grid g(1, n);
+		for(int j = 0; j < n; j++)
+			g.feld[0][j] = vs[j];
+		g.write_ascii((char*)file.c_str());
+
+		string expected;
+		char buf[64];
+		for(int j = 0; j < n; j++)
+		{
+			snprintf(buf, sizeof(buf), "%4.3f ", vs[j]);
+			expected += buf;
+		}
+		expected += "\n";
+
+		string line, last;
+		ifstream in(file.c_str());
+		while(getline(in, line))
+			last = line;
+		check(last + "\n" == expected, "asciiWritesLikeFprintf: " + last);
+
+		remove(file.c_str());
+	}
+
+	//! the header keywords are case insensitive
+	void asciiUpperCaseHeader()
+	{
+		string file = "grid-tests-upper-case.asc";
+		FILE* f = fopen(file.c_str(), "w");
+		fprintf(f, "NCOLS 2\nNROWS 2\nXLLCORNER 10\nYLLCORNER 20\n"
+		        "CELLSIZE 50\nNODATA_VALUE -1\n1 2\n3 4\n");
+		fclose(f);
+
+		grid r(50);
+		check(r.read_ascii(file.c_str()) == 0, "asciiUpperCaseHeader: read");
+		check(r.nrows == 2 && r.ncols == 2 && r.xcorner == 10 && r.ycorner == 20
+		      && r.csize == 50 && r.nodata == -1, "asciiUpperCaseHeader: header");
+		check(r.nrows == 2 && r.ncols == 2 && r.feld[0][1] == 2 && r.feld[1][0] == 3,
+		      "asciiUpperCaseHeader: values");
+
+		remove(file.c_str());
+	}
+
+	//! the transform function is called serially in row order unless the
+	//! parallel variant is asked for, so it may keep state
+	void transformSerialUnlessAsked()
+	{
+		set_grid_threads(4);
+		GridP g(numbered(50, 30));
+		int calls = 0;
+		bool inOrder = true;
+		float last = -1;
+		GridPPtr t = g.transform([&](float v)
+		{
+			calls++;
+			inOrder = inOrder && v > last;
+			last = v;
+			return v + 1;
+		});
+		check(calls == 50*30 && inOrder, "transformSerialUnlessAsked: serial calls");
+
+		calls = 0;
+		last = -1;
+		g.transformInPlace([&](float v)
+		{
+			calls++;
+			inOrder = inOrder && v > last;
+			last = v;
+			return v;
+		});
+		check(calls == 50*30 && inOrder, "transformSerialUnlessAsked: serial in place");
+
+		GridPPtr p = g.transform([](float v){ return v + 1; }, true);
+		bool same = true;
+		for(int r = 0; r < 50; r++)
+			for(int c = 0; c < 30; c++)
+				same = same && p->dataAt(r, c) == t->dataAt(r, c);
+		check(same, "transformSerialUnlessAsked: parallel values");
+		set_grid_threads(0);
+	}
+
+	//! the prefetch stage (simulated I/O, 1ms sleep per job) overlaps with
+	//! the worker (3ms busy per job), so the worker hardly waits and the run
+	//! takes about as long as the processing alone
+	void pipelineKeepsWorkersBusy()
+	{
+		typedef chrono::steady_clock Clock;
+		auto busyFor = [](double ms)
+		{
+			Clock::time_point end = Clock::now()
+				+ chrono::microseconds(int(ms*1000));
+			while(Clock::now() < end)
+				;
+		};
+
+		const int noOfJobs = 100;
+		vector<int> jobs;
+		for(int i = 0; i < noOfJobs; i++)
+			jobs.push_back(i);
+		vector<int> results(noOfJobs, -1);
+
+		Pipeline<int, int, int> pipeline(
+			[](const int& j){ this_thread::sleep_for(chrono::milliseconds(1)); return j; },
+			[&](const int& j){ busyFor(3); return 2*j; },
+			[&](const int& j, const int& r){ results[j] = r; },
+			1, 4);
+
+		Clock::time_point start = Clock::now();
+		pipeline.run(jobs);
+		double secs = chrono::duration<double>(Clock::now() - start).count();
+
+		bool all = true;
+		for(int i = 0; i < noOfJobs; i++)
+			all = all && results[i] == 2*i;
+		check(all, "pipelineKeepsWorkersBusy: results");
+
+		const vector<StageStatistics>& stats = pipeline.statistics();
+		check(stats.size() == 3 && stats.at(1).noOfItems == unsigned(noOfJobs),
+		      "pipelineKeepsWorkersBusy: items");
+		check(stats.at(1).utilisation() > 0.9,
+		      "pipelineKeepsWorkersBusy: worker utilisation");
+		// sequentially it would take at least 4ms per job
+		check(secs < noOfJobs*0.004*0.9, "pipelineKeepsWorkersBusy: overlapped");
+	}
+
+	/*!
+	 * known points (Berlin and Leipzig in GK5, Buenos Aires in UTM21S) are
+	 * projected to the meter and back, one by one and in a batch
+	 */
+	void coordTransKnownPoints()
+	{
+		vector<LatLngCoord> llcs;
+		llcs.push_back(LatLngCoord(52.52, 13.40));
+		llcs.push_back(LatLngCoord(51.0, 12.0));
+		double rs[] = {5391531.4, 5289561.8};
+		double hs[] = {5821962.8, 5655926.2};
+
+		vector<RectCoord> rcs = latLng2RC(llcs);
+		check(rcs.size() == 2, "coordTransKnownPoints: batch size");
+		for(size_t i = 0; i < rcs.size() && i < 2; i++)
+		{
+			RectCoord single = latLng2RC(llcs[i]);
+			check(fabs(rcs[i].r - rs[i]) < 1 && fabs(rcs[i].h - hs[i]) < 1,
+			      "coordTransKnownPoints: GK5");
+			check(single.r == rcs[i].r && single.h == rcs[i].h
+			      && single.coordinateSystem == GK5_EPSG31469,
+			      "coordTransKnownPoints: batch like single");
+		}
+
+		vector<LatLngCoord> back = RC2latLng(rcs);
+		bool roundTrip = back.size() == llcs.size();
+		for(size_t i = 0; roundTrip && i < back.size(); i++)
+			roundTrip = fabs(back[i].lat - llcs[i].lat) < 1e-7
+					&& fabs(back[i].lng - llcs[i].lng) < 1e-7;
+		check(roundTrip, "coordTransKnownPoints: GK5 round trip");
+
+		LatLngCoord ba(-34.6, -58.4);
+		RectCoord utm = latLng2RC(ba, UTM21S_EPSG32721);
+		check(fabs(utm.r - 371624.5) < 1 && fabs(utm.h - 6170423.2) < 1,
+		      "coordTransKnownPoints: UTM21S");
+		LatLngCoord baBack = RC2latLng(utm);
+		check(fabs(baBack.lat - ba.lat) < 1e-7 && fabs(baBack.lng - ba.lng) < 1e-7,
+		      "coordTransKnownPoints: UTM21S round trip");
+	}
+
+#ifndef NO_HDF5
+	//! an outdated dataset (e.g. an overview level) can be replaced in its file
+	void replaceHdfDataset()
+	{
+		string file = "grid-tests-replace.h5";
+		float first[4] = {1, 2, 3, 4};
+		float second[4] = {5, 6, 7, 8};
+		{
+			hdf5 hd;
+			hd.create_f(file.c_str());
+			hd.write_f_feld("level", first, 2, 2);
+			hd.write_l_attribute("time", 1);
+		}
+		{
+			hdf5 hd;
+			check(hd.open_f(file.c_str()) == 0 && hd.open_d("level") == 0,
+			      "replaceHdfDataset: written");
+			check(hd.get_l_attribute("time") == 1, "replaceHdfDataset: first time");
+			check(hd.delete_d("level") == 0, "replaceHdfDataset: deleted");
+			check(hd.open_d("level") != 0, "replaceHdfDataset: gone");
+			hd.write_f_feld("level", second, 2, 2);
+			hd.write_l_attribute("time", 2);
+		}
+		{
+			hdf5 hd;
+			check(hd.open_f(file.c_str()) == 0 && hd.open_d("level") == 0,
+			      "replaceHdfDataset: rewritten");
+			check(hd.get_l_attribute("time") == 2, "replaceHdfDataset: second time");
+			float read[4] = {0, 0, 0, 0};
+			hd.read_f_feld("level", read, 2, 2, 2);
+			check(read[0] == 5 && read[3] == 8, "replaceHdfDataset: values");
+		}
+		remove(file.c_str());
+	}
+
+	long fileSize(const string& file)
+	{
+		FILE* f = fopen(file.c_str(), "rb");
+		if(!f)
+			return -1;
+		fseek(f, 0, SEEK_END);
+		long size = ftell(f);
+		fclose(f);
+		return size;
+	}
+
+	//! rewriting a dataset of the same size (an outdated overview level)
+	//! replaces it in place, so the file doesn't grow
+	void overwriteHdfInPlace()
+	{
+		string file = "./grid-tests-overwrite.h5";
+		remove(file.c_str());
+		GridP g(numbered(60, 80));
+		check(g.writeHdf(file, "level", "test", 1), "overwriteHdfInPlace: written");
+		long size = fileSize(file);
+		check(!g.writeHdf(file, "level", "test", 2), "overwriteHdfInPlace: kept");
+
+		for(int k = 2; k <= 6; k++)
+		{
+			g.gridRef().feld[0][0] = float(k);
+			check(g.writeHdf(file, "level", "test", k, true),
+			      "overwriteHdfInPlace: overwritten");
+		}
+		check(fileSize(file) == size, "overwriteHdfInPlace: same file size");
+
+		GridP r("level", GridP::HDF, file);
+		check(r.rows() == 60 && r.cols() == 80 && r.dataAt(0, 0) == 6
+		      && r.dataAt(59, 79) == 59*1000 + 79, "overwriteHdfInPlace: values");
+		{
+			hdf5 hd;
+			check(hd.open_f(file.c_str()) == 0 && hd.open_d("level") == 0
+			      && hd.get_l_attribute("time") == 6, "overwriteHdfInPlace: time");
+		}
+
+		GridP other(numbered(30, 80));
+		check(!other.writeHdf(file, "level", "test", 7, true),
+		      "overwriteHdfInPlace: other size not overwritten");
+		remove(file.c_str());
+	}
+
+	//! tiles and whole grids are read from several threads at once, the
+	//! accesses to the hdf library are serialized by the HdfLock
+	void concurrentHdfReads()
+	{
+		string file = "./grid-tests-concurrent.h5";
+		remove(file.c_str());
+		GridP g(numbered(300, 200));
+		g.writeHdf(file, "values", "test", 1);
+		g.writeHdf(file, "other", "test", 1);
+
+		TiledGridP tg("values", file, Tools::GK5_EPSG31469, 16, 8);
+		const int noOfThreads = 8;
+		vector<int> wrong(noOfThreads, 0);
+		vector<thread> ts;
+		for(int t = 0; t < noOfThreads; t++)
+			ts.push_back(thread([&, t]()
+			{
+				for(int k = 0; k < 200; k++)
+				{
+					int row = (k*37 + t*11) % 300, col = (k*53 + t*7) % 200;
+					if(tg.dataAt(row, col) != row*1000 + col)
+						wrong[t]++;
+					if(k % 50 == 0)
+					{
+						GridP w("other", GridP::HDF, file);
+						if(w.rows() != 300 || w.dataAt(299, 199) != 299*1000 + 199)
+							wrong[t]++;
+					}
+				}
+			}));
+		for(size_t t = 0; t < ts.size(); t++)
+			ts[t].join();
+
+		int noOfWrong = 0;
+		for(int t = 0; t < noOfThreads; t++)
+			noOfWrong += wrong[t];
+		check(noOfWrong == 0, "concurrentHdfReads: values");
+		check(tg.noOfTileReads() > 8, "concurrentHdfReads: tiles evicted and reread");
+		remove(file.c_str());
+	}
+
+	//! a dataset which can't be created is reported instead of being
+	//! treated as written
+	void writeHdfReportsFailure()
+	{
+		string file = "./grid-tests-write-failure.h5";
+		remove(file.c_str());
+		grid* g = numbered(4, 6);
+		check(g->write_hdf((char*)file.c_str(), (char*)"values",
+		                   (char*)"test", (char*)"test"), "writeHdfReportsFailure: written");
+		{
+			hdf5 hd;
+			check(hd.open_f(file.c_str()) == 0
+			      && hd.write_f_feld("values", g->data, 4, 6, g->stride) != 0,
+			      "writeHdfReportsFailure: existing dataset");
+		}
+		// the group "missing" doesn't exist, so the dataset can't be created
+		check(!g->write_hdf((char*)file.c_str(), (char*)"missing/values",
+		                    (char*)"test", (char*)"test"), "writeHdfReportsFailure: grid");
+		GridP gp(g);
+		check(!gp.writeHdf(file, "missing/values", "test", 1),
+		      "writeHdfReportsFailure: GridP");
+		remove(file.c_str());
+	}
+
+	//! a block lands in its strided buffer rows, the padding stays untouched
+	void readHdfBlock()
+	{
+		string file = "grid-tests-block.h5";
+		int nx = 30, ny = 40;
+		vector<float> all(nx*ny);
+		for(int i = 0; i < nx; i++)
+			for(int j = 0; j < ny; j++)
+				all[i*ny + j] = i*1000 + j;
+		{
+			hdf5 hd;
+			hd.create_f(file.c_str());
+			hd.write_f_feld("values", &all[0], nx, ny);
+		}
+
+		hdf5 hd;
+		check(hd.open_f(file.c_str()) == 0 && hd.open_d("values") == 0,
+		      "readHdfBlock: written");
+		int row = 7, col = 11, rows = 5, cols = 9, stride = 12;
+		vector<float> block(rows*stride, -1);
+		check(hd.read_f_block(&block[0], nx, ny, row, col, rows, cols, stride) == 0,
+		      "readHdfBlock: read");
+		bool same = true;
+		for(int i = 0; i < rows; i++)
+			for(int j = 0; j < stride; j++)
+				same = same && block[i*stride + j] == (j < cols ? (row + i)*1000 + col + j : -1);
+		check(same, "readHdfBlock: values");
+
+		// the last row and column of the dataset
+		float corner = 0;
+		check(hd.read_f_block(&corner, nx, ny, nx - 1, ny - 1, 1, 1, 1) == 0
+		      && corner == (nx - 1)*1000 + ny - 1, "readHdfBlock: corner");
+
+		check(hd.read_f_block(&block[0], nx, ny, nx - 2, col, rows, cols, stride) != 0,
+		      "readHdfBlock: past the last row");
+		check(hd.read_f_block(&block[0], nx, ny, row, col, rows, cols, cols - 1) != 0,
+		      "readHdfBlock: stride too small");
+		check(hd.read_f_block(&block[0], nx + 1, ny, row, col, rows, cols, stride) != 0,
+		      "readHdfBlock: wrong dimensions");
+		remove(file.c_str());
+	}
+#endif
+}
+
+int main()
+{
+	copySubView();
+	memorySizeOfViews();
+	voronoiMatchesFullScan();
+	shepardMatchesFullScan();
+	validityMaskStat();
+	depressionDrainsToOutlet();
+	mappedGridRoundTrip();
+	runningStatsMerged();
+	quantileSketchBounds();
+	gridStatisticsMerged();
+	asciiRoundTrip();
+	asciiUpperCaseHeader();
+	asciiWritesLikeFprintf();
+	transformSerialUnlessAsked();
+	pipelineKeepsWorkersBusy();
+	coordTransKnownPoints();
+#ifndef NO_HDF5
+	replaceHdfDataset();
+	readHdfBlock();
+	overwriteHdfInPlace();
+	writeHdfReportsFailure();
+	concurrentHdfReads();
+#endif
+
+	if(failures == 0)
+		cout << "all grid tests passed" << endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -26,6 +26,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <cstdio>
 #include <cstring>
+#include <new>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <atomic>
 //#include <gsl/gsl_linalg.h>
 //#include <gsl/gsl_vector.h>
 //#include <gsl/gsl_matrix.h>
@@ -106,6 +112,114 @@ typedef mapType::value_type ValuePair;
 typedef map<int,double> doubleMap;
 typedef doubleMap::value_type doublePair;
 
+namespace
+{
+	atomic<int> grid_thread_count(0);
+
+	// uniform bucket grid over points (x=p[k][0], y=p[k][1]) for radius and
+	// nearest neighbour queries, about two points per bucket, the indices
+	// in a bucket are kept in ascending order
+	struct point_buckets{
+		point_buckets(double** p, const vector<int>& ids,
+		              double x0, double y0, double width, double height)
+		: pts(p), bx0(x0), by0(y0), bcols(1), brows(1), bsize(1)
+		{
+			double area=width*height;
+			if(!ids.empty() && area>0)
+				bsize=sqrt(area/ids.size()*2);
+			else
+				bsize=width>height ? width : height;
+			if(bsize<=0) bsize=1;
+			bcols=int(width/bsize)+1;
+			brows=int(height/bsize)+1;
+			buckets.resize(size_t(bcols)*brows);
+			for(size_t i=0; i<ids.size(); i++)
+				buckets[size_t(row_of(pts[ids[i]][1]))*bcols+col_of(pts[ids[i]][0])].push_back(ids[i]);
+		}
+		int col_of(double x) const {
+			int c=int(floor((x-bx0)/bsize));
+			return c<0 ? 0 : c>=bcols ? bcols-1 : c;
+		}
+		int row_of(double y) const {
+			int r=int(floor((y-by0)/bsize));
+			return r<0 ? 0 : r>=brows ? brows-1 : r;
+		}
+		// indices (ascending) of all points, which may be closer than r to (x,y)
+		void within(double x, double y, double r, vector<int>& res) const {
+			res.clear();
+			int c0=col_of(x-r), c1=col_of(x+r), r0=row_of(y-r), r1=row_of(y+r);
+			for(int br=r0; br<=r1; br++)
+				for(int bc=c0; bc<=c1; bc++){
+					const vector<int>& b=buckets[size_t(br)*bcols+bc];
+					res.insert(res.end(),b.begin(),b.end());
+				}
+			sort(res.begin(),res.end());
+		}
+		// index of the point nearest to (x,y) (the lowest index among equally
+		// near ones), dist(x,y,k) has to be the distance used by the caller
+		template<class D>
+		int nearest(double x, double y, D dist) const {
+			int bc=col_of(x), br=row_of(y), best=-1;
+			double bestd=0;
+			int maxring=bcols>brows ? bcols : brows;
+			for(int d=0; d<=maxring; d++){
+				for(int rr=br-d; rr<=br+d; rr++){
+					if(rr<0 || rr>=brows) continue;
+					bool edge=(rr==br-d || rr==br+d);
+					for(int cc=bc-d; cc<=bc+d; cc+=(edge || d==0) ? 1 : 2*d){
+						if(cc<0 || cc>=bcols) continue;
+						const vector<int>& b=buckets[size_t(rr)*bcols+cc];
+						for(size_t i=0; i<b.size(); i++){
+							double l=dist(b[i]);
+							if(best<0 || l<bestd || (l==bestd && b[i]<best)){
+								bestd=l;
+								best=b[i];
+							}
+						}
+					}
+				}
+				// points in further rings are at least d*bsize away
+				if(best>=0 && bestd<d*bsize*(1-1e-9)) break;
+			}
+			return best;
+		}
+		double** pts;
+		double bx0, by0;
+		int bcols, brows;
+		double bsize;
+		vector<vector<int> > buckets;
+	};
+}
+
+void Grids::set_grid_threads(int n)
+{
+	grid_thread_count=n<0 ? 0 : n;
+}
+
+int Grids::grid_threads()
+{
+	int n=grid_thread_count;
+	if(n<=0) n=int(thread::hardware_concurrency());
+	return n<1 ? 1 : n;
+}
+
+void Grids::parallel_rows(int n, const function<void(int,int)>& f)
+{
+	int nthreads=grid_threads();
+	if(nthreads>n) nthreads=n;
+	if(nthreads<=1){
+		if(n>0) f(0,n);
+		return;
+	}
+	vector<thread> pool;
+	for(int t=1; t<nthreads; t++)
+		pool.push_back(thread(f,int((long long)n*t/nthreads),
+		                      int((long long)n*(t+1)/nthreads)));
+	f(0,n/nthreads);
+	for(size_t t=0; t<pool.size(); t++)
+		pool[t].join();
+}
+
 int dcompare(const void* e1, const void* e2)
 {
 	double* v1=(double*)e1;
@@ -118,6 +232,9 @@ grid::grid(int rg)
 {
 	rgr = rg;       // setze Rastergroesse
 	feld=(float**)NULL;
+	data=(float*)NULL;
+	buffer=(char*)NULL;
+	stride=0;
 	has_nodata = UNKNOWN;
   nrows = 0;
   ncols = 0;
@@ -126,6 +243,10 @@ grid::grid(int rg)
 grid::grid(int rows, int cols)
 {
 	rgr = 1;       // setze Rastergroesse
+	feld=(float**)NULL;
+	data=(float*)NULL;
+	buffer=(char*)NULL;
+	stride=0;
 	has_nodata = UNKNOWN;
 	variance1=variance2=covariance=0.0;
 	nrows=rows;
@@ -133,16 +254,7 @@ grid::grid(int rows, int cols)
 	csize=1.0;
 	nodata=-9999;
 	xcorner=ycorner=0.0;
-	feld= new float*[nrows];
-	//   cerr << nrows << " " << ncols << " feld=" << feld << endl;
-	if(feld==NULL)
-		cerr << "no sufficient memory" << endl;
-	for(int i=0; i<nrows; i++){
-		if((feld[i]= new float[ncols])==NULL){
-			cerr << "no sufficient memory" << endl;
-		}
-		//	cerr << "feld[" << i << "]=" << feld[i] << endl;
-	}
+	alloc_feld(nrows, ncols);
 	time_t now = time(NULL);
 	srand(now);
 	for(int i=0; i<rows; i++){
@@ -154,12 +266,45 @@ grid::grid(int rows, int cols)
 
 grid::~grid()       // Freigabe inneres Feld
 {
-	if(feld!=(float**)NULL){
-		for(int i=0; i<nrows; i++){
-			delete [] feld[i];
-		}
-		delete [] feld;
+	free_feld();
+}
+
+// the field is one contiguous block of memory aligned to 64 bytes,
+// every row starts at a 64 byte boundary, feld[i] points to row i
+void grid::alloc_feld(int rows, int cols)
+{
+	free_feld();
+	if(rows <= 0 || cols <= 0)
+		return;
+	stride=(cols+15) & ~15;
+	size_t bytes=size_t(rows)*stride*sizeof(float);
+	buffer=new (nothrow) char[bytes+63];
+	feld=new (nothrow) float*[rows];
+	if(buffer==NULL || feld==NULL){
+		cerr << "error (alloc_feld): no sufficient memory" << endl;
+		exit(2);
 	}
+	data=(float*)(((size_t)buffer+63) & ~(size_t)63);
+	for(int i=0; i<rows; i++)
+		feld[i]=data+size_t(i)*stride;
+}
+
+void grid::free_feld()
+{
+	delete [] feld;
+	delete [] buffer;
+	feld=(float**)NULL;
+	data=(float*)NULL;
+	buffer=(char*)NULL;
+	stride=0;
+}
+
+size_t grid::memory_size() const
+{
+	size_t bytes=feld==NULL ? 0 : size_t(nrows)*sizeof(float*);
+	if(buffer!=NULL)
+		bytes+=size_t(nrows)*stride*sizeof(float)+63;
+	return bytes;
 }
 
 grid* Grids::read_xyz(const char* name,grid* g1)
@@ -251,94 +396,6 @@ grid* Grids::read_xyz(const char* name,grid* g1)
 	return a1;
 }
 
-int grid::read_ascii(const char* name)
-{
-	char buf[255];
-	float val1;
-	ifstream file1(name);
-	if(!file1){
-		cerr << "error (read_ascii): can not open inputfile: " << name << endl;
-		file1.close();
-		return(-1);
-	}
-	if(feld!=(float**)NULL){
-		for(int i=0; i<nrows; i++){
-			delete [] feld[i];
-		}
-	}
-	file1 >> buf >> ncols;
-	if(strncmp(buf,"ncols",5)!=0){
-		cerr << "error (read_ascii): not an ASCII-Grid: " << name << endl;
-		file1.close();
-		return(-2);
-	}
-	file1 >> buf >> nrows;
-	file1 >> buf >> xcorner;
-	file1 >> buf >> ycorner;
-	file1 >> buf >> csize;
-	file1 >> buf >> nodata;
-	// allocate memory
-	if(nrows <= 0 || ncols <= 0) return -2;
-	feld= new float*[nrows];
-	for(int i=0; i<nrows; i++){
-		if((feld[i]= new float[ncols])==NULL){
-			cerr << "error (read_ascii): no sufficient memory" << endl;
-		}
-	}
-	// read_in
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			file1 >> val1;
-			feld[i][j]=val1;
-		}
-	}
-	file1.close();
-	return 0;
-}
-
-int grid::read_ascii_inv(const char* name)
-{
-	char buf[255];
-	float val1;
-	ifstream file1(name);
-	if(!file1){
-		cerr << "errot (read_ascii): can not open inputfile: " << name << endl;
-		return(-1);
-	}
-	if(feld!=(float**)NULL){
-		for(int i=0; i<nrows; i++){
-			delete [] feld[i];
-		}
-	}
-	file1 >> buf >> ncols;
-	if(strncmp(buf,"ncols",5)!=0){
-		cerr << "error (read_ascii): not a ASCII-Grid: " << name << endl;
-		return(-2);
-	}
-	file1 >> buf >> nrows;
-	file1 >> buf >> xcorner;
-	file1 >> buf >> ycorner;
-	file1 >> buf >> csize;
-	file1 >> buf >> nodata;
-	// allocate memory
-	if(nrows <= 0 || ncols <= 0) return -2;
-	feld= new float*[nrows];
-	for(int i=0; i<nrows; i++){
-		if((feld[i]= new float[ncols])==NULL){
-			cerr << "error (read_ascii): no sufficient memory" << endl;
-		}
-	}
-	// read_in
-	for(int i=nrows-1; i>=0; i--){
-		for(int j=ncols-1; j>=0; j--){
-			file1 >> val1;
-			feld[i][j]=val1;
-		}
-	}
-	file1.close();
-	return 0;
-}
-
 grid* grid::grid_copy()
 {
 	grid* gx = new grid((int)csize);
@@ -348,51 +405,143 @@ grid* grid::grid_copy()
 	gx->ycorner = ycorner;
 	gx->csize = csize;
 	gx->nodata = nodata;
-	gx->feld = new float*[gx->nrows];
-	for(int i=0; i<gx->nrows; i++){
-		if((gx->feld[i]=new float[gx->ncols])==NULL){
-			cerr << "error (grid_copy): no sufficient memory" << endl;
-		}
-	}
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			gx->feld[i][j] = feld[i][j];
-		}
-	}
+	gx->alloc_feld(gx->nrows, gx->ncols);
+	if(data==NULL || gx->data==NULL)
+		return gx;
+	// views (sub_view) own no buffer and keep the stride of their parent
+	if(buffer!=NULL && stride==gx->stride)
+		memcpy(gx->data, data, size_t(nrows)*stride*sizeof(float));
+	else
+		for(int i=0; i<nrows; i++)
+			memcpy(gx->feld[i], feld[i], size_t(ncols)*sizeof(float));
 	return gx;
 }
 
+namespace
+{
+	// visits all fields of a row with data
+	struct all_valid{
+		all_valid(const grid& g) : g(g) {}
+		template<class F>
+		void operator()(int i, F f) const {
+			const float* row=g.feld[i];
+			for(int j=0; j<g.ncols; j++)
+				if(int(row[j])!=g.nodata)
+					f(j);
+		}
+		const grid& g;
+	};
+
+	// visits the fields of a row set in a validity mask
+	struct mask_valid{
+		mask_valid(const validity_mask& vm) : vm(vm) {}
+		template<class F>
+		void operator()(int i, F f) const { vm.for_each_valid(i, f); }
+		const validity_mask& vm;
+	};
+
+	// minimum, maximum (first position in row order) and sum of a block of rows
+	struct row_stats{
+		row_stats() : sum(0), count(0), vmin(FLT_MAX), vmax(-FLT_MAX),
+		              minx(0), miny(0), maxx(0), maxy(0) {}
+		double sum;
+		long count;
+		float vmin, vmax;
+		int minx, miny, maxx, maxy;
+	};
+
+	// rows per partial result, fixed so the sums don't depend on the number of threads
+	const int stat_grain=16;
+
+	template<class ForValid>
+	row_stats scan_rows(const grid& g, ForValid for_valid)
+	{
+		return parallel_reduce(g.nrows, stat_grain, row_stats(),
+			[&](int i0, int i1){
+				row_stats p;
+				for(int i=i0; i<i1; i++){
+					const float* row=g.feld[i];
+					for_valid(i, [&](int j){
+						float v=row[j];
+						if(v<p.vmin){ p.vmin=v; p.minx=i; p.miny=j; }
+						if(v>p.vmax){ p.vmax=v; p.maxx=i; p.maxy=j; }
+						p.sum+=v;
+						p.count++;
+					});
+				}
+				return p;
+			},
+			[](row_stats a, const row_stats& b){
+				if(b.vmin<a.vmin){ a.vmin=b.vmin; a.minx=b.minx; a.miny=b.miny; }
+				if(b.vmax>a.vmax){ a.vmax=b.vmax; a.maxx=b.maxx; a.maxy=b.maxy; }
+				a.sum+=b.sum;
+				a.count+=b.count;
+				return a;
+			});
+	}
+
+	// grid::stat for the fields visited by for_valid
+	template<class ForValid>
+	void stat_rows(grid& g, ForValid for_valid)
+	{
+		row_stats s=scan_rows(g, for_valid);
+		g.gridmin=s.vmin;
+		g.gridmax=s.vmax;
+		if(s.count>0){
+			g.minx=s.minx; g.miny=s.miny;
+			g.maxx=s.maxx; g.maxy=s.maxy;
+		}
+		g.count_data=int(s.count);
+		g.count_nodata=g.nrows*g.ncols-g.count_data;
+		if(g.count_nodata>0) g.has_nodata=YES;
+		float mean=float(s.sum/s.count);
+		g.gridmean=mean;
+		double var=parallel_reduce(g.nrows, stat_grain, 0.0,
+			[&](int i0, int i1){
+				double v=0;
+				for(int i=i0; i<i1; i++){
+					const float* row=g.feld[i];
+					for_valid(i, [&](int j){ v+=(row[j]-mean)*(row[j]-mean); });
+				}
+				return v;
+			},
+			[](double a, double b){ return a+b; });
+		g.gridstd=float(var/(s.count-1));
+		if(g.gridstd>=0) g.gridstd = sqrt(g.gridstd);
+		else g.gridstd = sqrt(-g.gridstd);
+		g.max=g.gridmax;
+		g.min=g.gridmin;
+	}
+}
+
 void grid::norm_grid()
 {
-	min=FLT_MAX;
-	max=-FLT_MAX;
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				min = (feld[i][j]<min) ? feld[i][j] : min;
-				max = (feld[i][j]>max) ? feld[i][j] : max;
-			}
-		}
-	}
+	row_stats s=scan_rows(*this, all_valid(*this));
+	min=s.vmin;
+	max=s.vmax;
 	if(max==min){
 		min=0.0;
 		max=0.0;
-		for(int i=0; i<nrows; i++){
-			for(int j=0; j<ncols; j++){
-				if(int(feld[i][j])!=nodata){
-					feld[i][j]=1.0;
+		parallel_rows(nrows,[&](int i0, int i1){
+			for(int i=i0; i<i1; i++){
+				for(int j=0; j<ncols; j++){
+					if(int(feld[i][j])!=nodata){
+						feld[i][j]=1.0;
+					}
 				}
 			}
-		}
+		});
 	}
 	else{
-		for(int i=0; i<nrows; i++){
-			for(int j=0; j<ncols; j++){
-				if(int(feld[i][j])!=nodata){
-					feld[i][j] = (feld[i][j]-min)/(max-min);
+		parallel_rows(nrows,[&](int i0, int i1){
+			for(int i=i0; i<i1; i++){
+				for(int j=0; j<ncols; j++){
+					if(int(feld[i][j])!=nodata){
+						feld[i][j] = (feld[i][j]-min)/(max-min);
+					}
 				}
 			}
-		}
+		});
 	}
 }
 
@@ -400,101 +549,60 @@ void grid::norm_grid(float min1,float max1)
 {
 	min=min1;
 	max=max1;
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				if(feld[i][j]>max)feld[i][j]=max;
-				feld[i][j] = (feld[i][j]-min)/(max-min);
+	parallel_rows(nrows,[&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				if(int(feld[i][j])!=nodata){
+					if(feld[i][j]>max)feld[i][j]=max;
+					feld[i][j] = (feld[i][j]-min)/(max-min);
+				}
 			}
 		}
-	}
+	});
 }
 
 void grid::norm_grid1()
 {
-	min=FLT_MAX;
-	max=-FLT_MAX;
-	int count1=0;
-	gridstd=gridmean=0.0;
-	float val;
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				min = (feld[i][j]<min) ? feld[i][j] : min;
-				max = (feld[i][j]>max) ? feld[i][j] : max;
-				gridmean+=feld[i][j];
-				count1++;
-			}
-		}
-	}
-	gridmean/=count1;
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				gridstd+=(feld[i][j]-gridmean)*(feld[i][j]-gridmean);
-			}
-		}
-	}
-	gridstd /= (float)(count1-1.0);
-	gridstd = sqrt(gridstd);
+	stat();
 	if(max>gridmean+3*gridstd) max=gridmean+3*gridstd;
 	if(min<gridmean-3*gridstd) min=gridmean-3*gridstd;
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				val=feld[i][j];
-				if(val>=max)
-					feld[i][j]=1.0;
-				if(val<=min)
-					feld[i][j]=0.0;
-				if(val<max && val>min)
-					feld[i][j] = (feld[i][j]-min)/(max-min);
+	parallel_rows(nrows,[&](int i0, int i1){
+		float val;
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				if(int(feld[i][j])!=nodata){
+					val=feld[i][j];
+					if(val>=max)
+						feld[i][j]=1.0;
+					if(val<=min)
+						feld[i][j]=0.0;
+					if(val<max && val>min)
+						feld[i][j] = (feld[i][j]-min)/(max-min);
+				}
 			}
 		}
-	}
+	});
 	fprintf(stderr,"norm1: mean=%f min=%f max=%f std=%f\n",
 	        gridmean,min,max,gridstd);
 }
 
 void grid::norm_grid2()
 {
-	min=FLT_MAX;
-	max=-FLT_MAX;
-	int count1=0;
-	gridstd=gridmean=0.0;
-	//float val;
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				min = (feld[i][j]<min) ? feld[i][j] : min;
-				max = (feld[i][j]>max) ? feld[i][j] : max;
-				gridmean+=feld[i][j];
-				count1++;
-			}
-		}
-	}
-	gridmean/=count1;
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				gridstd+=(feld[i][j]-gridmean)*(feld[i][j]-gridmean);
-			}
-		}
-	}
-	gridstd /= (float)(count1-1.0);
-	gridstd = sqrt(gridstd);
+	stat();
 	if(max>gridmean+3*gridstd) max=gridmean+3*gridstd;
 	if(min<gridmean-3*gridstd) min=gridmean-3*gridstd;
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				if(gridstd==0)
-					feld[i][j]=0.0;
-				else
-					feld[i][j]=(feld[i][j]-gridmean)/gridstd;
+	parallel_rows(nrows,[&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				if(int(feld[i][j])!=nodata){
+					if(gridstd==0)
+						feld[i][j]=0.0;
+					else
+						feld[i][j]=(feld[i][j]-gridmean)/gridstd;
+				}
 			}
 		}
-	}
+	});
 	fprintf(stderr,"norm2: mean=%f min=%f max=%f std=%f\n",
 	        gridmean,min,max,gridstd);
 }
@@ -538,46 +646,120 @@ int grid::cov_grid(grid* g1)
 
 void grid::stat()
 {
-	gridmin=FLT_MAX;
-	gridmax=-FLT_MAX;
-	gridmean=0.0;
-	gridstd=0.0;
-	long int count=0;
-	count_data=count_nodata=0;
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				count_data++;
-				if(feld[i][j]<gridmin){
-					gridmin=feld[i][j];
-					minx=i;
-					miny=j;
-				}
-				if(feld[i][j]>gridmax){
-					gridmax=feld[i][j];
-					maxx=i;
-					maxy=j;
-				}
-				gridmean += feld[i][j];
-				count++;
+	stat_rows(*this, all_valid(*this));
+}
+
+// same results as stat(), but words of the mask without data are skipped
+void grid::stat(const validity_mask& vm)
+{
+	stat_rows(*this, mask_valid(vm));
+}
+
+validity_mask::validity_mask(const grid& g)
+	: nrows(g.nrows), ncols(g.ncols), nwords((g.ncols+bits_per_word-1)/bits_per_word),
+		bits(size_t(g.nrows)*((g.ncols+bits_per_word-1)/bits_per_word), 0)
+{
+	for(int i=0; i<nrows; i++)
+		update_row(i, g.feld[i], g.nodata);
+}
+
+void validity_mask::update_row(int row, const float* data, int nodata)
+{
+	word* ws=&bits[size_t(row)*nwords];
+	for(int i=0; i<nwords; i++){
+		int j0=i*bits_per_word;
+		int n=ncols-j0<bits_per_word ? ncols-j0 : bits_per_word;
+		word w=0;
+		for(int j=0; j<n; j++)
+			w |= word(int(data[j0+j])!=nodata) << j;
+		ws[i]=w;
+	}
+}
+
+long validity_mask::count() const
+{
+	long n=0;
+	for(size_t i=0; i<bits.size(); i++){
+		for(word w=bits[i]; w; w &= w-1)
+			n++;
+	}
+	return n;
+}
+
+focal_table::focal_table(const grid& g)
+	: nrows(g.nrows), ncols(g.ncols),
+		s(size_t(g.nrows+1)*(g.ncols+1), 0), s2(s.size(), 0), n(s.size(), 0)
+{
+	// prefix sums along the rows, then down the columns
+	parallel_rows(nrows, [&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			const float* row=g.feld[i];
+			for(int j=0; j<ncols; j++){
+				size_t k=at(i+1,j+1);
+				bool valid=int(row[j])!=g.nodata;
+				double v=valid ? row[j] : 0;
+				s[k]=s[k-1]+v;
+				s2[k]=s2[k-1]+v*v;
+				n[k]=n[k-1]+valid;
+			}
+		}
+	});
+	parallel_rows(ncols, [&](int j0, int j1){
+		for(int i=1; i<nrows; i++){
+			for(int j=j0+1; j<=j1; j++){
+				size_t k=at(i+1,j), up=at(i,j);
+				s[k]+=s[up];
+				s2[k]+=s2[up];
+				n[k]+=n[up];
 			}
-			else count_nodata++;
 		}
+	});
+}
+
+double focal_table::mean(int row0, int col0, int row1, int col1) const
+{
+	int c=count(row0, col0, row1, col1);
+	return c ? sum(row0, col0, row1, col1)/c : 0;
+}
+
+double focal_table::variance(int row0, int col0, int row1, int col1) const
+{
+	int c=count(row0, col0, row1, col1);
+	if(!c) return 0;
+	double m=sum(row0, col0, row1, col1)/c;
+	double v=sum2(row0, col0, row1, col1)/c-m*m;
+	return v>0 ? v : 0;
+}
+
+double focal_table::sum(int row, int col, const vector<run>& shape) const
+{
+	double res=0;
+	for(size_t k=0; k<shape.size(); k++){
+		const run& r=shape[k];
+		res+=sum(row+r.drow, col+r.dcol0, row+r.drow, col+r.dcol1);
 	}
-	if(count_nodata>0) has_nodata=YES;
-	gridmean /= count;
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				gridstd+=(feld[i][j]-gridmean)*(feld[i][j]-gridmean);
+	return res;
+}
+
+vector<focal_table::run> focal_table::circle_shape(int r)
+{
+	// grid::moore(..,CIRCLE) takes the fields of the r-environment which are
+	// in the circle of radius r around offset (r,r)
+	vector<run> shape;
+	for(int i=-r; i<=r; i++){
+		int j0=r+1;
+		for(int j=-r; j<=r; j++){
+			if((i-r)*(i-r)+(j-r)*(j-r)<=r*r){
+				j0=j;
+				break;
 			}
 		}
+		if(j0<=r){
+			run ru={i, j0, r};
+			shape.push_back(ru);
+		}
 	}
-	gridstd /= (count-1);
-	if(gridstd>=0) gridstd = sqrt(gridstd);
-	else gridstd = sqrt(-gridstd);
-	max=gridmax;
-	min=gridmin;
+	return shape;
 }
 
 void grid::calc_pattern(float thresh)
@@ -661,13 +843,15 @@ void grid::calc_pattern(float thresh)
 void grid::inv_grid()
 {
 	stat();
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				feld[i][j]=gridmax-feld[i][j];
+	parallel_rows(nrows,[&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				if(int(feld[i][j])!=nodata){
+					feld[i][j]=gridmax-feld[i][j];
+				}
 			}
 		}
-	}
+	});
 }
 
 int* grid::hist(int bins)
@@ -679,14 +863,23 @@ int* grid::hist(int bins)
 	}
 	stat();
 	float delta=(gridmax-gridmin);
-	for(int i=0; i<=bins; i++) erg[i]=0;
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				erg[(int)((bins)*(feld[i][j]-gridmin)/delta)]++;
+	vector<int> counts=parallel_reduce(nrows, 64, vector<int>(bins+1, 0),
+		[&](int i0, int i1){
+			vector<int> c(bins+1, 0);
+			for(int i=i0; i<i1; i++){
+				for(int j=0; j<ncols; j++){
+					if(int(feld[i][j])!=nodata){
+						c[(int)((bins)*(feld[i][j]-gridmin)/delta)]++;
+					}
+				}
 			}
-		}
-	}
+			return c;
+		},
+		[](vector<int> a, const vector<int>& b){
+			for(size_t k=0; k<a.size(); k++) a[k]+=b[k];
+			return a;
+		});
+	for(int i=0; i<=bins; i++) erg[i]=counts[i];
 	for(int i=0; i<=bins; i++)
 		fprintf(stderr,"%-6d %f %f\n",erg[i],
 		        gridmin+i*delta/bins,gridmin+(i+1)*delta/bins);
@@ -855,29 +1048,31 @@ grid* grid::sobol()
 {
 	grid* gx;
 	gx=grid_copy();
-	double  n,m;
-	for(int i=1; i<nrows-1; i++){
-		for(int j=1; j<ncols-1; j++){
-			gx->feld[i][j]=gx->nodata;
-			if(int(feld[i][j])!=nodata){
-				if(int(feld[i-1][j-1])!=nodata &&
-						int(feld[i][j-1])!=nodata &&
-						int(feld[i+1][j-1])!=nodata &&
-						int(feld[i-1][j])!=nodata &&
-						int(feld[i][j])!=nodata &&
-						int(feld[i+1][j])!=nodata &&
-						int(feld[i-1][j+1])!=nodata &&
-						int(feld[i][j+1])!=nodata &&
-						int(feld[i+1][j+1])!=nodata){
-					n= feld[i-1][j+1]+2*feld[i][j+1]+feld[i+1][j+1]
-					                                           -feld[i-1][j-1]-2*feld[i][j-1]-feld[i+1][j-1];
-					m=feld[i+1][j-1]+2*feld[i+1][j]+feld[i+1][j+1]+
-							-feld[i-1][j-1]-2*feld[i-1][j]+feld[i-1][j+1];
-					gx->feld[i][j]=(float)(fabs(n)+fabs(m));
+	parallel_rows(nrows-2,[&](int i0, int i1){
+		double  n,m;
+		for(int i=i0+1; i<i1+1; i++){
+			for(int j=1; j<ncols-1; j++){
+				gx->feld[i][j]=gx->nodata;
+				if(int(feld[i][j])!=nodata){
+					if(int(feld[i-1][j-1])!=nodata &&
+							int(feld[i][j-1])!=nodata &&
+							int(feld[i+1][j-1])!=nodata &&
+							int(feld[i-1][j])!=nodata &&
+							int(feld[i][j])!=nodata &&
+							int(feld[i+1][j])!=nodata &&
+							int(feld[i-1][j+1])!=nodata &&
+							int(feld[i][j+1])!=nodata &&
+							int(feld[i+1][j+1])!=nodata){
+						n= feld[i-1][j+1]+2*feld[i][j+1]+feld[i+1][j+1]
+						                                           -feld[i-1][j-1]-2*feld[i][j-1]-feld[i+1][j-1];
+						m=feld[i+1][j-1]+2*feld[i+1][j]+feld[i+1][j+1]+
+								-feld[i-1][j-1]-2*feld[i-1][j]+feld[i-1][j+1];
+						gx->feld[i][j]=(float)(fabs(n)+fabs(m));
+					}
 				}
 			}
 		}
-	}
+	});
 	return gx;
 }
 
@@ -886,27 +1081,29 @@ grid* grid::laplace()
 	grid* gx;
 	gx=grid_copy();
 	//double  n,m;
-	for(int i=1; i<nrows-1; i++){
-		for(int j=1; j<ncols-1; j++){
-			gx->feld[i][j]=gx->nodata;
-			if(int(feld[i][j])!=nodata){
-				if(int(feld[i-1][j-1])!=nodata &&
-						int(feld[i][j-1])!=nodata &&
-						int(feld[i+1][j-1])!=nodata &&
-						int(feld[i-1][j])!=nodata &&
-						int(feld[i][j])!=nodata &&
-						int(feld[i+1][j])!=nodata &&
-						int(feld[i-1][j+1])!=nodata &&
-						int(feld[i][j+1])!=nodata &&
-						int(feld[i+1][j+1])!=nodata){
-					gx->feld[i][j]=-feld[i-1][j-1]-feld[i-1][j]-
-							feld[i-1][j+1]-feld[i][j-1]+8*feld[i][j]-
-							feld[i][j+1]-feld[i+1][j-1]-
-							feld[i+1][j]-feld[i+1][j+1];
+	parallel_rows(nrows-2,[&](int i0, int i1){
+		for(int i=i0+1; i<i1+1; i++){
+			for(int j=1; j<ncols-1; j++){
+				gx->feld[i][j]=gx->nodata;
+				if(int(feld[i][j])!=nodata){
+					if(int(feld[i-1][j-1])!=nodata &&
+							int(feld[i][j-1])!=nodata &&
+							int(feld[i+1][j-1])!=nodata &&
+							int(feld[i-1][j])!=nodata &&
+							int(feld[i][j])!=nodata &&
+							int(feld[i+1][j])!=nodata &&
+							int(feld[i-1][j+1])!=nodata &&
+							int(feld[i][j+1])!=nodata &&
+							int(feld[i+1][j+1])!=nodata){
+						gx->feld[i][j]=-feld[i-1][j-1]-feld[i-1][j]-
+								feld[i-1][j+1]-feld[i][j-1]+8*feld[i][j]-
+								feld[i][j+1]-feld[i+1][j-1]-
+								feld[i+1][j]-feld[i+1][j+1];
+					}
 				}
 			}
 		}
-	}
+	});
 	return gx;
 }
 
@@ -915,33 +1112,35 @@ grid* grid::edge()
 	grid* gx;
 	gx=grid_copy();
 	//const float sq2=sqrt(2.0);
-	for(int i=1; i<nrows-1; i++){
-		for(int j=1; j<ncols-1; j++){
-			gx->feld[i][j]=gx->nodata;
-			if(int(feld[i][j])!=nodata){
-				if(int(feld[i-1][j-1])!=nodata &&
-						int(feld[i][j-1])!=nodata &&
-						int(feld[i+1][j-1])!=nodata &&
-						int(feld[i-1][j])!=nodata &&
-						int(feld[i][j])!=nodata &&
-						int(feld[i+1][j])!=nodata &&
-						int(feld[i-1][j+1])!=nodata &&
-						int(feld[i][j+1])!=nodata &&
-						int(feld[i+1][j+1])!=nodata){
-					gx->feld[i][j]=
-							-2.0/8*feld[i-1][j-1]
-							                 -2.0/8*feld[i][j-1]
-							                                -2.0/8*feld[i+1][j-1]
-							                                                 -2.0/8*feld[i-1][j]
-							                                                                  +3.0*feld[i][j]
-							                                                                               -2.0/8*feld[i+1][j]
-							                                                                                                -2.0/8*feld[i-1][j+1]
-							                                                                                                                 -2.0/8*feld[i][j+1]
-							                                                                                                                                -2.0/8*feld[i+1][j+1];
+	parallel_rows(nrows-2,[&](int i0, int i1){
+		for(int i=i0+1; i<i1+1; i++){
+			for(int j=1; j<ncols-1; j++){
+				gx->feld[i][j]=gx->nodata;
+				if(int(feld[i][j])!=nodata){
+					if(int(feld[i-1][j-1])!=nodata &&
+							int(feld[i][j-1])!=nodata &&
+							int(feld[i+1][j-1])!=nodata &&
+							int(feld[i-1][j])!=nodata &&
+							int(feld[i][j])!=nodata &&
+							int(feld[i+1][j])!=nodata &&
+							int(feld[i-1][j+1])!=nodata &&
+							int(feld[i][j+1])!=nodata &&
+							int(feld[i+1][j+1])!=nodata){
+						gx->feld[i][j]=
+								-2.0/8*feld[i-1][j-1]
+								                 -2.0/8*feld[i][j-1]
+								                                -2.0/8*feld[i+1][j-1]
+								                                                 -2.0/8*feld[i-1][j]
+								                                                                  +3.0*feld[i][j]
+								                                                                               -2.0/8*feld[i+1][j]
+								                                                                                                -2.0/8*feld[i-1][j+1]
+								                                                                                                                 -2.0/8*feld[i][j+1]
+								                                                                                                                                -2.0/8*feld[i+1][j+1];
+					}
 				}
 			}
 		}
-	}
+	});
 	return gx;
 }
 
@@ -1083,12 +1282,7 @@ grid* grid::n2()
 	gx->xcorner=xcorner+dx*csize;
 	gx->ycorner=ycorner+(nrows-dy)*csize;
 	// allocate memory
-	gx->feld = new float*[k];
-	for(int i=0; i<k; i++){
-		if((gx->feld[i]=new float[k])==NULL){
-			cerr << "error (grid::select): no sufficient memory" << endl;
-		}
-	}
+	gx->alloc_feld(k, k);
 	// fill the new grid
 	for(int i=0; i<k; i++)
 		for(int j=0; j<k; j++)
@@ -2306,14 +2500,7 @@ grid* grid::rotate(int beta1)
 		gx->ncols=nrows;
 		gx->nrows=ncols;
 		gx->csize = csize;
-		gx->feld=new float*[gx->nrows];
-		for(int i=0; i<gx->nrows; i++){
-			gx->feld[i]=new float[gx->ncols];
-			if(gx->feld[i]==0){
-				fprintf(stderr,"error in rotate: no space on device\n");
-				return 0;
-			}
-		}
+		gx->alloc_feld(gx->nrows, gx->ncols);
 		for(int i=0; i<nrows; i++)
 			for(int j=0; j<ncols; j++)
 				gx->feld[j][i]=feld[nrows-i-1][j];
@@ -2326,14 +2513,7 @@ grid* grid::rotate(int beta1)
 		gx->ncols=nrows;
 		gx->nrows=ncols;
 		gx->csize = csize;
-		gx->feld=new float*[gx->nrows];
-		for(int i=0; i<gx->nrows; i++){
-			gx->feld[i]=new float[gx->ncols];
-			if(gx->feld[i]==0){
-				fprintf(stderr,"error in rotate: no space on device\n");
-				return 0;
-			}
-		}
+		gx->alloc_feld(gx->nrows, gx->ncols);
 		for(int i=0; i<nrows; i++)
 			for(int j=0; j<ncols; j++)
 				gx->feld[j][i]=feld[i][ncols-j-1];
@@ -2346,14 +2526,7 @@ grid* grid::rotate(int beta1)
 		gx->ncols=ncols;
 		gx->nrows=nrows;
 		gx->csize = csize;
-		gx->feld=new float*[gx->nrows];
-		for(int i=0; i<gx->nrows; i++){
-			gx->feld[i]=new float[gx->ncols];
-			if(gx->feld[i]==0){
-				fprintf(stderr,"error in rotate: no space on device\n");
-				return 0;
-			}
-		}
+		gx->alloc_feld(gx->nrows, gx->ncols);
 		for(int i=0; i<nrows; i++)
 			for(int j=0; j<ncols; j++)
 				gx->feld[i][j]=feld[nrows-i-1][j];
@@ -2383,12 +2556,7 @@ grid* grid::rotate(int beta1)
 	fprintf(stderr,"P1 %f %f\nP2 %f %f\nP3 %f %f\nP4 %f %f\n",
 	        a.a,a.b,b.a,b.b,c.a,c.b,d.a,d.b);
 	fprintf(stderr,"nrows=%d ncols=%d\n",n_ncols,n_nrows);
-	gx->feld= new float*[n_nrows];
-	for(int i=0; i<n_nrows; i++){
-		if((gx->feld[i]= new float[n_ncols])==NULL){
-			cerr << "error (read_ascii): no sufficient memory" << endl;
-		}
-	}
+	gx->alloc_feld(n_nrows, n_ncols);
 	gx->nodata=nodata;
 	gx->xcorner = xcorner;
 	gx->ycorner = ycorner;
@@ -2510,12 +2678,13 @@ grid* grid::cluster2value(grid* vgrid)
 void grid::w_fill()
 {
 	grid* gx=w_focalflow();
-	float val;
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				if(gx->feld[i][j]==255){
-					for(int k=0; k<8;k++){
+	// two sinks can't be neighbours, so the rows are independent
+	parallel_rows(nrows,[&](int i0, int i1){
+		float val;
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				if(int(feld[i][j])!=nodata){
+					if(gx->feld[i][j]==255){
 						val=FLT_MAX;
 						if(i+1<nrows && val>feld[i+1][j])
 							val=feld[i+1][j];
@@ -2533,41 +2702,101 @@ void grid::w_fill()
 							val=feld[i-1][j+1];
 						if(i-1>=0 && j-1>=0 && val>feld[i-1][j-1])
 							val=feld[i-1][j-1];
+						feld[i][j]=val;
 					}
-					feld[i][j]=val;
 				}
 			}
 		}
-	}
+	});
 	delete gx;
 }
 
-grid* grid::w_focalflow()
-{
-	grid *gx=grid_copy();
+// priority flood (Barnes, Lehman, Mulla 2014): the cells are flooded from
+// the border (and nodata) inwards in order of their height, cells lower
+// than the cell they are reached from lie in a depression and get its height,
+// these are processed by a plain fifo queue, only the rim of the flooded
+// region is kept in the priority queue
+void grid::w_fill_depressions()
+{
+	if(nrows<=0 || ncols<=0) return;
+	static const int di[8]={0,1,1,1,0,-1,-1,-1};
+	static const int dj[8]={1,1,0,-1,-1,-1,0,1};
+	typedef pair<float,long> Cell; // height, i*ncols+j
+	priority_queue<Cell,vector<Cell>,greater<Cell> > open;
+	queue<long> pit;
+	vector<char> closed(size_t(nrows)*ncols,0);
+	// seed with the cells on the border and next to nodata
 	for(int i=0; i<nrows; i++){
 		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				gx->feld[i][j]=0;
-				if(j+1<ncols && feld[i][j]<feld[i][j+1])
-					gx->feld[i][j]+=1; // E
-				if(j+1<ncols && i+1<nrows && feld[i][j]<feld[i+1][j+1])
-					gx->feld[i][j]+=2; //SE
-				if(i+1<nrows && feld[i][j]<feld[i+1][j])
-					gx->feld[i][j]+=4; // S
-				if(j-1>=0 && i+1<nrows && feld[i][j]<feld[i+1][j-1])
-					gx->feld[i][j]+=8; // SW
-				if(j-1>=0 && feld[i][j]<feld[i][j-1])
-					gx->feld[i][j]+=16; // W
-				if(j-1>=0 && i-1>=0 && feld[i][j]<feld[i-1][j-1])
-					gx->feld[i][j]+=32; // NW
-				if(i-1>=0 && feld[i][j]<feld[i-1][j])
-					gx->feld[i][j]+=64; // N
-				if(j+1<ncols && i-1>=0 && feld[i][j]<feld[i-1][j+1])
-					gx->feld[i][j]+=128; // NE
+			long c=long(i)*ncols+j;
+			if(int(feld[i][j])==nodata){
+				closed[c]=1;
+				continue;
+			}
+			bool rim=(i==0 || j==0 || i==nrows-1 || j==ncols-1);
+			for(int k=0; k<8 && !rim; k++)
+				rim=int(feld[i+di[k]][j+dj[k]])==nodata;
+			if(rim){
+				closed[c]=1;
+				open.push(Cell(feld[i][j],c));
+			}
+		}
+	}
+	while(!open.empty() || !pit.empty()){
+		long c;
+		if(!pit.empty()){
+			c=pit.front();
+			pit.pop();
+		}
+		else{
+			c=open.top().second;
+			open.pop();
+		}
+		int i=int(c/ncols), j=int(c%ncols);
+		for(int k=0; k<8; k++){
+			int ni=i+di[k], nj=j+dj[k];
+			if(ni<0 || nj<0 || ni>=nrows || nj>=ncols) continue;
+			long n=long(ni)*ncols+nj;
+			if(closed[n]) continue;
+			closed[n]=1;
+			if(feld[ni][nj]<=feld[i][j]){
+				feld[ni][nj]=feld[i][j];
+				pit.push(n);
 			}
+			else
+				open.push(Cell(feld[ni][nj],n));
 		}
 	}
+}
+
+grid* grid::w_focalflow()
+{
+	grid *gx=grid_copy();
+	parallel_rows(nrows,[&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				if(int(feld[i][j])!=nodata){
+					gx->feld[i][j]=0;
+					if(j+1<ncols && feld[i][j]<feld[i][j+1])
+						gx->feld[i][j]+=1; // E
+					if(j+1<ncols && i+1<nrows && feld[i][j]<feld[i+1][j+1])
+						gx->feld[i][j]+=2; //SE
+					if(i+1<nrows && feld[i][j]<feld[i+1][j])
+						gx->feld[i][j]+=4; // S
+					if(j-1>=0 && i+1<nrows && feld[i][j]<feld[i+1][j-1])
+						gx->feld[i][j]+=8; // SW
+					if(j-1>=0 && feld[i][j]<feld[i][j-1])
+						gx->feld[i][j]+=16; // W
+					if(j-1>=0 && i-1>=0 && feld[i][j]<feld[i-1][j-1])
+						gx->feld[i][j]+=32; // NW
+					if(i-1>=0 && feld[i][j]<feld[i-1][j])
+						gx->feld[i][j]+=64; // N
+					if(j+1<ncols && i-1>=0 && feld[i][j]<feld[i-1][j+1])
+						gx->feld[i][j]+=128; // NE
+				}
+			}
+		}
+	});
 	return gx;
 }
 
@@ -2698,8 +2927,6 @@ grid* grid::delta_diff(grid *g1)
 // very early version please do not use!
 grid* grid::w_flowdirection()
 {   // usage after w_fill !!!
-	float x;
-	float val,maxval;
 	//int xxx, yyy,a,b;
 	//float delta;
 	//    stack2i *s=new stack2i(1000000);
@@ -2708,72 +2935,76 @@ grid* grid::w_flowdirection()
 	//	return (grid*) 0;
 	//    }
 	grid *gx=grid_copy();
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				gx->feld[i][j]=0;
-				maxval=0.0;
-				x=0;
-				if(j+1<ncols && feld[i][j]>feld[i][j+1]){
-					val=feld[i][j]-feld[i][j+1];
-					if(val>maxval){
-						maxval=val;
-						x=1;  // E
+	parallel_rows(nrows,[&](int i0, int i1){
+		float x;
+		float val,maxval;
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				if(int(feld[i][j])!=nodata){
+					gx->feld[i][j]=0;
+					maxval=0.0;
+					x=0;
+					if(j+1<ncols && feld[i][j]>feld[i][j+1]){
+						val=feld[i][j]-feld[i][j+1];
+						if(val>maxval){
+							maxval=val;
+							x=1;  // E
+						}
 					}
-				}
-				if(j+1<ncols && i+1<nrows && feld[i][j]>feld[i+1][j+1]){
-					val=feld[i][j]-feld[i+1][j+1];
-					if(val>maxval){
-						maxval=val;
-						x=2; // SE
+					if(j+1<ncols && i+1<nrows && feld[i][j]>feld[i+1][j+1]){
+						val=feld[i][j]-feld[i+1][j+1];
+						if(val>maxval){
+							maxval=val;
+							x=2; // SE
+						}
 					}
-				}
-				if(i+1<nrows && feld[i][j]>feld[i+1][j]){
-					val=feld[i][j]-feld[i+1][j];
-					if(val>maxval){
-						maxval=val;
-						x=4; // S
+					if(i+1<nrows && feld[i][j]>feld[i+1][j]){
+						val=feld[i][j]-feld[i+1][j];
+						if(val>maxval){
+							maxval=val;
+							x=4; // S
+						}
 					}
-				}
-				if(j-1>=0 && i+1<nrows && feld[i][j]>feld[i+1][j-1]){
-					val=feld[i][j]-feld[i+1][j-1];
-					if(val>maxval){
-						maxval=val;
-						x=8;  // SW
+					if(j-1>=0 && i+1<nrows && feld[i][j]>feld[i+1][j-1]){
+						val=feld[i][j]-feld[i+1][j-1];
+						if(val>maxval){
+							maxval=val;
+							x=8;  // SW
+						}
 					}
-				}
-				if(j-1>=0 && feld[i][j]>feld[i][j-1]){
-					val=feld[i][j]-feld[i][j-1];
-					if(val>maxval){
-						maxval=val;
-						x=16; // W
+					if(j-1>=0 && feld[i][j]>feld[i][j-1]){
+						val=feld[i][j]-feld[i][j-1];
+						if(val>maxval){
+							maxval=val;
+							x=16; // W
+						}
 					}
-				}
-				if(j-1>=0 && i-1>=0 && feld[i][j]>feld[i-1][j-1]){
-					val=feld[i][j]-feld[i-1][j-1];
-					if(val>maxval){
-						maxval=val;
-						x=32; // NW
+					if(j-1>=0 && i-1>=0 && feld[i][j]>feld[i-1][j-1]){
+						val=feld[i][j]-feld[i-1][j-1];
+						if(val>maxval){
+							maxval=val;
+							x=32; // NW
+						}
 					}
-				}
-				if(i-1>=0 && feld[i][j]>feld[i-1][j]){
-					val=feld[i][j]-feld[i-1][j];
-					if(val>maxval){
-						maxval=val;
-						x=64; // N
+					if(i-1>=0 && feld[i][j]>feld[i-1][j]){
+						val=feld[i][j]-feld[i-1][j];
+						if(val>maxval){
+							maxval=val;
+							x=64; // N
+						}
 					}
-				}
-				if(j+1<ncols && i-1>=0 && feld[i][j]>feld[i-1][j+1]){
-					val=feld[i][j]-feld[i-1][j+1];
-					if(val>maxval){
-						maxval=val;
-						x=128; // NE
+					if(j+1<ncols && i-1>=0 && feld[i][j]>feld[i-1][j+1]){
+						val=feld[i][j]-feld[i-1][j+1];
+						if(val>maxval){
+							maxval=val;
+							x=128; // NE
+						}
 					}
+					gx->feld[i][j]=x;
 				}
-				gx->feld[i][j]=x;
 			}
 		}
-	}
+	});
 	// correction on the border
 	for(int i=0; i<gx->nrows; i++){
 		if(gx->feld[i][0]!=gx->nodata)
@@ -2812,6 +3043,102 @@ grid* grid::w_d8()
 }
 
 
+// number of cells (including the cell itself) draining through each cell,
+// following the d8 flow directions of the depression filled surface,
+// the filled depressions are flats without a lower neighbour, their cells
+// are routed over the flat to the nearest cell which drains (breadth first
+// from the outlets of the flat), the cells are visited in topological order
+// (a cell after all cells draining into it), so a single pass is enough
+grid* grid::w_flowaccumulation()
+{
+	static const int di[8]={0,1,1,1,0,-1,-1,-1};
+	static const int dj[8]={1,1,0,-1,-1,-1,0,1};
+	grid* ele=grid_copy();
+	ele->w_fill_depressions();
+	grid* flowd=ele->w_flowdirection();
+	grid* acc=grid_copy();
+	if(nrows<=0 || ncols<=0){
+		delete ele;
+		delete flowd;
+		return acc;
+	}
+	// the cell each cell drains to, -1 if it drains out of the grid or not at all
+	vector<long> down(size_t(nrows)*ncols,-1);
+	// the cell has got a flow direction (nodata cells count as resolved)
+	vector<char> resolved(size_t(nrows)*ncols,1);
+	parallel_rows(nrows,[&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				acc->feld[i][j]=int(feld[i][j])==nodata ? float(nodata) : 1.0f;
+				if(int(feld[i][j])==nodata) continue;
+				int dir=int(flowd->feld[i][j]), ni=i, nj=j;
+				switch(dir){
+				case 1: nj++; break;
+				case 2: ni++; nj++; break;
+				case 4: ni++; break;
+				case 8: ni++; nj--; break;
+				case 16: nj--; break;
+				case 32: ni--; nj--; break;
+				case 64: ni--; break;
+				case 128: ni--; nj++; break;
+				default:
+					resolved[long(i)*ncols+j]=0;
+					continue;
+				}
+				if(ni<0 || nj<0 || ni>=nrows || nj>=ncols || int(feld[ni][nj])==nodata)
+					continue;
+				down[long(i)*ncols+j]=long(ni)*ncols+nj;
+			}
+		}
+	});
+	delete flowd;
+	// flats: every unresolved cell drains to a neighbour of the same filled
+	// height, which is one step closer to a cell with a flow direction
+	queue<long> flat;
+	for(size_t c=0; c<resolved.size(); c++){
+		if(!resolved[c]) continue;
+		int i=int(c/ncols), j=int(c%ncols);
+		for(int k=0; k<8; k++){
+			int ni=i+di[k], nj=j+dj[k];
+			if(ni>=0 && nj>=0 && ni<nrows && nj<ncols && !resolved[long(ni)*ncols+nj]){
+				flat.push(long(c));
+				break;
+			}
+		}
+	}
+	while(!flat.empty()){
+		long c=flat.front();
+		flat.pop();
+		int i=int(c/ncols), j=int(c%ncols);
+		if(int(feld[i][j])==nodata) continue;
+		for(int k=0; k<8; k++){
+			int ni=i+di[k], nj=j+dj[k];
+			if(ni<0 || nj<0 || ni>=nrows || nj>=ncols) continue;
+			long n=long(ni)*ncols+nj;
+			if(resolved[n] || ele->feld[ni][nj]!=ele->feld[i][j]) continue;
+			resolved[n]=1;
+			down[n]=c;
+			flat.push(n);
+		}
+	}
+	delete ele;
+	vector<int> indegree(size_t(nrows)*ncols,0);
+	for(size_t c=0; c<down.size(); c++)
+		if(down[c]>=0) indegree[down[c]]++;
+	vector<long> ready;
+	for(size_t c=0; c<down.size(); c++)
+		if(indegree[c]==0) ready.push_back(long(c));
+	while(!ready.empty()){
+		long c=ready.back();
+		ready.pop_back();
+		long d=down[c];
+		if(d<0) continue;
+		acc->feld[d/ncols][d%ncols]+=acc->feld[c/ncols][c%ncols];
+		if(--indegree[d]==0) ready.push_back(d);
+	}
+	return acc;
+}
+
 // algorithm for dr. thinh
 float grid::moore(int a, int b, int r, int PARA)
 {
@@ -2844,46 +3171,49 @@ float grid::moore(int a, int b, int r, int PARA)
 	return res;
 }
 
+// the moore sums are taken from a focal_table, O(1) per window
 void grid::nachbarmatrix(grid* g1, int r, float thres)
 {
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(this->moore(i,j,r,MOORE)>thres)g1->feld[i][j]=1.0;
-			else g1->feld[i][j]=0.0;
+	focal_table ft(*this);
+	parallel_rows(nrows, [&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				if(float(ft.moore_sum(i,j,r))>thres)g1->feld[i][j]=1.0;
+				else g1->feld[i][j]=0.0;
+			}
 		}
-	}
+	});
 }
 
 void grid::naehematrix(grid* g1, int r, float thres)
 {
-	int k;
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			g1->feld[i][j]=9999;
-		}
-	}
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			k=1;
-			while(k<=r){
-				if(this->moore(i,j,k,MOORE)>thres){
-					g1->feld[i][j]=k;
-					break;
+	focal_table ft(*this);
+	parallel_rows(nrows, [&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				g1->feld[i][j]=9999;
+				for(int k=1; k<=r; k++){
+					if(float(ft.moore_sum(i,j,k))>thres){
+						g1->feld[i][j]=k;
+						break;
+					}
 				}
-				k++;
 			}
 		}
-	}
+	});
 }
 
 void grid::kompaktheit(grid* g1, int r)
 {
 	float teiler=(2*r+1)*(2*r+1);
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			g1->feld[i][j]=this->moore(i,j,r,MOORE)/teiler;
+	focal_table ft(*this);
+	parallel_rows(nrows, [&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				g1->feld[i][j]=float(ft.moore_sum(i,j,r))/teiler;
+			}
 		}
-	}
+	});
 }
 
 void grid::attraktivitaet(grid* g1, int im, int jm, float alpha,
@@ -2917,6 +3247,32 @@ grid* grid::select(float val)
 	return gx;
 }
 
+// the view has its own row pointers into the fields of this grid, but no
+// data of its own, so it is only valid as long as this grid lives
+grid* grid::sub_view(int top, int left, int rows, int cols)
+{
+	if(top<0 || left<0 || rows<=0 || cols<=0
+		 || top+rows>nrows || left+cols>ncols){
+		cerr << "error (grid::sub_view): " << rows << "x" << cols << " at ";
+		cerr << top << "," << left << " not in grid" << endl;
+		return 0;
+	}
+	grid* gx = new grid(rgr);
+	gx->nrows=rows;
+	gx->ncols=cols;
+	gx->csize=csize;
+	gx->nodata=nodata;
+	gx->xcorner=xcorner+left*double(csize);
+	gx->ycorner=ycorner+(nrows-top-rows)*double(csize);
+	gx->has_nodata=has_nodata;
+	gx->stride=stride;
+	gx->data=feld[top]+left;
+	gx->feld=new float*[rows];
+	for(int i=0; i<rows; i++)
+		gx->feld[i]=feld[top+i]+left;
+	return gx;
+}
+
 grid* grid::select(int a,int b,int c, int d)
 {
 	if(a<0 || b<0 || a>ncols || b>nrows){
@@ -2943,12 +3299,7 @@ grid* grid::select(int a,int b,int c, int d)
 	gx->ycorner = ycorner+(nrows-d)*csize;
 	gx->csize = csize;
 	gx->nodata = nodata;
-	gx->feld = new float*[gx->nrows];
-	for(int i=0; i<gx->nrows; i++){
-		if((gx->feld[i]=new float[gx->ncols])==NULL){
-			cerr << "error (grid::select): no sufficient memory" << endl;
-		}
-	}
+	gx->alloc_feld(gx->nrows, gx->ncols);
 	for(int i=0; i<gx->nrows; i++){
 		for(int j=0; j<gx->ncols; j++){
 			gx->feld[i][j] = feld[i+b][j+a];
@@ -2960,20 +3311,13 @@ grid* grid::select(int a,int b,int c, int d)
 #ifndef NO_HDF5
 bool grid::write_hdf(char* fname, char* datasetn, char* autor, char* modell) {
   //cerr << "hdf " << fname << " " << datasetn << endl;
-	float* f1=new float[nrows*ncols];
-	if (f1==NULL) {
-		cerr << "error (write_hdf): no space on device\n";
-		exit(2);
-	}
-	for (int i=0; i<nrows; i++)
-		for (int j=0; j<ncols; j++)
-			f1[i*ncols+j]=feld[i][j];
+	HdfLock lock;
 	hd=new hdf5;
 	if (hd->open_f(fname)!=0)
 		hd->create_f(fname);
 	bool success = false;
-	if (hd->open_d(datasetn)!=0){
-		hd->write_f_feld(datasetn, f1, nrows, ncols);
+	if (hd->open_d(datasetn)!=0
+	    && hd->write_f_feld(datasetn, data, nrows, ncols, stride)==0){
 		hd->write_s_attribute("Autor", autor);
 		hd->write_s_attribute("Modell", modell);
 		hd->write_l_attribute("time", time(NULL));
@@ -2985,7 +3329,6 @@ bool grid::write_hdf(char* fname, char* datasetn, char* autor, char* modell) {
 		hd->write_i_attribute("nrows", nrows);
 		success = true;
 	}
-	delete[] f1;
 	delete hd;
 	hd = NULL;
 	return success;
@@ -3009,6 +3352,7 @@ static herr_t file_info(hid_t /*loc_id*/, const char *name, void* /*opdata*/)
 void Grids::grid_save_to_R(char* name, int bins)
 {
 	cerr << name << " " << bins << endl;
+	HdfLock lock;
 	hid_t    file;
 	int i,j,k;
 	int      idx;
@@ -3074,6 +3418,7 @@ void Grids::grid_save_to_R(char* name, int bins)
 
 int grid::read_hdf(char* fname, char* datasetn)
 {
+	HdfLock lock;
 	hd=new(hdf5);
 	if(hd->open_f(fname)!=0){
 		cerr << "error (read_hdf): can not open hdf_file: " << fname << endl;
@@ -3083,11 +3428,7 @@ int grid::read_hdf(char* fname, char* datasetn)
 		cerr << "error (read_hdf): can not open dataset: " << datasetn << endl;
 		return -2;
 	}
-	if(feld!=(float**)NULL){
-		for(int i=0; i<nrows; i++){
-			delete [] feld[i];
-		}
-	}
+	free_feld();
 	ncols=hd->get_i_attribute("ncols");
 	nrows=hd->get_i_attribute("nrows");
 	nodata=hd->get_i_attribute("nodata");
@@ -3095,19 +3436,9 @@ int grid::read_hdf(char* fname, char* datasetn)
 	ycorner=hd->get_d_attribute("ycorner");
 	csize=hd->get_f_attribute("csize");
   //cerr << ncols << " " << nrows << " " << csize << endl;
-	hd->read_f_feld(datasetn); // writes to f1 in grid
-	feld=new float*[nrows];
-	for(int i=0; i<nrows; i++){
-		if((feld[i]=new float[ncols])==NULL){
-			cerr << "error (read_hdf): no sufficient memory" << endl;
-		}
-	}
-	// read_in
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			feld[i][j]=hd->f1[i*ncols+j];
-		}
-	}
+	alloc_feld(nrows, ncols);
+	// read_in directly into the rows
+	hd->read_f_feld(datasetn, data, nrows, ncols, stride);
 	delete hd;
 	return 0;
 }
@@ -3152,73 +3483,85 @@ int grid::combine_grid(grid* g1,int selector)
 	}
 	switch(selector){
 	case MIN:
-		for(int i=0; i<nrows; i++){
-			for(int j=0; j<ncols; j++){
-				if(int(feld[i][j]) == nodata ||
-						int(g1->feld[i][j]) == g1->nodata)
-					feld[i][j]=nodata;
-				else
-					feld[i][j]=
-							g1->feld[i][j]>feld[i][j] ?
-									feld[i][j] : g1->feld[i][j];
+		parallel_rows(nrows,[&](int i0, int i1){
+			for(int i=i0; i<i1; i++){
+				for(int j=0; j<ncols; j++){
+					if(int(feld[i][j]) == nodata ||
+							int(g1->feld[i][j]) == g1->nodata)
+						feld[i][j]=nodata;
+					else
+						feld[i][j]=
+								g1->feld[i][j]>feld[i][j] ?
+										feld[i][j] : g1->feld[i][j];
+				}
 			}
-		}
+		});
 		break;
 	case MAX:
-		for(int i=0; i<nrows; i++){
-			for(int j=0; j<ncols; j++){
-				feld[i][j]=
-						g1->feld[i][j]<feld[i][j] ? feld[i][j] : g1->feld[i][j];
+		parallel_rows(nrows,[&](int i0, int i1){
+			for(int i=i0; i<i1; i++){
+				for(int j=0; j<ncols; j++){
+					feld[i][j]=
+							g1->feld[i][j]<feld[i][j] ? feld[i][j] : g1->feld[i][j];
+				}
 			}
-		}
+		});
 		break;
 	case AVG:
-		for(int i=0; i<nrows; i++){
-			for(int j=0; j<ncols; j++){
-				if(int(feld[i][j]) == nodata
-						|| int(g1->feld[i][j]) == g1->nodata)
-					feld[i][j]=nodata;
-				else
-					feld[i][j]=
-							(feld[i][j]+g1->feld[i][j])/2;
+		parallel_rows(nrows,[&](int i0, int i1){
+			for(int i=i0; i<i1; i++){
+				for(int j=0; j<ncols; j++){
+					if(int(feld[i][j]) == nodata
+							|| int(g1->feld[i][j]) == g1->nodata)
+						feld[i][j]=nodata;
+					else
+						feld[i][j]=
+								(feld[i][j]+g1->feld[i][j])/2;
+				}
 			}
-		}
+		});
 		break;
 	case ADD:
-		for(int i=0; i<nrows; i++){
-			for(int j=0; j<ncols; j++){
-				if(int(feld[i][j]) == nodata
-						|| int(g1->feld[i][j])==nodata)
-					feld[i][j] = nodata;
-				else
-					feld[i][j]=
-							(feld[i][j]+g1->feld[i][j]);
+		parallel_rows(nrows,[&](int i0, int i1){
+			for(int i=i0; i<i1; i++){
+				for(int j=0; j<ncols; j++){
+					if(int(feld[i][j]) == nodata
+							|| int(g1->feld[i][j])==nodata)
+						feld[i][j] = nodata;
+					else
+						feld[i][j]=
+								(feld[i][j]+g1->feld[i][j]);
+				}
 			}
-		}
+		});
 		break;
 	case MUL:
-		for(int i=0; i<nrows; i++){
-			for(int j=0; j<ncols; j++){
-				if(int(feld[i][j]) == nodata
-						|| int(g1->feld[i][j]) == g1->nodata)
-					feld[i][j]=nodata;
-				else
-					feld[i][j]=
-							(feld[i][j]*g1->feld[i][j]);
+		parallel_rows(nrows,[&](int i0, int i1){
+			for(int i=i0; i<i1; i++){
+				for(int j=0; j<ncols; j++){
+					if(int(feld[i][j]) == nodata
+							|| int(g1->feld[i][j]) == g1->nodata)
+						feld[i][j]=nodata;
+					else
+						feld[i][j]=
+								(feld[i][j]*g1->feld[i][j]);
+				}
 			}
-		}
+		});
 		break;
 	case DIV:
-		for(int i=0; i<nrows; i++){
-			for(int j=0; j<ncols; j++){
-				if(int(feld[i][j]) == nodata || g1->feld[i][j]==0
-						|| int(g1->feld[i][j]) == g1->nodata)
-					feld[i][j]=nodata;
-				else
-					feld[i][j]=
-							(feld[i][j]/g1->feld[i][j]);
+		parallel_rows(nrows,[&](int i0, int i1){
+			for(int i=i0; i<i1; i++){
+				for(int j=0; j<ncols; j++){
+					if(int(feld[i][j]) == nodata || g1->feld[i][j]==0
+							|| int(g1->feld[i][j]) == g1->nodata)
+						feld[i][j]=nodata;
+					else
+						feld[i][j]=
+								(feld[i][j]/g1->feld[i][j]);
+				}
 			}
-		}
+		});
 		break;
 	}
 	return 0;
@@ -3227,45 +3570,51 @@ int grid::combine_grid(grid* g1,int selector)
 grid* grid::combine_grid(float (*f)(float))
 {
 	grid* gx=grid_copy();
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata){
-				gx->feld[i][j]=f(feld[i][j]);
+	parallel_rows(nrows,[&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				if(int(feld[i][j])!=nodata){
+					gx->feld[i][j]=f(feld[i][j]);
+				}
+				else gx->feld[i][j]=nodata;
 			}
-			else gx->feld[i][j]=nodata;
 		}
-	}
+	});
 	return gx;
 }
 
 grid* grid::combine_grid(grid *g1, float (*f)(float,float))
 {
 	grid* gx=grid_copy();
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata &&
-					int(g1->feld[i][j])!=g1->nodata){
-				gx->feld[i][j]=f(feld[i][j],g1->feld[i][j]);
+	parallel_rows(nrows,[&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				if(int(feld[i][j])!=nodata &&
+						int(g1->feld[i][j])!=g1->nodata){
+					gx->feld[i][j]=f(feld[i][j],g1->feld[i][j]);
+				}
+				else gx->feld[i][j]=nodata;
 			}
-			else gx->feld[i][j]=nodata;
 		}
-	}
+	});
 	return gx;
 }
 
 grid* grid::combine_grid(grid *g1, grid *g2, float (*f)(float,float,float))
 {
 	grid* gx=grid_copy();
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(int(feld[i][j])!=nodata &&
-					int(g1->feld[i][j])!=g1->nodata &&
-					int(g2->feld[i][j])!=g1->nodata){
-				gx->feld[i][j]=f(feld[i][j],g1->feld[i][j],g2->feld[i][j]);
+	parallel_rows(nrows,[&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				if(int(feld[i][j])!=nodata &&
+						int(g1->feld[i][j])!=g1->nodata &&
+						int(g2->feld[i][j])!=g1->nodata){
+					gx->feld[i][j]=f(feld[i][j],g1->feld[i][j],g2->feld[i][j]);
+				}
+				else gx->feld[i][j]=nodata;
 			}
-			else gx->feld[i][j]=nodata;
 		}
-	}
+	});
 	return gx;
 }
 
@@ -3279,12 +3628,7 @@ grid* grid::zoom()
 	gxxx->csize=csize/2;
 	gxxx->nodata=nodata;
 	// allocate memory
-	gxxx->feld=new float*[gxxx->nrows];
-	for(int i=0; i<gxxx->nrows; i++){
-		if((gxxx->feld[i]=new float[gxxx->ncols])==NULL){
-			cerr << "error (upscale): no sufficient memory" << endl;
-		}
-	}
+	gxxx->alloc_feld(gxxx->nrows, gxxx->ncols);
 	has_nodata=NO;
 	for(int i=0; i<nrows; i++)
 		for(int j=0; j<ncols; j++)
@@ -3415,21 +3759,18 @@ grid* grid::upscale(int teiler)
 	gxxx->csize=csize/teiler;
 	gxxx->nodata=nodata;
 
-	gxxx->feld= new float*[gxxx->nrows];
-	for(int i=0; i<gxxx->nrows; i++){
-		if((gxxx->feld[i]=new float[gxxx->ncols])==NULL){
-			cerr << "error (upscale): no sufficient memory" << endl;
-		}
-	}
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			for(int k=0; k<teiler; k++){
-				for(int l=0; l<teiler; l++){
-					gxxx->feld[teiler*i+k][teiler*j+l]=feld[i][j];
+	gxxx->alloc_feld(gxxx->nrows, gxxx->ncols);
+	parallel_rows(nrows,[&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++){
+				for(int k=0; k<teiler; k++){
+					for(int l=0; l<teiler; l++){
+						gxxx->feld[teiler*i+k][teiler*j+l]=feld[i][j];
+					}
 				}
 			}
 		}
-	}
+	});
 	return gxxx;
 }
 
@@ -3448,28 +3789,25 @@ grid* grid::downscale(int multi)
 	gxxx->ycorner=ycorner;
 	gxxx->csize=csize*multi;
 	gxxx->nodata=nodata;
-	int flag=0;
-	gxxx->feld=new float*[gxxx->nrows];
-	for(int i=0; i<gxxx->nrows; i++){
-		if((gxxx->feld[i]=new float[gxxx->ncols])==NULL){
-			cerr << "error (downscale): no sufficient memory" << endl;
-		}
-	}
-	for(int i=0; i<gxxx->nrows; i++){
-		for(int j=0; j<gxxx->ncols; j++){
-			gxxx->feld[i][j]=0.0;
-			flag=0;
-			for(int k=0; k<multi; k++){
-				for(int l=0; l<multi; l++){
-					if(int(feld[multi*i+k][multi*j+l])==nodata) flag++;
-					else
-						gxxx->feld[i][j] += feld[multi*i+k][multi*j+l];
+	gxxx->alloc_feld(gxxx->nrows, gxxx->ncols);
+	parallel_rows(gxxx->nrows,[&](int i0, int i1){
+		int flag;
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<gxxx->ncols; j++){
+				gxxx->feld[i][j]=0.0;
+				flag=0;
+				for(int k=0; k<multi; k++){
+					for(int l=0; l<multi; l++){
+						if(int(feld[multi*i+k][multi*j+l])==nodata) flag++;
+						else
+							gxxx->feld[i][j] += feld[multi*i+k][multi*j+l];
+					}
 				}
+				if(flag>(multi*multi/2)) gxxx->feld[i][j]=nodata;
+				else gxxx->feld[i][j]/=(multi*multi-flag);
 			}
-			if(flag>(multi*multi/2)) gxxx->feld[i][j]=nodata;
-			else gxxx->feld[i][j]/=(multi*multi-flag);
 		}
-	}
+	});
 	return gxxx;
 }
 
@@ -3488,78 +3826,164 @@ grid* grid::downscale_s(int multi)
 	gxxx->ycorner=ycorner;
 	gxxx->csize=csize*multi;
 	gxxx->nodata=nodata;
-	int flag=0;
-	gxxx->feld= new float*[gxxx->nrows];
-	for(int i=0; i<gxxx->nrows; i++){
-		if((gxxx->feld[i]=new float[gxxx->ncols])==NULL){
-			cerr << "error (downscale_s): no sufficient memory" << endl;
+	gxxx->alloc_feld(gxxx->nrows, gxxx->ncols);
+	parallel_rows(gxxx->nrows,[&](int i0, int i1){
+		int flag;
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<gxxx->ncols; j++){
+				gxxx->feld[i][j]=0.0;
+				flag=0;
+				for(int k=0; k<multi; k++){
+					for(int l=0; l<multi; l++){
+						if(int(feld[multi*i+k][multi*j+l])==nodata) flag++;
+						else
+							gxxx->feld[i][j] += feld[multi*i+k][multi*j+l];
+					}
+				}
+				if(flag>(multi*multi/2)) gxxx->feld[i][j]=nodata;
+				else gxxx->feld[i][j]*=(float)(multi*multi-flag)/(multi*multi);
+			}
 		}
+	});
+	return gxxx;
+}
+
+// aggregates blocks of multi x multi fields like downscale (how=0, mean),
+// downscale_s (how=1, sum) or to the most frequent value (how=2, mode, the
+// smallest of equally frequent values), blocks at the right and bottom border
+// may be smaller, so the size doesn't have to be a multiple of multi, the
+// upper left corner stays in place
+grid* grid::overview(int multi, int how)
+{
+	if(multi<1 || how<0 || how>2){
+		cerr << "error (overview): multi=" << multi << " how=" << how << endl;
+		return 0;
 	}
-	for(int i=0; i<gxxx->nrows; i++){
-		for(int j=0; j<gxxx->ncols; j++){
-			gxxx->feld[i][j]=0.0;
-			flag=0;
-			for(int k=0; k<multi; k++){
-				for(int l=0; l<multi; l++){
-					if(int(feld[multi*i+k][multi*j+l])==nodata) flag++;
-					else
-						gxxx->feld[i][j] += feld[multi*i+k][multi*j+l];
+	grid* gx = new grid(rgr*multi);
+	gx->ncols = (ncols+multi-1)/multi;
+	gx->nrows = (nrows+multi-1)/multi;
+	gx->xcorner=xcorner;
+	gx->ycorner=ycorner+(nrows-gx->nrows*multi)*double(csize);
+	gx->csize=csize*multi;
+	gx->nodata=nodata;
+	gx->alloc_feld(gx->nrows, gx->ncols);
+	parallel_rows(gx->nrows,[&](int i0, int i1){
+		vector<float> vals;
+		for(int i=i0; i<i1; i++){
+			int kn=nrows-multi*i<multi ? nrows-multi*i : multi;
+			for(int j=0; j<gx->ncols; j++){
+				int ln=ncols-multi*j<multi ? ncols-multi*j : multi;
+				int n=kn*ln, flag=0;
+				float acc=0.0;
+				vals.clear();
+				for(int k=0; k<kn; k++){
+					for(int l=0; l<ln; l++){
+						float v=feld[multi*i+k][multi*j+l];
+						if(int(v)==nodata) flag++;
+						else if(how==2) vals.push_back(v);
+						else acc += v;
+					}
+				}
+				if(flag>(n/2)) gx->feld[i][j]=nodata;
+				else if(how==0) gx->feld[i][j]=acc/(n-flag);
+				else if(how==1) gx->feld[i][j]=acc*((float)(n-flag)/n);
+				else{
+					sort(vals.begin(),vals.end());
+					size_t best=0, bestn=0;
+					for(size_t k=0; k<vals.size();){
+						size_t e=k;
+						while(e<vals.size() && vals[e]==vals[k]) e++;
+						if(e-k>bestn){ best=k; bestn=e-k; }
+						k=e;
+					}
+					gx->feld[i][j]=vals[best];
 				}
 			}
-			if(flag>(multi*multi/2)) gxxx->feld[i][j]=nodata;
-			else gxxx->feld[i][j]*=(float)(multi*multi-flag)/(multi*multi);
 		}
-	}
-	return gxxx;
+	});
+	return gx;
 }
 
 
+namespace
+{
+	// 1d squared euclidean distance transform of the sampled function f
+	// (lower envelope of parabolas, Felzenszwalb & Huttenlocher 2004)
+	// f=HUGE_VAL marks cells without source, v and z need n and n+1 elements
+	void edt_1d(const double* f, double* d, int n, int* v, double* z)
+	{
+		int k=-1;
+		for(int q=0; q<n; q++){
+			if(f[q]==HUGE_VAL) continue;
+			if(k<0){
+				k=0; v[0]=q; z[0]=-HUGE_VAL; z[1]=HUGE_VAL;
+				continue;
+			}
+			double s=((f[q]+double(q)*q)-(f[v[k]]+double(v[k])*v[k]))/(2.0*(q-v[k]));
+			while(s<=z[k]){
+				k--;
+				s=((f[q]+double(q)*q)-(f[v[k]]+double(v[k])*v[k]))/(2.0*(q-v[k]));
+			}
+			k++;
+			v[k]=q; z[k]=s; z[k+1]=HUGE_VAL;
+		}
+		if(k<0){
+			for(int q=0; q<n; q++) d[q]=HUGE_VAL;
+			return;
+		}
+		k=0;
+		for(int q=0; q<n; q++){
+			while(z[k+1]<q) k++;
+			d[q]=double(q-v[k])*(q-v[k])+f[v[k]];
+		}
+	}
+}
+
+// exact euclidean distance (in csize units) to the next cell with value val,
+// computed as separable distance transform, first along the columns,
+// then along the rows, each pass running on all cores
 grid* grid::distance(float val)
 {
-	vector<ipoint*> ivec;
-	vector<ipoint*>::iterator p;
-	double dist;
 	grid* gx=grid_copy();
-	// init gx
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(fabs(feld[i][j]-val)<RES)
-				gx->feld[i][j]=0;
-			else
-				gx->feld[i][j]=FLT_MAX;
+	if(nrows<=0 || ncols<=0) return gx;
+	// column pass: gx gets the number of cells to the next source cell
+	// in the same column (exact as float up to 2^24 rows), FLT_MAX if none
+	parallel_rows(ncols,[&](int j0, int j1){
+		for(int j=j0; j<j1; j++)
+			gx->feld[0][j]=fabs(feld[0][j]-val)<RES ? 0 : FLT_MAX;
+		for(int i=1; i<nrows; i++){
+			for(int j=j0; j<j1; j++){
+				if(fabs(feld[i][j]-val)<RES)
+					gx->feld[i][j]=0;
+				else
+					gx->feld[i][j]=gx->feld[i-1][j]==FLT_MAX ? FLT_MAX : gx->feld[i-1][j]+1;
+			}
 		}
-	}
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(fabs((double)gx->feld[i][j])<RES){
-				ipoint* fp=new ipoint();
-				fp->x=i;
-				fp->y=j;
-				ivec.push_back(fp);
+		for(int i=nrows-2; i>=0; i--){
+			for(int j=j0; j<j1; j++){
+				if(gx->feld[i+1][j]!=FLT_MAX && gx->feld[i+1][j]+1<gx->feld[i][j])
+					gx->feld[i][j]=gx->feld[i+1][j]+1;
 			}
 		}
-	}
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			if(fabs((double)gx->feld[i][j])<RES);
-			else{
-				for(p=ivec.begin(); p!=ivec.end(); p++){
-					dist=sqrt((double)(((*p)->x-i)*((*p)->x-i)+
-							((*p)->y-j)*((*p)->y-j)));
-					if(gx->feld[i][j]>dist) gx->feld[i][j]=
-							(float)dist;
-					if(fabs((double)(gx->feld[i][j]-1)) < RES) break;
-				}
+	});
+	// row pass: combine the column distances to the squared distance
+	parallel_rows(nrows,[&](int i0, int i1){
+		vector<double> f(ncols), d(ncols), z(ncols+1);
+		vector<int> v(ncols);
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<ncols; j++)
+				f[j]=gx->feld[i][j]==FLT_MAX ? HUGE_VAL
+				     : double(gx->feld[i][j])*gx->feld[i][j];
+			edt_1d(&f[0],&d[0],ncols,&v[0],&z[0]);
+			for(int j=0; j<ncols; j++){
+				gx->feld[i][j]=d[j]==HUGE_VAL ? FLT_MAX : (float)sqrt(d[j]);
+				if(feld[i][j]!=nodata)
+					gx->feld[i][j]*=gx->csize;
+				else
+					gx->feld[i][j]=nodata;
 			}
-			if(feld[i][j]!=nodata)
-				gx->feld[i][j]*=gx->csize;
-			else
-				gx->feld[i][j]=nodata;
 		}
-	}
-	for(p=ivec.begin(); p!=ivec.end(); p++){
-		delete (*p);
-	}
+	});
 	return gx;
 }
 
@@ -3656,46 +4080,6 @@ grid* grid::visuability(point* pf)
 	return v_grid;
 }
 
-void grid::write_ascii(char* name)
-{
-	FILE *fp1;
-	fp1 = fopen(name,"w");
-
-	fprintf(fp1,"ncols         %d\n",ncols);
-	fprintf(fp1,"nrows         %d\n",nrows);
-	fprintf(fp1,"xllcorner     %f\n",xcorner);
-	fprintf(fp1,"yllcorner     %f\n",ycorner);
-	fprintf(fp1,"cellsize      %5.1f\n",csize);
-	fprintf(fp1,"NODATA_value  %d\n",nodata);
-	// write out
-	for(int i=0; i<nrows; i++){
-		for(int j=0; j<ncols; j++){
-			fprintf(fp1,"%4.3f ",feld[i][j]);
-		}
-		fprintf(fp1,"\n");
-	}
-	fclose(fp1);
-}
-void grid::write_ascii_inv(char* name)
-{
-	FILE *fp1;
-	fp1 = fopen(name,"w");
-	fprintf(fp1,"ncols         %d\n",ncols);
-	fprintf(fp1,"nrows         %d\n",nrows);
-	fprintf(fp1,"xllcorner     %f\n",xcorner);
-	fprintf(fp1,"yllcorner     %f\n",ycorner);
-	fprintf(fp1,"cellsize      %5.1f\n",csize);
-	fprintf(fp1,"NODATA_value  %d\n",nodata);
-	// write out
-	for(int i=nrows-1; i>=0; i--){
-		for(int j=0; j<ncols; j++){
-			fprintf(fp1,"%4.3f ",feld[i][j]);
-		}
-		fprintf(fp1,"\n");
-	}
-	fclose(fp1);
-}
-
 void grid::write_pnm(char* name, int farbe)
 {
 	float wert;
@@ -4276,8 +4660,6 @@ grid* point::p2g(grid* gx, double r)
 
 grid* point::p2g_shepard(grid* gx,double R, double mu)
 {
-	double l,val;
-	unsigned count=0;
 	fprintf(stderr,"point to grid using shepard: R=%lf mu=%lf\n",R,mu);
 	if(R>sqrt((gx->nrows*gx->csize)*(gx->nrows*gx->csize)+
 	          (gx->ncols*gx->csize)*(gx->ncols*gx->csize))/2){
@@ -4293,76 +4675,80 @@ grid* point::p2g_shepard(grid* gx,double R, double mu)
 		for(int j=0; j<nx->ncols; j++)
 			if(nx->feld[i][j]!=nx->nodata)
 				nx->feld[i][j]=0;
-	for(int i=0; i<nx->nrows; i++){
-		for(int j=0; j<nx->ncols; j++){
-			double r=0;
-			double rall=0;
-			count=0;
-			for(int k=0; k<length; k++){
-				if(feld[k][0]>=nx->xcorner &&
-						feld[k][0]<nx->xcorner+gx->csize*gx->ncols &&
-						feld[k][1]>=nx->ycorner &&
-						feld[k][1]<nx->ycorner+nx->csize*gx->nrows){
-					count++;
-					l=sqrt((nx->xcorner+nx->csize*j-feld[k][0])*
-					       (nx->xcorner+nx->csize*j-feld[k][0])+
-					       (nx->ycorner+nx->csize*i-feld[k][1])*
-					       (nx->ycorner+nx->csize*i-feld[k][1]));
+	// only the points within the grid are used
+	vector<int> ids;
+	for(int k=0; k<length; k++){
+		if(feld[k][0]>=nx->xcorner &&
+				feld[k][0]<nx->xcorner+gx->csize*gx->ncols &&
+				feld[k][1]>=nx->ycorner &&
+				feld[k][1]<nx->ycorner+nx->csize*gx->nrows)
+			ids.push_back(k);
+	}
+	point_buckets pb(feld,ids,nx->xcorner,nx->ycorner,
+	                 nx->csize*nx->ncols,nx->csize*nx->nrows);
+	// the points are summed up in the original order, to get the same results
+	parallel_rows(nx->nrows,[&](int i0, int i1){
+		vector<int> near;
+		double l,val;
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<nx->ncols; j++){
+				double r=0;
+				double rall=0;
+				double x=nx->xcorner+nx->csize*j, y=nx->ycorner+nx->csize*i;
+				pb.within(x,y,R,near);
+				for(size_t n=0; n<near.size(); n++){
+					int k=near[n];
+					l=sqrt((x-feld[k][0])*(x-feld[k][0])+
+					       (y-feld[k][1])*(y-feld[k][1]));
 					if(l<R){
 						l=1-l/R;
 						val=pow(l,mu);
 						rall+=val;
 						r+=val*feld[k][2];}
 				}
+				if(gx->feld[nx->nrows-1-i][j]!=gx->nodata && r!=0 && rall!=0)
+					nx->feld[nx->nrows-1-i][j]=r/rall;
+				else
+					nx->feld[nx->nrows-1-i][j]=nx->nodata;
 			}
-			if(gx->feld[nx->nrows-1-i][j]!=gx->nodata && r!=0 && rall!=0)
-				nx->feld[nx->nrows-1-i][j]=r/rall;
-			else
-				nx->feld[nx->nrows-1-i][j]=nx->nodata;
 		}
-	}
-	fprintf(stderr,"p2g_shepard: %d points are used\n",count);
+	});
+	fprintf(stderr,"p2g_shepard: %d points are used\n",int(ids.size()));
 	return nx;
 }
 
 
 grid* point::p2g_voronoi(grid* gx)
 {
-	double l,val;
-	unsigned count=0;
 	grid* nx=gx->grid_copy();
-	for(int i=0; i<nx->nrows; i++)
-		for(int j=0; j<nx->ncols; j++)
-			if(nx->feld[i][j]!=nx->nodata)
-				nx->feld[i][j]=0;
-	for(int i=0; i<nx->nrows; i++){
-		for(int j=0; j<nx->ncols; j++){
-			count=0;
-			val=FLT_MAX;
-			for(int k=0; k<length; k++){
-				if(feld[k][0]>=nx->xcorner &&
-						feld[k][0]<nx->xcorner+gx->csize*gx->ncols &&
-						feld[k][1]>=nx->ycorner &&
-						feld[k][1]<nx->ycorner+nx->csize*gx->nrows){
-					l=sqrt((nx->xcorner+nx->csize*j-feld[k][0])*
-					       (nx->xcorner+nx->csize*j-feld[k][0])+
-					       (nx->ycorner+nx->csize*(nx->nrows-i-1)
-					      		 -feld[k][1])*
-					      		 (nx->ycorner+nx->csize*(nx->nrows-i-1)
-					      				 -feld[k][1]));
-					if(val>l){
-						val=l;
-						count=k;
-					}
-				}
+	vector<int> ids;
+	for(int k=0; k<length; k++){
+		if(feld[k][0]>=nx->xcorner &&
+				feld[k][0]<nx->xcorner+gx->csize*gx->ncols &&
+				feld[k][1]>=nx->ycorner &&
+				feld[k][1]<nx->ycorner+nx->csize*gx->nrows)
+			ids.push_back(k);
+	}
+	point_buckets pb(feld,ids,nx->xcorner,nx->ycorner,
+	                 nx->csize*nx->ncols,nx->csize*nx->nrows);
+	// exact nearest point for every cell (ties go to the first point)
+	parallel_rows(nx->nrows,[&](int i0, int i1){
+		for(int i=i0; i<i1; i++){
+			double y=nx->ycorner+nx->csize*(nx->nrows-i-1);
+			for(int j=0; j<nx->ncols; j++){
+				double x=nx->xcorner+nx->csize*j;
+				int k=pb.nearest(x,y,[&](int p){
+					return sqrt((x-feld[p][0])*(x-feld[p][0])+
+					            (y-feld[p][1])*(y-feld[p][1]));
+				});
+				if(gx->feld[i][j]!=gx->nodata)
+					nx->feld[i][j]=feld[k<0 ? 0 : k][2];
+				else
+					nx->feld[i][j]=nx->nodata;
 			}
-			if(gx->feld[i][j]!=gx->nodata)
-				nx->feld[i][j]=feld[count][2];
-			else
-				nx->feld[i][j]=nx->nodata;
 		}
-	}
-	fprintf(stderr,"p2g_voronoi: %d points are used\n",count);
+	});
+	fprintf(stderr,"p2g_voronoi: %d points are used\n",int(ids.size()));
 	return nx;
 }
 
@@ -5562,13 +5948,7 @@ grid* cluster::get_cluster()
 	gx->ycorner = ycorner;
 	gx->csize = csize;
 	gx->nodata = nodata;
-	gx->feld = (float**) new float*[gx->nrows];
-	for(int i=0; i<gx->nrows; i++){
-		if((gx->feld[i]=new float[gx->ncols])==NULL){
-			cerr << "error (get_cluster): no sufficient memory" << endl;
-			exit(2);
-		}
-	}
+	gx->alloc_feld(gx->nrows, gx->ncols);
 	for(int i=0; i<nrows; i++){
 		for(int j=0; j<ncols; j++){
 			if(feld[i][j]<0) gx->feld[i][j]=-0.001;
@@ -6288,14 +6668,8 @@ grid* grid::shepard(int c, int r, int R, float mu)
 	gx->ycorner = ycorner;
 	gx->csize = csize*sqrt((double((nrows*ncols))/(c*r)));
 	gx->nodata = nodata;
-	gx->feld = (float**) new float*[gx->nrows];
-	for(int i=0; i<gx->nrows; i++){
-		if((gx->feld[i]=new float[gx->ncols])==NULL){
-			cerr << "error (grid::shepard): no sufficient memory" << endl;
-		}
-	}
-	float wxy, wz, dist, radius, phi;//, sci;
-	int lx,ly;
+	gx->alloc_feld(gx->nrows, gx->ncols);
+	float dist, radius, phi;//, sci;
 	float dly,dlx;
 	int fx,fy;
 	fx=c/ncols;
@@ -6303,33 +6677,51 @@ grid* grid::shepard(int c, int r, int R, float mu)
 	radius=sqrt((double)(R+1)*(R+1)+(R+1)*(R+1));
 	cerr << " radius: " << radius
 	<< " R: " << R << " mu: " << mu << endl;
-	for(int i=0; i<gx->nrows; i++){
-		for(int j=0; j<gx->ncols; j++){
-			wxy=wz=0.0;
-			lx=(int)i/fy;
-			ly=(int)j/fx;
-			dlx=(float)(i%fy)/fy;
-			dly=(float)(j%fx)/fx;
-			// cerr << "dlx " << dlx << " dly: " << dly << endl;
+	// the weights only depend on the position within the source cell,
+	// so they are calculated once for each of the fx*fy positions
+	int w=2*R+1;
+	vector<float> weights(size_t(fx)*fy*w*w);
+	for(int a=0; a<fy; a++){
+		for(int b=0; b<fx; b++){
+			dlx=(float)a/fy;
+			dly=(float)b/fx;
+			float* wt=&weights[(size_t(a)*fx+b)*w*w];
 			for(int k=-R; k<=R; k++){
 				for(int l=-R; l<=R; l++){
 					dist=sqrt((k-dlx)*(k-dlx)+(l-dly)*(l-dly));
-					if(dist<radius)phi=1.0-dist/radius;
-					if(lx+k>=0 && lx+k<nrows && ly+l>=0
-							&& ly+l<ncols && phi>0){
-						if(int(feld[lx+k][ly+l])!=nodata){
-							wz+=pow(phi,mu)*feld[lx+k][ly+l];
-							wxy+=pow(phi,mu);
+					phi=1.0-dist/radius; // dist<radius for all k,l
+					wt[(k+R)*w+l+R]=phi>0 ? pow(phi,mu) : 0;
+				}
+			}
+		}
+	}
+	parallel_rows(gx->nrows,[&](int i0, int i1){
+		float wxy, wz;
+		int lx,ly;
+		for(int i=i0; i<i1; i++){
+			for(int j=0; j<gx->ncols; j++){
+				wxy=wz=0.0;
+				lx=(int)i/fy;
+				ly=(int)j/fx;
+				const float* wt=&weights[(size_t(i%fy)*fx+j%fx)*w*w];
+				for(int k=-R; k<=R; k++){
+					for(int l=-R; l<=R; l++){
+						if(lx+k>=0 && lx+k<nrows && ly+l>=0
+								&& ly+l<ncols && wt[(k+R)*w+l+R]>0){
+							if(int(feld[lx+k][ly+l])!=nodata){
+								wz+=wt[(k+R)*w+l+R]*feld[lx+k][ly+l];
+								wxy+=wt[(k+R)*w+l+R];
+							}
 						}
 					}
 				}
+				if(wz>0 && wxy>0)
+					gx->feld[i][j]=wz/wxy;
+				else
+					gx->feld[i][j]=nodata;
 			}
-			if(wz>0 && wxy>0)
-				gx->feld[i][j]=wz/wxy;
-			else
-				gx->feld[i][j]=nodata;
 		}
-	}
+	});
 	return gx;
 }
 
@@ -53,7 +53,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <fstream>
 #include <map>
 #include <vector>
+#include <functional>
 #include <cmath>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #ifndef NO_HDF5
 #include "hdf5.h"
@@ -88,14 +92,21 @@ namespace Grids
 		int closeFile();
 		int create_f(const char*);
 		int open_d(const char*);                          // dataset_name
+		int delete_d(const char*);                        // dataset_name, unlinks it from the file
 
 		static std::list<std::string> allDatasetNames(const char* fileName);
 
 		// data read/write
 		void write_i_feld(const char*,int*,int,int);      // name,feld[NX*NY],NX,NY
 		void write_f_feld(const char*,float*,int,int);
+		int write_f_feld(const char*,float*,int,int,int);  // name,feld,NX,NY,row stride of feld
 		int* read_i_feld(const char*);
 		float* read_f_feld(const char*);
+		int read_f_feld(const char*,float*,int,int,int); // name,feld,NX,NY,row stride of feld
+		// overwrites the values of the dataset opened by open_d, if it holds NX*NY of them
+		int overwrite_f_feld(float*,int,int,int);         // feld,NX,NY,row stride of feld
+		// block of the open dataset: feld,NX,NY of dataset,row,col,rows,cols,row stride of feld
+		int read_f_block(float*,int,int,int,int,int,int,int);
 		// attributes
 		int write_s_attribute(const char*,const char*);         // attribute_name,data
 		int write_f_attribute(const char*,float);
@@ -113,6 +124,21 @@ namespace Grids
 	protected:
 		hid_t file, dataset;
 	};
+
+	//! holds the process wide hdf lock during its lifetime
+	//! - the hdf5 library isn't built thread safe, so every access to a hdf
+	//! file (grid::read_hdf/write_hdf, GridP, TiledGridP, GridManager) holds
+	//! it while the file is open
+	//! - the lock is recursive, so the accesses may nest
+	class HdfLock
+	{
+	public:
+		HdfLock();
+		~HdfLock();
+	private:
+		HdfLock(const HdfLock&);
+		HdfLock& operator=(const HdfLock&);
+	};
 #endif
 #endif //NO_HDF5
 
@@ -144,10 +170,39 @@ namespace Grids
 	class point;
 	class line;
 	class stack2i;
+	class validity_mask;
+	class focal_table;
 	//class tree;
 
 	void grid_save_to_R(char*,int);   // filename, number of bins
 
+	// number of threads used by the grid operations, 0 = one per core (default)
+	void set_grid_threads(int);
+	int grid_threads();
+
+	// calls f(first,last) for consecutive parts of [0,n), one per thread
+	void parallel_rows(int n, const std::function<void(int,int)>& f);
+
+	// deterministic reduction over [0,n): the range is cut into chunks of
+	// grain rows independent of the number of threads, map(first,last) is
+	// called for every chunk (in parallel) and the partial results are
+	// combined in chunk order, so sums don't change with the number of threads
+	template<class T, class Map, class Combine>
+	T parallel_reduce(int n, int grain, T init, Map map, Combine combine)
+	{
+		if(grain<1) grain=1;
+		int nchunks=(n+grain-1)/grain;
+		std::vector<T> parts(nchunks, init);
+		parallel_rows(nchunks, [&](int c0, int c1){
+			for(int c=c0; c<c1; c++)
+				parts[c]=map(c*grain, c*grain+grain<n ? c*grain+grain : n);
+		});
+		T res=init;
+		for(int c=0; c<nchunks; c++)
+			res=combine(res, parts[c]);
+		return res;
+	}
+
 	class grid{
 	public:
 		grid(int);              // Rastergroesse in m (10,50,100,500,1000)
@@ -172,12 +227,15 @@ namespace Grids
 		grid* upscale(int);      // generiert ein 100m grid aus 500m
 		grid* downscale(int);      // und umgekehrt
 		grid* downscale_s(int);    // bildet die Summe, nicht den Mittelwert
+		grid* overview(int,int);   // multi, 0=mean 1=sum 2=mode (any size)
 		grid* zoom();            // zooming a grid with 2
 		grid* shepard(int,int,int,float);    // shepard interpolation
 		grid* select(int,int,int,int); // selectiert ein Teilfeld
 		grid* select(float); // selects only values=float
+		grid* sub_view(int,int,int,int); // top,left,rows,cols shares the fields (no copy)
 		// lu,rl  (x,y)-linke obere Ecke (x,y)-rechte untere Ecke
 		void stat();          // berechnet min,max,mean,std
+		void stat(const validity_mask&); // same, only visiting the valid fields
 		int* hist(int);     // Histogramm (MAX-MIN)/BINS
 		void class_grid(float,float,float); // min max step
 		void set_value(float); // set all values
@@ -206,11 +264,13 @@ namespace Grids
 		// im,jm (Mittelpunkt) alpha,sigma,gamma
 		// some algorithms for erosionsmodelling
 		void w_fill();         // fills sink cells in the grid
+		void w_fill_depressions(); // fills all depressions (priority flood)
 		grid* w_focalflow();   // calculates a possible in flowdirection
 		grid* w_d8();     // calc flow from dir and elevation
 		// e:1 se:2 s:4 sw:8 w:16 nw:32 n:64 ne:128
 		grid* w_flowdirection(); // calculates the steepest decent of outflow
 		// e:1 se:2 s:4 sw:8 w:16 nw:32 n:64 ne:128
+		grid* w_flowaccumulation(); // number of cells draining through a cell (d8)
 		grid* grid_copy();    // grid 1:1 kopieren
 		void norm_grid();     // grid in [0 1] range
 		void norm_grid(float,float);  // grid in [0 1] range from min to max
@@ -257,7 +317,12 @@ namespace Grids
 		float obv,ebv,sigmabv;
 		float variance1,variance2,covariance;
 		int minx,miny,maxx,maxy; // Ergebnisse stat Koordinaten
-		float **feld;           // Feld[nrows][ncols]
+		float **feld;           // Feld[nrows][ncols], row pointers into data
+		float *data;            // contiguous field, row i starts at data+i*stride
+		int stride;             // floats per row (ncols padded to 64 bytes)
+		void alloc_feld(int,int); // nrows, ncols (doesn't set nrows, ncols)
+		void free_feld();
+		size_t memory_size() const; // bytes allocated by the grid, views don't own their fields
 		int has_nodata;         // yes=1 no=0 unknown=-1
 		int nodata;
 		int rgr;                // Rastergroesse
@@ -269,6 +334,114 @@ namespace Grids
 #endif
 		double *dfeld;
 		bool variance_flag;
+	private:
+		char *buffer;           // allocated memory of data
+	};
+
+	// packed validity mask of a grid, one bit per field (1=data, 0=nodata)
+	// every row starts at a new 64 bit word, so whole words without data
+	// (e.g. outside of a federal state in its bounding box) can be skipped
+	class validity_mask{
+	public:
+		typedef unsigned long long word;
+		enum { bits_per_word = 64 };
+
+		validity_mask() : nrows(0), ncols(0), nwords(0) {}
+		validity_mask(int rows, int cols)  // all fields invalid
+			: nrows(rows), ncols(cols), nwords((cols+bits_per_word-1)/bits_per_word),
+				bits(size_t(rows)*((cols+bits_per_word-1)/bits_per_word), 0) {}
+		validity_mask(const grid&);        // valid = int(feld[i][j])!=nodata
+
+		// recalculate the bits of row from the data of the row
+		void update_row(int row, const float* data, int nodata);
+		bool is_valid(int row, int col) const {
+			return (bits[size_t(row)*nwords + col/bits_per_word] >> (col%bits_per_word)) & 1;
+		}
+		void set(int row, int col, bool valid){
+			word& w = bits[size_t(row)*nwords + col/bits_per_word];
+			word b = word(1) << (col%bits_per_word);
+			w = valid ? (w | b) : (w & ~b);
+		}
+		const word* row_words(int row) const { return &bits[size_t(row)*nwords]; }
+		long count() const;                // number of valid fields
+
+		// calls f(col) for the valid fields of row in ascending order
+		template<class F>
+		void for_each_valid(int row, F f) const {
+			const word* ws = row_words(row);
+			for(int i=0; i<nwords; i++){
+				for(word w=ws[i]; w; w &= w-1)
+					f(i*bits_per_word + lowest_bit(w));
+			}
+		}
+
+		static int lowest_bit(word w){
+#ifdef _MSC_VER
+			unsigned long i;
+			_BitScanForward64(&i, w);
+			return int(i);
+#else
+			return __builtin_ctzll(w);
+#endif
+		}
+
+		int nrows, ncols;
+		int nwords;                          // words per row
+		std::vector<word> bits;
+	};
+
+	// summed-area tables (integral images) of the data fields of a grid,
+	// sum, number, mean and variance of the data fields in any rectangular
+	// window are answered in O(1), other window shapes in O(rows of the shape)
+	// - the sums are accumulated in double, so they are exact for integer data
+	// - windows are clipped to the grid, nodata fields don't count
+	class focal_table{
+	public:
+		// a horizontal part of a window: row offset, first and last column offset
+		struct run{ int drow, dcol0, dcol1; };
+
+		focal_table(const grid&);
+
+		// windows [row0..row1] x [col0..col1]
+		double sum(int row0, int col0, int row1, int col1) const {
+			return rect(s, row0, col0, row1, col1);
+		}
+		double sum2(int row0, int col0, int row1, int col1) const {
+			return rect(s2, row0, col0, row1, col1);
+		}
+		int count(int row0, int col0, int row1, int col1) const {
+			return int(rect(n, row0, col0, row1, col1));
+		}
+		double mean(int row0, int col0, int row1, int col1) const; // 0 if empty
+		double variance(int row0, int col0, int row1, int col1) const; // population
+
+		// moore environment of radius r, same fields as grid::moore(row,col,r,MOORE)
+		double moore_sum(int row, int col, int r) const {
+			return sum(row-r, col-r, row+r, col+r);
+		}
+
+		// window of any shape around (row,col), given by its runs
+		double sum(int row, int col, const std::vector<run>&) const;
+		// same fields as grid::moore(row,col,r,CIRCLE)
+		static std::vector<run> circle_shape(int r);
+
+		int nrows, ncols;
+	private:
+		template<class T>
+		double rect(const std::vector<T>& t, int row0, int col0, int row1, int col1) const {
+			if(row0<0) row0=0;
+			if(col0<0) col0=0;
+			if(row1>=nrows) row1=nrows-1;
+			if(col1>=ncols) col1=ncols-1;
+			if(row0>row1 || col0>col1) return 0;
+			return double(t[at(row1+1,col1+1)]) - t[at(row0,col1+1)]
+				- t[at(row1+1,col0)] + t[at(row0,col0)];
+		}
+		size_t at(int row, int col) const { return size_t(row)*(ncols+1)+col; }
+
+		// (nrows+1) x (ncols+1), entry (i,j) covers the fields [0..i) x [0..j)
+		std::vector<double> s, s2;
+		std::vector<int> n;
 	};
 
 	class stack2i{
@@ -0,0 +1,130 @@
+/**
+Authors:
+Ralf Wieland <ralf.wieland@zalf.de>
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers:
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <cstddef>
+
+#ifdef WIN32
+#include <fstream>
+#include <iterator>
+#include <string>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Grids
+{
+	/*!
+	 * view of a whole file in memory (read completely on windows)
+	 * - sequential: the file is going to be read from start to end
+	 * - copy on write: the view may be changed, but the changes never get
+	 * into the file
+	 */
+	class MappedFile
+	{
+	public:
+		enum Usage { eSequential, eCopyOnWrite };
+
+		MappedFile(const char* name, Usage usage = eSequential)
+			: begin(NULL), end(NULL), _ok(false)
+		{
+#ifdef WIN32
+			std::ifstream in(name, std::ios::in | std::ios::binary);
+			if(!in)
+				return;
+			_buffer.assign(std::istreambuf_iterator<char>(in),
+			               std::istreambuf_iterator<char>());
+			begin = &_buffer[0];
+			end = begin + _buffer.size();
+			_ok = true;
+#else
+			_fd = open(name, O_RDONLY);
+			if(_fd < 0)
+				return;
+			struct stat st;
+			if(fstat(_fd, &st) != 0)
+				return;
+			_size = size_t(st.st_size);
+			_ok = true;
+			if(_size == 0)
+				return;
+			_map = usage == eCopyOnWrite
+				? mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE, _fd, 0)
+				: mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+			if(_map == MAP_FAILED)
+			{
+				_map = NULL;
+				_ok = false;
+				return;
+			}
+#ifdef MADV_SEQUENTIAL
+			if(usage == eSequential)
+				madvise(_map, _size, MADV_SEQUENTIAL);
+#endif
+			begin = (char*)_map;
+			end = begin + _size;
+#endif
+		}
+
+		~MappedFile()
+		{
+#ifndef WIN32
+			if(_map)
+				munmap(_map, _size);
+			if(_fd >= 0)
+				close(_fd);
+#endif
+		}
+
+		bool isOpen() const { return _ok; }
+
+		size_t size() const { return size_t(end - begin); }
+
+		char* begin;
+		char* end;
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+
+		bool _ok;
+#ifdef WIN32
+		std::string _buffer;
+#else
+		int _fd = -1;
+		void* _map = NULL;
+		size_t _size = 0;
+#endif
+	};
+}
+
+#endif
@@ -0,0 +1,405 @@
+/**
+Authors:
+Ralf Wieland <ralf.wieland@zalf.de>
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers:
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifndef Q_MOC_RUN
+#include <boost/cstdint.hpp>
+#include <boost/weak_ptr.hpp>
+#endif //Q_MOC_RUN
+
+#define LOKI_OBJECT_LEVEL_THREADING
+#include "loki/Threads.h"
+
+#include "mapped-grid-file.h"
+#include "mapped-file.h"
+
+using namespace Grids;
+using namespace std;
+using boost::int32_t;
+using boost::int64_t;
+
+namespace
+{
+	struct L : public Loki::ObjectLevelLockable<L> {};
+
+	const char magic[8] = {'M', 'A', 'P', 'G', 'R', 'I', 'D', '1'};
+	const int64_t pageSize = 4096;
+
+	struct FileHeader
+	{
+		char magic[8];
+		int32_t noOfGrids;
+		int32_t reserved;
+	};
+
+	struct IndexEntry
+	{
+		char name[64];
+		int32_t nrows, ncols, stride, nodata;
+		float csize;
+		int32_t reserved;
+		double xcorner, ycorner;
+		int64_t offset; //!< of the first row in the file
+	};
+
+	const size_t indexSize =
+			sizeof(FileHeader) + maxGridsPerMappedFile*sizeof(IndexEntry);
+
+	//! the grids start behind the index at the next page
+	const int64_t firstGridOffset =
+			(int64_t(indexSize) + pageSize - 1) / pageSize * pageSize;
+
+	int seekTo(FILE* f, int64_t offset)
+	{
+#ifdef WIN32
+		return _fseeki64(f, offset, SEEK_SET);
+#else
+		return fseeko(f, off_t(offset), SEEK_SET);
+#endif
+	}
+
+	//! the bytes of a grid in the file, padded to the next page
+	int64_t gridBytes(const IndexEntry& e)
+	{
+		int64_t bytes = int64_t(e.nrows)*e.stride*int64_t(sizeof(float));
+		return (bytes + pageSize - 1) / pageSize * pageSize;
+	}
+
+	//! copies n bytes at offset in from to the current position in to
+	bool copyBytes(FILE* from, int64_t offset, int64_t n, FILE* to)
+	{
+		if(seekTo(from, offset) != 0)
+			return false;
+		vector<char> buffer(size_t(min(n, int64_t(1 << 20))));
+		while(n > 0)
+		{
+			size_t chunk = size_t(min(n, int64_t(buffer.size())));
+			if(fread(&buffer[0], 1, chunk, from) != chunk
+				 || fwrite(&buffer[0], 1, chunk, to) != chunk)
+				return false;
+			n -= chunk;
+		}
+		return true;
+	}
+
+	/*!
+	 * exclusive lock of the writers of a file across processes, it is taken on
+	 * a separate lock file, because the file itself gets replaced
+	 */
+	class WriterLock
+	{
+	public:
+		WriterLock(const string& pathToFile) : _fd(-1)
+		{
+#ifndef WIN32
+			_fd = open((pathToFile + ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+			if(_fd >= 0 && flock(_fd, LOCK_EX) != 0)
+			{
+				close(_fd);
+				_fd = -1;
+			}
+#endif
+		}
+
+		~WriterLock()
+		{
+#ifndef WIN32
+			if(_fd >= 0)
+				close(_fd);
+#endif
+		}
+
+		bool isLocked() const
+		{
+#ifdef WIN32
+			return true;
+#else
+			return _fd >= 0;
+#endif
+		}
+
+	private:
+		int _fd;
+	};
+
+	//! the index part of the file, false if it isn't a mapped grid file
+	bool readIndex(const char* begin, size_t size, FileHeader& h,
+	               const IndexEntry*& entries)
+	{
+		if(size < indexSize)
+			return false;
+		memcpy(&h, begin, sizeof(FileHeader));
+		entries = (const IndexEntry*)(begin + sizeof(FileHeader));
+		return memcmp(h.magic, magic, sizeof(magic)) == 0
+				&& 0 <= h.noOfGrids && h.noOfGrids <= maxGridsPerMappedFile;
+	}
+
+	int findEntry(const FileHeader& h, const IndexEntry* entries,
+	              const string& gridName)
+	{
+		for(int i = 0; i < h.noOfGrids; i++)
+			if(strncmp(entries[i].name, gridName.c_str(), sizeof(entries[i].name)) == 0)
+				return i;
+		return -1;
+	}
+
+	struct Mapping
+	{
+		Mapping() : ino(0), mtime(0) {}
+		boost::weak_ptr<MappedFile> mf;
+		ino_t ino;
+		time_t mtime;
+	};
+
+	//! the current mapping of the file, shared by all grids using it
+	boost::shared_ptr<MappedFile> mappingOf(const string& pathToFile)
+	{
+		static L lockable;
+		static map<string, Mapping> mappings;
+
+		struct stat st;
+		if(stat(pathToFile.c_str(), &st) != 0)
+			return boost::shared_ptr<MappedFile>();
+
+		L::Lock lock(lockable);
+		Mapping& m = mappings[pathToFile];
+		boost::shared_ptr<MappedFile> mf = m.mf.lock();
+		//every write replaces the file, the inode of a mapped file can't be
+		//reused as long as the mapping keeps it open
+		if(!mf || mf->size() != size_t(st.st_size)
+			 || m.ino != st.st_ino || m.mtime != st.st_mtime)
+		{
+			mf = boost::shared_ptr<MappedFile>
+					(new MappedFile(pathToFile.c_str(), MappedFile::eCopyOnWrite));
+			if(!mf->isOpen())
+				return boost::shared_ptr<MappedFile>();
+			m.mf = mf;
+			m.ino = st.st_ino;
+			m.mtime = st.st_mtime;
+		}
+		return mf;
+	}
+}
+
+bool Grids::writeMappedGrid(const string& pathToFile, const string& gridName,
+                            const grid& g)
+{
+	static L lockable;
+
+	if(gridName.empty() || gridName.size() >= sizeof(IndexEntry().name))
+	{
+		cerr << "error (writeMappedGrid): invalid grid name: " << gridName << endl;
+		return false;
+	}
+	if(g.nrows <= 0 || g.ncols <= 0 || !g.feld)
+		return false;
+
+	L::Lock lock(lockable);
+	WriterLock writerLock(pathToFile);
+	if(!writerLock.isLocked())
+	{
+		cerr << "error (writeMappedGrid): can not lock: " << pathToFile << endl;
+		return false;
+	}
+
+	FileHeader h;
+	vector<IndexEntry> entries(maxGridsPerMappedFile);
+	FILE* old = fopen(pathToFile.c_str(), "rb");
+	if(old)
+	{
+		if(fread(&h, sizeof(h), 1, old) != 1
+			 || fread(&entries[0], sizeof(IndexEntry), entries.size(), old) != entries.size()
+			 || memcmp(h.magic, magic, sizeof(magic)) != 0
+			 || h.noOfGrids < 0 || h.noOfGrids > maxGridsPerMappedFile)
+		{
+			cerr << "error (writeMappedGrid): " << pathToFile
+					 << " is no mapped grid file" << endl;
+			fclose(old);
+			return false;
+		}
+	}
+	else
+	{
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, magic, sizeof(magic));
+		memset(&entries[0], 0, entries.size()*sizeof(IndexEntry));
+	}
+
+	int i = findEntry(h, &entries[0], gridName);
+	if(i < 0)
+	{
+		if(h.noOfGrids == maxGridsPerMappedFile)
+		{
+			cerr << "error (writeMappedGrid): " << pathToFile << " holds already "
+					 << maxGridsPerMappedFile << " grids" << endl;
+			if(old)
+				fclose(old);
+			return false;
+		}
+		i = h.noOfGrids++;
+	}
+
+	IndexEntry ne;
+	memset(&ne, 0, sizeof(ne));
+	strncpy(ne.name, gridName.c_str(), sizeof(ne.name) - 1);
+	ne.nrows = g.nrows;
+	ne.ncols = g.ncols;
+	ne.stride = (g.ncols + 15) & ~15;
+	ne.nodata = g.nodata;
+	ne.csize = g.csize;
+	ne.xcorner = g.xcorner;
+	ne.ycorner = g.ycorner;
+
+	//the file is written anew into a temporary file, which replaces the old
+	//one, so the grids are stored without gaps and grids mapped from the old
+	//file keep their data
+	vector<IndexEntry> newEntries(entries);
+	newEntries[i] = ne;
+	int64_t offset = firstGridOffset;
+	for(int k = 0; k < h.noOfGrids; k++)
+	{
+		newEntries[k].offset = offset;
+		offset += gridBytes(newEntries[k]);
+	}
+
+	string tmpFile = pathToFile + ".tmp";
+	FILE* f = fopen(tmpFile.c_str(), "wb");
+	if(!f)
+	{
+		cerr << "error (writeMappedGrid): can not create: " << tmpFile << endl;
+		if(old)
+			fclose(old);
+		return false;
+	}
+
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+			&& fwrite(&newEntries[0], sizeof(IndexEntry), newEntries.size(), f) == newEntries.size();
+	vector<float> padding(ne.stride - ne.ncols, 0.0f);
+	for(int k = 0; ok && k < h.noOfGrids; k++)
+	{
+		const IndexEntry& e = newEntries[k];
+		ok = seekTo(f, e.offset) == 0;
+		if(k != i)
+			ok = ok && copyBytes(old, entries[k].offset,
+			                     int64_t(e.nrows)*e.stride*int64_t(sizeof(float)), f);
+		else
+			for(int r = 0; ok && r < g.nrows; r++)
+			{
+				ok = fwrite(g.feld[r], sizeof(float), g.ncols, f) == size_t(g.ncols);
+				if(ok && !padding.empty())
+					ok = fwrite(&padding[0], sizeof(float), padding.size(), f) == padding.size();
+			}
+	}
+	if(fclose(f) != 0)
+		ok = false;
+	if(old)
+		fclose(old);
+
+#ifdef WIN32
+	//rename doesn't replace an existing file
+	if(ok)
+		remove(pathToFile.c_str());
+#endif
+	ok = ok && rename(tmpFile.c_str(), pathToFile.c_str()) == 0;
+
+	if(!ok)
+	{
+		remove(tmpFile.c_str());
+		cerr << "error (writeMappedGrid): couldn't write " << gridName << " to "
+				 << pathToFile << endl;
+	}
+	return ok;
+}
+
+grid* Grids::mapGrid(const string& pathToFile, const string& gridName,
+                     boost::shared_ptr<MappedFile>& mapping)
+{
+	boost::shared_ptr<MappedFile> mf = mappingOf(pathToFile);
+	if(!mf)
+		return NULL;
+
+	FileHeader h;
+	const IndexEntry* entries = NULL;
+	if(!readIndex(mf->begin, mf->size(), h, entries))
+	{
+		cerr << "error (mapGrid): " << pathToFile << " is no mapped grid file" << endl;
+		return NULL;
+	}
+
+	int i = findEntry(h, entries, gridName);
+	if(i < 0)
+		return NULL;
+
+	const IndexEntry& e = entries[i];
+	if(e.nrows <= 0 || e.ncols <= 0 || e.stride < e.ncols || e.offset < 0
+		 || e.offset + int64_t(e.nrows)*e.stride*int64_t(sizeof(float)) > int64_t(mf->size()))
+	{
+		cerr << "error (mapGrid): index entry of " << gridName << " in "
+				 << pathToFile << " is corrupt" << endl;
+		return NULL;
+	}
+
+	grid* g = new grid(int(e.csize));
+	g->nrows = e.nrows;
+	g->ncols = e.ncols;
+	g->csize = e.csize;
+	g->nodata = e.nodata;
+	g->xcorner = e.xcorner;
+	g->ycorner = e.ycorner;
+	g->stride = e.stride;
+	g->data = (float*)(mf->begin + e.offset);
+	g->feld = new float*[e.nrows];
+	for(int r = 0; r < e.nrows; r++)
+		g->feld[r] = g->data + size_t(r)*e.stride;
+	mapping = mf;
+	return g;
+}
+
+vector<string> Grids::mappedGridNames(const string& pathToFile)
+{
+	vector<string> names;
+	boost::shared_ptr<MappedFile> mf = mappingOf(pathToFile);
+	FileHeader h;
+	const IndexEntry* entries = NULL;
+	if(mf && readIndex(mf->begin, mf->size(), h, entries))
+		for(int i = 0; i < h.noOfGrids; i++)
+			names.push_back(string(entries[i].name,
+			                       strnlen(entries[i].name, sizeof(entries[i].name))));
+	return names;
+}
@@ -0,0 +1,81 @@
+/**
+Authors:
+Ralf Wieland <ralf.wieland@zalf.de>
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers:
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MAPPEDGRIDFILE_H_
+#define MAPPEDGRIDFILE_H_
+
+#include <string>
+#include <vector>
+
+#ifndef Q_MOC_RUN
+#include <boost/shared_ptr.hpp>
+#endif //Q_MOC_RUN
+
+#include "grid.h"
+
+namespace Grids
+{
+	class MappedFile;
+
+	/*
+	 * files holding several named grids (e.g. the years of a regionalized
+	 * result), which are used directly from a memory mapping
+	 * - a small index in front of the data holds name, geometry and offset of
+	 * at most maxGridsPerMappedFile grids
+	 * - the rows are padded like in grid::alloc_feld and every grid starts at
+	 * a page boundary, so the rows of a mapped grid point right into the
+	 * mapping and the cells are read from disk (page faults) when they are
+	 * accessed the first time
+	 * - the mapping is copy on write, changes of a mapped grid never get into
+	 * the file
+	 * - every write stores the file anew in a temporary file, which then
+	 * replaces it, so a grid written under an existing name doesn't leave the
+	 * old data behind and grids mapped from the old file keep their values,
+	 * writers in other processes are serialized by a lock on "<file>.lock"
+	 * - the data are stored in the byte order of the machine
+	 */
+
+	const int maxGridsPerMappedFile = 256;
+
+	//! stores g under gridName in the file (which is created if necessary)
+	bool writeMappedGrid(const std::string& pathToFile,
+	                     const std::string& gridName, const grid& g);
+
+	/*!
+	 * grid using the data of gridName in the memory mapped file
+	 * - a mapping of the file still used by other grids is shared
+	 * @param mapping is set to the mapping the grid's fields belong to, it
+	 * has to outlive the grid
+	 * @return NULL if the file or the grid doesn't exist
+	 */
+	grid* mapGrid(const std::string& pathToFile, const std::string& gridName,
+	              boost::shared_ptr<MappedFile>& mapping);
+
+	//! names of the grids in the file
+	std::vector<std::string> mappedGridNames(const std::string& pathToFile);
+}
+
+#endif
@@ -0,0 +1,228 @@
+/**
+Authors:
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers:
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NO_HDF5
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include "tiled-grid.h"
+
+using namespace Grids;
+using namespace std;
+using namespace Tools;
+
+TiledGridP::TiledGridP(const string& datasetName, const string& pathToHdfFile,
+                       CoordinateSystem cs, int tileSize, size_t maxTiles)
+	: _hdf(NULL),
+		_datasetName(datasetName),
+		_coordinateSystem(cs),
+		_ncols(0), _nrows(0), _nodata(-9999),
+		_xcorner(0), _ycorner(0), _csize(0),
+		_tileSize(max(1, tileSize)),
+		_tileCols(0),
+		_maxTiles(max(size_t(1), maxTiles)),
+		_noOfTileReads(0)
+{
+	HdfLock lock;
+	hdf5* hd = new hdf5;
+	if(hd->open_f(pathToHdfFile.c_str()) != 0)
+	{
+		cerr << "error (TiledGridP): can not open hdf_file: " << pathToHdfFile << endl;
+		delete hd;
+		return;
+	}
+	if(hd->open_d(datasetName.c_str()) != 0)
+	{
+		cerr << "error (TiledGridP): can not open dataset: " << datasetName << endl;
+		delete hd;
+		return;
+	}
+	_ncols = hd->get_i_attribute("ncols");
+	_nrows = hd->get_i_attribute("nrows");
+	_nodata = hd->get_i_attribute("nodata");
+	_xcorner = hd->get_d_attribute("xcorner");
+	_ycorner = hd->get_d_attribute("ycorner");
+	_csize = hd->get_f_attribute("csize");
+	_tileCols = (_ncols + _tileSize - 1) / _tileSize;
+	_hdf = hd;
+}
+
+TiledGridP::~TiledGridP()
+{
+	HdfLock lock;
+	delete _hdf;
+}
+
+float TiledGridP::dataAt(int row, int col) const
+{
+	Lock lock(this);
+	TilePtr t = tileAt(row / _tileSize, col / _tileSize);
+	int tileWidth = min(_tileSize, _ncols - (col / _tileSize)*_tileSize);
+	return t ? (*t)[(row % _tileSize)*tileWidth + (col % _tileSize)]
+	         : float(_nodata);
+}
+
+float TiledGridP::dataAt(RectCoord rcc) const
+{
+	pair<int, int> p = rc2rowCol(rcc);
+	return p.first == -1 || p.second == -1
+		? noDataValue() : dataAt(p.first, p.second);
+}
+
+GridMetaData TiledGridP::metaData() const
+{
+	GridMetaData gmd(_coordinateSystem);
+	gmd.ncols = _ncols;
+	gmd.nrows = _nrows;
+	gmd.nodata = _nodata;
+	gmd.xllcorner = int(_xcorner);
+	gmd.yllcorner = int(_ycorner);
+	gmd.cellsize = int(_csize);
+	return gmd;
+}
+
+pair<int, int> TiledGridP::rc2rowCol(RectCoord rc) const
+{
+	int row = -1, col = -1;
+	if(_xcorner <= rc.r && rc.r <= (_xcorner + cellSize()*cols())
+		 && _ycorner <= rc.h && rc.h <= (_ycorner + cellSize()*rows()))
+	{
+		col = int(std::floor((rc.r - _xcorner)/cellSize()));
+		if(col == cols())
+			--col;
+		row = rows() - int(std::ceil((rc.h - _ycorner)/cellSize()));
+		if(row == rows())
+			--row;
+	}
+	return make_pair(row, col);
+}
+
+GridP* TiledGridP::subGridClone(int top, int left, int nrows, int ncols) const
+{
+	GridP* subGrid = new GridP(datasetName(), nrows, ncols, cellSize(),
+	                           _xcorner + left*cellSize(),
+	                           _ycorner + (rows() - top)*cellSize(),
+	                           noDataValue(),
+	                           coordinateSystem());
+	if(nrows <= 0 || ncols <= 0)
+		return subGrid;
+
+	int bottom = min(top + nrows, rows()), right = min(left + ncols, cols());
+	int t = max(0, top), l = max(0, left);
+	if(t >= bottom || l >= right)
+		return subGrid;
+
+	grid& g = subGrid->gridRef();
+	float* dst = g.feld[t - top] + (l - left);
+
+	Lock lock(this);
+	// if the whole region is cached (e.g. a tiled grid used for many small
+	// queries) copy from the tiles, else read just the region from the file
+	bool allCached = true;
+	for(int tr = t / _tileSize; allCached && tr <= (bottom - 1) / _tileSize; tr++)
+		for(int tc = l / _tileSize; allCached && tc <= (right - 1) / _tileSize; tc++)
+			allCached = _tiles.find(tr*_tileCols + tc) != _tiles.end();
+
+	if(!allCached)
+	{
+		if(!readBlock(dst, t, l, bottom - t, right - l, g.stride))
+			cerr << "error (TiledGridP::subGridClone): couldn't read rows " << t
+					 << "-" << bottom << ", cols " << l << "-" << right << " of "
+					 << datasetName() << endl;
+		return subGrid;
+	}
+
+	for(int tr = t / _tileSize; tr <= (bottom - 1) / _tileSize; tr++)
+	{
+		for(int tc = l / _tileSize; tc <= (right - 1) / _tileSize; tc++)
+		{
+			TilePtr tile = tileAt(tr, tc);
+			int tileTop = tr*_tileSize, tileLeft = tc*_tileSize;
+			int tileWidth = min(_tileSize, _ncols - tileLeft);
+			int c0 = max(l, tileLeft), c1 = min(right, tileLeft + tileWidth);
+			for(int r = max(t, tileTop), rs = min(bottom, tileTop + _tileSize); r < rs; r++)
+				copy(tile->begin() + (r - tileTop)*tileWidth + (c0 - tileLeft),
+				     tile->begin() + (r - tileTop)*tileWidth + (c1 - tileLeft),
+				     g.feld[r - top] + (c0 - left));
+		}
+	}
+
+	return subGrid;
+}
+
+size_t TiledGridP::noOfCachedTiles() const
+{
+	Lock lock(this);
+	return _tiles.size();
+}
+
+size_t TiledGridP::noOfTileReads() const
+{
+	Lock lock(this);
+	return _noOfTileReads;
+}
+
+TiledGridP::TilePtr TiledGridP::tileAt(int tileRow, int tileCol) const
+{
+	int id = tileRow*_tileCols + tileCol;
+	Tiles::iterator ti = _tiles.find(id);
+	if(ti != _tiles.end())
+	{
+		_lru.splice(_lru.begin(), _lru, ti->second.second);
+		return ti->second.first;
+	}
+
+	int top = tileRow*_tileSize, left = tileCol*_tileSize;
+	int height = min(_tileSize, _nrows - top), width = min(_tileSize, _ncols - left);
+	if(height <= 0 || width <= 0)
+		return TilePtr();
+
+	vector<float>* tile = new vector<float>(size_t(height)*width, float(_nodata));
+	if(!readBlock(&(*tile)[0], top, left, height, width, width))
+		cerr << "error (TiledGridP): couldn't read tile (" << tileRow << ","
+				 << tileCol << ") of " << datasetName() << endl;
+	_noOfTileReads++;
+
+	if(_tiles.size() >= _maxTiles)
+	{
+		_tiles.erase(_lru.back());
+		_lru.pop_back();
+	}
+	_lru.push_front(id);
+	TilePtr t(tile);
+	_tiles[id] = make_pair(t, _lru.begin());
+	return t;
+}
+
+bool TiledGridP::readBlock(float* feld, int top, int left, int rows, int cols,
+                           int stride) const
+{
+	HdfLock lock;
+	return _hdf && _hdf->read_f_block(feld, _nrows, _ncols, top, left, rows, cols, stride) == 0;
+}
+
+#endif //NO_HDF5
@@ -0,0 +1,157 @@
+/**
+Authors:
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers:
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILEDGRID_H_
+#define TILEDGRID_H_
+
+#ifndef NO_HDF5
+
+#include <string>
+#include <list>
+#include <map>
+#include <vector>
+#include <utility>
+
+#ifndef Q_MOC_RUN
+#include <boost/shared_ptr.hpp>
+#endif //Q_MOC_RUN
+
+#include "grid+.h"
+
+namespace Grids
+{
+	/*!
+	 * read only grid in a hdf store, which isn't loaded as a whole
+	 * - the data are read in square tiles (hdf5 hyperslabs) when they are
+	 * accessed the first time and kept in a LRU cache of at most maxTiles tiles
+	 * - offers the read interface of GridP (rows, cols, dataAt ...), so
+	 * code only reading a grid can use both
+	 * - subGridClone reads just the requested part of the dataset, that way
+	 * a district can be cut out of a countrywide grid without loading it
+	 */
+	class TiledGridP : public Loki::ObjectLevelLockable<TiledGridP>
+	{
+	public:
+		TiledGridP(const std::string& datasetName, const std::string& pathToHdfFile,
+		           Tools::CoordinateSystem cs = Tools::GK5_EPSG31469,
+		           int tileSize = 256, size_t maxTiles = 64);
+
+		~TiledGridP();
+
+		bool isValid() const { return _hdf && rows() > 0 && cols() > 0; }
+
+		//! number of rows
+		int rows() const { return _nrows; }
+
+		//! number of columns
+		int cols() const { return _ncols; }
+
+		//! size of gridcells
+		double cellSize() const { return _csize; }
+
+		int noDataValue() const { return _nodata; }
+
+		float dataAt(int row, int col) const;
+
+		float dataAt(Tools::RectCoord rcc) const;
+
+		bool isNoDataField(int row, int col) const
+		{
+			return int(dataAt(row, col)) == noDataValue();
+		}
+
+		bool isDataField(int row, int col) const
+		{
+			return !isNoDataField(row, col);
+		}
+
+		//! same metadata a GridP loaded from the same dataset would have
+		GridMetaData metaData() const;
+
+		RCRect rcRect() const { return metaData().rcRect(); }
+
+		Tools::RectCoord lowerLeftCorner() const
+		{
+			return Tools::RectCoord(_coordinateSystem, _xcorner, _ycorner);
+		}
+
+		std::pair<int, int> rc2rowCol(Tools::RectCoord rcc) const;
+
+		std::string datasetName() const { return _datasetName; }
+
+		Tools::CoordinateSystem coordinateSystem() const { return _coordinateSystem; }
+
+		//! same result as GridP::subGridClone, but reads only the part needed
+		GridP* subGridClone(int top, int left, int rows, int cols) const;
+
+		//! loads the whole grid
+		GridP* clone() const { return subGridClone(0, 0, rows(), cols()); }
+
+		int tileSize() const { return _tileSize; }
+
+		size_t maxTiles() const { return _maxTiles; }
+
+		size_t noOfCachedTiles() const;
+
+		//! number of tiles read from the hdf file so far
+		size_t noOfTileReads() const;
+
+	private:
+		typedef boost::shared_ptr<const std::vector<float> > TilePtr;
+		typedef std::list<int> LRUList;
+		typedef std::map<int, std::pair<TilePtr, LRUList::iterator> > Tiles;
+
+		TiledGridP(const TiledGridP&);
+		TiledGridP& operator=(const TiledGridP&);
+
+		//! get the tile, reading it if necessary, the lock has to be held
+		TilePtr tileAt(int tileRow, int tileCol) const;
+
+		//! read the given part of the dataset into feld (stride floats per row),
+		//! holds the HdfLock while reading
+		bool readBlock(float* feld, int top, int left, int rows, int cols,
+		               int stride) const;
+
+		hdf5* _hdf;
+		std::string _datasetName;
+		Tools::CoordinateSystem _coordinateSystem;
+		int _ncols, _nrows;
+		int _nodata;
+		double _xcorner, _ycorner;
+		float _csize;
+
+		int _tileSize;
+		int _tileCols;
+		size_t _maxTiles;
+		mutable Tiles _tiles;
+		//! tile ids, most recently used first
+		mutable LRUList _lru;
+		mutable size_t _noOfTileReads;
+	};
+}
+
+#endif //NO_HDF5
+
+#endif
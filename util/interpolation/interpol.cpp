@@ -190,6 +190,10 @@ void interpolation::add_stat(int id, int sz, int begin, int end)
   weather* stp;
   stp=new weather(id,sz,begin,end);
   stv.push_back(stp);
+  // regressions and weights depend on all stations
+  for(int i=0; i<8; i++)
+    regressions[i].clear();
+  last_cell.valid=false;
 }
 
 interpolation::~interpolation()
@@ -201,360 +205,125 @@ interpolation::~interpolation()
   delete voronoi;
 }
 
-double interpolation::get_TX(int yearday,double hwx,double rwx,double nn)
+// the regression against the height of the stations only depends on the day,
+// so it is calculated once per variable and day
+const interpolation::regression& interpolation::get_regression(int var, getter get, bool zero_if_dry, int yearday)
 {
-  // calc the regression
-  double varx,vary,varxy,xquer,yquer;
-  double m,n,r2;
-  double sum, sumz,dist;
+  vector<regression>& rs = regressions[var];
+  if(yearday >= (int)rs.size())
+    rs.resize(yearday+1);
+  regression& r = rs[yearday];
+  if(r.computed)
+    return r;
+
+  double varx,varxy,xquer,yquer;
   xquer=yquer=0.0;
   for(int i=0; i<stv.size(); i++){
       xquer+=stv[i]->nn;
-      yquer+=stv[i]->get_TX(yearday);
+      yquer+=(stv[i]->*get)(yearday);
+  }
+  r.computed=true;
+  if(zero_if_dry && yquer<=0.0){
+      r.zero=true;
+      return r;
   }
   xquer/=stv.size();
   yquer/=stv.size();
   double xdiff,ydiff;
-  varx=vary=varxy=0.0;
+  varx=varxy=0.0;
   for(int i=0; i<stv.size(); i++){
       xdiff = stv[i]->nn-xquer;
-      ydiff = stv[i]->get_TX(yearday)-yquer;
+      ydiff = (stv[i]->*get)(yearday)-yquer;
       varx += (xdiff*xdiff);
-      vary += (ydiff*ydiff);
       varxy += (xdiff*ydiff);
   }
-  m = varxy/varx;
-  n = yquer-m*xquer;
-  varx /= (stv.size()-1);
-  vary /= (stv.size()-1);
-  varxy /= (stv.size()-1);
-  // r2 = (varxy*varxy)/(varx*vary);
-  // calc inverse distance and residium
-  sum=sumz=0.0;
+  r.m = varxy/varx;
+  r.n = yquer-r.m*xquer;
+  r.residium.resize(stv.size());
+  for(int k=0; k<stv.size(); k++)
+    r.residium[k]=((stv[k]->*get)(yearday))-(r.m*(stv[k]->nn)+r.n);
+  return r;
+}
+
+// the distances of the stations to a cell don't depend on the day,
+// the weights of the last requested cell are kept, as usually all
+// variables of all days are requested for one cell after the other
+const interpolation::cell_weights& interpolation::get_weights(double hwx,double rwx)
+{
+  if(last_cell.valid && last_cell.hw==hwx && last_cell.rw==rwx)
+    return last_cell;
+
+  last_cell.valid=true;
+  last_cell.hw=hwx;
+  last_cell.rw=rwx;
+  last_cell.station=-1;
+  last_cell.dist.clear();
+  last_cell.sum=0.0;
   for(int k=0; k<stv.size(); k++){
-      dist=stv[k]->dist(hwx,rwx);
-      stv[k]->residium=(stv[k]->get_TX(yearday))-(m*(stv[k]->nn)+n);
-      if(dist<10000.0)   // return value of weather if dist<100m
-        return(stv[k]->get_TX(yearday));
-      sum+=1.0/(dist);
-      sumz+=(stv[k]->residium)/(dist);
+      double dist=stv[k]->dist(hwx,rwx);
+      if(dist<10000.0){   // use value of weather if dist<100m
+          last_cell.station=k;
+          break;
+      }
+      last_cell.dist.push_back(dist);
+      last_cell.sum+=1.0/(dist);
   }
-  return(m*nn+n+sumz/sum);
+  return last_cell;
+}
+
+double interpolation::interpolate(int var, getter get, bool zero_if_dry, int yearday,double hwx,double rwx,double nn)
+{
+  const regression& r=get_regression(var,get,zero_if_dry,yearday);
+  if(r.zero)
+    return 0.0;
+  const cell_weights& w=get_weights(hwx,rwx);
+  if(w.station>=0)
+    return((stv[w.station]->*get)(yearday));
+  // inverse distance weighted residua
+  double sumz=0.0;
+  for(int k=0; k<w.dist.size(); k++)
+    sumz+=(r.residium[k])/(w.dist[k]);
+  return(r.m*nn+r.n+sumz/w.sum);
+}
+
+double interpolation::get_TX(int yearday,double hwx,double rwx,double nn)
+{
+  return interpolate(0,&weather::get_TX,false,yearday,hwx,rwx,nn);
 }
 
 double interpolation::get_TM(int yearday,double hwx,double rwx,double nn)
 {
-  // calc the regression
-  double varx,vary,varxy,xquer,yquer;
-  double m,n,r2;
-  double sum, sumz,dist;
-  xquer=yquer=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xquer+=stv[i]->nn;
-      yquer+=stv[i]->get_TM(yearday);
-  }
-  xquer/=stv.size();
-  yquer/=stv.size();
-  double xdiff,ydiff;
-  varx=vary=varxy=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xdiff = stv[i]->nn-xquer;
-      ydiff = stv[i]->get_TM(yearday)-yquer;
-      varx += (xdiff*xdiff);
-      vary += (ydiff*ydiff);
-      varxy += (xdiff*ydiff);
-  }
-  m = varxy/varx;
-  n = yquer-m*xquer;
-  varx /= (stv.size()-1);
-  vary /= (stv.size()-1);
-  varxy /= (stv.size()-1);
-  // r2 = (varxy*varxy)/(varx*vary);
-  // calc inverse distance and residium
-  sum=sumz=0.0;
-  for(int k=0; k<stv.size(); k++){
-      dist=stv[k]->dist(hwx,rwx);
-      stv[k]->residium=(stv[k]->get_TM(yearday))-(m*(stv[k]->nn)+n);
-      if(dist<10000.0)   // return value of weather if dist<100m
-        return(stv[k]->get_TM(yearday));
-      sum+=1.0/(dist);
-      sumz+=(stv[k]->residium)/(dist);
-  }
-  return(m*nn+n+sumz/sum);
+  return interpolate(1,&weather::get_TM,false,yearday,hwx,rwx,nn);
 }
 
 double interpolation::get_TN(int yearday,double hwx,double rwx,double nn)
 {
-  // calc the regression
-  double varx,vary,varxy,xquer,yquer;
-  double m,n,r2;
-  double sum, sumz,dist;
-  xquer=yquer=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xquer+=stv[i]->nn;
-      yquer+=stv[i]->get_TN(yearday);
-  }
-  xquer/=stv.size();
-  yquer/=stv.size();
-  double xdiff,ydiff;
-  varx=vary=varxy=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xdiff = stv[i]->nn-xquer;
-      ydiff = stv[i]->get_TN(yearday)-yquer;
-      varx += (xdiff*xdiff);
-      vary += (ydiff*ydiff);
-      varxy += (xdiff*ydiff);
-  }
-  m = varxy/varx;
-  n = yquer-m*xquer;
-  varx /= (stv.size()-1);
-  vary /= (stv.size()-1);
-  varxy /= (stv.size()-1);
-  // r2 = (varxy*varxy)/(varx*vary);
-  // calc inverse distance and residium
-  sum=sumz=0.0;
-  for(int k=0; k<stv.size(); k++){
-      dist=stv[k]->dist(hwx,rwx);
-      stv[k]->residium=(stv[k]->get_TN(yearday))-(m*(stv[k]->nn)+n);
-      if(dist<10000.0)   // return value of weather if dist<100m
-        return(stv[k]->get_TN(yearday));
-      sum+=1.0/(dist);
-      sumz+=(stv[k]->residium)/(dist);
-  }
-  return(m*nn+n+sumz/sum);
+  return interpolate(2,&weather::get_TN,false,yearday,hwx,rwx,nn);
 }
 
 double interpolation::get_RR(int yearday,double hwx,double rwx,double nn)
 {
-  // calc the regression
-  double varx,vary,varxy,xquer,yquer;
-  double m,n,r2;
-  double sum, sumz,dist;
-  xquer=yquer=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xquer+=stv[i]->nn;
-      yquer+=stv[i]->get_RR(yearday);
-  }
-  if(yquer<=0.0)
-    return 0.0;
-  xquer/=stv.size();
-  yquer/=stv.size();
-  double xdiff,ydiff;
-  varx=vary=varxy=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xdiff = stv[i]->nn-xquer;
-      ydiff = stv[i]->get_RR(yearday)-yquer;
-      varx += (xdiff*xdiff);
-      vary += (ydiff*ydiff);
-      varxy += (xdiff*ydiff);
-  }
-  m = varxy/varx;
-  n = yquer-m*xquer;
-  varx /= (stv.size()-1);
-  vary /= (stv.size()-1);
-  varxy /= (stv.size()-1);
-  // r2 = (varxy*varxy)/(varx*vary);
-  // cerr << "r2=" << r2 << endl;
-  // return(r2);
-  // calc inverse distance and residium
-  sum=sumz=0.0;
-  for(int k=0; k<stv.size(); k++){
-      dist=stv[k]->dist(hwx,rwx);
-      stv[k]->residium=(stv[k]->get_RR(yearday))-(m*(stv[k]->nn)+n);
-      if(dist<10000.0){   // return value of weather if dist<100m
-          // cerr << k << " " << dist << " " << hwx << " " << stv[k]->hw <<
-          //        " " << rwx << " " << stv[k]->rw << endl;
-          return(stv[k]->get_RR(yearday));
-      }
-      sum+=1.0/(dist);
-      sumz+=(stv[k]->residium)/(dist);
-  }
-  return(m*nn+n+sumz/sum);
+  return interpolate(3,&weather::get_RR,true,yearday,hwx,rwx,nn);
 }
 
 double interpolation::get_SD(int yearday,double hwx,double rwx,double nn)
 {
-  // calc the regression
-  double varx,vary,varxy,xquer,yquer;
-  double m,n,r2;
-  double sum, sumz,dist;
-  xquer=yquer=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xquer+=stv[i]->nn;
-      yquer+=stv[i]->get_SD(yearday);
-  }
-  if(yquer<=0.0)
-    return 0.0;
-  xquer/=stv.size();
-  yquer/=stv.size();
-  double xdiff,ydiff;
-  varx=vary=varxy=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xdiff = stv[i]->nn-xquer;
-      ydiff = stv[i]->get_SD(yearday)-yquer;
-      varx += (xdiff*xdiff);
-      vary += (ydiff*ydiff);
-      varxy += (xdiff*ydiff);
-  }
-  m = varxy/varx;
-  n = yquer-m*xquer;
-  varx /= (stv.size()-1);
-  vary /= (stv.size()-1);
-  varxy /= (stv.size()-1);
-  // r2 = (varxy*varxy)/(varx*vary);
-  // cerr << "r2=" << r2 << endl;
-  // return(r2);
-  // calc inverse distance and residium
-  sum=sumz=0.0;
-  for(int k=0; k<stv.size(); k++){
-      dist=stv[k]->dist(hwx,rwx);
-      stv[k]->residium=(stv[k]->get_SD(yearday))-(m*(stv[k]->nn)+n);
-      if(dist<10000.0){   // return value of weather if dist<100m
-          // cerr << k << " " << dist << " " << hwx << " " << stv[k]->hw <<
-          //        " " << rwx << " " << stv[k]->rw << endl;
-          return(stv[k]->get_SD(yearday));
-      }
-      sum+=1.0/(dist);
-      sumz+=(stv[k]->residium)/(dist);
-  }
-  return(m*nn+n+sumz/sum);
+  return interpolate(4,&weather::get_SD,true,yearday,hwx,rwx,nn);
 }
 
 double interpolation::get_FF(int yearday,double hwx,double rwx,double nn)
 {
-  // calc the regression
-  double varx,vary,varxy,xquer,yquer;
-  double m,n,r2;
-  double sum, sumz,dist;
-  xquer=yquer=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xquer+=stv[i]->nn;
-      yquer+=stv[i]->get_FF(yearday);
-  }
-  if(yquer<=0.0)
-    return 0.0;
-  xquer/=stv.size();
-  yquer/=stv.size();
-  double xdiff,ydiff;
-  varx=vary=varxy=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xdiff = stv[i]->nn-xquer;
-      ydiff = stv[i]->get_FF(yearday)-yquer;
-      varx += (xdiff*xdiff);
-      vary += (ydiff*ydiff);
-      varxy += (xdiff*ydiff);
-  }
-  m = varxy/varx;
-  n = yquer-m*xquer;
-  varx /= (stv.size()-1);
-  vary /= (stv.size()-1);
-  varxy /= (stv.size()-1);
-  // r2 = (varxy*varxy)/(varx*vary);
-  // cerr << "r2=" << r2 << endl;
-  // return(r2);
-  // calc inverse distance and residium
-  sum=sumz=0.0;
-  for(int k=0; k<stv.size(); k++){
-      dist=stv[k]->dist(hwx,rwx);
-      stv[k]->residium=(stv[k]->get_FF(yearday))-(m*(stv[k]->nn)+n);
-      if(dist<10000.0){   // return value of weather if dist<100m
-          // cerr << k << " " << dist << " " << hwx << " " << stv[k]->hw <<
-          //        " " << rwx << " " << stv[k]->rw << endl;
-          return(stv[k]->get_FF(yearday));
-      }
-      sum+=1.0/(dist);
-      sumz+=(stv[k]->residium)/(dist);
-  }
-  return(m*nn+n+sumz/sum);
+  return interpolate(5,&weather::get_FF,true,yearday,hwx,rwx,nn);
 }
 
 double interpolation::get_RF(int yearday,double hwx,double rwx,double nn)
 {
-  // calc the regression
-  double varx,vary,varxy,xquer,yquer;
-  double m,n,r2;
-  double sum, sumz,dist;
-  xquer=yquer=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xquer+=stv[i]->nn;
-      yquer+=stv[i]->get_RF(yearday);
-  }
-  if(yquer<=0.0)
-    return 0.0;
-  xquer/=stv.size();
-  yquer/=stv.size();
-  double xdiff,ydiff;
-  varx=vary=varxy=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xdiff = stv[i]->nn-xquer;
-      ydiff = stv[i]->get_RF(yearday)-yquer;
-      varx += (xdiff*xdiff);
-      vary += (ydiff*ydiff);
-      varxy += (xdiff*ydiff);
-  }
-  m = varxy/varx;
-  n = yquer-m*xquer;
-  varx /= (stv.size()-1);
-  vary /= (stv.size()-1);
-  varxy /= (stv.size()-1);
-  // r2 = (varxy*varxy)/(varx*vary);
-  // cerr << "r2=" << r2 << endl;
-  // return(r2);
-  // calc inverse distance and residium
-  sum=sumz=0.0;
-  for(int k=0; k<stv.size(); k++){
-      dist=stv[k]->dist(hwx,rwx);
-      stv[k]->residium=(stv[k]->get_RF(yearday))-(m*(stv[k]->nn)+n);
-      if(dist<10000.0){   // return value of weather if dist<100m
-          // cerr << k << " " << dist << " " << hwx << " " << stv[k]->hw <<
-          //        " " << rwx << " " << stv[k]->rw << endl;
-          return(stv[k]->get_RF(yearday));
-      }
-      sum+=1.0/(dist);
-      sumz+=(stv[k]->residium)/(dist);
-  }
-  return(m*nn+n+sumz/sum);
+  return interpolate(6,&weather::get_RF,true,yearday,hwx,rwx,nn);
 }
 
 double interpolation::get_GS(int yearday,double hwx,double rwx,double nn)
 {
-  // calc the regression
-  double varx,vary,varxy,xquer,yquer;
-  double m,n,r2;
-  double sum, sumz,dist;
-  xquer=yquer=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xquer+=stv[i]->nn;
-      yquer+=stv[i]->get_GS(yearday);
-  }
-  xquer/=stv.size();
-  yquer/=stv.size();
-  double xdiff,ydiff;
-  varx=vary=varxy=0.0;
-  for(int i=0; i<stv.size(); i++){
-      xdiff = stv[i]->nn-xquer;
-      ydiff = stv[i]->get_GS(yearday)-yquer;
-      varx += (xdiff*xdiff);
-      vary += (ydiff*ydiff);
-      varxy += (xdiff*ydiff);
-  }
-  m = varxy/varx;
-  n = yquer-m*xquer;
-  varx /= (stv.size()-1);
-  vary /= (stv.size()-1);
-  varxy /= (stv.size()-1);
-  // r2 = (varxy*varxy)/(varx*vary);
-  // calc inverse distance and residium
-  sum=sumz=0.0;
-  for(int k=0; k<stv.size(); k++){
-      dist=stv[k]->dist(hwx,rwx);
-      stv[k]->residium=(stv[k]->get_GS(yearday))-(m*(stv[k]->nn)+n);
-      if(dist<10000.0)   // return value of weather if dist<100m
-        return(stv[k]->get_GS(yearday));
-      sum+=1.0/(dist);
-      sumz+=(stv[k]->residium)/(dist);
-  }
-  return(m*nn+n+sumz/sum);
+  return interpolate(7,&weather::get_GS,false,yearday,hwx,rwx,nn);
 }
 
 void interpolation::map_RR(int yearday)
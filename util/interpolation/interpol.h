@@ -82,6 +82,29 @@ class interpolation{
   grid* igrid;
   bool initialized;
  private:
+  typedef double (weather::*getter)(int);
+  // regression of a variable against the stations height for one day
+  struct regression{
+    regression() : computed(false), zero(false), m(0.0), n(0.0) {}
+    bool computed;
+    bool zero;                // no interpolation needed, all station values are 0
+    double m,n;
+    vector<double> residium;  // residium of every station
+  };
+  // inverse distance weights of the stations for one cell
+  struct cell_weights{
+    cell_weights() : valid(false), hw(0.0), rw(0.0), station(-1), sum(0.0) {}
+    bool valid;
+    double hw,rw;
+    int station;              // station closer than 100m or -1
+    vector<double> dist;      // squared distances of the stations
+    double sum;               // sum of inverse distances
+  };
+  const regression& get_regression(int,getter,bool,int); // variable,getter,zero if dry,yearday
+  const cell_weights& get_weights(double,double); // hw,rw
+  double interpolate(int,getter,bool,int,double,double,double); // variable,getter,zero if dry,yearday,hw,rw,nn
+  vector<regression> regressions[8]; // [variable][yearday]
+  cell_weights last_cell;
   vector<weather*> stv;
   grid* dgm;
   grid* voronoi;
@@ -25,6 +25,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 
 #include "proj_api.h"
 
@@ -33,6 +34,29 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 using namespace std;
 using namespace Tools;
 
+namespace
+{
+	//! the proj context and projections of one thread, freed when it ends
+	struct ThreadProjections
+	{
+		ThreadProjections() : ctx(pj_ctx_alloc())
+		{
+			fill(pjs, pjs + UndefinedCoordinateSystem, projPJ(NULL));
+		}
+
+		~ThreadProjections()
+		{
+			for(int cs = 0; cs < UndefinedCoordinateSystem; cs++)
+				if(pjs[cs])
+					pj_free(pjs[cs]);
+			pj_ctx_free(ctx);
+		}
+
+		projCtx ctx;
+		projPJ pjs[UndefinedCoordinateSystem];
+	};
+}
+
 string Tools::coordinateSystemToString(CoordinateSystem cs)
 {
 	switch(cs)
@@ -91,6 +115,69 @@ CoordConversionParams Tools::coordConversionParams(CoordinateSystem cs)
 	return ccp;
 }
 
+projPJ Tools::projectionFor(CoordinateSystem cs)
+{
+	if(cs < 0 || cs >= UndefinedCoordinateSystem)
+		return NULL;
+
+	static thread_local ThreadProjections tps;
+	if(!tps.pjs[cs])
+		tps.pjs[cs] = pj_init_plus_ctx(tps.ctx,
+		                               coordConversionParams(cs).projectionParams.c_str());
+	return tps.pjs[cs];
+}
+
+bool Tools::transformCoordinates(CoordinateSystem sourceCS,
+                                 CoordinateSystem targetCS,
+                                 size_t n, double* firstDims, double* secondDims)
+{
+	if(n == 0 || sourceCS == targetCS)
+		return true;
+
+	projPJ sourcePJ = projectionFor(sourceCS);
+	projPJ targetPJ = projectionFor(targetCS);
+	if(!sourcePJ || !targetPJ)
+		return false;
+
+	CoordConversionParams sccp = coordConversionParams(sourceCS);
+	CoordConversionParams tccp = coordConversionParams(targetCS);
+
+	//proj works on x/y (lng/lat for geographic coordinates)
+	double* xs = sccp.switch2DCoordinates ? secondDims : firstDims;
+	double* ys = sccp.switch2DCoordinates ? firstDims : secondDims;
+	double scv = sccp.sourceConversionFactor;
+	if(scv != 1.0)
+  {
+		for(size_t i = 0; i < n; i++)
+    {
+			xs[i] *= scv;
+			ys[i] *= scv;
+		}
+	}
+
+	int error = pj_transform(sourcePJ, targetPJ, long(n), 1, xs, ys, NULL);
+  if(error)
+  {
+		cerr << "error: " << error << endl;
+		return false;
+	}
+
+	double tcv = tccp.targetConversionFactor;
+	if(tcv != 1.0)
+  {
+		for(size_t i = 0; i < n; i++)
+    {
+			xs[i] *= tcv;
+			ys[i] *= tcv;
+		}
+	}
+	//back into the order of the target coordinate type
+	if(sccp.switch2DCoordinates != tccp.switch2DCoordinates)
+		swap_ranges(firstDims, firstDims + n, secondDims);
+
+	return true;
+}
+
 /*
 CoordConversionParams Tools::GK5Params()
 {
@@ -27,8 +27,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define COORDTRANS_H_
 
 #include <vector>
+#include <string>
 #include <cmath>
 #include <cassert>
+#include <cstddef>
 
 #include "proj_api.h"
 
@@ -184,8 +186,28 @@ namespace Tools
 
 	CoordConversionParams coordConversionParams(CoordinateSystem cs);
 
+	/*!
+	 * projection for the coordinate system
+	 * - the handles are created once per thread (proj handles mustn't be used
+	 * by several threads at a time) and kept until the thread ends,
+	 * so don't free them
+	 * @return NULL for an undefined coordinate system
+	 */
+	projPJ projectionFor(CoordinateSystem cs);
+
+	/*!
+	 * transform n coordinates from sourceCS to targetCS in place
+	 * - firstDims/secondDims hold the dimensions in the order of the coordinate
+	 * types, e.g. r/h for RectCoord, lat/lng for LatLngCoord
+	 * - uses the cached projections, so it's cheap to call for a few coordinates
+	 * @return false if the transformation failed
+	 */
+	bool transformCoordinates(CoordinateSystem sourceCS,
+	                          CoordinateSystem targetCS,
+	                          std::size_t n, double* firstDims, double* secondDims);
+
 	template<typename SourceCoordType, typename TargetCoordType>
-	std::vector<typename TargetCoordType>
+	std::vector<TargetCoordType>
 	sourceProj2targetProj(const std::vector<SourceCoordType>& sourceCoords,
 												CoordinateSystem targetCoordinateSystem);
 
@@ -273,54 +295,24 @@ Tools::sourceProj2targetProj(const std::vector<SCT>& scs, CoordinateSystem targe
 	if(scs.empty())
 		return std::vector<TCT>();
 
-	CoordConversionParams sccp = coordConversionParams(scs.front().coordinateSystem);
-	CoordConversionParams tccp = coordConversionParams(targetCS);
-
-	unsigned int nocs = (unsigned int)scs.size(); //no of coordinates
-	double* xs = new double[nocs];
-	double* ys = new double[nocs];
-	double* zs = new double[nocs];
-
-	double scv = sccp.sourceConversionFactor;
-	bool ss2Dc = sccp.switch2DCoordinates;
-	for(unsigned int i = 0; i < nocs; i++)
+	std::size_t nocs = scs.size(); //no of coordinates
+	std::vector<double> fds(nocs), sds(nocs);
+	for(std::size_t i = 0; i < nocs; i++)
 	{
-		xs[i] = ss2Dc ? scs.at(i).secondDimension() * scv
-									: scs.at(i).firstDimension() * scv;
-		ys[i] = ss2Dc ? scs.at(i).firstDimension() * scv
-									: scs.at(i).secondDimension() * scv;
-		zs[i] = 0;
-	}
-
-	projPJ sourcePJ = pj_init_plus(sccp.projectionParams.c_str());
-	projPJ targetPJ = pj_init_plus(tccp.projectionParams.c_str());
-
-	if(sourcePJ && targetPJ){
-		int error = pj_transform(sourcePJ, targetPJ, nocs, 0, xs, ys, zs);
-		if(error)
-		{
-			std::cerr << "error: " << error << std::endl;
-			return std::vector<TCT>();
-		}
+		fds[i] = scs[i].firstDimension();
+		sds[i] = scs[i].secondDimension();
 	}
 
-	std::vector<TCT> tcs(nocs);
-	double tcv = tccp.targetConversionFactor;
-	bool ts2Dc = tccp.switch2DCoordinates;
-	for(unsigned int i = 0; i < nocs; i++)
-		tcs[i] = ts2Dc ? TCT(targetCS, ys[i]*tcv, xs[i]*tcv)
-									 : TCT(targetCS, xs[i]*tcv, ys[i]*tcv);
-
-	if(sourcePJ)
-		pj_free(sourcePJ);
-	if(targetPJ)
-		pj_free(targetPJ);
+	if(!transformCoordinates(scs.front().coordinateSystem, targetCS,
+	                         nocs, &fds[0], &sds[0]))
+		return std::vector<TCT>();
 
-	delete[] xs;
-	delete[] ys;
-	delete[] zs;
+	std::vector<TCT> tcs;
+	tcs.reserve(nocs);
+	for(std::size_t i = 0; i < nocs; i++)
+		tcs.push_back(TCT(targetCS, fds[i], sds[i]));
 
-	return !sourcePJ || !targetPJ ? std::vector<TCT>() : tcs;
+	return tcs;
 }
 
 template<typename SCT, typename TCT>
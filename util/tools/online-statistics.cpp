@@ -0,0 +1,123 @@
+/**
+Authors: 
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers: 
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of 
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "online-statistics.h"
+
+using namespace std;
+using namespace Tools;
+
+void RunningStats::merge(const RunningStats& other)
+{
+  if(other._n == 0)
+    return;
+  if(_n == 0)
+  {
+    *this = other;
+    return;
+  }
+
+  //Chan et al.: combine the sums of squares around the two means
+  long long n = _n + other._n;
+  double d = other._mean - _mean;
+  _mean += d * (double(other._n) / double(n));
+  _m2 += other._m2 + d * d * (double(_n) * double(other._n) / double(n));
+  _n = n;
+  _min = std::min(_min, other._min);
+  _max = std::max(_max, other._max);
+}
+
+//------------------------------------------------------------------------------
+
+QuantileSketch::QuantileSketch(double compression)
+  : _compression(std::max(1.0, compression)),
+  _capacity(centroidsCapacity(_compression)),
+  _n(0),
+  _min(numeric_limits<double>::max()),
+  _max(-numeric_limits<double>::max()),
+  _sorted(true)
+{
+  _centroids.reserve(_capacity);
+}
+
+void QuantileSketch::add(double x)
+{
+  if(int(_centroids.size()) >= _capacity)
+    _centroids.resize(compressCentroids(&_centroids[0], int(_centroids.size()),
+                                        _compression));
+  Centroid<double> c = {x, 1};
+  _centroids.push_back(c);
+  _sorted = false;
+  _n++;
+  if(x < _min) _min = x;
+  if(x > _max) _max = x;
+}
+
+void QuantileSketch::merge(const QuantileSketch& other)
+{
+  if(other._n == 0)
+    return;
+  _centroids.insert(_centroids.end(), other._centroids.begin(),
+                    other._centroids.end());
+  _sorted = false;
+  _n += other._n;
+  _min = std::min(_min, other._min);
+  _max = std::max(_max, other._max);
+  if(int(_centroids.size()) > _capacity)
+    _centroids.resize(compressCentroids(&_centroids[0], int(_centroids.size()),
+                                        _compression));
+}
+
+void QuantileSketch::sortCentroids() const
+{
+  if(_sorted)
+    return;
+
+  //the centroids are merged only when there are too many of them
+  sort(_centroids.begin(), _centroids.end());
+  _sorted = true;
+}
+
+double QuantileSketch::quantile(double q) const
+{
+  sortCentroids();
+  return centroidsQuantile(_centroids.empty() ? NULL : &_centroids[0],
+                           int(_centroids.size()), _min, _max, q);
+}
+
+double QuantileSketch::maxQuantileError() const
+{
+  //only single values
+  if(_n == (long long)_centroids.size())
+    return 0;
+  return pi / _compression + 1.0 / double(_n);
+}
+
+BoxPlotInfo QuantileSketch::boxPlotInfo() const
+{
+  return _n == 0
+      ? BoxPlotInfo()
+      : BoxPlotInfo(quantile(0.5), quantile(0.25), quantile(0.75), min(), max());
+}
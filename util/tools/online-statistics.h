@@ -0,0 +1,269 @@
+/**
+Authors: 
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers: 
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of 
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ONLINE_STATISTICS_H_
+#define ONLINE_STATISTICS_H_
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "algorithms.h"
+
+namespace Tools
+{
+#undef min
+#undef max
+
+  /*!
+  * mean, variance, min and max of a stream of values without keeping them
+  * (Welford's update), the statistics of parts of the stream (e.g. of
+  * different threads) can be merged
+  */
+  class RunningStats
+  {
+  public:
+    RunningStats()
+      : _n(0), _mean(0), _m2(0),
+      _min(std::numeric_limits<double>::max()),
+      _max(-std::numeric_limits<double>::max()) {}
+
+    void add(double x)
+    {
+      _n++;
+      double d = x - _mean;
+      _mean += d / double(_n);
+      _m2 += d * (x - _mean);
+      if(x < _min) _min = x;
+      if(x > _max) _max = x;
+    }
+
+    void merge(const RunningStats& other);
+
+    long long count() const { return _n; }
+
+    double mean() const { return _mean; }
+
+    //! sample variance (n-1, like standardDeviation), 0 for less than two values
+    double variance() const { return _n > 1 ? _m2 / double(_n - 1) : 0; }
+
+    double standardDeviation() const { return std::sqrt(variance()); }
+
+    double min() const { return _n > 0 ? _min : 0; }
+
+    double max() const { return _n > 0 ? _max : 0; }
+
+  private:
+    long long _n;
+    double _mean;
+    double _m2; //!< sum of the squared differences to the mean
+    double _min, _max;
+  };
+
+  //----------------------------------------------------------------------------
+
+  //! a value of a t-digest standing for weight values around mean
+  template<typename T>
+  struct Centroid
+  {
+    T mean;
+    T weight;
+    bool operator<(const Centroid& other) const { return mean < other.mean; }
+  };
+
+  /*!
+  * merges the n centroids (sorted afterwards) of a t-digest with the given
+  * compression, so that no centroid spans more than 1 on the k1 scale
+  * k(q) = compression/(2pi) * asin(2q-1)
+  * - afterwards there are at most compression + 1 centroids
+  * - a centroid has got at most the weight pi/compression * total weight
+  * or it is one of the centroids passed in
+  * @return the new number of centroids
+  */
+  template<typename T>
+  int compressCentroids(Centroid<T>* cs, int n, double compression);
+
+  /*!
+  * q quantile of the values represented by the sorted centroids, linearly
+  * interpolated between the centroids at their mid ranks and min/max at
+  * the ends (for single values the same as the Hazen definition, rank
+  * q*n-0.5)
+  */
+  template<typename T>
+  double centroidsQuantile(const Centroid<T>* cs, int n, double min, double max,
+                           double q);
+
+  /*!
+  * quantiles of a stream of values from a merging t-digest, the values are
+  * kept as weighted centroids, which are the smaller the closer they are to
+  * the tails
+  * - exact as long as the centroids are single values, so at least as long
+  * as at most capacity() values have been added
+  * - else the value returned for q has got a rank within
+  * (q +- maxQuantileError()) * count(), maxQuantileError() being
+  * pi/compression + 1/count() (e.g. 3.2% for compression 100)
+  * - sketches of parts of the stream (e.g. of different threads) can be
+  * merged, the error bound holds for the merged sketch as well
+  * - not thread safe, even the const member functions might sort the
+  * values added last
+  */
+  class QuantileSketch
+  {
+  public:
+    QuantileSketch(double compression = 100);
+
+    void add(double x);
+
+    void merge(const QuantileSketch& other);
+
+    double quantile(double q) const;
+
+    double median() const { return quantile(0.5); }
+
+    //! median, quartiles, min and max (without outliers)
+    BoxPlotInfo boxPlotInfo() const;
+
+    double maxQuantileError() const;
+
+    long long count() const { return _n; }
+
+    double min() const { return _n > 0 ? _min : 0; }
+
+    double max() const { return _n > 0 ? _max : 0; }
+
+    double compression() const { return _compression; }
+
+    //! number of centroids kept before they are merged
+    int capacity() const { return _capacity; }
+
+  private:
+    //! sorts the centroids
+    void sortCentroids() const;
+
+    double _compression;
+    int _capacity;
+    long long _n;
+    double _min, _max;
+    mutable std::vector<Centroid<double> > _centroids;
+    //! the centroids are sorted
+    mutable bool _sorted;
+  };
+
+  //! capacity of a t-digest with the given compression, twice the
+  //! number of centroids left after compressing
+  inline int centroidsCapacity(double compression)
+  {
+    return 2 * (int(std::ceil(compression)) + 1);
+  }
+
+  //----------------------------------------------------------------------------
+
+  const double pi = 3.14159265358979323846;
+
+  inline double tdigestK(double q, double compression)
+  {
+    return compression / (2 * pi) * std::asin(2 * q - 1);
+  }
+
+  inline double tdigestQ(double k, double compression)
+  {
+    double a = k * 2 * pi / compression;
+    return a >= pi / 2 ? 1 : (std::sin(a) + 1) / 2;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+template<typename T>
+int Tools::compressCentroids(Centroid<T>* cs, int n, double compression)
+{
+  if(n <= 1)
+    return n;
+
+  std::sort(cs, cs + n);
+  double total = 0;
+  for(int i = 0; i < n; i++)
+    total += cs[i].weight;
+
+  int last = 0;
+  double weightBefore = 0; //weight of the centroids before cs[last]
+  double weightLimit = tdigestQ(tdigestK(0, compression) + 1, compression) * total;
+  for(int i = 1; i < n; i++)
+  {
+    double w = double(cs[last].weight) + cs[i].weight;
+    if(weightBefore + w <= weightLimit)
+    {
+      cs[last].mean = T(cs[last].mean + (cs[i].mean - cs[last].mean) * (cs[i].weight / w));
+      cs[last].weight = T(w);
+    }
+    else
+    {
+      weightBefore += cs[last].weight;
+      cs[++last] = cs[i];
+      weightLimit = tdigestQ(tdigestK(weightBefore / total, compression) + 1,
+                             compression) * total;
+    }
+  }
+  return last + 1;
+}
+
+template<typename T>
+double Tools::centroidsQuantile(const Centroid<T>* cs, int n, double min,
+                                double max, double q)
+{
+  if(n == 0)
+    return 0;
+  if(n == 1 && cs[0].weight <= 1)
+    return cs[0].mean;
+
+  double total = 0;
+  for(int i = 0; i < n; i++)
+    total += cs[i].weight;
+  double rank = std::max(0.0, std::min(1.0, q)) * total;
+
+  //lower end: between min (rank 0) and the first centroid
+  double mid = cs[0].weight / 2.0;
+  if(rank <= mid)
+    return mid > 0 ? min + (cs[0].mean - min) * (rank / mid) : min;
+
+  double weightBefore = 0;
+  for(int i = 0; i + 1 < n; i++)
+  {
+    double nextMid = weightBefore + cs[i].weight + cs[i+1].weight / 2.0;
+    if(rank <= nextMid)
+      return cs[i].mean + (cs[i+1].mean - cs[i].mean) * ((rank - mid) / (nextMid - mid));
+    weightBefore += cs[i].weight;
+    mid = nextMid;
+  }
+
+  //upper end: between the last centroid and max (rank total)
+  return total > mid
+      ? cs[n-1].mean + (max - cs[n-1].mean) * ((rank - mid) / (total - mid))
+      : max;
+}
+
+#endif
@@ -0,0 +1,341 @@
+/**
+Authors:
+Michael Berg <michael.berg@zalf.de>
+
+Maintainers:
+Currently maintained by the authors.
+
+This file is part of the util library used by models created at the Institute of
+Landscape Systems Analysis at the ZALF.
+Copyright (C) 2007-2013, Leibniz Centre for Agricultural Landscape Research (ZALF)
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <sstream>
+#include <utility>
+#include <functional>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace Tools
+{
+	/*!
+	 * fifo queue with a fixed capacity, which can be used to connect
+	 * the stages of a pipeline
+	 * - push blocks while the queue is full (backpressure)
+	 * - pop blocks while the queue is empty
+	 * - after close() no more elements can be pushed and waiting
+	 * consumers return as soon as the queue is drained
+	 */
+	template<typename T>
+	class BoundedQueue
+	{
+	public:
+		BoundedQueue(size_t capacity)
+			: _capacity(capacity < 1 ? 1 : capacity), _closed(false) {}
+
+		//! returns false if the queue has been closed
+		bool push(const T& t)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			while(_queue.size() >= _capacity && !_closed)
+				_notFull.wait(lock);
+			if(_closed)
+				return false;
+			_queue.push_back(t);
+			_notEmpty.notify_one();
+			return true;
+		}
+
+		//! returns false if the queue has been closed and is empty
+		bool pop(T& t)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			while(_queue.empty() && !_closed)
+				_notEmpty.wait(lock);
+			if(_queue.empty())
+				return false;
+			t = _queue.front();
+			_queue.pop_front();
+			_notFull.notify_one();
+			return true;
+		}
+
+		void close()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_closed = true;
+			_notEmpty.notify_all();
+			_notFull.notify_all();
+		}
+
+		size_t size() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _queue.size();
+		}
+
+		size_t capacity() const { return _capacity; }
+
+	private:
+		size_t _capacity;
+		bool _closed;
+		std::deque<T> _queue;
+		mutable std::mutex _mutex;
+		std::condition_variable _notEmpty;
+		std::condition_variable _notFull;
+	};
+
+	//----------------------------------------------------------------------------
+
+	//! where the threads of a pipeline stage spent their time
+	struct StageStatistics
+	{
+		StageStatistics(const std::string& name = std::string(),
+		                unsigned int noOfThreads = 1)
+			: name(name), noOfThreads(noOfThreads), noOfItems(0),
+				busySeconds(0), waitSeconds(0) {}
+
+		std::string name;
+		unsigned int noOfThreads;
+		unsigned int noOfItems;
+		//! summed up over all threads of the stage
+		double busySeconds;
+		//! time spent waiting for input or on a full output queue
+		double waitSeconds;
+
+		//! fraction of the stage's time spent doing actual work
+		double utilisation() const
+		{
+			double total = busySeconds + waitSeconds;
+			return total > 0 ? busySeconds / total : 0;
+		}
+
+		std::string toString() const
+		{
+			std::ostringstream s;
+			s << name << " (" << noOfThreads << " thread(s)): " << noOfItems
+				<< " items, busy: " << busySeconds << "s, waiting: " << waitSeconds
+				<< "s, utilisation: " << int(utilisation()*100) << "%";
+			return s.str();
+		}
+	};
+
+	//----------------------------------------------------------------------------
+
+	/*!
+	 * three stage pipeline
+	 * 1. a single prefetch thread prepares the jobs in order and stays
+	 * at most prefetchDepth jobs ahead of the workers
+	 * (meant for I/O or other not thread safe setup work)
+	 * 2. noOfWorkers threads process the prepared jobs
+	 * 3. the sink is called on the thread calling run(), in the
+	 * order the results get ready, which isn't necessarily the job order
+	 *
+	 * The stages are connected by BoundedQueues, so a slow stage
+	 * throttles the stages in front of it instead of letting prepared
+	 * data pile up in memory.
+	 */
+	template<typename Job, typename Prepared, typename Result>
+	class Pipeline
+	{
+	public:
+		typedef std::function<Prepared(const Job&)> PrepareFunction;
+		typedef std::function<Result(const Prepared&)> ProcessFunction;
+		typedef std::function<void(const Job&, const Result&)> SinkFunction;
+
+		Pipeline(PrepareFunction prepare, ProcessFunction process,
+		         SinkFunction sink, unsigned int noOfWorkers = 0,
+		         unsigned int prefetchDepth = 8)
+			: _prepare(prepare), _process(process), _sink(sink),
+				_noOfWorkers(noOfWorkers > 0
+				             ? noOfWorkers
+				             : std::max(1u, std::thread::hardware_concurrency())),
+				_prefetchDepth(prefetchDepth < 1 ? 1 : prefetchDepth) {}
+
+		/*!
+		 * runs all jobs through the pipeline and returns when the last
+		 * result has been passed to the sink
+		 * - an exception thrown in any stage stops the pipeline
+		 * and is rethrown here
+		 */
+		void run(const std::vector<Job>& jobs)
+		{
+			_stats.clear();
+			_stats.push_back(StageStatistics("prefetch", 1));
+			_stats.push_back(StageStatistics("process", _noOfWorkers));
+			_stats.push_back(StageStatistics("sink", 1));
+			_error = std::exception_ptr();
+
+			BoundedQueue<std::pair<size_t, Prepared> > prepared(_prefetchDepth);
+			BoundedQueue<std::pair<size_t, Result> > results(_noOfWorkers);
+
+			std::thread prefetcher([&]()
+			{
+				try
+				{
+					for(size_t i = 0, size = jobs.size(); i < size; i++)
+					{
+						Clock::time_point start = Clock::now();
+						std::pair<size_t, Prepared> p(i, _prepare(jobs.at(i)));
+						Clock::time_point prepared_ = Clock::now();
+						bool ok = prepared.push(p);
+						addTime(0, start, start, prepared_, Clock::now());
+						if(!ok)
+							break;
+					}
+				}
+				catch(...)
+				{
+					setError(std::current_exception());
+					results.close();
+				}
+				prepared.close();
+			});
+
+			unsigned int noOfRunningWorkers = _noOfWorkers;
+			std::mutex runningMutex;
+			std::vector<std::thread> workers;
+			for(unsigned int w = 0; w < _noOfWorkers; w++)
+			{
+				workers.push_back(std::thread([&]()
+				{
+					try
+					{
+						std::pair<size_t, Prepared> p;
+						Clock::time_point start = Clock::now();
+						while(prepared.pop(p))
+						{
+							Clock::time_point got = Clock::now();
+							std::pair<size_t, Result> r(p.first, _process(p.second));
+							Clock::time_point processed = Clock::now();
+							bool ok = results.push(r);
+							Clock::time_point pushed = Clock::now();
+							addTime(1, start, got, processed, pushed);
+							if(!ok)
+								break;
+							start = pushed;
+						}
+					}
+					catch(...)
+					{
+						setError(std::current_exception());
+						prepared.close();
+					}
+
+					std::lock_guard<std::mutex> lock(runningMutex);
+					if(--noOfRunningWorkers == 0)
+						results.close();
+				}));
+			}
+
+			try
+			{
+				std::pair<size_t, Result> r;
+				Clock::time_point start = Clock::now();
+				while(results.pop(r))
+				{
+					Clock::time_point got = Clock::now();
+					_sink(jobs.at(r.first), r.second);
+					Clock::time_point sunk = Clock::now();
+					addTime(2, start, got, sunk);
+					start = sunk;
+				}
+			}
+			catch(...)
+			{
+				setError(std::current_exception());
+				prepared.close();
+				results.close();
+			}
+
+			prefetcher.join();
+			for(size_t w = 0; w < workers.size(); w++)
+				workers[w].join();
+
+			if(_error)
+				std::rethrow_exception(_error);
+		}
+
+		//! statistics of the last run, for the prefetch, process and sink stages
+		const std::vector<StageStatistics>& statistics() const { return _stats; }
+
+		std::string statisticsToString() const
+		{
+			std::ostringstream s;
+			for(size_t i = 0; i < _stats.size(); i++)
+				s << _stats.at(i).toString() << std::endl;
+			return s.str();
+		}
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		static double seconds(Clock::time_point from, Clock::time_point to)
+		{
+			return std::chrono::duration<double>(to - from).count();
+		}
+
+		//! [waitStart, busyStart) is waiting, [busyStart, busyEnd) is work
+		void addTime(size_t stage, Clock::time_point waitStart,
+		             Clock::time_point busyStart, Clock::time_point busyEnd)
+		{
+			std::lock_guard<std::mutex> lock(_statsMutex);
+			StageStatistics& s = _stats[stage];
+			s.noOfItems++;
+			s.waitSeconds += seconds(waitStart, busyStart);
+			s.busySeconds += seconds(busyStart, busyEnd);
+		}
+
+		//! as above, but additionally [busyEnd, waitEnd) is spent on the full output queue
+		void addTime(size_t stage, Clock::time_point waitStart,
+		             Clock::time_point busyStart, Clock::time_point busyEnd,
+		             Clock::time_point waitEnd)
+		{
+			addTime(stage, waitStart, busyStart, busyEnd);
+			std::lock_guard<std::mutex> lock(_statsMutex);
+			_stats[stage].waitSeconds += seconds(busyEnd, waitEnd);
+		}
+
+		void setError(std::exception_ptr e)
+		{
+			std::lock_guard<std::mutex> lock(_statsMutex);
+			if(!_error)
+				_error = e;
+		}
+
+		PrepareFunction _prepare;
+		ProcessFunction _process;
+		SinkFunction _sink;
+		unsigned int _noOfWorkers;
+		unsigned int _prefetchDepth;
+		std::vector<StageStatistics> _stats;
+		std::mutex _statsMutex;
+		std::exception_ptr _error;
+	};
+
+}
+
+#endif